@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef INCLUDE_PERFETTO_EXT_BASE_ASYNC_FILE_WRITER_H_
+#define INCLUDE_PERFETTO_EXT_BASE_ASYNC_FILE_WRITER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "perfetto/ext/base/paged_memory.h"
+
+namespace perfetto {
+namespace base {
+
+// Writes data into a file descriptor from a dedicated thread, so that the
+// caller thread (e.g. the tracing service thread, which also handles IPCs) is
+// not blocked on slow storage (eMMC, network filesystems).
+//
+// Data passed to Write() is copied into page-aligned staging buffers of
+// |buffer_size| bytes. Full buffers are handed over to the writer thread,
+// which issues one write() per buffer. All writes except the last one of a
+// Flush() are therefore page-aligned and of a page-multiple size.
+// At most |max_buffers| buffers can be in flight: when the writer thread can't
+// keep up, Write() blocks until a buffer is recycled. This bounds the memory
+// usage and applies back-pressure instead of dropping data.
+//
+// The fd is NOT owned and must outlive this object. The destructor flushes
+// all pending data (but doesn't fsync) and joins the writer thread.
+// This class is not thread-safe: Write() and Flush() must be called on the
+// same thread.
+class AsyncFileWriter {
+ public:
+  static constexpr size_t kDefaultBufferSize = 128 * 1024;
+  static constexpr size_t kDefaultMaxBuffers = 32;
+
+  struct Stats {
+    // Bytes that reached the fd.
+    uint64_t bytes_written = 0;
+    // Number of write() calls issued by the writer thread.
+    uint64_t writes = 0;
+    // Number of times Write() had to wait for the writer thread because all
+    // the staging buffers were in flight.
+    uint64_t times_blocked = 0;
+  };
+
+  explicit AsyncFileWriter(int fd,
+                           size_t buffer_size = kDefaultBufferSize,
+                           size_t max_buffers = kDefaultMaxBuffers);
+  ~AsyncFileWriter();
+
+  AsyncFileWriter(const AsyncFileWriter&) = delete;
+  AsyncFileWriter& operator=(const AsyncFileWriter&) = delete;
+
+  // Appends |size| bytes to the file. Returns false if a previous write
+  // failed, in which case the data is discarded.
+  bool Write(const void* data, size_t size);
+
+  // Hands the partially filled staging buffer to the writer thread and blocks
+  // until all the data passed to Write() so far has been written to the fd.
+  // If |sync| is true, also flushes the file to the storage (see FlushFile()).
+  // Returns false if any write failed.
+  bool Flush(bool sync = false);
+
+  // Returns true if a write() failed. Sticky.
+  bool has_error() const;
+
+  Stats GetStats() const;
+
+ private:
+  struct Buffer {
+    PagedMemory mem;
+    size_t size = 0;
+  };
+
+  // Moves |cur_buf_| into |queue_|. Blocks if too many buffers are in flight.
+  // Returns false if the writer thread hit an error.
+  bool SubmitCurrentBuffer();
+  void WriterThreadMain();
+
+  const int fd_;
+  const size_t buffer_size_;
+  const size_t max_buffers_;
+
+  // Staging buffer being filled by Write(). Only accessed by the caller thread.
+  Buffer cur_buf_;
+
+  std::thread thread_;
+
+  mutable std::mutex mutex_;
+  // Signalled when a buffer is queued or |quit_| is set (wakes up the writer).
+  std::condition_variable queue_cv_;
+  // Signalled when a buffer has been written (wakes up Write() and Flush()).
+  std::condition_variable done_cv_;
+  std::deque<Buffer> queue_;      // Guarded by |mutex_|.
+  std::vector<Buffer> free_;      // Guarded by |mutex_|.
+  size_t buffers_allocated_ = 0;  // Guarded by |mutex_|.
+  bool writing_ = false;          // Guarded by |mutex_|.
+  bool error_ = false;            // Guarded by |mutex_|.
+  bool quit_ = false;             // Guarded by |mutex_|.
+  Stats stats_;                   // Guarded by |mutex_|.
+};
+
+}  // namespace base
+}  // namespace perfetto
+
+#endif  // INCLUDE_PERFETTO_EXT_BASE_ASYNC_FILE_WRITER_H_
@@ -143,6 +143,7 @@ class FlatHashMap {
     values_ = std::move(other.values_);
     capacity_ = other.capacity_;
     size_ = other.size_;
+    num_tombstones_ = other.num_tombstones_;
     max_probe_length_ = other.max_probe_length_;
     load_limit_ = other.load_limit_;
     load_limit_percent_ = other.load_limit_percent_;
@@ -220,6 +221,15 @@ class FlatHashMap {
         MaybeGrowAndRehash(/*grow=*/true);
         continue;
       }
+      // Insertions reuse tombstones, but a churn of insertions and erasures
+      // of different keys can still turn all the free slots into tombstones.
+      // Then every lookup of a missing key would scan the whole table. Purge
+      // them, growing the table only if it's at least half full.
+      if (PERFETTO_UNLIKELY(!AppendOnly &&
+                            size_ + num_tombstones_ >= load_limit_)) {
+        MaybeGrowAndRehash(/*grow=*/size_ >= load_limit_ / 2);
+        continue;
+      }
       PERFETTO_DCHECK(insertion_slot != kSlotNotFound);
       break;
     }  // for (attempt)
@@ -228,6 +238,8 @@ class FlatHashMap {
 
     // We found a free slot (or a tombstone). Proceed with the insertion.
     Value* value_idx = &values_[insertion_slot];
+    if (!AppendOnly && tags_[insertion_slot] == kTombstone)
+      num_tombstones_--;
     new (&keys_[insertion_slot]) Key(std::move(key));
     new (value_idx) Value(std::move(value));
     tags_[insertion_slot] = tag;
@@ -314,6 +326,7 @@ class FlatHashMap {
     keys_[idx].~Key();
     values_[idx].~Value();
     size_--;
+    num_tombstones_++;
   }
 
   PERFETTO_NO_INLINE void MaybeGrowAndRehash(bool grow) {
@@ -358,6 +371,7 @@ class FlatHashMap {
     capacity_ = n;
     max_probe_length_ = 0;
     size_ = 0;
+    num_tombstones_ = 0;
     load_limit_ = n * static_cast<size_t>(load_limit_percent_) / 100;
     load_limit_ = std::min(load_limit_, n);
 
@@ -377,6 +391,7 @@ class FlatHashMap {
 
   size_t capacity_ = 0;
   size_t size_ = 0;
+  size_t num_tombstones_ = 0;
   size_t max_probe_length_ = 0;
   size_t load_limit_ = 0;  // Updated every time |capacity_| changes.
   int load_limit_percent_ =
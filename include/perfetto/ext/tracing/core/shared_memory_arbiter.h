@@ -139,6 +139,18 @@ class PERFETTO_EXPORT_COMPONENT SharedMemoryArbiter {
   // DataSourceDescriptor.will_notify_on_stop=true).
   virtual void SetBatchCommitsDuration(uint32_t batch_commits_duration_ms) = 0;
 
+  // Enables adaptive batching of commits. When |max_batch_commits_duration_ms|
+  // is greater than the duration set via SetBatchCommitsDuration(), the
+  // batching period is no longer static: it is widened (up to
+  // |max_batch_commits_duration_ms|) while trace writers keep committing many
+  // chunks per period and shrunk back to the base duration when commits become
+  // sparse or the SMB fills up before the period ends. This coalesces the
+  // CommitData() IPCs of busy producers without adding latency to idle ones.
+  // The same caveats about losing batched data at the end of a session
+  // described above apply. Passing 0 (the default) disables adaptive batching.
+  virtual void SetMaxBatchCommitsDuration(
+      uint32_t max_batch_commits_duration_ms) = 0;
+
   // Called to enable direct producer-side patching of chunks that have not yet
   // been committed to the service. The return value indicates whether direct
   // patching was successfully enabled. It will be true if
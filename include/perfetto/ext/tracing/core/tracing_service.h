@@ -260,6 +260,12 @@ struct PERFETTO_EXPORT_COMPONENT TracingServiceInitOpts {
   // compressed ones.
   using CompressorFn = void (*)(std::vector<TracePacket>*);
   CompressorFn compressor_fn = nullptr;
+
+  // If true, sessions with write_into_file=true hand the trace data over to a
+  // dedicated writer thread (see base::AsyncFileWriter) rather than issuing
+  // blocking writes on the service thread. This keeps the service responsive
+  // to IPCs when the output file is on slow storage.
+  bool async_file_writes = false;
 };
 
 // The public API of the tracing Service business logic.
@@ -267,6 +267,38 @@ class PackedRepeatedFieldIterator {
   bool* const parse_error_;
 };
 
+// Decodes the varints of a packed repeated field in bulk, into a buffer
+// supplied by the caller. Prefer this to
+// PackedRepeatedFieldIterator<kVarInt, ...> when all the values of a large
+// field are needed: it decodes up to 8 bytes at a time, rather than byte by
+// byte. Example usage:
+//   PackedVarIntDecoder decoder(field.data, field.size);
+//   uint64_t values[64];
+//   while (size_t n = decoder.Decode(values, 64)) { ... }
+//   if (decoder.parse_error()) { ... }
+class PERFETTO_EXPORT_COMPONENT PackedVarIntDecoder {
+ public:
+  PackedVarIntDecoder(const uint8_t* data, size_t size)
+      : read_ptr_(data), end_(data ? data + size : nullptr) {}
+  explicit PackedVarIntDecoder(ConstBytes bytes)
+      : PackedVarIntDecoder(bytes.data, bytes.size) {}
+
+  // Decodes up to |max_values| varints into |out| and returns their number,
+  // which is 0 once all the input has been consumed. A truncated varint stops
+  // the decoding and sets parse_error().
+  size_t Decode(uint64_t* out, size_t max_values);
+
+  // True once all the input has been consumed (or after a parse error).
+  bool done() const { return read_ptr_ == end_; }
+
+  bool parse_error() const { return parse_error_; }
+
+ private:
+  const uint8_t* read_ptr_;
+  const uint8_t* const end_;
+  bool parse_error_ = false;
+};
+
 // This decoder loads all fields upfront, without recursing in nested messages.
 // It is used as a base class for typed decoders generated by the pbzero plugin.
 // The split between TypedProtoDecoderBase and TypedProtoDecoder<> is to have
@@ -349,6 +381,17 @@ class PERFETTO_EXPORT_COMPONENT TypedProtoDecoderBase : public ProtoDecoder {
         nullptr, 0, parse_error_location);
   }
 
+  // As GetPackedRepeated<kVarInt, ...>(), but returns a decoder that decodes
+  // the varints of the field in bulk. See PackedVarIntDecoder.
+  PackedVarIntDecoder GetPackedVarInts(uint32_t field_id) const {
+    const Field& field = Get(field_id);
+    if (field.valid() &&
+        field.type() == proto_utils::ProtoWireType::kLengthDelimited) {
+      return PackedVarIntDecoder(field.data(), field.size());
+    }
+    return PackedVarIntDecoder(nullptr, 0);
+  }
+
  protected:
   TypedProtoDecoderBase(Field* storage,
                         uint32_t num_fields,
@@ -479,14 +479,32 @@ class DataSource : public DataSourceBase {
 
   template <typename T>
   static internal::DataSourceInstanceThreadLocalState::ObjectWithDeleter
-  CreateIncrementalState(internal::DataSourceInstanceThreadLocalState*,
+  CreateIncrementalState(internal::DataSourceInstanceThreadLocalState* tls_inst,
                          uint32_t,
                          void*) {
+    T* state = new T();
+    // When the incremental state is being cleared, |tls_inst| still holds the
+    // previous state, which can donate its reusable allocations.
+    if (tls_inst->incremental_state) {
+      MaybeRecycleIncrementalState(
+          state, reinterpret_cast<T*>(tls_inst->incremental_state.get()), 0);
+    }
     return internal::DataSourceInstanceThreadLocalState::ObjectWithDeleter(
-        reinterpret_cast<void*>(new T()),
+        reinterpret_cast<void*>(state),
         [](void* p) { delete reinterpret_cast<T*>(p); });
   }
 
+  // Incremental state types can opt into recycling the state they replace by
+  // defining a `void RecycleFrom(T* previous)` method.
+  template <typename T>
+  static auto MaybeRecycleIncrementalState(T* state, T* previous, int)
+      -> decltype(state->RecycleFrom(previous), void()) {
+    state->RecycleFrom(previous);
+  }
+
+  template <typename T>
+  static void MaybeRecycleIncrementalState(T*, T*, long) {}
+
   // The second parameter here is used to specialize the case where there is no
   // incremental state type.
   template <typename T>
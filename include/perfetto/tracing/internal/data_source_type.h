@@ -196,10 +196,11 @@ class PERFETTO_EXPORT_COMPONENT DataSourceType {
       internal::DataSourceInstanceThreadLocalState* tls_inst,
       uint32_t instance_index) {
     // Recreate incremental state data if it has been reset by the service.
+    // The previous state is destroyed only after the new one has been created,
+    // so that the latter can recycle its allocations.
     if (tls_inst->incremental_state_generation !=
         static_state()->incremental_state_generation.load(
             std::memory_order_relaxed)) {
-      tls_inst->incremental_state.reset();
       CreateIncrementalState(tls_inst, instance_index);
     }
     return tls_inst->incremental_state.get();
@@ -29,6 +29,7 @@
 #include "protos/perfetto/trace/interned_data/interned_data.pbzero.h"
 #include "protos/perfetto/trace/track_event/track_event.pbzero.h"
 
+#include <array>
 #include <unordered_map>
 
 namespace perfetto {
@@ -90,6 +91,11 @@ class PERFETTO_EXPORT_COMPONENT BaseTrackEventInternedDataIndex {
  public:
   virtual ~BaseTrackEventInternedDataIndex();
 
+  // Called when the incremental state owning this index is reset. Returns true
+  // if the index dropped all its entries and can be moved into the new
+  // incremental state, or false if it has to be destroyed.
+  virtual bool ClearForReuse();
+
 #if PERFETTO_DCHECK_IS_ON()
   const char* type_id_ = nullptr;
   const void* add_function_ptr_ = nullptr;
@@ -162,6 +168,36 @@ struct TrackEventIncrementalState {
   // The value is used for delta encoding of counter values.
   std::unordered_map<uint64_t, int64_t> last_counter_value_per_track;
   int64_t last_thread_time_ns = 0;
+
+  // The static prefix of a TrackEvent message (the `type` and `category_iids`
+  // fields), pre-serialized for a given category and event type. Category
+  // iids don't change for the lifetime of the incremental state, so once the
+  // prefix has been built, emitting it is a single memcpy.
+  struct EventPrefix {
+    static constexpr size_t kMaxSize = 32;
+
+    const Category* category = nullptr;
+    int32_t type = 0;  // protos::pbzero::TrackEvent::Type.
+    uint8_t size = 0;
+    uint8_t bytes[kMaxSize];
+  };
+
+  // Direct-mapped cache of event prefixes, indexed by a hash of the category
+  // and the event type. See TrackEventInternal::WriteEvent().
+  static constexpr size_t kEventPrefixCacheSize = 32;
+  std::array<EventPrefix, kEventPrefixCacheSize> event_prefix_cache = {};
+
+  // Called by DataSource when this state replaces |previous| after an
+  // incremental state clear. Takes over the interned data indices that can be
+  // cleared in place, so the hot interning tables (event names, categories)
+  // don't need to be reallocated and regrown after every clear.
+  void RecycleFrom(TrackEventIncrementalState* previous) {
+    size_t i = 0;
+    for (auto& entry : previous->interned_data_indices) {
+      if (entry.first && entry.second->ClearForReuse())
+        interned_data_indices[i++] = std::move(entry);
+    }
+  }
 };
 
 // The backend portion of the track event trace point implemention. Outlined to
@@ -32,7 +32,7 @@ struct PERFETTO_EXPORT_COMPONENT InternedEventCategory
           InternedEventCategory,
           perfetto::protos::pbzero::InternedData::kEventCategoriesFieldNumber,
           const char*,
-          SmallInternedDataTraits> {
+          PointerInternedDataTraits> {
   ~InternedEventCategory() override;
 
   static void Add(protos::pbzero::InternedData* interned_data,
@@ -46,7 +46,7 @@ struct PERFETTO_EXPORT_COMPONENT InternedEventName
           InternedEventName,
           perfetto::protos::pbzero::InternedData::kEventNamesFieldNumber,
           const char*,
-          SmallInternedDataTraits> {
+          PointerInternedDataTraits> {
   ~InternedEventName() override;
 
   static void Add(protos::pbzero::InternedData* interned_data,
@@ -60,7 +60,7 @@ struct PERFETTO_EXPORT_COMPONENT InternedDebugAnnotationName
           perfetto::protos::pbzero::InternedData::
               kDebugAnnotationNamesFieldNumber,
           const char*,
-          SmallInternedDataTraits> {
+          PointerInternedDataTraits> {
   ~InternedDebugAnnotationName() override;
 
   static void Add(protos::pbzero::InternedData* interned_data,
@@ -74,7 +74,7 @@ struct PERFETTO_EXPORT_COMPONENT InternedDebugAnnotationValueTypeName
           perfetto::protos::pbzero::InternedData::
               kDebugAnnotationValueTypeNamesFieldNumber,
           const char*,
-          SmallInternedDataTraits> {
+          PointerInternedDataTraits> {
   ~InternedDebugAnnotationValueTypeName() override;
 
   static void Add(protos::pbzero::InternedData* interned_data,
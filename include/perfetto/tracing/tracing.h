@@ -108,6 +108,14 @@ struct TracingInitArgs {
   // delay, i.e. commits will be sent to the service at the next opportunity.
   uint32_t shmem_batch_commits_duration_ms = 0;
 
+  // [Optional] If greater than |shmem_batch_commits_duration_ms|, enables
+  // adaptive batching: the batching period grows up to this value while the
+  // producer is committing chunks at a high rate (coalescing more chunks per
+  // IPC) and shrinks back to |shmem_batch_commits_duration_ms| when it becomes
+  // idle. For more details, see the SetMaxBatchCommitsDuration method in
+  // shared_memory_arbiter.h.
+  uint32_t shmem_batch_commits_max_duration_ms = 0;
+
   // [Optional] If set, the policy object is notified when certain SDK events
   // occur and may apply policy decisions, such as denying connections. The
   // embedder is responsible for ensuring the object remains alive for the
@@ -170,7 +178,8 @@ class PERFETTO_EXPORT_COMPONENT Tracing {
   // the call will have no effect on it. All the members of `args` will be
   // ignored in subsequent calls, except those require to initialize new
   // backends (`backends`, `enable_system_consumer`, `shmem_size_hint_kb`,
-  // `shmem_page_size_hint_kb` and `shmem_batch_commits_duration_ms`).
+  // `shmem_page_size_hint_kb`, `shmem_batch_commits_duration_ms` and
+  // `shmem_batch_commits_max_duration_ms`).
   static inline void Initialize(const TracingInitArgs& args)
       PERFETTO_ALWAYS_INLINE {
     TracingInitArgs args_copy(args);
@@ -22,7 +22,10 @@
 #include "perfetto/base/compiler.h"
 #include "perfetto/tracing/event_context.h"
 
+#include <stdint.h>
+
 #include <map>
+#include <memory>
 #include <type_traits>
 #include <unordered_map>
 
@@ -143,6 +146,113 @@ struct HashedInternedDataTraits {
   };
 };
 
+// This type of interning index is keyed by the address of the interned value
+// and never looks at the data it points to, like SmallInternedDataTraits. It
+// is meant for pointers with static lifetime which are interned on every trace
+// point (e.g., event names and categories): the pointers are stored in a
+// compact open-addressing hash table, so a lookup is a multiplication and
+// (usually) a single cache line access instead of a std::map traversal.
+//
+// Entries are stamped with a generation number, so clearing the index is O(1)
+// and keeps its storage. Indices using these traits are carried over, cleared,
+// into the new incremental state when the incremental state of a sequence is
+// reset (see TrackEventIncrementalState::RecycleFrom()).
+struct PointerInternedDataTraits {
+  template <typename ValueType>
+  class Index {
+   public:
+    static_assert(std::is_pointer<ValueType>::value,
+                  "PointerInternedDataTraits only supports pointer values");
+
+    Index() { Reset(kInitialCapacity); }
+
+    bool LookUpOrInsert(size_t* iid, const ValueType& value) {
+      const uintptr_t key = reinterpret_cast<uintptr_t>(value);
+      const size_t mask = capacity_ - 1;
+      for (size_t i = Hash(key) & mask;; i = (i + 1) & mask) {
+        Slot& slot = slots_[i];
+        if (PERFETTO_LIKELY(slot.generation == generation_)) {
+          if (slot.key == key) {
+            *iid = slot.iid;
+            return true;
+          }
+          continue;
+        }
+        // |value| is not in the table. Keep the load factor below 1/2 so that
+        // probe sequences stay short.
+        if (PERFETTO_UNLIKELY((size_ + 1) * 2 > capacity_)) {
+          Grow();
+          return LookUpOrInsert(iid, value);
+        }
+        slot.key = key;
+        slot.generation = generation_;
+        slot.iid = static_cast<uint32_t>(++size_);
+        *iid = size_;
+        return false;
+      }
+    }
+
+    // Removes all the entries. Interning ids start again from 1.
+    void Clear() {
+      size_ = 0;
+      if (PERFETTO_UNLIKELY(++generation_ == 0))
+        Reset(capacity_);
+    }
+
+    size_t size() const { return size_; }
+    size_t capacity() const { return capacity_; }
+
+   private:
+    static constexpr size_t kInitialCapacity = 64;
+
+    struct Slot {
+      uintptr_t key;
+      // A slot is occupied only if its generation matches |generation_|.
+      uint32_t generation;
+      uint32_t iid;
+    };
+
+    static size_t Hash(uintptr_t key) {
+      // Fibonacci hashing. The low bits of pointers are mostly zeros because of
+      // alignment, so take the high half of the product.
+      return static_cast<size_t>(
+          (static_cast<uint64_t>(key) * 0x9E3779B97F4A7C15ull) >> 32);
+    }
+
+    void Reset(size_t capacity) {
+      slots_.reset(new Slot[capacity]());
+      capacity_ = capacity;
+      generation_ = 1;
+      size_ = 0;
+    }
+
+    void Grow() {
+      std::unique_ptr<Slot[]> old_slots = std::move(slots_);
+      const size_t old_capacity = capacity_;
+      const uint32_t old_generation = generation_;
+      const size_t size = size_;
+      Reset(capacity_ * 2);
+      const size_t mask = capacity_ - 1;
+      for (size_t i = 0; i < old_capacity; i++) {
+        const Slot& old_slot = old_slots[i];
+        if (old_slot.generation != old_generation)
+          continue;
+        size_t j = Hash(old_slot.key) & mask;
+        while (slots_[j].generation == generation_)
+          j = (j + 1) & mask;
+        slots_[j] = old_slot;
+        slots_[j].generation = generation_;
+      }
+      size_ = size;
+    }
+
+    std::unique_ptr<Slot[]> slots_;
+    size_t capacity_ = 0;
+    size_t size_ = 0;
+    uint32_t generation_ = 1;
+  };
+};
+
 // A templated base class for an interned data type which corresponds to a field
 // in interned_data.proto.
 //
@@ -194,6 +304,8 @@ class TrackEventInternedDataIndex
     return iid;
   }
 
+  bool ClearForReuse() override { return ClearIndex(&index_, 0); }
+
  protected:
   // Some use cases require a custom Get implemention, so they need access to
   // GetOrCreateIndexForField + the returned index.
@@ -250,6 +362,21 @@ class TrackEventInternedDataIndex
   // container type is defined by |Traits|, hence the extra layer of template
   // indirection here.
   typename Traits::template Index<ValueType> index_;
+
+ private:
+  // Only indices which can be cleared in place (see PointerInternedDataTraits)
+  // are reused across incremental state clears.
+  template <typename IndexType>
+  static auto ClearIndex(IndexType* index, int)
+      -> decltype(index->Clear(), bool()) {
+    index->Clear();
+    return true;
+  }
+
+  template <typename IndexType>
+  static bool ClearIndex(IndexType*, long) {
+    return false;
+  }
 };
 
 }  // namespace perfetto
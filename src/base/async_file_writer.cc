@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "perfetto/ext/base/async_file_writer.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "perfetto/base/logging.h"
+#include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/thread_utils.h"
+#include "perfetto/ext/base/utils.h"
+
+namespace perfetto {
+namespace base {
+namespace {
+
+size_t RoundUpToPageSize(size_t size) {
+  const size_t page_size = GetSysPageSize();
+  return (std::max<size_t>(size, 1) + page_size - 1) / page_size * page_size;
+}
+
+}  // namespace
+
+AsyncFileWriter::AsyncFileWriter(int fd, size_t buffer_size, size_t max_buffers)
+    : fd_(fd),
+      buffer_size_(RoundUpToPageSize(buffer_size)),
+      max_buffers_(std::max<size_t>(max_buffers, 2)) {
+  PERFETTO_CHECK(fd_ >= 0);
+  thread_ = std::thread(&AsyncFileWriter::WriterThreadMain, this);
+}
+
+AsyncFileWriter::~AsyncFileWriter() {
+  Flush();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    quit_ = true;
+  }
+  queue_cv_.notify_one();
+  thread_.join();
+}
+
+bool AsyncFileWriter::Write(const void* data, size_t size) {
+  const uint8_t* src = static_cast<const uint8_t*>(data);
+  while (size > 0) {
+    if (!cur_buf_.mem.IsValid()) {
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (free_.empty() && buffers_allocated_ >= max_buffers_ && !error_) {
+        stats_.times_blocked++;
+        done_cv_.wait(lock, [this] { return !free_.empty() || error_; });
+      }
+      if (error_)
+        return false;
+      if (!free_.empty()) {
+        cur_buf_ = std::move(free_.back());
+        free_.pop_back();
+      } else {
+        buffers_allocated_++;
+        lock.unlock();
+        cur_buf_.mem = PagedMemory::Allocate(buffer_size_);
+      }
+      cur_buf_.size = 0;
+    }
+    size_t chunk_size = std::min(size, buffer_size_ - cur_buf_.size);
+    memcpy(static_cast<uint8_t*>(cur_buf_.mem.Get()) + cur_buf_.size, src,
+           chunk_size);
+    cur_buf_.size += chunk_size;
+    src += chunk_size;
+    size -= chunk_size;
+    if (cur_buf_.size == buffer_size_ && !SubmitCurrentBuffer())
+      return false;
+  }
+  return true;
+}
+
+bool AsyncFileWriter::SubmitCurrentBuffer() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (error_) {
+      cur_buf_.size = 0;
+      free_.emplace_back(std::move(cur_buf_));
+      cur_buf_ = Buffer();
+      return false;
+    }
+    queue_.emplace_back(std::move(cur_buf_));
+  }
+  cur_buf_ = Buffer();
+  queue_cv_.notify_one();
+  return true;
+}
+
+bool AsyncFileWriter::Flush(bool sync) {
+  if (cur_buf_.mem.IsValid() && cur_buf_.size > 0)
+    SubmitCurrentBuffer();
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_cv_.wait(lock, [this] { return queue_.empty() && !writing_; });
+    if (error_)
+      return false;
+  }
+  if (sync)
+    return FlushFile(fd_);
+  return true;
+}
+
+bool AsyncFileWriter::has_error() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return error_;
+}
+
+AsyncFileWriter::Stats AsyncFileWriter::GetStats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+void AsyncFileWriter::WriterThreadMain() {
+  MaybeSetThreadName("async_fwrite");
+  for (;;) {
+    Buffer buf;
+    bool skip_write;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      queue_cv_.wait(lock, [this] { return !queue_.empty() || quit_; });
+      if (queue_.empty())
+        return;  // |quit_| is set and there is nothing left to write.
+      buf = std::move(queue_.front());
+      queue_.pop_front();
+      writing_ = true;
+      skip_write = error_;
+    }
+
+    // Once a write has failed, the remaining buffers are just recycled: writing
+    // them would leave a hole in the file.
+    ssize_t wr_size = 0;
+    if (!skip_write)
+      wr_size = WriteAll(fd_, buf.mem.Get(), buf.size);
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!skip_write) {
+        if (wr_size != static_cast<ssize_t>(buf.size)) {
+          PERFETTO_PLOG("AsyncFileWriter: write() failed");
+          error_ = true;
+        } else {
+          stats_.bytes_written += buf.size;
+          stats_.writes++;
+        }
+      }
+      writing_ = false;
+      buf.size = 0;
+      free_.emplace_back(std::move(buf));
+    }
+    done_cv_.notify_all();
+  }
+}
+
+}  // namespace base
+}  // namespace perfetto
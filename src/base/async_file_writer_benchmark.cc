@@ -0,0 +1,118 @@
+// Copyright (C) 2023 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "perfetto/base/time.h"
+#include "perfetto/ext/base/async_file_writer.h"
+#include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/pipe.h"
+
+namespace {
+
+using perfetto::base::AsyncFileWriter;
+
+// Each iteration writes a batch of trace-packet-sized slices, like
+// TracingServiceImpl::WriteIntoFile() does on every write period.
+constexpr size_t kSliceSize = 4096;
+constexpr size_t kSlicesPerIteration = 64;
+
+// Emulates slow storage: a pipe whose reader drains at most |kSinkBytesPerMs|
+// per millisecond (64KB is also the default pipe capacity on Linux).
+constexpr size_t kSinkBytesPerMs = 64 * 1024;
+
+class ThrottledSink {
+ public:
+  ThrottledSink() : pipe_(perfetto::base::Pipe::Create()) {
+    thread_ = std::thread([this] {
+      std::vector<char> buf(kSinkBytesPerMs);
+      while (!quit_) {
+        if (perfetto::base::Read(*pipe_.rd, buf.data(), buf.size()) <= 0)
+          break;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+    });
+  }
+
+  ~ThrottledSink() {
+    quit_ = true;
+    pipe_.wr.reset();
+    thread_.join();
+  }
+
+  int fd() const { return *pipe_.wr; }
+
+ private:
+  perfetto::base::Pipe pipe_;
+  std::atomic<bool> quit_{false};
+  std::thread thread_;
+};
+
+// Measures how long the caller is blocked when writing a burst of data, which
+// is what delays IPC handling on the service thread. Between bursts the sink
+// is given enough time to drain, like between two file write periods.
+template <typename WriteFn>
+void RunBenchmark(benchmark::State& state, WriteFn write_fn) {
+  std::vector<char> slice(kSliceSize, 'x');
+  int64_t max_burst_ns = 0;
+  for (auto _ : state) {
+    auto start = perfetto::base::GetWallTimeNs();
+    for (size_t i = 0; i < kSlicesPerIteration; i++)
+      write_fn(slice.data(), slice.size());
+    auto burst_ns = (perfetto::base::GetWallTimeNs() - start).count();
+    max_burst_ns = std::max(max_burst_ns, static_cast<int64_t>(burst_ns));
+
+    state.PauseTiming();
+    std::this_thread::sleep_for(std::chrono::milliseconds(
+        2 * kSliceSize * kSlicesPerIteration / kSinkBytesPerMs));
+    state.ResumeTiming();
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          kSliceSize * kSlicesPerIteration);
+  state.counters["max_block_us"] =
+      benchmark::Counter(static_cast<double>(max_burst_ns) / 1000);
+}
+
+static void BM_FileWriteSync(benchmark::State& state) {
+  ThrottledSink sink;
+  int fd = sink.fd();
+  RunBenchmark(state, [fd](const char* data, size_t size) {
+    perfetto::base::WriteAll(fd, data, size);
+  });
+}
+
+static void BM_FileWriteAsync(benchmark::State& state) {
+  ThrottledSink sink;
+  AsyncFileWriter writer(sink.fd(), AsyncFileWriter::kDefaultBufferSize,
+                         static_cast<size_t>(state.range(0)));
+  RunBenchmark(state, [&writer](const char* data, size_t size) {
+    writer.Write(data, size);
+  });
+  writer.Flush();
+  state.counters["times_blocked"] = benchmark::Counter(
+      static_cast<double>(writer.GetStats().times_blocked));
+}
+
+}  // namespace
+
+// The number of iterations is fixed because the wall time is dominated by the
+// pauses between bursts, which are not measured.
+BENCHMARK(BM_FileWriteSync)->Iterations(200);
+BENCHMARK(BM_FileWriteAsync)->Arg(4)->Arg(32)->Iterations(200);
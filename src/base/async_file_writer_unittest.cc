@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "perfetto/ext/base/async_file_writer.h"
+
+#include <string>
+
+#include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/pipe.h"
+#include "perfetto/ext/base/temp_file.h"
+#include "perfetto/ext/base/utils.h"
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace base {
+namespace {
+
+std::string ReadTempFile(const TempFile& tmp) {
+  std::string contents;
+  PERFETTO_CHECK(ReadFile(tmp.path(), &contents));
+  return contents;
+}
+
+std::string MakeData(size_t size, size_t seed) {
+  std::string data(size, '\0');
+  for (size_t i = 0; i < size; i++)
+    data[i] = static_cast<char>('a' + (i * 7 + seed) % 26);
+  return data;
+}
+
+TEST(AsyncFileWriterTest, SmallWrites) {
+  TempFile tmp = TempFile::Create();
+  AsyncFileWriter writer(tmp.fd());
+  ASSERT_TRUE(writer.Write("foo", 3));
+  ASSERT_TRUE(writer.Write("", 0));
+  ASSERT_TRUE(writer.Write("bar", 3));
+  ASSERT_TRUE(writer.Flush());
+  EXPECT_EQ(ReadTempFile(tmp), "foobar");
+  EXPECT_EQ(writer.GetStats().bytes_written, 6u);
+  EXPECT_EQ(writer.GetStats().writes, 1u);
+
+  ASSERT_TRUE(writer.Write("baz", 3));
+  ASSERT_TRUE(writer.Flush(/*sync=*/true));
+  EXPECT_EQ(ReadTempFile(tmp), "foobarbaz");
+}
+
+TEST(AsyncFileWriterTest, LargeWritesSpanMultipleBuffers) {
+  TempFile tmp = TempFile::Create();
+  const size_t buf_size = GetSysPageSize();
+  std::string expected;
+  {
+    // Only two buffers: forces Write() to wait for the writer thread.
+    AsyncFileWriter writer(tmp.fd(), buf_size, /*max_buffers=*/2);
+    for (size_t i = 0; i < 50; i++) {
+      std::string data = MakeData(buf_size / 3 + i * 97, i);
+      ASSERT_TRUE(writer.Write(data.data(), data.size()));
+      expected += data;
+    }
+    std::string big = MakeData(buf_size * 10 + 1, 42);
+    ASSERT_TRUE(writer.Write(big.data(), big.size()));
+    expected += big;
+    // The destructor flushes.
+  }
+  EXPECT_EQ(ReadTempFile(tmp), expected);
+}
+
+TEST(AsyncFileWriterTest, BufferSizeIsPageAligned) {
+  TempFile tmp = TempFile::Create();
+  AsyncFileWriter writer(tmp.fd(), /*buffer_size=*/1);
+  std::string data = MakeData(GetSysPageSize() * 3, 0);
+  ASSERT_TRUE(writer.Write(data.data(), data.size()));
+  ASSERT_TRUE(writer.Flush());
+  // One write() per full page-sized buffer.
+  EXPECT_EQ(writer.GetStats().writes, 3u);
+  EXPECT_EQ(ReadTempFile(tmp), data);
+}
+
+#if !PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
+TEST(AsyncFileWriterTest, WriteErrorIsSticky) {
+  Pipe pipe = Pipe::Create();
+  pipe.rd.reset();  // Writes into the pipe will fail with EPIPE.
+  AsyncFileWriter writer(*pipe.wr);
+  std::string data = MakeData(AsyncFileWriter::kDefaultBufferSize, 0);
+  writer.Write(data.data(), data.size());
+  EXPECT_FALSE(writer.Flush());
+  EXPECT_TRUE(writer.has_error());
+  EXPECT_FALSE(writer.Write("x", 1));
+  EXPECT_EQ(writer.GetStats().bytes_written, 0u);
+}
+#endif
+
+}  // namespace
+}  // namespace base
+}  // namespace perfetto
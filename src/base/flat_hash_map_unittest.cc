@@ -191,6 +191,43 @@ TYPED_TEST(FlatHashMapTest, FillWithTombstones) {
   }
 }
 
+// Exposes the free slots, which are the end of the probing sequences.
+template <typename Probe>
+class FreeSlotsCountingMap : public FlatHashMap<int, int, Hash<int>, Probe> {
+ public:
+  size_t CountFreeSlots() const {
+    size_t free_slots = 0;
+    for (size_t i = 0; i < this->capacity_; i++)
+      free_slots += this->tags_[i] == this->kFreeSlot;
+    return free_slots;
+  }
+};
+
+// A churn of insertions and erasures of different keys must not turn all the
+// free slots into tombstones, nor make the table grow.
+TYPED_TEST(FlatHashMapTest, PurgeTombstones) {
+  FreeSlotsCountingMap<typename TestFixture::Probe> fmap;
+  const int kLiveKeys = 10;
+  for (int i = 0; i < 100000; i++) {
+    ASSERT_TRUE(fmap.Insert(i, i).second);
+    if (i >= kLiveKeys) {
+      ASSERT_TRUE(fmap.Erase(i - kLiveKeys));
+    }
+  }
+  ASSERT_EQ(fmap.size(), static_cast<size_t>(kLiveKeys));
+  EXPECT_EQ(fmap.capacity(), 1024u);
+  EXPECT_GT(fmap.CountFreeSlots(), fmap.capacity() / 4);
+  for (int i = 0; i < 100000; i++) {
+    int* value = fmap.Find(i);
+    if (i < 100000 - kLiveKeys) {
+      EXPECT_EQ(value, nullptr);
+    } else {
+      ASSERT_NE(value, nullptr);
+      EXPECT_EQ(*value, i);
+    }
+  }
+}
+
 TYPED_TEST(FlatHashMapTest, Collisions) {
   FlatHashMap<int, int, CollidingHasher, typename TestFixture::Probe> fmap(
       /*initial_capacity=*/0, /*load_limit_pct=*/100);
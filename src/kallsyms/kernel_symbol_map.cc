@@ -31,6 +31,7 @@
 #include <algorithm>
 #include <cinttypes>
 #include <functional>
+#include <limits>
 #include <map>
 #include <unordered_map>
 #include <utility>
@@ -48,6 +49,20 @@ using TokenId = KernelSymbolMap::TokenTable::TokenId;
 constexpr size_t kSymNameMaxLen = 128;
 constexpr size_t kSymMaxSizeBytes = 1024 * 1024;
 
+// Fills |eytzinger| (1-based) with the elements of |sorted|, by visiting the
+// implicit tree in-order.
+template <typename T>
+void FillEytzinger(const std::vector<T>& sorted,
+                   size_t k,
+                   size_t* sorted_idx,
+                   std::vector<T>* eytzinger) {
+  if (k >= eytzinger->size())
+    return;
+  FillEytzinger(sorted, 2 * k, sorted_idx, eytzinger);
+  (*eytzinger)[k] = sorted[(*sorted_idx)++];
+  FillEytzinger(sorted, 2 * k + 1, sorted_idx, eytzinger);
+}
+
 // Reads a kallsyms file in blocks of 4 pages each and decode its lines using
 // a simple FSM. Calls the passed lambda for each valid symbol.
 // It skips undefined symbols and other useless stuff.
@@ -209,7 +224,7 @@ TokenId KernelSymbolMap::TokenTable::Add(const std::string& token) {
 
 // NOTE: the caller need to mask the returned chars with 0x7f. The last char of
 // the StringView will have its MSB set (it's used as a EOF char internally).
-base::StringView KernelSymbolMap::TokenTable::Lookup(TokenId id) {
+base::StringView KernelSymbolMap::TokenTable::Lookup(TokenId id) const {
   if (id == 0)
     return base::StringView();
   if (id > num_tokens_)
@@ -362,6 +377,17 @@ size_t KernelSymbolMap::Parse(const std::string& kallsyms_path) {
 
   buf_.resize(static_cast<size_t>(wptr - buf_.data()));
   buf_.shrink_to_fit();
+
+  // Rearrange the (sorted) index in Eytzinger order.
+  {
+    std::vector<std::pair<uint32_t, uint32_t>> eytzinger(index_.size() + 1);
+    size_t sorted_idx = 0;
+    FillEytzinger(index_, 1, &sorted_idx, &eytzinger);
+    PERFETTO_DCHECK(sorted_idx == index_.size());
+    index_ = std::move(eytzinger);
+    if (index_.size() == 1)
+      index_.clear();
+  }
   base::MaybeReleaseAllocatorMemToOS();  // For Scudo, b/170217718.
 
   if (num_syms_ == 0) {
@@ -379,27 +405,30 @@ size_t KernelSymbolMap::Parse(const std::string& kallsyms_path) {
   return num_syms_;
 }
 
-std::string KernelSymbolMap::Lookup(uint64_t sym_addr) {
-  if (index_.empty() || sym_addr < base_addr_)
-    return "";
-
-  // First find the highest symbol address <= sym_addr.
-  // Start with a binary search using the sparse index.
-
-  const uint32_t sym_rel_addr = static_cast<uint32_t>(sym_addr - base_addr_);
-  auto it = std::upper_bound(index_.cbegin(), index_.cend(),
-                             std::make_pair(sym_rel_addr, 0u));
-  if (it != index_.cbegin())
-    --it;
+KernelSymbolMap::SymbolId KernelSymbolMap::FindSymbol(
+    uint32_t sym_rel_addr,
+    uint32_t* sym_start,
+    uint32_t* next_sym_start) const {
+  // First find the highest indexed symbol address <= sym_rel_addr, walking
+  // down the Eytzinger index. The branch-free step keeps the loop free of
+  // mispredictions, which dominate with random addresses.
+  const size_t index_size = index_.size();
+  size_t best = 0;
+  for (size_t k = 1; k < index_size;) {
+    const size_t right = index_[k].first <= sym_rel_addr ? 1 : 0;
+    best = right ? k : best;
+    k = 2 * k + right;
+  }
+  if (best == 0)
+    return kInvalidSymbolId;
 
   // Then continue with a linear scan (of at most kSymIndexSampling steps).
-  uint32_t addr = it->first;
-  uint32_t off = it->second;
-  const uint8_t* rdptr = &buf_[off];
+  uint32_t addr = index_[best].first;
+  const uint8_t* rdptr = &buf_[index_[best].second];
   const uint8_t* const buf_end = buf_.data() + buf_.size();
   bool parsing_addr = true;
-  const uint8_t* next_rdptr = nullptr;
-  uint64_t sym_start_addr = 0;
+  const uint8_t* entry_rdptr = nullptr;
+  *next_sym_start = std::numeric_limits<uint32_t>::max();
   for (bool is_first_addr = true;; is_first_addr = false) {
     uint64_t v = 0;
     const auto* prev_rdptr = rdptr;
@@ -409,34 +438,80 @@ std::string KernelSymbolMap::Lookup(uint64_t sym_addr) {
     if (parsing_addr) {
       addr += is_first_addr ? 0 : static_cast<uint32_t>(v);
       parsing_addr = false;
-      if (addr > sym_rel_addr)
+      if (addr > sym_rel_addr) {
+        *next_sym_start = addr;
         break;
-      next_rdptr = rdptr;
-      sym_start_addr = addr;
+      }
+      entry_rdptr = prev_rdptr;
+      *sym_start = addr;
     } else {
       // This is a token. Wait for the EOF maker.
       parsing_addr = (v & 1) == 1;
     }
   }
 
-  if (!next_rdptr)
-    return "";
+  if (!entry_rdptr)
+    return kInvalidSymbolId;
+  PERFETTO_DCHECK(sym_rel_addr >= *sym_start);
+  return static_cast<SymbolId>(entry_rdptr - buf_.data()) + 1;
+}
 
-  PERFETTO_DCHECK(sym_rel_addr >= sym_start_addr);
+KernelSymbolMap::SymbolId KernelSymbolMap::LookupId(uint64_t sym_addr) const {
+  SymbolId id = kInvalidSymbolId;
+  LookupBatch(&sym_addr, 1, &id);
+  return id;
+}
 
-  // If this address is too far from the start of the symbol, this is likely
-  // a pointer to something else (e.g. some vmalloc struct) and we just picked
-  // the very last symbol for a loader region.
-  if (sym_rel_addr - sym_start_addr > kSymMaxSizeBytes)
-    return "";
+void KernelSymbolMap::LookupBatch(const uint64_t* addrs,
+                                  size_t num_addrs,
+                                  SymbolId* ids) const {
+  // The absolute [start, end) range of the last symbol found, so that runs of
+  // addresses within the same function skip the search altogether.
+  SymbolId last_id = kInvalidSymbolId;
+  uint64_t last_start = 0;
+  uint64_t last_end = 0;
+  for (size_t i = 0; i < num_addrs; ++i) {
+    const uint64_t sym_addr = addrs[i];
+    if (sym_addr >= last_start && sym_addr < last_end) {
+      ids[i] = last_id;
+      continue;
+    }
+    ids[i] = kInvalidSymbolId;
+    if (index_.empty() || sym_addr < base_addr_)
+      continue;
 
-  // The address has been found. Now rejoin the tokens to form the symbol name.
+    const uint32_t sym_rel_addr = static_cast<uint32_t>(sym_addr - base_addr_);
+    uint32_t sym_start = 0;
+    uint32_t next_sym_start = 0;
+    SymbolId id = FindSymbol(sym_rel_addr, &sym_start, &next_sym_start);
+    if (id == kInvalidSymbolId)
+      continue;
 
-  rdptr = next_rdptr;
-  std::string sym_name;
-  sym_name.reserve(kSymNameMaxLen);
+    // If this address is too far from the start of the symbol, this is likely
+    // a pointer to something else (e.g. some vmalloc struct) and we just picked
+    // the very last symbol for a loader region.
+    if (sym_rel_addr - sym_start > kSymMaxSizeBytes)
+      continue;
+
+    ids[i] = id;
+    last_id = id;
+    last_start = sym_addr - (sym_rel_addr - sym_start);
+    last_end = last_start + std::min<uint64_t>(next_sym_start - sym_start,
+                                               kSymMaxSizeBytes + 1);
+  }
+}
+
+void KernelSymbolMap::GetSymbolName(SymbolId id, std::string* sym_name) const {
+  sym_name->clear();
+  if (id == kInvalidSymbolId || id > buf_.size())
+    return;
+
+  // Skip the address delta, then rejoin the tokens to form the symbol name.
+  const uint8_t* const buf_end = buf_.data() + buf_.size();
+  uint64_t v = 0;
+  const uint8_t* rdptr = protozero::proto_utils::ParseVarInt(
+      &buf_[id - 1], buf_end, &v);
   for (bool eof = false, is_first_token = true; !eof; is_first_token = false) {
-    uint64_t v = 0;
     const auto* old = rdptr;
     rdptr = protozero::proto_utils::ParseVarInt(rdptr, buf_end, &v);
     if (rdptr == old)
@@ -444,10 +519,19 @@ std::string KernelSymbolMap::Lookup(uint64_t sym_addr) {
     eof = v & 1;
     base::StringView token = tokens_.Lookup(static_cast<TokenId>(v >> 1));
     if (!is_first_token)
-      sym_name.push_back('_');
+      sym_name->push_back('_');
     for (size_t i = 0; i < token.size(); i++)
-      sym_name.push_back(token.at(i) & 0x7f);
+      sym_name->push_back(token.at(i) & 0x7f);
   }
+}
+
+std::string KernelSymbolMap::Lookup(uint64_t sym_addr) const {
+  std::string sym_name;
+  SymbolId id = LookupId(sym_addr);
+  if (id == kInvalidSymbolId)
+    return sym_name;
+  sym_name.reserve(kSymNameMaxLen);
+  GetSymbolName(id, &sym_name);
   return sym_name;
 }
 
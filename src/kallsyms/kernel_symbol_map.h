@@ -104,13 +104,18 @@ class StringView;
 // 8 7|0  3|1         // 0xbeef0008: 7,3   -> el0_load
 // ...
 // Like in the case of the token table, a lookaside index keeps track of the
-// offset of one every kSymIndexSamplinig addresses.
-// The Lookup(ADDR) function operates as follows:
-// 1. Performs a logarithmic binary search in the symbols index, finding the
-//    offset of the closest addres <= ADDR.
+// offset of one every kSymIndexSamplinig addresses. The index is stored in
+// Eytzinger (BFS) order: the root of the implicit binary search tree is at
+// position 1, and the children of node k at 2k and 2k+1. The first levels of
+// the tree, which every search goes through, are thus packed in a few cache
+// lines, rather than being spread across the whole index.
+// The LookupId(ADDR) function operates as follows:
+// 1. Walks down the Eytzinger index, finding the offset of the closest
+//    address <= ADDR.
 // 2. Skip over at most kSymIndexSamplinig until the symbol is found.
-// 3. For each token index, lookup the corresponding token string and
-//    concatenate them to build the symbol name.
+// The symbol is identified by the offset of its entry in the symbol buffer.
+// GetSymbolName(ID) then looks up the string of each of its tokens and
+// concatenates them to build the symbol name.
 
 class KernelSymbolMap {
  public:
@@ -125,11 +130,28 @@ class KernelSymbolMap {
   // Parses a kallsyms file. Returns the number of valid symbols decoded.
   size_t Parse(const std::string& kallsyms_path);
 
+  // Identifies a symbol. Ids are stable for the lifetime of the map.
+  using SymbolId = uint32_t;
+  static constexpr SymbolId kInvalidSymbolId = 0;
+
   // Looks up the closest symbol (i.e. the one with the highest address <=
   // |addr|) from its absolute 64-bit address.
   // Returns an empty string if the symbol is not found (which can happen only
   // if the passed |addr| is < min(addr)).
-  std::string Lookup(uint64_t addr);
+  std::string Lookup(uint64_t addr) const;
+
+  // Like Lookup(), but returns the id of the symbol rather than its name.
+  // Returns kInvalidSymbolId if the symbol is not found.
+  SymbolId LookupId(uint64_t addr) const;
+
+  // Looks up |num_addrs| addresses, storing their symbol ids in |ids|.
+  // Consecutive addresses within the same symbol are resolved without
+  // searching the index, which makes sorted streams of addresses cheaper.
+  void LookupBatch(const uint64_t* addrs, size_t num_addrs, SymbolId* ids) const;
+
+  // Stores the name of the symbol |id| in |name|, reusing its capacity.
+  // Stores an empty string if |id| is kInvalidSymbolId.
+  void GetSymbolName(SymbolId id, std::string* name) const;
 
   // Returns the numberr of valid symbols decoded.
   size_t num_syms() const { return num_syms_; }
@@ -148,7 +170,7 @@ class KernelSymbolMap {
     TokenTable();
     ~TokenTable();
     TokenId Add(const std::string&);
-    base::StringView Lookup(TokenId);
+    base::StringView Lookup(TokenId) const;
     size_t size_bytes() const { return buf_.size() + index_.size() * 4; }
 
     void shrink_to_fit() {
@@ -173,9 +195,17 @@ class KernelSymbolMap {
   size_t num_syms_ = 0;       // Number of valid symbols stored.
   std::vector<uint8_t> buf_;  // Symbol buffer.
 
+  // Returns the id of the symbol containing |sym_rel_addr|, and the relative
+  // addresses of its start and of the start of the next symbol (or UINT32_MAX
+  // if it is the last one).
+  SymbolId FindSymbol(uint32_t sym_rel_addr,
+                      uint32_t* sym_start,
+                      uint32_t* next_sym_start) const;
+
   // The key is (address - base_addr_), the value is the byte offset in |buf_|
   // where the symbol entry starts (i.e. the start of the varint that tells the
-  // delta from the previous symbol).
+  // delta from the previous symbol). In Eytzinger order, starting from index 1
+  // (see the comment at the top). Index 0 is unused.
   std::vector<std::pair<uint32_t /*rel_addr*/, uint32_t /*offset*/>> index_;
 };
 
@@ -12,14 +12,19 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
+#include <cinttypes>
 #include <random>
 #include <set>
 #include <unordered_set>
+#include <vector>
 
 #include <benchmark/benchmark.h>
 
 #include "perfetto/base/logging.h"
 #include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/string_utils.h"
+#include "perfetto/ext/base/temp_file.h"
 #include "perfetto/ext/base/utils.h"
 #include "src/base/test/utils.h"
 #include "src/kallsyms/kernel_symbol_map.h"
@@ -143,3 +148,72 @@ static void BM_KallSymsLoad(benchmark::State& state) {
 }
 
 BENCHMARK(BM_KallSymsLoad)->Apply(BenchmarkArgs);
+
+namespace {
+
+// Writes a kallsyms file with |num_syms| synthetic symbols, 256 bytes apart,
+// and returns the addresses of |num_addrs| random locations within them.
+std::vector<uint64_t> WriteFakeKallsyms(size_t num_syms,
+                                        size_t num_addrs,
+                                        perfetto::base::TempFile* file) {
+  static const uint64_t kBaseAddr = 0xffffff8f70000000ULL;
+  static const uint64_t kSymSize = 256;
+  std::minstd_rand rng(0);
+  std::string contents;
+  for (size_t i = 0; i < num_syms; i++) {
+    perfetto::base::StackString<128> line(
+        "%" PRIx64 " t sym_%zu_%s\n", kBaseAddr + i * kSymSize, i % 4096,
+        (rng() % 2) ? "lock" : "init");
+    contents += line.ToStdString();
+  }
+  perfetto::base::WriteAll(file->fd(), contents.data(), contents.size());
+  perfetto::base::FlushFile(file->fd());
+
+  std::vector<uint64_t> addrs(num_addrs);
+  for (uint64_t& addr : addrs)
+    addr = kBaseAddr + rng() % (num_syms * kSymSize);
+  return addrs;
+}
+
+void LookupBatch(benchmark::State& state, bool sorted) {
+  const size_t num_syms = IsBenchmarkFunctionalOnly() ? 1024 : 128 * 1024;
+  const size_t num_addrs = static_cast<size_t>(state.range(0));
+  perfetto::base::TempFile file = perfetto::base::TempFile::Create();
+  std::vector<uint64_t> addrs = WriteFakeKallsyms(num_syms, num_addrs, &file);
+  if (sorted)
+    std::sort(addrs.begin(), addrs.end());
+
+  perfetto::KernelSymbolMap kallsyms;
+  PERFETTO_CHECK(kallsyms.Parse(file.path()) == num_syms);
+  std::vector<perfetto::KernelSymbolMap::SymbolId> ids(addrs.size());
+
+  for (auto _ : state) {
+    kallsyms.LookupBatch(addrs.data(), addrs.size(), ids.data());
+    benchmark::DoNotOptimize(ids.data());
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          state.range(0));
+}
+
+void LookupBatchArgs(benchmark::internal::Benchmark* b) {
+  if (IsBenchmarkFunctionalOnly()) {
+    b->Arg(64);
+  } else {
+    b->RangeMultiplier(8)->Range(64, 32768);
+  }
+}
+
+}  // namespace
+
+static void BM_KallSymsLookupBatchSorted(benchmark::State& state) {
+  LookupBatch(state, /*sorted=*/true);
+}
+
+BENCHMARK(BM_KallSymsLookupBatchSorted)->Apply(LookupBatchArgs);
+
+static void BM_KallSymsLookupBatchRandom(benchmark::State& state) {
+  LookupBatch(state, /*sorted=*/false);
+}
+
+BENCHMARK(BM_KallSymsLookupBatchRandom)->Apply(LookupBatchArgs);
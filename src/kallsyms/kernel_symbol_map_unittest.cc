@@ -16,7 +16,9 @@
 
 #include "src/kallsyms/kernel_symbol_map.h"
 
+#include <algorithm>
 #include <cinttypes>
+#include <map>
 #include <random>
 #include <unordered_map>
 
@@ -128,6 +130,47 @@ ffffff8f73e2fa90 t NiNe
   EXPECT_EQ(kallsyms.Lookup(0xffffff8fffffffffULL), "");
 }
 
+TEST(KernelSymbolMapTest, LookupBatch) {
+  base::TempFile tmp = base::TempFile::Create();
+  static const char kContents[] = R"(ffffff8f73e2fa10 t one
+ffffff8f73e2fa20 t two
+ffffff8f73e2fa30 t three
+)";
+  base::WriteAll(tmp.fd(), kContents, sizeof(kContents));
+  base::FlushFile(tmp.fd());
+
+  KernelSymbolMap kallsyms;
+  kallsyms.Parse(tmp.path().c_str());
+  ASSERT_EQ(kallsyms.num_syms(), 3u);
+
+  const uint64_t kAddrs[] = {
+      0xffffff8f73e2fa10ULL, 0xffffff8f73e2fa1fULL, 0xffffff8f73e2fa20ULL,
+      0xffffff8f73e2fa00ULL, 0xffffff8f73e2fa35ULL, 0xffffff8f73e2fa11ULL,
+      0xffffff8fffffffffULL, 0xffffff8f73e2fa30ULL};
+  KernelSymbolMap::SymbolId ids[8];
+  kallsyms.LookupBatch(kAddrs, 8, ids);
+
+  EXPECT_NE(ids[0], KernelSymbolMap::kInvalidSymbolId);
+  EXPECT_EQ(ids[1], ids[0]);
+  EXPECT_NE(ids[2], ids[0]);
+  EXPECT_EQ(ids[3], KernelSymbolMap::kInvalidSymbolId);
+  EXPECT_EQ(ids[5], ids[0]);
+  EXPECT_EQ(ids[6], KernelSymbolMap::kInvalidSymbolId);
+  EXPECT_EQ(ids[7], ids[4]);
+  for (size_t i = 0; i < 8; i++)
+    EXPECT_EQ(kallsyms.LookupId(kAddrs[i]), ids[i]);
+
+  std::string name = "reused";
+  kallsyms.GetSymbolName(ids[0], &name);
+  EXPECT_EQ(name, "one");
+  kallsyms.GetSymbolName(ids[2], &name);
+  EXPECT_EQ(name, "two");
+  kallsyms.GetSymbolName(ids[4], &name);
+  EXPECT_EQ(name, "three");
+  kallsyms.GetSymbolName(KernelSymbolMap::kInvalidSymbolId, &name);
+  EXPECT_EQ(name, "");
+}
+
 TEST(KernelSymbolMapTest, GoldenTest) {
   std::string fake_kallsyms;
   fake_kallsyms.reserve(8 * 1024 * 1024);
@@ -158,6 +201,42 @@ TEST(KernelSymbolMapTest, GoldenTest) {
   for (const auto& kv : symbols) {
     ASSERT_EQ(kallsyms.Lookup(kv.first), kv.second);
   }
+
+  // Look up the same symbols, plus an address within each, through the batch
+  // path, both in address order and shuffled.
+  std::vector<uint64_t> addrs;
+  std::vector<std::string> names;
+  for (const auto& kv : symbols) {
+    for (uint64_t addr : {kv.first, kv.first + 1}) {
+      if (addr != kv.first && symbols.count(addr))
+        continue;
+      addrs.push_back(addr);
+      names.push_back(kv.second);
+    }
+  }
+  for (int pass = 0; pass < 2; pass++) {
+    if (pass == 1) {
+      std::vector<size_t> perm(addrs.size());
+      for (size_t i = 0; i < perm.size(); i++)
+        perm[i] = i;
+      std::shuffle(perm.begin(), perm.end(), rng);
+      std::vector<uint64_t> shuffled_addrs;
+      std::vector<std::string> shuffled_names;
+      for (size_t i : perm) {
+        shuffled_addrs.push_back(addrs[i]);
+        shuffled_names.push_back(names[i]);
+      }
+      addrs = std::move(shuffled_addrs);
+      names = std::move(shuffled_names);
+    }
+    std::vector<KernelSymbolMap::SymbolId> ids(addrs.size());
+    kallsyms.LookupBatch(addrs.data(), addrs.size(), ids.data());
+    std::string name;
+    for (size_t i = 0; i < ids.size(); i++) {
+      kallsyms.GetSymbolName(ids[i], &name);
+      ASSERT_EQ(name, names[i]);
+    }
+  }
 }
 
 }  // namespace
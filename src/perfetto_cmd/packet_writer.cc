@@ -24,6 +24,8 @@
 #include <sys/stat.h>
 
 #include "perfetto/base/build_config.h"
+#include "perfetto/base/logging.h"
+#include "perfetto/ext/base/async_file_writer.h"
 #include "perfetto/ext/base/getopt.h"
 #include "perfetto/ext/base/paged_memory.h"
 #include "perfetto/ext/base/utils.h"
@@ -74,6 +76,9 @@ size_t GetPreamble(size_t sz, Preamble* preamble) {
   return preamble_size;
 }
 
+// Writes packets into the file from a dedicated thread (see
+// base::AsyncFileWriter), so that slow storage doesn't stall the main thread,
+// which also handles the IPCs with the service.
 class FilePacketWriter : public PacketWriter {
  public:
   FilePacketWriter(FILE* fd);
@@ -81,25 +86,31 @@ class FilePacketWriter : public PacketWriter {
   bool WritePacket(const TracePacket& packet) override;
 
  private:
-  FILE* fd_;
+  static int FlushAndGetFd(FILE* fd) {
+    // The data is written directly into the underlying fd, bypassing the stdio
+    // buffer. Make sure that anything previously written via |fd| comes first.
+    fflush(fd);
+    return fileno(fd);
+  }
+
+  base::AsyncFileWriter writer_;
 };
 
-FilePacketWriter::FilePacketWriter(FILE* fd) : fd_(fd) {}
+FilePacketWriter::FilePacketWriter(FILE* fd) : writer_(FlushAndGetFd(fd)) {}
 
 FilePacketWriter::~FilePacketWriter() {
-  fflush(fd_);
+  if (!writer_.Flush())
+    PERFETTO_ELOG("Failed to write the final part of the trace to the file");
 }
 
 bool FilePacketWriter::WritePacket(const TracePacket& packet) {
   Preamble preamble;
   size_t size = GetPreamble<kPacketId>(packet.size(), &preamble);
-  if (fwrite(preamble.data(), 1, size, fd_) != size)
+  if (!writer_.Write(preamble.data(), size))
     return false;
   for (const Slice& slice : packet.slices()) {
-    if (fwrite(reinterpret_cast<const char*>(slice.start), 1, slice.size,
-               fd_) != slice.size) {
+    if (!writer_.Write(slice.start, slice.size))
       return false;
-    }
   }
 
   return true;
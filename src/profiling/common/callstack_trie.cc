@@ -25,15 +25,38 @@
 namespace perfetto {
 namespace profiling {
 
+GlobalCallstackTrie::~GlobalCallstackTrie() {
+  DeleteChildren(&root_);
+}
+
 GlobalCallstackTrie::Node* GlobalCallstackTrie::GetOrCreateChild(
     Node* self,
     const Interned<Frame>& loc) {
-  Node* child = self->GetChild(loc);
-  if (!child)
-    child = self->AddChild(loc, ++next_callstack_id_, self);
+  InternID frame_id = loc.id();
+  Node* child = self->children_.Find(frame_id);
+  if (!child) {
+    PERFETTO_CHECK(callstack_ids_left_ > 0);
+    callstack_ids_left_--;
+    child = node_arena_.New(loc, ++next_callstack_id_, self);
+    self->children_.Insert(frame_id, child);
+  }
   return child;
 }
 
+void GlobalCallstackTrie::RemoveChild(Node* self, Node* child) {
+  self->children_.Remove(child->location_.id());
+  DeleteChildren(child);
+  node_arena_.Delete(child);
+}
+
+void GlobalCallstackTrie::DeleteChildren(Node* node) {
+  node->children_.ForEach([this](Node* child) {
+    DeleteChildren(child);
+    node_arena_.Delete(child);
+  });
+  node->children_.Clear();
+}
+
 std::vector<Interned<Frame>> GlobalCallstackTrie::BuildInverseCallstack(
     const Node* node) const {
   std::vector<Interned<Frame>> res;
@@ -88,7 +111,7 @@ void GlobalCallstackTrie::DecrementNode(Node* node) {
   Node* prev = nullptr;
   while (node != nullptr) {
     if (delete_prev)
-      node->RemoveChild(prev);
+      RemoveChild(node, prev);
     node->ref_count_ -= 1;
     delete_prev = node->ref_count_ == 0;
     prev = node;
@@ -126,29 +149,148 @@ Interned<Frame> GlobalCallstackTrie::MakeRootFrame() {
   return frame_interner_.Intern(frame);
 }
 
-GlobalCallstackTrie::Node* GlobalCallstackTrie::Node::AddChild(
-    const Interned<Frame>& loc,
-    uint64_t callstack_id,
-    Node* parent) {
-  auto it = children_.emplace(loc, callstack_id, parent);
-  return const_cast<Node*>(&(*it.first));
+GlobalCallstackTrie::Node* GlobalCallstackTrie::Node::Children::Find(
+    InternID frame_id) const {
+  if (capacity_ == 0)
+    return size_ && inline_child_.frame_id == frame_id ? inline_child_.node
+                                                       : nullptr;
+  if (!is_table()) {
+    for (uint32_t i = 0; i < size_; ++i) {
+      if (heap_[i].frame_id == frame_id)
+        return heap_[i].node;
+    }
+    return nullptr;
+  }
+  for (uint32_t i = Bucket(frame_id);; i = (i + 1) & (capacity_ - 1)) {
+    const Child& child = heap_[i];
+    if (!child.node)
+      return nullptr;
+    if (child.frame_id == frame_id)
+      return child.node;
+  }
 }
-void GlobalCallstackTrie::Node::RemoveChild(Node* node) {
-  children_.erase(*node);
+
+void GlobalCallstackTrie::Node::Children::Insert(InternID frame_id,
+                                                 Node* node) {
+  PERFETTO_DCHECK(!Find(frame_id));
+  if (capacity_ == 0 && size_ == 0) {
+    inline_child_ = {frame_id, node};
+    size_ = 1;
+    return;
+  }
+  // Keep the load factor of the hash table at most 1/2.
+  if (capacity_ == 0 || (!is_table() && size_ == capacity_) ||
+      (is_table() && (size_ + 1) * 2 > capacity_)) {
+    Grow();
+  }
+  if (is_table()) {
+    InsertIntoTable({frame_id, node});
+  } else {
+    heap_[size_] = {frame_id, node};
+  }
+  size_++;
 }
 
-GlobalCallstackTrie::Node* GlobalCallstackTrie::Node::GetChild(
-    const Interned<Frame>& loc) {
-  // This will be nicer with C++14 transparent comparators.
-  // Then we will be able to look up by just the key using a sutiable
-  // comparator.
-  //
-  // For now we need to allow to construct Node from the key.
-  Node node(loc);
-  auto it = children_.find(node);
-  if (it == children_.end())
-    return nullptr;
-  return const_cast<Node*>(&(*it));
+void GlobalCallstackTrie::Node::Children::Remove(InternID frame_id) {
+  if (capacity_ == 0) {
+    PERFETTO_DCHECK(size_ == 1 && inline_child_.frame_id == frame_id);
+    inline_child_ = {};
+    size_ = 0;
+    return;
+  }
+  if (!is_table()) {
+    for (uint32_t i = 0; i < size_; ++i) {
+      if (heap_[i].frame_id == frame_id) {
+        heap_[i] = heap_[size_ - 1];
+        heap_[size_ - 1] = {};
+        size_--;
+        return;
+      }
+    }
+    PERFETTO_DFATAL("Child not found");
+    return;
+  }
+  const uint32_t mask = capacity_ - 1;
+  uint32_t i = Bucket(frame_id);
+  while (heap_[i].frame_id != frame_id || !heap_[i].node) {
+    if (!heap_[i].node) {
+      PERFETTO_DFATAL("Child not found");
+      return;
+    }
+    i = (i + 1) & mask;
+  }
+  // Backward shift deletion: move back the following entries of the probe
+  // sequence, so that lookups never need tombstones.
+  for (uint32_t j = (i + 1) & mask; heap_[j].node; j = (j + 1) & mask) {
+    uint32_t bucket = Bucket(heap_[j].frame_id);
+    // Move |j| into the hole at |i| unless its bucket lies cyclically in
+    // (i, j], in which case it is reachable without going through |i|.
+    bool reachable = i <= j ? (i < bucket && bucket <= j)
+                            : (i < bucket || bucket <= j);
+    if (!reachable) {
+      heap_[i] = heap_[j];
+      i = j;
+    }
+  }
+  heap_[i] = {};
+  size_--;
+}
+
+void GlobalCallstackTrie::Node::Children::Grow() {
+  uint32_t old_capacity = capacity_;
+  std::unique_ptr<Child[]> old_heap = std::move(heap_);
+  if (old_capacity == 0) {
+    capacity_ = 4;
+    heap_.reset(new Child[capacity_]);
+    heap_[0] = inline_child_;
+    inline_child_ = {};
+    return;
+  }
+  // When switching from the list to the hash table, leave some slack.
+  capacity_ =
+      old_capacity == kMaxListSize ? kMaxListSize * 4 : old_capacity * 2;
+  heap_.reset(new Child[capacity_]);
+  if (!is_table()) {
+    for (uint32_t i = 0; i < size_; ++i)
+      heap_[i] = old_heap[i];
+    return;
+  }
+  for (uint32_t i = 0; i < old_capacity; ++i) {
+    if (old_heap[i].node)
+      InsertIntoTable(old_heap[i]);
+  }
+}
+
+void GlobalCallstackTrie::Node::Children::InsertIntoTable(Child child) {
+  uint32_t i = Bucket(child.frame_id);
+  while (heap_[i].node)
+    i = (i + 1) & (capacity_ - 1);
+  heap_[i] = child;
+}
+
+GlobalCallstackTrie::Node* GlobalCallstackTrie::NodeArena::New(
+    Interned<Frame> frame,
+    uint64_t id,
+    Node* parent) {
+  Slot* slot;
+  if (free_list_) {
+    slot = free_list_;
+    free_list_ = slot->next_free;
+  } else {
+    if (used_in_last_chunk_ == kNodesPerChunk) {
+      chunks_.emplace_back(new Slot[kNodesPerChunk]);
+      used_in_last_chunk_ = 0;
+    }
+    slot = &chunks_.back()[used_in_last_chunk_++];
+  }
+  return new (&slot->node) Node(std::move(frame), id, parent);
+}
+
+void GlobalCallstackTrie::NodeArena::Delete(Node* node) {
+  node->~Node();
+  Slot* slot = reinterpret_cast<Slot*>(node);
+  slot->next_free = free_list_;
+  free_list_ = slot;
 }
 
 }  // namespace profiling
@@ -17,7 +17,8 @@
 #ifndef SRC_PROFILING_COMMON_CALLSTACK_TRIE_H_
 #define SRC_PROFILING_COMMON_CALLSTACK_TRIE_H_
 
-#include <set>
+#include <limits>
+#include <memory>
 #include <string>
 #include <typeindex>
 #include <vector>
@@ -105,47 +106,95 @@ class GlobalCallstackTrie {
     // This is opaque except to GlobalCallstackTrie.
     friend class GlobalCallstackTrie;
 
-    // Allow building a node out of a frame for GetChild.
-    explicit Node(Interned<Frame> frame) : Node(frame, 0, nullptr) {}
-    Node(const Node&) = default;
-    Node(Node&&) = default;
-
-    Node(Interned<Frame> frame, uint64_t id)
-        : Node(std::move(frame), id, nullptr) {}
     Node(Interned<Frame> frame, uint64_t id, Node* parent)
-        : id_(id), parent_(parent), location_(frame) {}
+        : id_(id), parent_(parent), location_(std::move(frame)) {}
+    Node(const Node&) = delete;
+    Node& operator=(const Node&) = delete;
 
     ~Node() { PERFETTO_DCHECK(!ref_count_); }
 
     uint64_t id() const { return id_; }
 
    private:
-    Node* GetOrCreateChild(const Interned<Frame>& loc);
-    // Deletes all descendant nodes, regardless of |ref_count_|.
-    void DeleteChildren() { children_.clear(); }
+    // The children of a node, keyed by the id of their frame. Most nodes have
+    // a single child, which is stored inline. Up to |kMaxListSize| children
+    // are kept in an array and looked up with a linear scan, past that (e.g.
+    // for the callers of malloc) in an open addressing hash table.
+    class Children {
+     public:
+      Children() = default;
+      Children(const Children&) = delete;
+      Children& operator=(const Children&) = delete;
+
+      Node* Find(InternID frame_id) const;
+      void Insert(InternID frame_id, Node* node);
+      void Remove(InternID frame_id);
+      void Clear() {
+        inline_child_ = {};
+        heap_.reset();
+        size_ = 0;
+        capacity_ = 0;
+      }
+      size_t size() const { return size_; }
+
+      template <typename F>
+      void ForEach(F fn) const {
+        if (capacity_ == 0) {
+          if (size_)
+            fn(inline_child_.node);
+          return;
+        }
+        for (uint32_t i = 0; i < capacity_; ++i) {
+          if (heap_[i].node)
+            fn(heap_[i].node);
+        }
+      }
 
-    uint64_t ref_count_ = 0;
-    uint64_t id_;
-    Node* const parent_;
-    const Interned<Frame> location_;
+     private:
+      static constexpr uint32_t kMaxListSize = 8;
 
-    class NodeComparator {
-     public:
-      bool operator()(const Node& one, const Node& other) const {
-        return one.location_ < other.location_;
+      struct Child {
+        InternID frame_id = 0;
+        Node* node = nullptr;
+      };
+
+      bool is_table() const { return capacity_ > kMaxListSize; }
+      uint32_t Bucket(InternID frame_id) const {
+        uint32_t hash = frame_id * 2654435761u;  // Knuth's multiplicative hash.
+        return (hash ^ (hash >> 16)) & (capacity_ - 1);
       }
+      void Grow();
+      void InsertIntoTable(Child child);
+
+      // Used if |capacity_| is 0.
+      Child inline_child_;
+      // An unordered list of |size_| children if |capacity_| is at most
+      // kMaxListSize, a hash table with linear probing otherwise. Free slots
+      // have a null node.
+      std::unique_ptr<Child[]> heap_;
+      uint32_t size_ = 0;
+      uint32_t capacity_ = 0;
     };
-    Node* AddChild(const Interned<Frame>& loc,
-                   uint64_t next_callstack_id_,
-                   Node* parent);
-    void RemoveChild(Node* node);
-    Node* GetChild(const Interned<Frame>& loc);
 
-    std::set<Node, NodeComparator> children_;
+    uint64_t ref_count_ = 0;
+    uint64_t id_;
+    Node* const parent_;
+    const Interned<Frame> location_;
+    Children children_;
   };
 
   GlobalCallstackTrie() = default;
-  ~GlobalCallstackTrie() = default;
+  // The ids of the callstacks, frames, mappings and strings of this trie are
+  // in [first_id, first_id + num_ids). Tries with disjoint id ranges can be
+  // emitted into the same interning sequence. Running out of ids is a fatal
+  // error.
+  GlobalCallstackTrie(InternID first_id, uint64_t num_ids)
+      : string_interner_(first_id, num_ids),
+        mapping_interner_(first_id, num_ids),
+        frame_interner_(first_id, num_ids),
+        next_callstack_id_(first_id - 1),
+        callstack_ids_left_(num_ids - 1) {}  // The root takes one id.
+  ~GlobalCallstackTrie();
   GlobalCallstackTrie(const GlobalCallstackTrie&) = delete;
   GlobalCallstackTrie& operator=(const GlobalCallstackTrie&) = delete;
 
@@ -160,8 +209,8 @@ class GlobalCallstackTrie {
                        const std::vector<std::string>& build_ids);
   Node* CreateCallsite(const std::vector<Interned<Frame>>& callstack);
 
-  static void IncrementNode(Node* node);
-  static void DecrementNode(Node* node);
+  void IncrementNode(Node* node);
+  void DecrementNode(Node* node);
 
   std::vector<Interned<Frame>> BuildInverseCallstack(const Node* node) const;
 
@@ -170,11 +219,39 @@ class GlobalCallstackTrie {
   // of nodes (Node.ref_count_).
   void ClearTrie() {
     PERFETTO_DLOG("Clearing trie");
-    root_.DeleteChildren();
+    DeleteChildren(&root_);
   }
 
  private:
+  // Allocates the nodes in chunks, and recycles the deleted ones.
+  class NodeArena {
+   public:
+    NodeArena() = default;
+    NodeArena(const NodeArena&) = delete;
+    NodeArena& operator=(const NodeArena&) = delete;
+
+    Node* New(Interned<Frame> frame, uint64_t id, Node* parent);
+    void Delete(Node* node);
+
+   private:
+    static constexpr size_t kNodesPerChunk = 256;
+
+    union Slot {
+      Slot() {}
+      ~Slot() {}
+      Slot* next_free;
+      Node node;
+    };
+
+    std::vector<std::unique_ptr<Slot[]>> chunks_;
+    size_t used_in_last_chunk_ = kNodesPerChunk;
+    Slot* free_list_ = nullptr;
+  };
+
   Node* GetOrCreateChild(Node* self, const Interned<Frame>& loc);
+  void RemoveChild(Node* self, Node* child);
+  // Deletes all descendant nodes, regardless of |ref_count_|.
+  void DeleteChildren(Node* node);
 
   Interned<Frame> MakeRootFrame();
 
@@ -183,10 +260,17 @@ class GlobalCallstackTrie {
   Interner<Frame> frame_interner_;
 
   uint64_t next_callstack_id_ = 0;
+  // Nodes are recreated with new ids, so this keeps decreasing even if the
+  // size of the trie doesn't grow.
+  uint64_t callstack_ids_left_ = std::numeric_limits<uint64_t>::max();
+
+  // Must outlive root_.
+  NodeArena node_arena_;
 
   // Note: profile_module in trace processor relies on the value of this root
-  // callsite being exactly "1". See the perf_sample parsing code.
-  Node root_{MakeRootFrame(), ++next_callstack_id_};
+  // callsite being exactly "1" (the default |first_id|). See the perf_sample
+  // parsing code.
+  Node root_{MakeRootFrame(), ++next_callstack_id_, nullptr};
 };
 
 }  // namespace profiling
@@ -0,0 +1,120 @@
+// Copyright (C) 2023 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "src/profiling/common/callstack_trie.h"
+
+namespace perfetto {
+namespace profiling {
+namespace {
+
+constexpr size_t kNumCallstacks = 20000;
+constexpr size_t kNumFunctions = 20000;
+
+// Callstacks shaped like the ones of a heap profile of an Android app: a
+// deep, shared framework prefix (zygote, looper, ...), fanning out into the
+// app code, and ending in a few allocation entry points with many callers.
+struct Callstacks {
+  Callstacks() {
+    std::minstd_rand rnd(0);
+    std::vector<unwindstack::FrameData> frames(kNumFunctions);
+    for (size_t i = 0; i < frames.size(); i++) {
+      frames[i].pc = 0x7000000000 + i * 64;
+      frames[i].rel_pc = i * 64;
+      frames[i].function_name =
+          "android::SomeNamespace::SomeClass::Function" + std::to_string(i);
+    }
+    for (size_t i = 0; i < kNumCallstacks; i++) {
+      // libunwindstack reports the leaf frame first, here one of a few
+      // allocation entry points.
+      std::vector<unwindstack::FrameData> callstack;
+      callstack.push_back(frames[rnd() % 4]);
+      // The frames at distance |d| from the root are picked among ~8*d^2
+      // functions, so that the frames close to the root are mostly shared.
+      size_t depth = 20 + rnd() % 40;
+      for (size_t d = depth; d > 0; d--) {
+        size_t distinct = std::min<size_t>(kNumFunctions - 4, d * d * 8);
+        callstack.push_back(frames[4 + (d * 131 + rnd() % distinct) %
+                                           (kNumFunctions - 4)]);
+      }
+      callstacks.push_back(std::move(callstack));
+      build_ids.emplace_back(callstacks.back().size(), "buildid");
+      num_frames += callstacks.back().size();
+    }
+  }
+
+  std::vector<std::vector<unwindstack::FrameData>> callstacks;
+  std::vector<std::vector<std::string>> build_ids;
+  size_t num_frames = 0;
+};
+
+const Callstacks& GetCallstacks() {
+  static Callstacks* callstacks = new Callstacks();
+  return *callstacks;
+}
+
+// Looking up callstacks which are already in the trie, as heapprofd does for
+// most samples.
+void BM_CallstackTrieLookup(benchmark::State& state) {
+  const Callstacks& cs = GetCallstacks();
+  GlobalCallstackTrie trie;
+  std::vector<GlobalCallstackTrie::Node*> nodes;
+  for (size_t i = 0; i < cs.callstacks.size(); i++) {
+    nodes.push_back(trie.CreateCallsite(cs.callstacks[i], cs.build_ids[i]));
+    trie.IncrementNode(nodes.back());
+  }
+  for (auto _ : state) {
+    for (size_t i = 0; i < cs.callstacks.size(); i++) {
+      benchmark::DoNotOptimize(
+          trie.CreateCallsite(cs.callstacks[i], cs.build_ids[i]));
+    }
+  }
+  for (GlobalCallstackTrie::Node* node : nodes)
+    trie.DecrementNode(node);
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations() *
+                                               cs.num_frames));
+}
+
+// Building the trie from scratch, and releasing all of it.
+void BM_CallstackTrieInsert(benchmark::State& state) {
+  const Callstacks& cs = GetCallstacks();
+  GlobalCallstackTrie trie;
+  std::vector<GlobalCallstackTrie::Node*> nodes;
+  nodes.reserve(cs.callstacks.size());
+  for (auto _ : state) {
+    for (size_t i = 0; i < cs.callstacks.size(); i++) {
+      nodes.push_back(trie.CreateCallsite(cs.callstacks[i], cs.build_ids[i]));
+      trie.IncrementNode(nodes.back());
+    }
+    for (GlobalCallstackTrie::Node* node : nodes)
+      trie.DecrementNode(node);
+    nodes.clear();
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations() *
+                                               cs.num_frames));
+}
+
+}  // namespace
+
+BENCHMARK(BM_CallstackTrieLookup);
+BENCHMARK(BM_CallstackTrieInsert);
+
+}  // namespace profiling
+}  // namespace perfetto
@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/profiling/common/callstack_trie.h"
+
+#include <set>
+#include <string>
+#include <vector>
+
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace profiling {
+namespace {
+
+// Returns a callstack, leaf first, made of |frames| and then |leaf|.
+std::vector<unwindstack::FrameData> MakeCallstack(
+    const std::vector<uint64_t>& frames,
+    uint64_t leaf) {
+  std::vector<unwindstack::FrameData> res;
+  unwindstack::FrameData data{};
+  data.function_name = "fun" + std::to_string(leaf);
+  data.rel_pc = leaf;
+  res.emplace_back(data);
+  for (auto it = frames.rbegin(); it != frames.rend(); ++it) {
+    data.function_name = "fun" + std::to_string(*it);
+    data.rel_pc = *it;
+    res.emplace_back(data);
+  }
+  return res;
+}
+
+std::vector<std::string> BuildIds(size_t n) {
+  return std::vector<std::string>(n, "buildid");
+}
+
+TEST(GlobalCallstackTrieTest, SharedPrefix) {
+  GlobalCallstackTrie trie;
+  auto stack1 = MakeCallstack({1, 2}, 3);
+  auto stack2 = MakeCallstack({1, 2}, 4);
+  GlobalCallstackTrie::Node* node1 =
+      trie.CreateCallsite(stack1, BuildIds(stack1.size()));
+  GlobalCallstackTrie::Node* node2 =
+      trie.CreateCallsite(stack2, BuildIds(stack2.size()));
+  EXPECT_NE(node1, node2);
+  EXPECT_EQ(trie.CreateCallsite(stack1, BuildIds(stack1.size())), node1);
+
+  std::vector<Interned<Frame>> frames1 = trie.BuildInverseCallstack(node1);
+  std::vector<Interned<Frame>> frames2 = trie.BuildInverseCallstack(node2);
+  ASSERT_EQ(frames1.size(), 3u);
+  ASSERT_EQ(frames2.size(), 3u);
+  EXPECT_EQ(frames1[0]->rel_pc, 3u);
+  EXPECT_EQ(frames2[0]->rel_pc, 4u);
+  EXPECT_EQ(frames1[1], frames2[1]);
+  EXPECT_EQ(frames1[2], frames2[2]);
+}
+
+// Enough children to switch to a hash table and grow it, and then remove them
+// in an order different from the insertion one.
+TEST(GlobalCallstackTrieTest, ManyChildren) {
+  GlobalCallstackTrie trie;
+  constexpr uint64_t kNumChildren = 1000;
+  std::vector<GlobalCallstackTrie::Node*> nodes;
+  std::set<uint64_t> ids;
+  for (uint64_t i = 0; i < kNumChildren; ++i) {
+    auto stack = MakeCallstack({1}, 100 + i);
+    GlobalCallstackTrie::Node* node =
+        trie.CreateCallsite(stack, BuildIds(stack.size()));
+    trie.IncrementNode(node);
+    nodes.push_back(node);
+    ids.insert(node->id());
+  }
+  EXPECT_EQ(ids.size(), kNumChildren);
+
+  for (uint64_t i = 0; i < kNumChildren; i += 2)
+    trie.DecrementNode(nodes[i]);
+
+  for (uint64_t i = 0; i < kNumChildren; ++i) {
+    auto stack = MakeCallstack({1}, 100 + i);
+    GlobalCallstackTrie::Node* node =
+        trie.CreateCallsite(stack, BuildIds(stack.size()));
+    if (i % 2) {
+      EXPECT_EQ(node, nodes[i]);
+      EXPECT_EQ(node->id(), nodes[i]->id());
+    } else {
+      // Recreated with a new id.
+      EXPECT_EQ(ids.count(node->id()), 0u);
+    }
+  }
+
+  for (uint64_t i = 1; i < kNumChildren; i += 2)
+    trie.DecrementNode(nodes[i]);
+}
+
+TEST(GlobalCallstackTrieTest, DecrementDeletesOrphans) {
+  GlobalCallstackTrie trie;
+  auto stack1 = MakeCallstack({1, 2}, 3);
+  auto stack2 = MakeCallstack({1}, 4);
+  GlobalCallstackTrie::Node* node1 =
+      trie.CreateCallsite(stack1, BuildIds(stack1.size()));
+  trie.IncrementNode(node1);
+  GlobalCallstackTrie::Node* node2 =
+      trie.CreateCallsite(stack2, BuildIds(stack2.size()));
+  trie.IncrementNode(node2);
+  uint64_t id1 = node1->id();
+
+  trie.DecrementNode(node1);
+  // 1 -> 2 -> 3 is gone, while 1 is still referenced by 1 -> 4.
+  GlobalCallstackTrie::Node* recreated =
+      trie.CreateCallsite(stack1, BuildIds(stack1.size()));
+  EXPECT_NE(recreated->id(), id1);
+  EXPECT_EQ(trie.CreateCallsite(stack2, BuildIds(stack2.size())), node2);
+  trie.DecrementNode(node2);
+}
+
+#if defined(GTEST_HAS_DEATH_TEST)
+// Nodes that are deleted and created again take new ids, so the id range can
+// run out even if the trie doesn't grow.
+TEST(GlobalCallstackTrieTest, IdRangeExhausted) {
+  constexpr uint64_t kNumIds = 4;
+  GlobalCallstackTrie trie(/*first_id=*/100, kNumIds);
+  auto stack = MakeCallstack({}, 1);
+  GlobalCallstackTrie::Node* node =
+      trie.CreateCallsite(stack, BuildIds(stack.size()));
+  std::vector<Interned<Frame>> frames = trie.BuildInverseCallstack(node);
+  // The root has id 100.
+  EXPECT_EQ(node->id(), 101u);
+  for (uint64_t id = 102; id < 100 + kNumIds; ++id) {
+    trie.IncrementNode(node);
+    trie.DecrementNode(node);
+    node = trie.CreateCallsite(frames);
+    EXPECT_EQ(node->id(), id);
+  }
+  trie.IncrementNode(node);
+  trie.DecrementNode(node);
+  EXPECT_DEATH({ trie.CreateCallsite(frames); }, "");
+}
+#endif  // defined(GTEST_HAS_DEATH_TEST)
+
+}  // namespace
+}  // namespace profiling
+}  // namespace perfetto
@@ -20,6 +20,7 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <functional>
+#include <limits>
 #include <unordered_set>
 
 #include "perfetto/base/logging.h"
@@ -96,11 +97,22 @@ class Interner {
     Interner::Entry* entry_;
   };
 
+  Interner() = default;
+
+  // Hands out at most |num_ids| ids starting from |first_id|, so that several
+  // interners can share an id space without collisions. Running out of ids
+  // is a fatal error: the next ids belong to another interner.
+  explicit Interner(InternID first_id,
+                    uint64_t num_ids = std::numeric_limits<uint64_t>::max())
+      : next_id(first_id), ids_left_(num_ids) {}
+
   template <typename... U>
   Interned Intern(U... args) {
     Entry item(this, next_id, std::forward<U...>(args...));
     auto it = entries_.find(item);
     if (it == entries_.cend()) {
+      PERFETTO_CHECK(ids_left_ > 0);
+      ids_left_--;
       // This does not invalidate pointers to entries we hold in Interned. See
       // https://timsong-cpp.github.io/cppwp/n3337/unord.req#8
       auto it_and_inserted = entries_.emplace(std::move(item));
@@ -124,6 +136,7 @@ class Interner {
   }
 
   InternID next_id = 1;
+  uint64_t ids_left_ = std::numeric_limits<uint64_t>::max();
   std::unordered_set<Entry, typename Entry::Hash> entries_;
   static_assert(sizeof(Interned) == sizeof(void*),
                 "interned things should be small");
@@ -128,6 +128,25 @@ TEST(InternerStringTest, IdsConsecutive) {
   ASSERT_EQ(interner.entry_count_for_testing(), 0u);
 }
 
+TEST(InternerStringTest, FirstId) {
+  Interner<std::string> interner(1000);
+  Interned<std::string> interned_str = interner.Intern("foo");
+  Interned<std::string> other_interned_str = interner.Intern("bar");
+  EXPECT_EQ(interned_str.id(), 1000u);
+  EXPECT_EQ(other_interned_str.id(), 1001u);
+}
+
+#if defined(GTEST_HAS_DEATH_TEST)
+TEST(InternerStringTest, IdRangeExhausted) {
+  Interner<std::string> interner(1000, /*num_ids=*/2);
+  Interned<std::string> interned_str = interner.Intern("foo");
+  Interned<std::string> other_interned_str = interner.Intern("bar");
+  // Interning an existing string doesn't take an id.
+  EXPECT_EQ(interner.Intern("foo").id(), 1000u);
+  EXPECT_DEATH({ interner.Intern("baz"); }, "");
+}
+#endif  // defined(GTEST_HAS_DEATH_TEST)
+
 }  // namespace
 }  // namespace profiling
 }  // namespace perfetto
@@ -101,6 +101,7 @@ UnwindingMetadata::UnwindingMetadata(base::ScopedFile maps_fd,
 
 void UnwindingMetadata::ReparseMaps() {
   reparses++;
+  unwinding_cache.Clear();
   fd_maps.Reset();
   fd_maps.Parse();
 #if PERFETTO_BUILDFLAG(PERFETTO_ANDROID_BUILD)
@@ -33,6 +33,7 @@
 #include "perfetto/base/logging.h"
 #include "perfetto/base/time.h"
 #include "perfetto/ext/base/scoped_file.h"
+#include "src/profiling/common/unwinding_cache.h"
 
 namespace perfetto {
 namespace profiling {
@@ -115,6 +116,8 @@ struct UnwindingMetadata {
   std::shared_ptr<unwindstack::Memory> fd_mem;
   uint64_t reparses = 0;
   base::TimeMillis last_maps_reparse_time{0};
+  // Cleared on reparse, as the cached frames refer to the old maps.
+  UnwindingCache unwinding_cache;
 #if PERFETTO_BUILDFLAG(PERFETTO_ANDROID_BUILD)
   std::unique_ptr<unwindstack::JitDebug> jit_debug;
   std::unique_ptr<unwindstack::DexFiles> dex_files;
@@ -0,0 +1,164 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/profiling/common/unwinding_cache.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+
+#include <unwindstack/Maps.h>
+
+#include "perfetto/ext/base/hash.h"
+#include "perfetto/ext/base/string_utils.h"
+
+namespace perfetto {
+namespace profiling {
+namespace {
+
+// Mappings whose contents can change, or whose frames are symbolized by
+// reading the memory of the process rather than a file.
+bool IsFileBacked(const std::string& name) {
+  if (name.empty() || name[0] != '/')
+    return false;
+  if (base::StartsWith(name, "/memfd:") || base::StartsWith(name, "/dev/"))
+    return false;
+  for (const char* suffix : {".dex", ".vdex", ".jar", ".apk"}) {
+    if (base::EndsWith(name, suffix))
+      return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+UnwindingCache::Sample::Sample(unwindstack::Regs* r,
+                               uint64_t s,
+                               const uint8_t* st,
+                               size_t ss)
+    : regs(r->RawData()),
+      regs_size((r->Is32Bit() ? sizeof(uint32_t) : sizeof(uint64_t)) *
+                r->total_regs()),
+      sp(s),
+      stack(st),
+      stack_size(ss) {}
+
+size_t UnwindingCache::RecordingMemory::Read(uint64_t addr,
+                                             void* dst,
+                                             size_t size) {
+  if (!cacheable_ || size == 0)
+    return mem_->Read(addr, dst, size);
+
+  if (addr < sp_ && sp_ - addr <= kMaxUnvalidatedBytes && size <= sp_ - addr)
+    return mem_->Read(addr, dst, size);
+
+  if (addr < sp_ || addr >= stack_end_ || size > stack_end_ - addr ||
+      recorded_bytes_ + size > kMaxRecordedBytes) {
+    cacheable_ = false;
+    stack_reads_.clear();
+    return mem_->Read(addr, dst, size);
+  }
+
+  uint32_t offset = static_cast<uint32_t>(addr - sp_);
+  if (!stack_reads_.empty()) {
+    StackRead& last = stack_reads_.back();
+    if (last.offset <= offset && offset + size <= last.offset + last.size)
+      return mem_->Read(addr, dst, size);
+    if (last.offset + last.size == offset) {
+      last.size += static_cast<uint32_t>(size);
+      recorded_bytes_ += size;
+      return mem_->Read(addr, dst, size);
+    }
+  }
+  stack_reads_.push_back({offset, static_cast<uint32_t>(size)});
+  recorded_bytes_ += size;
+  return mem_->Read(addr, dst, size);
+}
+
+// static
+uint64_t UnwindingCache::Hash(const Sample& sample) {
+  base::Hasher hasher;
+  hasher.Update(reinterpret_cast<const char*>(sample.regs), sample.regs_size);
+  hasher.Update(sample.sp);
+  size_t key_bytes =
+      std::min(sample.stack_size, kKeyStackWords * sizeof(uint64_t));
+  hasher.Update(reinterpret_cast<const char*>(sample.stack), key_bytes);
+  return hasher.digest();
+}
+
+// static
+bool UnwindingCache::IsCacheable(
+    const std::vector<unwindstack::FrameData>& frames) {
+  for (const unwindstack::FrameData& frame : frames) {
+    if (frame.map_info == nullptr || !IsFileBacked(frame.map_info->name()))
+      return false;
+  }
+  return true;
+}
+
+const std::vector<unwindstack::FrameData>* UnwindingCache::Lookup(
+    const Sample& sample) {
+  if (slots_.empty()) {
+    misses_++;
+    return nullptr;
+  }
+  uint64_t hash = Hash(sample);
+  const Entry& entry = slots_[hash % capacity_];
+  if (entry.frames.empty() || entry.hash != hash || entry.sp != sample.sp ||
+      entry.regs.size() != sample.regs_size ||
+      memcmp(entry.regs.data(), sample.regs, sample.regs_size) != 0) {
+    misses_++;
+    return nullptr;
+  }
+  const uint8_t* bytes = entry.stack_bytes.data();
+  for (const RecordingMemory::StackRead& read : entry.stack_reads) {
+    if (read.offset + read.size > sample.stack_size ||
+        memcmp(sample.stack + read.offset, bytes, read.size) != 0) {
+      misses_++;
+      return nullptr;
+    }
+    bytes += read.size;
+  }
+  hits_++;
+  return &entry.frames;
+}
+
+void UnwindingCache::Insert(const Sample& sample,
+                            const RecordingMemory& memory,
+                            const std::vector<unwindstack::FrameData>& frames) {
+  if (!memory.cacheable_ || frames.empty() || !IsCacheable(frames))
+    return;
+  if (slots_.empty())
+    slots_.resize(capacity_);
+
+  uint64_t hash = Hash(sample);
+  Entry& entry = slots_[hash % capacity_];
+  entry.hash = hash;
+  entry.sp = sample.sp;
+  const uint8_t* regs = reinterpret_cast<const uint8_t*>(sample.regs);
+  entry.regs.assign(regs, regs + sample.regs_size);
+  entry.stack_reads = memory.stack_reads_;
+  entry.stack_bytes.clear();
+  for (const RecordingMemory::StackRead& read : memory.stack_reads_) {
+    entry.stack_bytes.insert(entry.stack_bytes.end(), sample.stack + read.offset,
+                             sample.stack + read.offset + read.size);
+  }
+  entry.frames = frames;
+}
+
+}  // namespace profiling
+}  // namespace perfetto
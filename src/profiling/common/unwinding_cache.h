@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_PROFILING_COMMON_UNWINDING_CACHE_H_
+#define SRC_PROFILING_COMMON_UNWINDING_CACHE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <vector>
+
+#include <unwindstack/Memory.h>
+#include <unwindstack/Regs.h>
+#include <unwindstack/Unwinder.h>
+
+namespace perfetto {
+namespace profiling {
+
+// Caches the frames unwound for a sample, so that samples with the same
+// registers and the same values in the parts of the stack that the unwinder
+// looked at are not unwound again. Hot allocation sites and CPU hotspots
+// produce such samples over and over.
+//
+// Unwinding is a deterministic function of the registers, of the memory read
+// by the unwinder and of the maps of the process. The cache records the stack
+// bytes read while unwinding (see RecordingMemory), and only returns an entry
+// if all of them have the same value in the new sample. Unwinds which read
+// memory outside of the sampled stack, or whose frames are not all in
+// file-backed mappings (JIT code, dex files, ...), are not cached. The cache
+// must be cleared when the maps are reparsed.
+//
+// The exception are reads just below the sampled stack: heapprofd copies the
+// stack from the frame address of the sampling function, whose saved registers
+// are below it. These bytes are not part of the sample, and are read from the
+// live process by a normal unwind, so they are not validated.
+//
+// The cache is direct-mapped on a hash of the registers and of the top of the
+// stack: a new entry replaces the one in its slot, which bounds the memory
+// used by each process.
+class UnwindingCache {
+ public:
+  static constexpr size_t kDefaultCapacity = 512;
+  // Number of words at the top of the stack that are hashed into the key.
+  static constexpr size_t kKeyStackWords = 8;
+  // Entries which depend on more stack bytes than this are not cached.
+  static constexpr size_t kMaxRecordedBytes = 8192;
+  // Reads this close below the sampled stack are allowed, but not validated.
+  static constexpr size_t kMaxUnvalidatedBytes = 512;
+
+  // The inputs to unwinding a sample.
+  struct Sample {
+    Sample(const void* r, size_t rs, uint64_t s, const uint8_t* st, size_t ss)
+        : regs(r), regs_size(rs), sp(s), stack(st), stack_size(ss) {}
+    Sample(unwindstack::Regs* regs, uint64_t sp, const uint8_t* stack,
+           size_t stack_size);
+
+    const void* regs;
+    size_t regs_size;
+    uint64_t sp;
+    // Copy of the stack memory in [sp, sp + stack_size).
+    const uint8_t* stack;
+    size_t stack_size;
+  };
+
+  // Wraps the memory used to unwind a sample, recording the stack bytes that
+  // the unwinder depends on.
+  class RecordingMemory : public unwindstack::Memory {
+   public:
+    RecordingMemory(std::shared_ptr<unwindstack::Memory> mem,
+                    uint64_t sp,
+                    size_t stack_size)
+        : mem_(std::move(mem)), sp_(sp), stack_end_(sp + stack_size) {}
+
+    size_t Read(uint64_t addr, void* dst, size_t size) override;
+
+   private:
+    friend class UnwindingCache;
+
+    struct StackRead {
+      uint32_t offset;
+      uint32_t size;
+    };
+
+    std::shared_ptr<unwindstack::Memory> mem_;
+    const uint64_t sp_;
+    const uint64_t stack_end_;
+    std::vector<StackRead> stack_reads_;
+    size_t recorded_bytes_ = 0;
+    bool cacheable_ = true;
+  };
+
+  explicit UnwindingCache(size_t capacity = kDefaultCapacity)
+      : capacity_(capacity) {}
+
+  // Returns the frames previously unwound for an equivalent sample, or nullptr.
+  const std::vector<unwindstack::FrameData>* Lookup(const Sample& sample);
+
+  // Stores the result of a successful unwind of |sample|, which was performed
+  // using |memory|. Does nothing if the result cannot be safely reused.
+  void Insert(const Sample& sample,
+              const RecordingMemory& memory,
+              const std::vector<unwindstack::FrameData>& frames);
+
+  void Clear() { slots_.clear(); }
+
+  uint64_t hits() const { return hits_; }
+  uint64_t misses() const { return misses_; }
+
+ private:
+  struct Entry {
+    uint64_t hash = 0;
+    uint64_t sp = 0;
+    std::vector<uint8_t> regs;
+    std::vector<RecordingMemory::StackRead> stack_reads;
+    // The bytes of |stack_reads|, concatenated.
+    std::vector<uint8_t> stack_bytes;
+    std::vector<unwindstack::FrameData> frames;
+  };
+
+  static uint64_t Hash(const Sample& sample);
+  static bool IsCacheable(const std::vector<unwindstack::FrameData>& frames);
+
+  size_t capacity_;
+  // Lazily allocated, so that processes that are never unwound do not pay for
+  // the cache.
+  std::vector<Entry> slots_;
+  uint64_t hits_ = 0;
+  uint64_t misses_ = 0;
+};
+
+}  // namespace profiling
+}  // namespace perfetto
+
+#endif  // SRC_PROFILING_COMMON_UNWINDING_CACHE_H_
@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/profiling/common/unwinding_cache.h"
+
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace profiling {
+namespace {
+
+constexpr uint64_t kSp = 0x7ffff000;
+
+class NullMemory : public unwindstack::Memory {
+ public:
+  size_t Read(uint64_t, void* dst, size_t size) override {
+    memset(dst, 0, size);
+    return size;
+  }
+};
+
+class UnwindingCacheTest : public ::testing::Test {
+ protected:
+  UnwindingCacheTest() : regs_(32, 1), stack_(1024, 2) {}
+
+  UnwindingCache::Sample MakeSample() {
+    return UnwindingCache::Sample(regs_.data(), regs_.size() * sizeof(regs_[0]),
+                                  kSp, stack_.data(), stack_.size());
+  }
+
+  std::unique_ptr<UnwindingCache::RecordingMemory> MakeMemory() {
+    return std::unique_ptr<UnwindingCache::RecordingMemory>(
+        new UnwindingCache::RecordingMemory(std::make_shared<NullMemory>(),
+                                            kSp, stack_.size()));
+  }
+
+  static std::vector<unwindstack::FrameData> MakeFrames(
+      const std::string& map_name) {
+    std::vector<unwindstack::FrameData> frames(2);
+    frames[0].function_name = "malloc";
+    frames[0].map_info =
+        unwindstack::MapInfo::Create(0x1000, 0x2000, 0, 0, map_name);
+    frames[1].function_name = "main";
+    frames[1].map_info =
+        unwindstack::MapInfo::Create(0x3000, 0x4000, 0, 0, "/system/bin/app");
+    return frames;
+  }
+
+  std::vector<uint64_t> regs_;
+  std::vector<uint8_t> stack_;
+};
+
+TEST_F(UnwindingCacheTest, HitIfReadStackIsUnchanged) {
+  UnwindingCache cache;
+  EXPECT_EQ(cache.Lookup(MakeSample()), nullptr);
+
+  auto memory = MakeMemory();
+  uint64_t word;
+  memory->Read(kSp + 8, &word, sizeof(word));
+  memory->Read(kSp + 512, &word, sizeof(word));
+  cache.Insert(MakeSample(), *memory, MakeFrames("/system/lib64/libc.so"));
+
+  // Stack bytes that were not read while unwinding do not matter.
+  stack_[256] = 42;
+  const std::vector<unwindstack::FrameData>* frames =
+      cache.Lookup(MakeSample());
+  ASSERT_NE(frames, nullptr);
+  ASSERT_EQ(frames->size(), 2u);
+  EXPECT_EQ((*frames)[0].function_name, "malloc");
+  EXPECT_EQ(cache.hits(), 1u);
+  EXPECT_EQ(cache.misses(), 1u);
+
+  stack_[512] = 42;
+  EXPECT_EQ(cache.Lookup(MakeSample()), nullptr);
+  stack_[512] = 2;
+  regs_[3] = 42;
+  EXPECT_EQ(cache.Lookup(MakeSample()), nullptr);
+  regs_[3] = 1;
+  EXPECT_NE(cache.Lookup(MakeSample()), nullptr);
+
+  cache.Clear();
+  EXPECT_EQ(cache.Lookup(MakeSample()), nullptr);
+}
+
+TEST_F(UnwindingCacheTest, ShorterStack) {
+  UnwindingCache cache;
+  auto memory = MakeMemory();
+  uint64_t word;
+  memory->Read(kSp + 1000, &word, sizeof(word));
+  cache.Insert(MakeSample(), *memory, MakeFrames("/system/lib64/libc.so"));
+  ASSERT_NE(cache.Lookup(MakeSample()), nullptr);
+
+  stack_.resize(512);
+  EXPECT_EQ(cache.Lookup(MakeSample()), nullptr);
+}
+
+TEST_F(UnwindingCacheTest, ReadOutsideOfStackIsNotCached) {
+  UnwindingCache cache;
+  auto memory = MakeMemory();
+  uint64_t word;
+  memory->Read(kSp + 8, &word, sizeof(word));
+  memory->Read(kSp + 1024, &word, sizeof(word));
+  cache.Insert(MakeSample(), *memory, MakeFrames("/system/lib64/libc.so"));
+  EXPECT_EQ(cache.Lookup(MakeSample()), nullptr);
+}
+
+TEST_F(UnwindingCacheTest, ReadJustBelowStackIsNotValidated) {
+  UnwindingCache cache;
+  auto memory = MakeMemory();
+  uint64_t word;
+  memory->Read(kSp - 16, &word, sizeof(word));
+  cache.Insert(MakeSample(), *memory, MakeFrames("/system/lib64/libc.so"));
+  EXPECT_NE(cache.Lookup(MakeSample()), nullptr);
+
+  memory = MakeMemory();
+  memory->Read(kSp - 4096, &word, sizeof(word));
+  cache.Clear();
+  cache.Insert(MakeSample(), *memory, MakeFrames("/system/lib64/libc.so"));
+  EXPECT_EQ(cache.Lookup(MakeSample()), nullptr);
+}
+
+TEST_F(UnwindingCacheTest, NonFileBackedFramesAreNotCached) {
+  UnwindingCache cache;
+  for (const char* name :
+       {"/memfd:jit-cache (deleted)", "[anon:dalvik-jit-code-cache]",
+        "/data/app/base.apk", "/system/framework/framework.jar", ""}) {
+    auto memory = MakeMemory();
+    cache.Insert(MakeSample(), *memory, MakeFrames(name));
+    EXPECT_EQ(cache.Lookup(MakeSample()), nullptr) << name;
+  }
+}
+
+}  // namespace
+}  // namespace profiling
+}  // namespace perfetto
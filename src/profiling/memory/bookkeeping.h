@@ -17,10 +17,10 @@
 #ifndef SRC_PROFILING_MEMORY_BOOKKEEPING_H_
 #define SRC_PROFILING_MEMORY_BOOKKEEPING_H_
 
-#include <map>
 #include <vector>
 
 #include "perfetto/base/time.h"
+#include "perfetto/ext/base/flat_hash_map.h"
 #include "src/profiling/common/callstack_trie.h"
 #include "src/profiling/common/interner.h"
 #include "src/profiling/memory/unwound_messages.h"
@@ -117,18 +117,18 @@ class HeapTracker {
       CallstackTotalAllocations totals;
     } value = {};
 
-    GlobalCallstackTrie::Node* const node;
-
-    ~CallstackAllocations() { GlobalCallstackTrie::DecrementNode(node); }
-
-    bool operator<(const CallstackAllocations& other) const {
-      return node < other.node;
-    }
+    // Holds a reference to the node, released when the CallstackAllocations
+    // is removed from the HeapTracker. nullptr for unused slots.
+    GlobalCallstackTrie::Node* node;
   };
 
   // Caller needs to ensure that callsites outlives the HeapTracker.
   explicit HeapTracker(GlobalCallstackTrie* callsites, bool dump_at_max_mode)
       : callsites_(callsites), dump_at_max_mode_(dump_at_max_mode) {}
+  ~HeapTracker();
+
+  HeapTracker(const HeapTracker&) = delete;
+  HeapTracker& operator=(const HeapTracker&) = delete;
 
   void RecordMalloc(const std::vector<unwindstack::FrameData>& callstack,
                     const std::vector<std::string>& build_ids,
@@ -145,10 +145,10 @@ class HeapTracker {
     // * We need to remove them after the callstacks were dumped, which
     //   currently happens after the allocations are dumped.
     // * This way, we do not destroy and recreate callstacks as frequently.
-    for (auto it_and_alloc : dead_callstack_allocations_) {
-      auto& it = it_and_alloc.first;
-      uint64_t allocated = it_and_alloc.second;
-      const CallstackAllocations& alloc = it->second;
+    for (const auto& slot_and_allocated : dead_callstack_allocations_) {
+      uint32_t slot = slot_and_allocated.first;
+      uint64_t allocated = slot_and_allocated.second;
+      const CallstackAllocations& alloc = callstack_allocations_[slot];
       // For non-dump-at-max, we need to check, even if there are still no
       // allocations referencing this callstack, whether there were any
       // allocations that happened but were freed again. If that was the case,
@@ -160,28 +160,29 @@ class HeapTracker {
         // TODO(fmayer): We could probably be smarter than throw away
         // our whole frames cache.
         ClearFrameCache();
-        callstack_allocations_.erase(it);
+        FreeCallstackSlot(slot);
       }
     }
     dead_callstack_allocations_.clear();
 
-    for (auto it = callstack_allocations_.begin();
-         it != callstack_allocations_.end(); ++it) {
-      const CallstackAllocations& alloc = it->second;
+    for (uint32_t slot = 0; slot < callstack_allocations_.size(); ++slot) {
+      const CallstackAllocations& alloc = callstack_allocations_[slot];
+      if (!alloc.node)
+        continue;
       fn(alloc);
 
       if (alloc.allocs == 0)
         dead_callstack_allocations_.emplace_back(
-            it, !dump_at_max_mode_ ? alloc.value.totals.allocation_count : 0);
+            slot, !dump_at_max_mode_ ? alloc.value.totals.allocation_count : 0);
     }
   }
 
   template <typename F>
   void GetAllocations(F fn) {
-    for (const auto& addr_and_allocation : allocations_) {
-      const Allocation& alloc = addr_and_allocation.second;
-      fn(addr_and_allocation.first, alloc.sample_size, alloc.alloc_size,
-         alloc.callstack_allocations()->node->id());
+    for (auto it = allocations_.GetIterator(); it; ++it) {
+      const Allocation& alloc = it.value();
+      fn(it.key(), alloc.sample_size, alloc.alloc_size,
+         callstack_allocations_[alloc.callstack_slot].node->id());
     }
   }
 
@@ -209,44 +210,12 @@ class HeapTracker {
 
  private:
   struct Allocation {
-    Allocation(uint64_t size,
-               uint64_t asize,
-               uint64_t seq,
-               CallstackAllocations* csa)
-        : sample_size(size), alloc_size(asize), sequence_number(seq) {
-      SetCallstackAllocations(csa);
-    }
-
-    Allocation() = default;
-    Allocation(const Allocation&) = delete;
-    Allocation(Allocation&& other) noexcept {
-      sample_size = other.sample_size;
-      alloc_size = other.alloc_size;
-      sequence_number = other.sequence_number;
-      callstack_allocations_ = other.callstack_allocations_;
-      other.callstack_allocations_ = nullptr;
-    }
-
-    ~Allocation() { SetCallstackAllocations(nullptr); }
-
-    void SetCallstackAllocations(CallstackAllocations* callstack_allocations) {
-      if (callstack_allocations_)
-        callstack_allocations_->allocs--;
-      callstack_allocations_ = callstack_allocations;
-      if (callstack_allocations_)
-        callstack_allocations_->allocs++;
-    }
-
-    CallstackAllocations* callstack_allocations() const {
-      return callstack_allocations_;
-    }
-
     uint64_t sample_size;
     uint64_t alloc_size;
     uint64_t sequence_number;
-
-   private:
-    CallstackAllocations* callstack_allocations_ = nullptr;
+    // Index of the CallstackAllocations in |callstack_allocations_|, whose
+    // |allocs| counts this allocation.
+    uint32_t callstack_slot;
   };
 
   struct PendingOperation {
@@ -254,17 +223,58 @@ class HeapTracker {
     uint64_t timestamp;
   };
 
-  CallstackAllocations* MaybeCreateCallstackAllocations(
-      GlobalCallstackTrie::Node* node) {
-    auto callstack_allocations_it = callstack_allocations_.find(node);
-    if (callstack_allocations_it == callstack_allocations_.end()) {
-      GlobalCallstackTrie::IncrementNode(node);
-      bool inserted;
-      std::tie(callstack_allocations_it, inserted) =
-          callstack_allocations_.emplace(node, node);
-      PERFETTO_DCHECK(inserted);
+  // Allocation addresses are aligned and sequence numbers are consecutive.
+  // FlatHashMap uses both the low bits (for the slot) and the high bits (for
+  // the tag) of the hash, so all the bits of the keys need to be mixed.
+  struct KeyHasher {
+    size_t operator()(uint64_t key) const {
+      key ^= key >> 33;
+      key *= 0xff51afd7ed558ccdULL;
+      key ^= key >> 33;
+      return static_cast<size_t>(key);
     }
-    return &callstack_allocations_it->second;
+    size_t operator()(const GlobalCallstackTrie::Node* node) const {
+      return (*this)(static_cast<uint64_t>(reinterpret_cast<uintptr_t>(node)));
+    }
+  };
+
+  // Returns the slot of the CallstackAllocations for |node|, creating it if
+  // needed.
+  uint32_t MaybeCreateCallstackAllocations(GlobalCallstackTrie::Node* node) {
+    uint32_t* slot = callstack_slots_.Find(node);
+    if (slot)
+      return *slot;
+    callsites_->IncrementNode(node);
+    uint32_t new_slot;
+    if (!free_callstack_slots_.empty()) {
+      new_slot = free_callstack_slots_.back();
+      free_callstack_slots_.pop_back();
+      callstack_allocations_[new_slot] = CallstackAllocations(node);
+    } else {
+      new_slot = static_cast<uint32_t>(callstack_allocations_.size());
+      callstack_allocations_.emplace_back(node);
+    }
+    callstack_slots_.Insert(node, new_slot);
+    return new_slot;
+  }
+
+  void FreeCallstackSlot(uint32_t slot) {
+    CallstackAllocations& alloc = callstack_allocations_[slot];
+    PERFETTO_DCHECK(alloc.node && alloc.allocs == 0);
+    callstack_slots_.Erase(alloc.node);
+    callsites_->DecrementNode(alloc.node);
+    alloc = CallstackAllocations(nullptr);
+    free_callstack_slots_.push_back(slot);
+  }
+
+  void SetCallstackSlot(Allocation* alloc, uint32_t slot) {
+    callstack_allocations_[alloc->callstack_slot].allocs--;
+    alloc->callstack_slot = slot;
+    callstack_allocations_[slot].allocs++;
+  }
+
+  CallstackAllocations& CallstackAllocationsFor(const Allocation& alloc) {
+    return callstack_allocations_[alloc.callstack_slot];
   }
 
   void RecordOperation(uint64_t sequence_number,
@@ -282,10 +292,12 @@ class HeapTracker {
                        const PendingOperation& operation);
 
   void AddToCallstackAllocations(uint64_t ts, const Allocation& alloc) {
+    CallstackAllocations& callstack_allocations =
+        CallstackAllocationsFor(alloc);
     if (dump_at_max_mode_) {
       current_unfreed_ += alloc.sample_size;
-      alloc.callstack_allocations()->value.retain_max.cur += alloc.sample_size;
-      alloc.callstack_allocations()->value.retain_max.cur_count++;
+      callstack_allocations.value.retain_max.cur += alloc.sample_size;
+      callstack_allocations.value.retain_max.cur_count++;
 
       if (current_unfreed_ <= max_unfreed_)
         return;
@@ -293,16 +305,16 @@ class HeapTracker {
       if (max_sequence_number_ == alloc.sequence_number - 1) {
         // We know the only CallstackAllocation that has max != cur is the
         // one we just updated.
-        alloc.callstack_allocations()->value.retain_max.max =
-            alloc.callstack_allocations()->value.retain_max.cur;
-        alloc.callstack_allocations()->value.retain_max.max_count =
-            alloc.callstack_allocations()->value.retain_max.cur_count;
+        callstack_allocations.value.retain_max.max =
+            callstack_allocations.value.retain_max.cur;
+        callstack_allocations.value.retain_max.max_count =
+            callstack_allocations.value.retain_max.cur_count;
       } else {
-        for (auto& p : callstack_allocations_) {
+        for (CallstackAllocations& csa : callstack_allocations_) {
           // We need to reset max = cur for every CallstackAllocation, as we
-          // do not know which ones have changed since the last max.
+          // do not know which ones have changed since the last max. Unused
+          // slots are all zeros, so this is a no-op for them.
           // TODO(fmayer): Add an index to speed this up
-          CallstackAllocations& csa = p.second;
           csa.value.retain_max.max = csa.value.retain_max.cur;
           csa.value.retain_max.max_count = csa.value.retain_max.cur_count;
         }
@@ -311,33 +323,41 @@ class HeapTracker {
       max_unfreed_ = current_unfreed_;
       max_timestamp_ = ts;
     } else {
-      alloc.callstack_allocations()->value.totals.allocated +=
-          alloc.sample_size;
-      alloc.callstack_allocations()->value.totals.allocation_count++;
+      callstack_allocations.value.totals.allocated += alloc.sample_size;
+      callstack_allocations.value.totals.allocation_count++;
     }
   }
 
   void SubtractFromCallstackAllocations(const Allocation& alloc) {
+    CallstackAllocations& callstack_allocations =
+        CallstackAllocationsFor(alloc);
     if (dump_at_max_mode_) {
       current_unfreed_ -= alloc.sample_size;
-      alloc.callstack_allocations()->value.retain_max.cur -= alloc.sample_size;
-      alloc.callstack_allocations()->value.retain_max.cur_count--;
+      callstack_allocations.value.retain_max.cur -= alloc.sample_size;
+      callstack_allocations.value.retain_max.cur_count--;
     } else {
-      alloc.callstack_allocations()->value.totals.freed += alloc.sample_size;
-      alloc.callstack_allocations()->value.totals.free_count++;
+      callstack_allocations.value.totals.freed += alloc.sample_size;
+      callstack_allocations.value.totals.free_count++;
     }
   }
 
   // We cannot use an interner here, because after the last allocation goes
   // away, we still need to keep the CallstackAllocations around until the next
   // dump.
-  std::map<GlobalCallstackTrie::Node*, CallstackAllocations>
-      callstack_allocations_;
-
-  std::vector<std::pair<decltype(callstack_allocations_)::iterator, uint64_t>>
+  // The CallstackAllocations are stored densely, and referred to by their
+  // index (slot). Slots are reused after the CallstackAllocations is removed.
+  std::vector<CallstackAllocations> callstack_allocations_;
+  std::vector<uint32_t> free_callstack_slots_;
+  base::FlatHashMap<GlobalCallstackTrie::Node*, uint32_t /* slot */, KeyHasher>
+      callstack_slots_;
+
+  std::vector<std::pair<uint32_t /* slot */, uint64_t>>
       dead_callstack_allocations_;
 
-  std::map<uint64_t /* allocation address */, Allocation> allocations_;
+  // Every sampled malloc and every free goes through this table, so it's an
+  // open-addressing hash table rather than a tree.
+  base::FlatHashMap<uint64_t /* allocation address */, Allocation, KeyHasher>
+      allocations_;
 
   // An operation is either a commit of an allocation or freeing of an
   // allocation. An operation is a free if its seq_id is larger than
@@ -346,7 +366,12 @@ class HeapTracker {
   //
   // If its seq_id is less than the sequence_number of the corresponding
   // allocation it could be either, but is ignored either way.
-  std::map<uint64_t /* seq_id */, PendingOperation /* allocation address */>
+  //
+  // Operations are committed in order, so this is only ever looked up for the
+  // sequence number following |committed_sequence_number_|.
+  base::FlatHashMap<uint64_t /* seq_id */,
+                    PendingOperation /* allocation address */,
+                    KeyHasher>
       pending_operations_;
 
   uint64_t committed_timestamp_ = 0;
@@ -0,0 +1,138 @@
+// Copyright (C) 2023 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <benchmark/benchmark.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "src/profiling/memory/bookkeeping.h"
+
+namespace perfetto {
+namespace profiling {
+namespace {
+
+constexpr size_t kNumCallstacks = 512;
+constexpr size_t kNumFrames = 2048;
+constexpr size_t kMaxLiveAllocations = 100000;
+
+// Sampled mallocs reach the bookkeeping only after being unwound, while frees
+// are forwarded as soon as they are read from the shared memory buffer. Delay
+// the mallocs by this many records.
+constexpr size_t kMallocDelay = 32;
+
+struct Record {
+  bool is_malloc;
+  uint32_t callstack;
+  uint64_t address;
+  uint64_t size;
+  uint64_t sequence_number;
+};
+
+// The records received by heapprofd from an allocation-heavy process, in the
+// order they reach the bookkeeping. Only a fraction of the mallocs are
+// sampled, but all the frees are sent, so that most of them are for addresses
+// that are unknown to the bookkeeping.
+struct RecordStream {
+  explicit RecordStream(size_t num_records) {
+    std::minstd_rand rnd(0);
+    callstacks.resize(kNumCallstacks);
+    for (auto& callstack : callstacks) {
+      size_t depth = 8 + rnd() % 24;
+      for (size_t i = 0; i < depth; i++) {
+        unwindstack::FrameData frame{};
+        // The outermost frames are shared by most callstacks.
+        frame.pc = i < 4 ? i + 1 : 0x1000 + rnd() % kNumFrames;
+        frame.rel_pc = frame.pc;
+        frame.function_name = "fun_" + std::to_string(frame.pc);
+        callstack.insert(callstack.begin(), std::move(frame));
+      }
+    }
+    for (const auto& callstack : callstacks)
+      build_ids.emplace_back(callstack.size(), "buildid");
+
+    std::vector<uint64_t> live;
+    std::vector<Record> delayed_mallocs;
+    uint64_t sequence_number = 0;
+    uint64_t next_address = 0x7000000000;
+    while (records.size() < num_records) {
+      Record rec{};
+      rec.sequence_number = ++sequence_number;
+      bool is_malloc = live.size() < kMaxLiveAllocations / 2 ||
+                       (live.size() < kMaxLiveAllocations && rnd() % 8 == 0);
+      if (is_malloc) {
+        rec.is_malloc = true;
+        rec.callstack = static_cast<uint32_t>(rnd() % kNumCallstacks);
+        rec.address = next_address;
+        next_address += 16 * (1 + rnd() % 64);
+        rec.size = 4096;
+        live.push_back(rec.address);
+        delayed_mallocs.push_back(rec);
+      } else if (rnd() % 4 == 0 && !live.empty()) {
+        size_t idx = rnd() % live.size();
+        rec.address = live[idx];
+        live[idx] = live.back();
+        live.pop_back();
+        records.push_back(rec);
+      } else {
+        // The free of an allocation that wasn't sampled.
+        rec.address = next_address + 8;
+        next_address += 16;
+        records.push_back(rec);
+      }
+      if (delayed_mallocs.size() > 0 &&
+          delayed_mallocs.front().sequence_number + kMallocDelay <
+              sequence_number) {
+        records.push_back(delayed_mallocs.front());
+        delayed_mallocs.erase(delayed_mallocs.begin());
+      }
+    }
+    records.insert(records.end(), delayed_mallocs.begin(),
+                   delayed_mallocs.end());
+  }
+
+  std::vector<std::vector<unwindstack::FrameData>> callstacks;
+  std::vector<std::vector<std::string>> build_ids;
+  std::vector<Record> records;
+};
+
+void BM_HeapTrackerReplay(benchmark::State& state) {
+  RecordStream stream(static_cast<size_t>(state.range(0)));
+  GlobalCallstackTrie callsites;
+  for (auto _ : state) {
+    HeapTracker tracker(&callsites, /*dump_at_max_mode=*/false);
+    for (const Record& rec : stream.records) {
+      if (rec.is_malloc) {
+        tracker.RecordMalloc(stream.callstacks[rec.callstack],
+                             stream.build_ids[rec.callstack], rec.address,
+                             rec.size, rec.size, rec.sequence_number,
+                             rec.sequence_number);
+      } else {
+        tracker.RecordFree(rec.address, rec.sequence_number,
+                           rec.sequence_number);
+      }
+    }
+    benchmark::DoNotOptimize(tracker.GetTimestampForTesting());
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations() *
+                                               stream.records.size()));
+}
+
+}  // namespace
+
+BENCHMARK(BM_HeapTrackerReplay)->Arg(1000000);
+
+}  // namespace profiling
+}  // namespace perfetto
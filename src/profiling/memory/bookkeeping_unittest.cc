@@ -197,6 +197,38 @@ TEST(BookkeepingTest, TwoHeapTrackers) {
   ASSERT_EQ(hd.GetSizeForTesting(stack(), DummyBuildIds(stack().size())), 5u);
 }
 
+TEST(BookkeepingTest, DisjointTries) {
+  GlobalCallstackTrie c;
+  GlobalCallstackTrie c2(1000);
+  HeapTracker hd(&c, false);
+  HeapTracker hd2(&c2, false);
+  hd.RecordMalloc(stack(), DummyBuildIds(stack().size()), 0x1, 5, 5, 1, 100);
+  hd2.RecordMalloc(stack(), DummyBuildIds(stack().size()), 0x1, 2, 2, 1, 100);
+
+  std::vector<const GlobalCallstackTrie::Node*> nodes;
+  hd.GetCallstackAllocations(
+      [&nodes](const HeapTracker::CallstackAllocations& alloc) {
+        nodes.push_back(alloc.node);
+      });
+  ASSERT_EQ(nodes.size(), 1u);
+  EXPECT_LT(nodes[0]->id(), 1000u);
+  for (const auto& frame : c.BuildInverseCallstack(nodes[0]))
+    EXPECT_LT(frame.id(), 1000u);
+
+  nodes.clear();
+  hd2.GetCallstackAllocations(
+      [&nodes](const HeapTracker::CallstackAllocations& alloc) {
+        nodes.push_back(alloc.node);
+      });
+  ASSERT_EQ(nodes.size(), 1u);
+  EXPECT_GE(nodes[0]->id(), 1000u);
+  for (const auto& frame : c2.BuildInverseCallstack(nodes[0])) {
+    EXPECT_GE(frame.id(), 1000u);
+    EXPECT_GE(frame->function_name.id(), 1000u);
+    EXPECT_GE(frame->mapping.id(), 1000u);
+  }
+}
+
 TEST(BookkeepingTest, ReplaceAlloc) {
   uint64_t sequence_number = 1;
   GlobalCallstackTrie c;
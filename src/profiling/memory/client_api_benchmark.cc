@@ -14,6 +14,11 @@
 
 #include <benchmark/benchmark.h>
 
+#include <unistd.h>
+
+#include <thread>
+#include <vector>
+
 #include "perfetto/heap_profile.h"
 #include "src/profiling/memory/heap_profile_internal.h"
 
@@ -152,6 +157,46 @@ static void BM_ClientApiSample(benchmark::State& state) {
 
 BENCHMARK(BM_ClientApiSample);
 
+// Samples reported concurrently by several threads, which all write to the
+// same shared memory buffer.
+static void BM_ClientApiSampleMultiThread(benchmark::State& state) {
+  constexpr int kSamplesPerThread = 2000;
+  const uint32_t heap_id = GetHeapId();
+  const int num_threads = static_cast<int>(state.range(0));
+
+  ClientConfiguration client_config{};
+  client_config.default_interval = 32000;
+  client_config.all_heaps = true;
+  g_client_config = client_config;
+  PERFETTO_CHECK(AHeapProfile_initSession(malloc, free));
+
+  PERFETTO_CHECK(g_shmem_fd);
+  auto ringbuf = SharedRingBuffer::Attach(base::ScopedFile(dup(g_shmem_fd)));
+
+  for (auto _ : state) {
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_threads; i++) {
+      threads.emplace_back([heap_id] {
+        for (int j = 0; j < kSamplesPerThread; j++)
+          AHeapProfile_reportSample(heap_id, 0x123, 20);
+      });
+    }
+    for (std::thread& thread : threads)
+      thread.join();
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          num_threads * kSamplesPerThread);
+  DisconnectGlobalServerSocket();
+  ringbuf->SetShuttingDown();
+}
+
+BENCHMARK(BM_ClientApiSampleMultiThread)
+    ->Arg(1)
+    ->Arg(2)
+    ->Arg(4)
+    ->Arg(8)
+    ->UseRealTime();
+
 static void BM_ClientApiDisabledHeapAllocation(benchmark::State& state) {
   const uint32_t heap_id = GetHeapId();
 
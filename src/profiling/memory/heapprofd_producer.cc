@@ -57,7 +57,6 @@ namespace {
 using ::perfetto::protos::pbzero::ProfilePacket;
 
 constexpr char kHeapprofdDataSource[] = "android.heapprofd";
-constexpr size_t kUnwinderThreads = 5;
 
 constexpr uint32_t kInitialConnectionBackoffMs = 100;
 constexpr uint32_t kMaxConnectionBackoffMs = 30 * 1000;
@@ -201,17 +200,26 @@ bool HeapprofdConfigToClientConfiguration(
   return true;
 }
 
-// We create kUnwinderThreads unwinding threads. Bookkeeping is done on the main
-// thread.
+// We create |unwinder_threads| unwinding threads, which also do the
+// bookkeeping of the processes they unwind.
 HeapprofdProducer::HeapprofdProducer(HeapprofdMode mode,
                                      base::TaskRunner* task_runner,
-                                     bool exit_when_done)
+                                     bool exit_when_done,
+                                     size_t unwinder_threads)
     : task_runner_(task_runner),
       mode_(mode),
       exit_when_done_(exit_when_done),
-      unwinding_workers_(MakeUnwindingWorkers(this, kUnwinderThreads)),
       socket_delegate_(this),
       weak_factory_(this) {
+  unwinder_threads =
+      std::max<size_t>(1, std::min(unwinder_threads, kMaxUnwinderThreads));
+  // The callstack tries of the shards use consecutive disjoint ranges of
+  // kShardInternIds ids, right after the invalid id 0.
+  for (size_t i = 0; i < unwinder_threads; ++i) {
+    shards_.emplace_back(new BookkeepingShard(
+        static_cast<InternID>(1 + i * kShardInternIds), kShardInternIds));
+  }
+  unwinding_workers_ = MakeUnwindingWorkers(this, unwinder_threads);
   CheckDataSourceCpuTask();
   CheckDataSourceMemoryTask();
 }
@@ -324,10 +332,12 @@ void HeapprofdProducer::Restart() {
   base::TaskRunner* task_runner = task_runner_;
   const char* socket_name = producer_sock_name_;
   const bool exit_when_done = exit_when_done_;
+  const size_t unwinder_threads = unwinding_workers_.size();
 
   // Invoke destructor and then the constructor again.
   this->~HeapprofdProducer();
-  new (this) HeapprofdProducer(mode, task_runner, exit_when_done);
+  new (this)
+      HeapprofdProducer(mode, task_runner, exit_when_done, unwinder_threads);
 
   ConnectWithRetries(socket_name);
 }
@@ -560,7 +570,67 @@ void HeapprofdProducer::StartDataSource(DataSourceInstanceID id,
 }
 
 UnwindingWorker& HeapprofdProducer::UnwinderForPID(pid_t pid) {
-  return unwinding_workers_[static_cast<uint64_t>(pid) % kUnwinderThreads];
+  auto it = unwinder_for_pid_.find(pid);
+  if (it != unwinder_for_pid_.end())
+    return unwinding_workers_[it->second];
+  return unwinding_workers_[static_cast<uint64_t>(pid) %
+                            unwinding_workers_.size()];
+}
+
+HeapprofdProducer::BookkeepingShard& HeapprofdProducer::ShardForWorker(
+    UnwindingWorker* worker) {
+  return *shards_[static_cast<size_t>(worker - unwinding_workers_.data())];
+}
+
+HeapprofdProducer::BookkeepingShard& HeapprofdProducer::ShardForPID(
+    pid_t pid) {
+  return ShardForWorker(&UnwinderForPID(pid));
+}
+
+// Picks the unwinding worker of a new process: the one that bookkept the
+// fewest records since the last placement, i.e. the least busy one, and then
+// the one with the fewest processes. Processes are not moved once handed off,
+// their socket and shared memory buffer are bound to the worker.
+size_t HeapprofdProducer::PlaceProcess(pid_t pid) {
+  auto it = unwinder_for_pid_.find(pid);
+  if (it != unwinder_for_pid_.end())
+    return it->second;
+
+  size_t best = 0;
+  uint64_t best_records = 0;
+  for (size_t i = 0; i < shards_.size(); ++i) {
+    BookkeepingShard& shard = *shards_[i];
+    uint64_t records = shard.records.load(std::memory_order_relaxed);
+    uint64_t recent_records = records - shard.records_at_last_placement;
+    shard.records_at_last_placement = records;
+    if (i == 0 || recent_records < best_records ||
+        (recent_records == best_records &&
+         shard.num_processes < shards_[best]->num_processes)) {
+      best = i;
+      best_records = recent_records;
+    }
+  }
+  shards_[best]->num_processes++;
+  unwinder_for_pid_.emplace(pid, best);
+  return best;
+}
+
+// Destroys the ProcessState of |pid|. The HeapTrackers release their callsites
+// on destruction, so this needs the lock of the shard.
+void HeapprofdProducer::RemoveProcessState(DataSource* ds, pid_t pid) {
+  auto unwinder_it = unwinder_for_pid_.find(pid);
+  if (unwinder_it == unwinder_for_pid_.end()) {
+    ds->process_states.erase(pid);
+    return;
+  }
+  BookkeepingShard& shard = *shards_[unwinder_it->second];
+  {
+    std::lock_guard<std::mutex> l(shard.mutex);
+    shard.processes.erase(pid);
+    ds->process_states.erase(pid);
+  }
+  shard.num_processes--;
+  unwinder_for_pid_.erase(unwinder_it);
 }
 
 void HeapprofdProducer::StopDataSource(DataSourceInstanceID id) {
@@ -619,13 +689,16 @@ void HeapprofdProducer::ShutdownDataSource(DataSource* data_source) {
           PERFETTO_ELOG("Final dump timed out.");
           DataSource& ds = ds_it->second;
 
+          std::vector<pid_t> pids;
           for (const auto& pid_and_process_state : ds.process_states) {
             pid_t pid = pid_and_process_state.first;
             weak_producer->UnwinderForPID(pid).PostPurgeProcess(pid);
+            pids.push_back(pid);
           }
           // Do not dump any stragglers, just trigger the Flush and tear down
           // the data source.
-          ds.process_states.clear();
+          for (pid_t pid : pids)
+            weak_producer->RemoveProcessState(&ds, pid);
           ds.rejected_pids.clear();
           PERFETTO_CHECK(weak_producer->MaybeFinishDataSource(&ds));
         }
@@ -692,6 +765,7 @@ void HeapprofdProducer::SetStats(
   stats->set_unwinding_errors(process_state.unwinding_errors);
   stats->set_heap_samples(process_state.heap_samples);
   stats->set_map_reparses(process_state.map_reparses);
+  stats->set_unwinding_cache_hits(process_state.unwinding_cache_hits);
   stats->set_total_unwinding_time_us(process_state.total_unwinding_time_us);
   stats->set_client_spinlock_blocked_us(
       process_state.client_spinlock_blocked_us);
@@ -709,6 +783,7 @@ void HeapprofdProducer::SetStats(
 void HeapprofdProducer::DumpProcessState(DataSource* data_source,
                                          pid_t pid,
                                          ProcessState* process_state) {
+  std::lock_guard<std::mutex> l(ShardForPID(pid).mutex);
   for (auto& heap_id_and_heap_info : process_state->heap_infos) {
     ProcessState::HeapInfo& heap_info = heap_id_and_heap_info.second;
 
@@ -744,7 +819,7 @@ void HeapprofdProducer::DumpProcessState(DataSource* data_source,
          &data_source](const HeapTracker::CallstackAllocations& alloc) {
           dump_state.WriteAllocation(alloc, data_source->config.dump_at_max());
         });
-    dump_state.DumpCallstacks(&callsites_);
+    dump_state.DumpCallstacks(process_state->callsites);
   }
 }
 
@@ -879,10 +954,21 @@ void HeapprofdProducer::SocketDelegate::OnDataAvailable(
       return;
     }
 
-    data_source.process_states.emplace(
-        std::piecewise_construct, std::forward_as_tuple(self->peer_pid_linux()),
-        std::forward_as_tuple(&producer_->callsites_,
+    pid_t peer_pid = self->peer_pid_linux();
+    BookkeepingShard& shard =
+        *producer_->shards_[producer_->PlaceProcess(peer_pid)];
+    auto process_state_it_and_inserted = data_source.process_states.emplace(
+        std::piecewise_construct, std::forward_as_tuple(peer_pid),
+        std::forward_as_tuple(&shard.callsites,
                               data_source.config.dump_at_max()));
+    if (process_state_it_and_inserted.second) {
+      ProcessState* process_state = &process_state_it_and_inserted.first->second;
+      process_state->config = &data_source.config;
+      if (!data_source.config.stream_allocations()) {
+        std::lock_guard<std::mutex> l(shard.mutex);
+        shard.processes[peer_pid] = process_state;
+      }
+    }
 
     PERFETTO_DLOG("%d: Received FDs.", self->peer_pid_linux());
     int raw_fd = pending_process.shmem.fd();
@@ -989,6 +1075,22 @@ void HeapprofdProducer::HandleClientConnection(
 void HeapprofdProducer::PostAllocRecord(
     UnwindingWorker* worker,
     std::unique_ptr<AllocRecord> alloc_rec) {
+  BookkeepingShard& shard = ShardForWorker(worker);
+  bool recorded = false;
+  {
+    std::lock_guard<std::mutex> l(shard.mutex);
+    auto it = shard.processes.find(alloc_rec->pid);
+    if (it != shard.processes.end()) {
+      RecordAlloc(it->second, alloc_rec.get());
+      recorded = true;
+    }
+  }
+  if (recorded) {
+    shard.records.fetch_add(1, std::memory_order_relaxed);
+    worker->ReturnAllocRecord(std::move(alloc_rec));
+    return;
+  }
+
   // Once we can use C++14, this should be std::moved into the lambda instead.
   auto* raw_alloc_rec = alloc_rec.release();
   auto weak_this = weak_factory_.GetWeakPtr();
@@ -1002,11 +1104,31 @@ void HeapprofdProducer::PostAllocRecord(
   });
 }
 
-void HeapprofdProducer::PostFreeRecord(UnwindingWorker*,
+void HeapprofdProducer::PostFreeRecord(UnwindingWorker* worker,
                                        std::vector<FreeRecord> free_recs) {
+  BookkeepingShard& shard = ShardForWorker(worker);
+  std::vector<FreeRecord> unhandled_free_recs;
+  {
+    std::lock_guard<std::mutex> l(shard.mutex);
+    for (FreeRecord& free_rec : free_recs) {
+      auto it = shard.processes.find(free_rec.pid);
+      if (it == shard.processes.end()) {
+        unhandled_free_recs.emplace_back(std::move(free_rec));
+        continue;
+      }
+      const FreeEntry& entry = free_rec.entry;
+      it->second->GetHeapTracker(entry.heap_id)
+          .RecordFree(entry.addr, entry.sequence_number, 0);
+    }
+  }
+  shard.records.fetch_add(free_recs.size() - unhandled_free_recs.size(),
+                          std::memory_order_relaxed);
+  if (unhandled_free_recs.empty())
+    return;
+
   // Once we can use C++14, this should be std::moved into the lambda instead.
   std::vector<FreeRecord>* raw_free_recs =
-      new std::vector<FreeRecord>(std::move(free_recs));
+      new std::vector<FreeRecord>(std::move(unhandled_free_recs));
   auto weak_this = weak_factory_.GetWeakPtr();
   task_runner_->PostTask([weak_this, raw_free_recs] {
     if (weak_this) {
@@ -1017,8 +1139,17 @@ void HeapprofdProducer::PostFreeRecord(UnwindingWorker*,
   });
 }
 
-void HeapprofdProducer::PostHeapNameRecord(UnwindingWorker*,
+void HeapprofdProducer::PostHeapNameRecord(UnwindingWorker* worker,
                                            HeapNameRecord rec) {
+  BookkeepingShard& shard = ShardForWorker(worker);
+  {
+    std::lock_guard<std::mutex> l(shard.mutex);
+    auto it = shard.processes.find(rec.pid);
+    if (it != shard.processes.end()) {
+      RecordHeapName(it->second, rec.entry);
+      return;
+    }
+  }
   auto weak_this = weak_factory_.GetWeakPtr();
   task_runner_->PostTask([weak_this, rec] {
     if (weak_this)
@@ -1065,7 +1196,15 @@ void HeapprofdProducer::HandleAllocRecord(AllocRecord* alloc_rec) {
     return;
   }
 
-  const auto& prefixes = ds.config.skip_symbol_prefix();
+  std::lock_guard<std::mutex> l(ShardForPID(alloc_rec->pid).mutex);
+  RecordAlloc(&process_state_it->second, alloc_rec);
+}
+
+// static
+void HeapprofdProducer::RecordAlloc(ProcessState* process_state,
+                                    AllocRecord* alloc_rec) {
+  const AllocMetadata& alloc_metadata = alloc_rec->alloc_metadata;
+  const auto& prefixes = process_state->config->skip_symbol_prefix();
   if (!prefixes.empty()) {
     for (unwindstack::FrameData& frame_data : alloc_rec->frames) {
       if (frame_data.map_info == nullptr) {
@@ -1081,17 +1220,18 @@ void HeapprofdProducer::HandleAllocRecord(AllocRecord* alloc_rec) {
     }
   }
 
-  ProcessState& process_state = process_state_it->second;
   HeapTracker& heap_tracker =
-      process_state.GetHeapTracker(alloc_rec->alloc_metadata.heap_id);
+      process_state->GetHeapTracker(alloc_rec->alloc_metadata.heap_id);
 
   if (alloc_rec->error)
-    process_state.unwinding_errors++;
+    process_state->unwinding_errors++;
   if (alloc_rec->reparsed_map)
-    process_state.map_reparses++;
-  process_state.heap_samples++;
-  process_state.unwinding_time_us.Add(alloc_rec->unwinding_time_us);
-  process_state.total_unwinding_time_us += alloc_rec->unwinding_time_us;
+    process_state->map_reparses++;
+  if (alloc_rec->unwinding_cache_hit)
+    process_state->unwinding_cache_hits++;
+  process_state->heap_samples++;
+  process_state->unwinding_time_us.Add(alloc_rec->unwinding_time_us);
+  process_state->total_unwinding_time_us += alloc_rec->unwinding_time_us;
 
   // abspc may no longer refer to the same functions, as we had to reparse
   // maps. Reset the cache.
@@ -1131,6 +1271,7 @@ void HeapprofdProducer::HandleFreeRecord(FreeRecord free_rec) {
   ProcessState& process_state = process_state_it->second;
 
   const FreeEntry& entry = free_rec.entry;
+  std::lock_guard<std::mutex> l(ShardForPID(free_rec.pid).mutex);
   HeapTracker& heap_tracker = process_state.GetHeapTracker(entry.heap_id);
   heap_tracker.RecordFree(entry.addr, entry.sequence_number, 0);
 }
@@ -1149,15 +1290,20 @@ void HeapprofdProducer::HandleHeapNameRecord(HeapNameRecord rec) {
     return;
   }
 
-  ProcessState& process_state = process_state_it->second;
-  const HeapName& entry = rec.entry;
+  std::lock_guard<std::mutex> l(ShardForPID(rec.pid).mutex);
+  RecordHeapName(&process_state_it->second, rec.entry);
+}
+
+// static
+void HeapprofdProducer::RecordHeapName(ProcessState* process_state,
+                                       const HeapName& entry) {
   if (entry.heap_name[0] != '\0') {
     std::string heap_name = entry.heap_name;
     if (entry.heap_id == 0) {
       PERFETTO_ELOG("Invalid zero heap ID.");
       return;
     }
-    ProcessState::HeapInfo& hi = process_state.GetHeapInfo(entry.heap_id);
+    ProcessState::HeapInfo& hi = process_state->GetHeapInfo(entry.heap_id);
     if (!hi.heap_name.empty() && hi.heap_name != heap_name) {
       PERFETTO_ELOG("Overriding heap name %s with %s", hi.heap_name.c_str(),
                     heap_name.c_str());
@@ -1165,7 +1311,7 @@ void HeapprofdProducer::HandleHeapNameRecord(HeapNameRecord rec) {
     hi.heap_name = entry.heap_name;
   }
   if (entry.sample_interval != 0) {
-    ProcessState::HeapInfo& hi = process_state.GetHeapInfo(entry.heap_id);
+    ProcessState::HeapInfo& hi = process_state->GetHeapInfo(entry.heap_id);
     if (!hi.sampling_interval)
       hi.orig_sampling_interval = entry.sample_interval;
     hi.sampling_interval = entry.sample_interval;
@@ -1235,7 +1381,7 @@ void HeapprofdProducer::HandleSocketDisconnected(
       stats.num_writes_corrupt > 0 || stats.num_reads_corrupt > 0;
 
   DumpProcessState(&ds, pid, &process_state);
-  ds.process_states.erase(pid);
+  RemoveProcessState(&ds, pid);
   MaybeFinishDataSource(&ds);
 }
 
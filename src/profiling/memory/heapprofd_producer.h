@@ -18,9 +18,12 @@
 #define SRC_PROFILING_MEMORY_HEAPPROFD_PRODUCER_H_
 
 #include <array>
+#include <atomic>
 #include <cinttypes>
 #include <functional>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <vector>
 
@@ -51,6 +54,15 @@ namespace profiling {
 
 using HeapprofdConfig = protos::gen::HeapprofdConfig;
 
+// Default number of unwinding threads of a HeapprofdProducer.
+constexpr size_t kDefaultUnwinderThreads = 5;
+// The callstack tries of the unwinding threads use disjoint id ranges, which
+// caps the number of threads.
+constexpr size_t kMaxUnwinderThreads = 16;
+// Size of the id range of each unwinding thread. Keeping the ranges small
+// keeps the ids, which are written as varints, short.
+constexpr uint64_t kShardInternIds = uint64_t{1} << 32;
+
 struct Process {
   pid_t pid;
   std::string cmdline;
@@ -80,12 +92,17 @@ bool HeapprofdConfigToClientConfiguration(
 // this producer in the "child" mode. In this scenario, the profiled process
 // never talks to the system daemon.
 //
+// Each client process is handed off to one of the unwinding threads, which
+// reads its shared memory buffer, unwinds the samples and applies them to the
+// process' HeapTrackers. The main thread owns the ProcessStates, and takes the
+// lock of the thread's BookkeepingShard to create, dump or destroy them.
+//
 // TODO(fmayer||rsavitski): cover interesting invariants/structure of the
-// implementation (e.g. number of data sources in child mode), including
-// threading structure.
+// implementation (e.g. number of data sources in child mode).
 class HeapprofdProducer : public Producer, public UnwindingWorker::Delegate {
  public:
   friend class SocketDelegate;
+  friend class HeapprofdProducerShardTest;
 
   // TODO(fmayer): Split into two delegates for the listening socket in kCentral
   // and for the per-client sockets to make this easier to understand?
@@ -107,7 +124,8 @@ class HeapprofdProducer : public Producer, public UnwindingWorker::Delegate {
 
   HeapprofdProducer(HeapprofdMode mode,
                     base::TaskRunner* task_runner,
-                    bool exit_when_done);
+                    bool exit_when_done,
+                    size_t unwinder_threads = kDefaultUnwinderThreads);
   ~HeapprofdProducer() override;
 
   // Producer Impl:
@@ -127,7 +145,9 @@ class HeapprofdProducer : public Producer, public UnwindingWorker::Delegate {
   void ConnectWithRetries(const char* socket_name);
   void DumpAll();
 
-  // UnwindingWorker::Delegate impl:
+  // UnwindingWorker::Delegate impl. Called on the unwinding threads. The
+  // records of the profiled processes are bookkept on the calling thread, the
+  // others are posted to the main thread.
   void PostAllocRecord(UnwindingWorker*, std::unique_ptr<AllocRecord>) override;
   void PostFreeRecord(UnwindingWorker*, std::vector<FreeRecord>) override;
   void PostHeapNameRecord(UnwindingWorker*, HeapNameRecord) override;
@@ -191,6 +211,7 @@ class HeapprofdProducer : public Producer, public UnwindingWorker::Delegate {
     uint64_t heap_samples = 0;
     uint64_t map_reparses = 0;
     uint64_t unwinding_errors = 0;
+    uint64_t unwinding_cache_hits = 0;
 
     uint64_t total_unwinding_time_us = 0;
     uint64_t client_spinlock_blocked_us = 0;
@@ -198,6 +219,8 @@ class HeapprofdProducer : public Producer, public UnwindingWorker::Delegate {
     bool dump_at_max_mode;
     LogHistogram unwinding_time_us;
     std::map<uint32_t, HeapInfo> heap_infos;
+    // Not owned, the DataSource outlives its ProcessStates.
+    const HeapprofdConfig* config = nullptr;
 
     HeapInfo& GetHeapInfo(uint32_t heap_id) {
       auto it = heap_infos.find(heap_id);
@@ -242,6 +265,30 @@ class HeapprofdProducer : public Producer, public UnwindingWorker::Delegate {
     GuardrailConfig guardrail_config;
   };
 
+  // The state of the processes handed off to one unwinding thread. Each shard
+  // has its own callstack trie, so that the unwinding threads never contend
+  // on it.
+  struct BookkeepingShard {
+    BookkeepingShard(InternID first_id, uint64_t num_ids)
+        : callsites(first_id, num_ids) {}
+
+    // Guards |processes|, the ProcessStates they point to and |callsites|.
+    std::mutex mutex;
+    GlobalCallstackTrie callsites;
+    // The ProcessStates bookkept on the unwinding thread, by pid. Streaming
+    // processes are not included, their records are handled on the main
+    // thread.
+    std::map<pid_t, ProcessState*> processes;
+
+    // Number of records bookkept by the unwinding thread. Used to balance
+    // the load of the threads.
+    std::atomic<uint64_t> records{0};
+
+    // Main thread only.
+    size_t num_processes = 0;
+    uint64_t records_at_last_placement = 0;
+  };
+
   struct PendingProcess {
     std::unique_ptr<base::UnixSocket> sock;
     DataSourceInstanceID data_source_instance_id;
@@ -265,6 +312,14 @@ class HeapprofdProducer : public Producer, public UnwindingWorker::Delegate {
   static void SetStats(protos::pbzero::ProfilePacket::ProcessStats* stats,
                        const ProcessState& process_state);
 
+  static void RecordAlloc(ProcessState* process_state, AllocRecord* alloc_rec);
+  static void RecordHeapName(ProcessState* process_state,
+                             const HeapName& entry);
+  BookkeepingShard& ShardForWorker(UnwindingWorker* worker);
+  BookkeepingShard& ShardForPID(pid_t pid);
+  size_t PlaceProcess(pid_t pid);
+  void RemoveProcessState(DataSource* ds, pid_t pid);
+
   void DoDrainAndContinuousDump(DataSourceInstanceID id);
   void DoContinuousDump(DataSource* ds);
   void DrainDone(DataSourceInstanceID);
@@ -308,8 +363,9 @@ class HeapprofdProducer : public Producer, public UnwindingWorker::Delegate {
   // TraceWriters.
   std::unique_ptr<TracingService::ProducerEndpoint> endpoint_;
 
-  // Must outlive data_sources_ - HeapTracker references the trie.
-  GlobalCallstackTrie callsites_;
+  // Must outlive data_sources_ - HeapTracker references the tries. One per
+  // unwinding worker.
+  std::vector<std::unique_ptr<BookkeepingShard>> shards_;
 
   // Must outlive data_sources_ - DataSource can hold
   // SystemProperties::Handle-s.
@@ -318,6 +374,10 @@ class HeapprofdProducer : public Producer, public UnwindingWorker::Delegate {
 
   std::map<FlushRequestID, size_t> flushes_in_progress_;
   std::map<DataSourceInstanceID, DataSource> data_sources_;
+  // Index of the unwinding worker (and shard) of each handed off process.
+  std::map<pid_t, size_t> unwinder_for_pid_;
+  // Destroyed before data_sources_, so that the workers are no longer
+  // bookkeeping when the ProcessStates are destroyed.
   std::vector<UnwindingWorker> unwinding_workers_;
 
   // Specific to mode_ == kChild
@@ -61,6 +61,76 @@ TEST(HeapprofdProducerTest, ExposesDataSource) {
   producer.OnConnect();
 }
 
+class HeapprofdProducerShardTest : public ::testing::Test {
+ protected:
+  static constexpr size_t kUnwinderThreads = 3;
+
+  size_t PlaceProcess(pid_t pid) { return producer_.PlaceProcess(pid); }
+  void RemoveProcess(pid_t pid) {
+    HeapprofdProducer::DataSource ds(nullptr);
+    producer_.RemoveProcessState(&ds, pid);
+  }
+  void AddRecords(size_t shard, uint64_t records) {
+    producer_.shards_[shard]->records += records;
+  }
+  size_t NumProcesses(size_t shard) {
+    return producer_.shards_[shard]->num_processes;
+  }
+  // The lock taken by the main thread to access the ProcessState of |pid|.
+  std::mutex* LockForPID(pid_t pid) {
+    return &producer_.ShardForPID(pid).mutex;
+  }
+  std::mutex* ShardLock(size_t shard) {
+    return &producer_.shards_[shard]->mutex;
+  }
+  InternID InternFrame(size_t shard, uint64_t rel_pc) {
+    unwindstack::FrameData frame{};
+    frame.rel_pc = rel_pc;
+    return producer_.shards_[shard]
+        ->callsites.CreateCallsite({frame}, {"buildid"})
+        ->id();
+  }
+
+  base::TestTaskRunner task_runner_;
+  HeapprofdProducer producer_{HeapprofdMode::kCentral, &task_runner_,
+                              /*exit_when_done=*/false, kUnwinderThreads};
+};
+
+// New processes go to the least busy shard, and stay there. The main thread
+// takes the lock of that shard.
+TEST_F(HeapprofdProducerShardTest, PlacesProcessesOnLeastBusyShard) {
+  // No records yet: spread by number of processes.
+  EXPECT_EQ(PlaceProcess(10), 0u);
+  EXPECT_EQ(PlaceProcess(11), 1u);
+  EXPECT_EQ(PlaceProcess(12), 2u);
+  EXPECT_EQ(PlaceProcess(10), 0u);
+
+  // Shard 1 bookkept the fewest records since the last placement, even if it
+  // has more processes than the others.
+  AddRecords(0, 100);
+  AddRecords(2, 100);
+  EXPECT_EQ(PlaceProcess(13), 1u);
+  EXPECT_EQ(NumProcesses(1), 2u);
+
+  for (pid_t pid : {10, 11, 12, 13})
+    EXPECT_EQ(LockForPID(pid), ShardLock(PlaceProcess(pid)));
+
+  RemoveProcess(11);
+  RemoveProcess(13);
+  EXPECT_EQ(NumProcesses(1), 0u);
+  EXPECT_EQ(PlaceProcess(14), 1u);
+}
+
+// The shards emit into the same interning sequence, their ids must not
+// collide.
+TEST_F(HeapprofdProducerShardTest, ShardsHaveDisjointIdRanges) {
+  for (size_t shard = 0; shard < kUnwinderThreads; ++shard) {
+    InternID id = InternFrame(shard, 42);
+    EXPECT_GT(id, 1 + shard * kShardInternIds);
+    EXPECT_LT(id, 1 + (shard + 1) * kShardInternIds);
+  }
+}
+
 TEST(HeapprofdConfigToClientConfigurationTest, Smoke) {
   HeapprofdConfig cfg;
   cfg.add_heaps("foo");
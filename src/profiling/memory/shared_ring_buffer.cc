@@ -18,6 +18,7 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <string.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -92,6 +93,7 @@ SharedRingBuffer::SharedRingBuffer(CreateFlag, size_t size) {
     return;
 
   new (meta_) MetadataPage();
+  meta_->lock_free_writes.store(true, std::memory_order_relaxed);
 }
 
 SharedRingBuffer::~SharedRingBuffer() {
@@ -229,6 +231,59 @@ SharedRingBuffer::Buffer SharedRingBuffer::BeginWrite(
   return result;
 }
 
+SharedRingBuffer::Buffer SharedRingBuffer::BeginWrite(size_t size) {
+  PERFETTO_DCHECK(lock_free_writes());
+  Buffer result;
+
+  const uint64_t size_with_header =
+      base::AlignUp<kAlignment>(size + kHeaderSize);
+
+  // size_with_header < size is for catching overflow of size_with_header.
+  if (PERFETTO_UNLIKELY(size_with_header < size)) {
+    errno = EINVAL;
+    return result;
+  }
+
+  PointerPositions pos;
+  for (;;) {
+    // The acquire load of read_pos makes sure we observe the reader zeroing
+    // the records it consumed, so the header of the space we reserve is 0
+    // until EndWrite. This is matched by the release in EndRead.
+    pos.read_pos = meta_->read_pos.load(std::memory_order_acquire);
+    pos.write_pos = meta_->write_pos.load(std::memory_order_relaxed);
+    // Other writers and the reader can advance the positions concurrently:
+    // only check them if read_pos did not change while we were loading
+    // write_pos, otherwise they can look inconsistent.
+    if (meta_->read_pos.load(std::memory_order_relaxed) != pos.read_pos)
+      continue;
+    if (IsCorrupt(pos)) {
+      IncrementStat(&meta_->stats.num_writes_corrupt, 1);
+      errno = EBADF;
+      return result;
+    }
+    if (size_with_header > write_avail(pos)) {
+      IncrementStat(&meta_->stats.num_writes_overflow, 1);
+      errno = EAGAIN;
+      return result;
+    }
+    // This does not need to release: the record is published by the release
+    // store of its size in EndWrite, and the reader does not go past a record
+    // of size 0.
+    if (meta_->write_pos.compare_exchange_weak(
+            pos.write_pos, pos.write_pos + size_with_header,
+            std::memory_order_relaxed)) {
+      break;
+    }
+  }
+
+  result.size = size;
+  result.data = at(pos.write_pos) + kHeaderSize;
+  result.bytes_free = write_avail(pos);
+  IncrementStat(&meta_->stats.bytes_written, size);
+  IncrementStat(&meta_->stats.num_writes_succeeded, 1);
+  return result;
+}
+
 void SharedRingBuffer::EndWrite(Buffer buf) {
   if (!buf)
     return;
@@ -291,7 +346,15 @@ size_t SharedRingBuffer::EndRead(Buffer buf) {
   if (!buf)
     return 0;
   size_t size_with_header = base::AlignUp<kAlignment>(buf.size + kHeaderSize);
-  meta_->read_pos.fetch_add(size_with_header, std::memory_order_relaxed);
+  if (lock_free_writes()) {
+    // Lock-free writers do not clear the header of the space they reserve, so
+    // the buffer needs to be zero wherever there is no reserved record. This
+    // is matched by the acquire load of read_pos in BeginWrite(size_t).
+    memset(buf.data - kHeaderSize, 0, size_with_header);
+    meta_->read_pos.fetch_add(size_with_header, std::memory_order_release);
+  } else {
+    meta_->read_pos.fetch_add(size_with_header, std::memory_order_relaxed);
+  }
   meta_->stats.num_reads_succeeded++;
   return size_with_header;
 }
@@ -52,8 +52,14 @@ namespace profiling {
 // meantime.
 // !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
 //
-// TODO:
-// - Write a benchmark.
+// Writers reserve space by advancing write_pos, and commit a record by storing
+// its size in its header. Buffers created by this version of the reader are
+// zeroed as they are read, so that the header of a newly reserved record is
+// always 0 (i.e. not committed). This allows writers to reserve space with a
+// compare-and-swap of write_pos, without the spinlock (see BeginWrite(size_t)
+// and lock_free_writes()). Older readers do not zero the buffer, and their
+// writers need to hold the spinlock to clear the header before publishing the
+// new write_pos.
 class SharedRingBuffer {
  public:
   class Buffer {
@@ -123,8 +129,17 @@ class SharedRingBuffer {
   }
 
   Buffer BeginWrite(const ScopedSpinlock& spinlock, size_t size);
+  // Reserves space without holding the spinlock. Only valid if
+  // lock_free_writes().
+  Buffer BeginWrite(size_t size);
   void EndWrite(Buffer buf);
 
+  // Whether the reader zeroes the buffer as it reads it, which allows
+  // concurrent writers to use BeginWrite(size_t).
+  bool lock_free_writes() {
+    return meta_->lock_free_writes.load(std::memory_order_relaxed);
+  }
+
   Buffer BeginRead();
   // Returns the number bytes read from the shared memory buffer. This is
   // different than the number of bytes returned in the Buffer, because it
@@ -134,6 +149,11 @@ class SharedRingBuffer {
   Stats GetStats(ScopedSpinlock& spinlock) {
     PERFETTO_DCHECK(spinlock.locked());
     Stats stats = meta_->stats;
+    // Lock-free writers update these concurrently.
+    stats.bytes_written = LoadStat(&meta_->stats.bytes_written);
+    stats.num_writes_succeeded = LoadStat(&meta_->stats.num_writes_succeeded);
+    stats.num_writes_corrupt = LoadStat(&meta_->stats.num_writes_corrupt);
+    stats.num_writes_overflow = LoadStat(&meta_->stats.num_writes_overflow);
     stats.failed_spinlocks =
         meta_->failed_spinlocks.load(std::memory_order_relaxed);
     stats.error_state = meta_->error_state.load(std::memory_order_relaxed);
@@ -205,9 +225,12 @@ class SharedRingBuffer {
     // When the user requests stats, the atomics above get copied into this
     // struct, which is then returned.
     alignas(sizeof(uint64_t)) Stats stats;
+    // Set by the reader when creating the buffer. After |stats| to keep the
+    // layout of older versions.
+    alignas(sizeof(uint64_t)) std::atomic<bool> lock_free_writes;
   };
 
-  static_assert(sizeof(MetadataPage) == 144,
+  static_assert(sizeof(MetadataPage) == 152,
                 "metadata page size needs to be ABI independent");
 
  private:
@@ -228,6 +251,15 @@ class SharedRingBuffer {
   void Initialize(base::ScopedFile mem_fd);
   bool IsCorrupt(const PointerPositions& pos);
 
+  static uint64_t LoadStat(uint64_t* stat) {
+    return reinterpret_cast<std::atomic<uint64_t>*>(stat)->load(
+        std::memory_order_relaxed);
+  }
+  static void IncrementStat(uint64_t* stat, uint64_t n) {
+    reinterpret_cast<std::atomic<uint64_t>*>(stat)->fetch_add(
+        n, std::memory_order_relaxed);
+  }
+
   inline std::optional<PointerPositions> GetPointerPositions() {
     PointerPositions pos;
     // We need to acquire load the write_pos to make sure we observe a
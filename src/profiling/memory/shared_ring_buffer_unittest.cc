@@ -34,9 +34,14 @@ std::string ToString(const SharedRingBuffer::Buffer& buf_and_size) {
                      buf_and_size.size);
 }
 
-bool TryWrite(SharedRingBuffer* wr, const char* src, size_t size) {
+bool TryWrite(SharedRingBuffer* wr,
+              const char* src,
+              size_t size,
+              bool lock_free = false) {
   SharedRingBuffer::Buffer buf;
-  {
+  if (lock_free) {
+    buf = wr->BeginWrite(size);
+  } else {
     auto lock = wr->AcquireLock(ScopedSpinlock::Mode::Try);
     if (!lock.locked())
       return false;
@@ -49,15 +54,17 @@ bool TryWrite(SharedRingBuffer* wr, const char* src, size_t size) {
   return true;
 }
 
-void StructuredTest(SharedRingBuffer* wr, SharedRingBuffer* rd) {
+void StructuredTest(SharedRingBuffer* wr,
+                    SharedRingBuffer* rd,
+                    bool lock_free = false) {
   ASSERT_TRUE(wr);
   ASSERT_TRUE(wr->is_valid());
   ASSERT_TRUE(wr->size() == rd->size());
   const size_t buf_size = wr->size();
 
   // Test small writes.
-  ASSERT_TRUE(TryWrite(wr, "foo", 4));
-  ASSERT_TRUE(TryWrite(wr, "bar", 4));
+  ASSERT_TRUE(TryWrite(wr, "foo", 4, lock_free));
+  ASSERT_TRUE(TryWrite(wr, "bar", 4, lock_free));
 
   {
     auto buf_and_size = rd->BeginRead();
@@ -82,9 +89,9 @@ void StructuredTest(SharedRingBuffer* wr, SharedRingBuffer* rd) {
   for (int i = 0; i < 3; i++) {
     // TryWrite precisely |buf_size| bytes (minus the size header itself).
     std::string data(buf_size - sizeof(uint64_t), '.' + static_cast<char>(i));
-    ASSERT_TRUE(TryWrite(wr, data.data(), data.size()));
-    ASSERT_FALSE(TryWrite(wr, data.data(), data.size()));
-    ASSERT_FALSE(TryWrite(wr, "?", 1));
+    ASSERT_TRUE(TryWrite(wr, data.data(), data.size(), lock_free));
+    ASSERT_FALSE(TryWrite(wr, data.data(), data.size(), lock_free));
+    ASSERT_FALSE(TryWrite(wr, "?", 1, lock_free));
 
     // And read it back
     auto buf_and_size = rd->BeginRead();
@@ -94,8 +101,8 @@ void StructuredTest(SharedRingBuffer* wr, SharedRingBuffer* rd) {
 
   // Test large writes that wrap.
   std::string data(buf_size / 4 * 3 - sizeof(uint64_t), '!');
-  ASSERT_TRUE(TryWrite(wr, data.data(), data.size()));
-  ASSERT_FALSE(TryWrite(wr, data.data(), data.size()));
+  ASSERT_TRUE(TryWrite(wr, data.data(), data.size(), lock_free));
+  ASSERT_FALSE(TryWrite(wr, data.data(), data.size(), lock_free));
   {
     auto buf_and_size = rd->BeginRead();
     ASSERT_EQ(ToString(buf_and_size), data);
@@ -103,7 +110,7 @@ void StructuredTest(SharedRingBuffer* wr, SharedRingBuffer* rd) {
   }
   data = std::string(base::kPageSize - sizeof(uint64_t), '#');
   for (int i = 0; i < 4; i++)
-    ASSERT_TRUE(TryWrite(wr, data.data(), data.size()));
+    ASSERT_TRUE(TryWrite(wr, data.data(), data.size(), lock_free));
 
   for (int i = 0; i < 4; i++) {
     auto buf_and_size = rd->BeginRead();
@@ -113,11 +120,11 @@ void StructuredTest(SharedRingBuffer* wr, SharedRingBuffer* rd) {
   }
 
   // Test misaligned writes.
-  ASSERT_TRUE(TryWrite(wr, "1", 1));
-  ASSERT_TRUE(TryWrite(wr, "22", 2));
-  ASSERT_TRUE(TryWrite(wr, "333", 3));
-  ASSERT_TRUE(TryWrite(wr, "55555", 5));
-  ASSERT_TRUE(TryWrite(wr, "7777777", 7));
+  ASSERT_TRUE(TryWrite(wr, "1", 1, lock_free));
+  ASSERT_TRUE(TryWrite(wr, "22", 2, lock_free));
+  ASSERT_TRUE(TryWrite(wr, "333", 3, lock_free));
+  ASSERT_TRUE(TryWrite(wr, "55555", 5, lock_free));
+  ASSERT_TRUE(TryWrite(wr, "7777777", 7, lock_free));
   {
     auto buf_and_size = rd->BeginRead();
     ASSERT_EQ(ToString(buf_and_size), "1");
@@ -186,7 +193,7 @@ TEST(SharedRingBufferTest, SingleThreadAttach) {
   StructuredTest(&*buf1, &*buf2);
 }
 
-TEST(SharedRingBufferTest, MultiThreadingTest) {
+void MultiThreadingTest(bool lock_free) {
   constexpr auto kBufSize = base::kPageSize * 1024;  // 4 MB
   SharedRingBuffer rd = *SharedRingBuffer::Create(kBufSize);
   SharedRingBuffer wr =
@@ -196,8 +203,8 @@ TEST(SharedRingBufferTest, MultiThreadingTest) {
   std::unordered_map<std::string, int64_t> expected_contents;
   std::atomic<bool> writers_enabled{false};
 
-  auto writer_thread_fn = [&wr, &expected_contents, &mutex,
-                           &writers_enabled](size_t thread_id) {
+  auto writer_thread_fn = [&wr, &expected_contents, &mutex, &writers_enabled,
+                           lock_free](size_t thread_id) {
     while (!writers_enabled.load()) {
     }
     std::minstd_rand0 rnd_engine(static_cast<uint32_t>(thread_id));
@@ -208,7 +215,7 @@ TEST(SharedRingBufferTest, MultiThreadingTest) {
       std::string data;
       data.resize(size);
       std::generate(data.begin(), data.end(), rnd_engine);
-      if (TryWrite(&wr, data.data(), data.size())) {
+      if (TryWrite(&wr, data.data(), data.size(), lock_free)) {
         std::lock_guard<std::mutex> lock(mutex);
         expected_contents[std::move(data)]++;
       } else {
@@ -219,13 +226,15 @@ TEST(SharedRingBufferTest, MultiThreadingTest) {
 
   auto reader_thread_fn = [&rd, &expected_contents, &mutex, &writers_enabled] {
     for (;;) {
+      // Sample the flag before reading: a writer can commit its last record
+      // between an empty read and the flag turning false. Once the writers
+      // are joined every record is committed, so an empty read after that
+      // means the ring buffer has been drained.
+      bool writers_done = !writers_enabled.load();
       auto buf_and_size = rd.BeginRead();
       if (!buf_and_size) {
-        if (!writers_enabled.load()) {
-          // Failing to read after the writers are done means that there is no
-          // data left in the ring buffer.
+        if (writers_done)
           return;
-        }
         std::this_thread::yield();
         continue;
       }
@@ -252,6 +261,50 @@ TEST(SharedRingBufferTest, MultiThreadingTest) {
   writers_enabled.store(false);
 
   reader_thread.join();
+
+  for (const auto& contents_and_count : expected_contents)
+    EXPECT_EQ(contents_and_count.second, 0);
+}
+
+TEST(SharedRingBufferTest, SingleThreadLockFree) {
+  constexpr auto kBufSize = base::kPageSize * 4;
+  std::optional<SharedRingBuffer> buf1 = SharedRingBuffer::Create(kBufSize);
+  std::optional<SharedRingBuffer> buf2 =
+      SharedRingBuffer::Attach(base::ScopedFile(dup(buf1->fd())));
+  ASSERT_TRUE(buf2->lock_free_writes());
+  StructuredTest(&*buf2, &*buf1, /*lock_free=*/true);
+}
+
+TEST(SharedRingBufferTest, LockFreeUncommittedRecord) {
+  constexpr auto kBufSize = base::kPageSize * 4;
+  std::optional<SharedRingBuffer> buf = SharedRingBuffer::Create(kBufSize);
+  SharedRingBuffer::Buffer first = buf->BeginWrite(4);
+  ASSERT_TRUE(first);
+  ASSERT_TRUE(TryWrite(&*buf, "bar", 4, /*lock_free=*/true));
+
+  // The second record is committed, but must not be read before the first.
+  EXPECT_FALSE(buf->BeginRead());
+  memcpy(first.data, "foo", 4);
+  buf->EndWrite(std::move(first));
+  {
+    auto buf_and_size = buf->BeginRead();
+    EXPECT_EQ(ToString(buf_and_size), std::string("foo", 4));
+    buf->EndRead(std::move(buf_and_size));
+  }
+  {
+    auto buf_and_size = buf->BeginRead();
+    EXPECT_EQ(ToString(buf_and_size), std::string("bar", 4));
+    buf->EndRead(std::move(buf_and_size));
+  }
+  EXPECT_FALSE(buf->BeginRead());
+}
+
+TEST(SharedRingBufferTest, MultiThreadingTest) {
+  MultiThreadingTest(/*lock_free=*/false);
+}
+
+TEST(SharedRingBufferTest, MultiThreadingLockFreeTest) {
+  MultiThreadingTest(/*lock_free=*/true);
 }
 
 TEST(SharedRingBufferTest, InvalidSize) {
@@ -143,11 +143,31 @@ bool DoUnwind(WireMessage* msg, UnwindingMetadata* metadata, AllocRecord* out) {
     out->error = true;
     return false;
   }
+  out->error = false;
+  out->reparsed_map = false;
+  out->unwinding_cache_hit = false;
   uint8_t* stack = reinterpret_cast<uint8_t*>(msg->payload);
-  std::shared_ptr<unwindstack::Memory> mems =
+  // Use the raw register data, as libunwindstack clobbers |regs|.
+  UnwindingCache::Sample sample(alloc_metadata->register_data,
+                                GetRegsSize(regs.get()),
+                                alloc_metadata->stack_pointer, stack,
+                                msg->payload_size);
+  if (const std::vector<unwindstack::FrameData>* frames =
+          metadata->unwinding_cache.Lookup(sample)) {
+    out->frames = *frames;
+    out->build_ids.resize(out->frames.size());
+    for (size_t i = 0; i < out->frames.size(); ++i) {
+      out->build_ids[i] = metadata->GetBuildId(out->frames[i]);
+    }
+    out->unwinding_cache_hit = true;
+    return true;
+  }
+
+  auto mems = std::make_shared<UnwindingCache::RecordingMemory>(
       std::make_shared<StackOverlayMemory>(metadata->fd_mem,
                                            alloc_metadata->stack_pointer, stack,
-                                           msg->payload_size);
+                                           msg->payload_size),
+      alloc_metadata->stack_pointer, msg->payload_size);
 
   unwindstack::Unwinder unwinder(kMaxFrames, &metadata->fd_maps, regs.get(),
                                  mems);
@@ -191,6 +211,9 @@ bool DoUnwind(WireMessage* msg, UnwindingMetadata* metadata, AllocRecord* out) {
     out->build_ids[i] = metadata->GetBuildId(out->frames[i]);
   }
 
+  if (error_code == unwindstack::ERROR_NONE)
+    metadata->unwinding_cache.Insert(sample, *mems, out->frames);
+
   if (error_code != unwindstack::ERROR_NONE) {
     PERFETTO_DLOG("Unwinding error %" PRIu8, error_code);
     unwindstack::FrameData frame_data{};
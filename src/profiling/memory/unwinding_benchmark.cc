@@ -0,0 +1,116 @@
+// Copyright (C) 2023 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <benchmark/benchmark.h>
+
+#include <fcntl.h>
+#include <string.h>
+
+#include <unwindstack/RegsGetLocal.h>
+
+#include "perfetto/ext/base/file_utils.h"
+#include "src/profiling/common/unwind_support.h"
+#include "src/profiling/memory/client.h"
+#include "src/profiling/memory/unwinding.h"
+#include "src/profiling/memory/wire_protocol.h"
+
+namespace perfetto {
+namespace profiling {
+namespace {
+
+// A malloc sample of this process, as the heapprofd client would send it.
+struct CapturedSample {
+  std::unique_ptr<uint8_t[]> payload;
+  AllocMetadata metadata;
+  WireMessage msg;
+};
+
+// See unwinding_unittest.cc: ASAN thinks copying the whole stack is a buffer
+// underrun.
+void __attribute__((noinline))
+UnsafeMemcpy(void* dst, const void* src, size_t n)
+    __attribute__((no_sanitize("address", "hwaddress", "memory"))) {
+  const uint8_t* from = reinterpret_cast<const uint8_t*>(src);
+  uint8_t* to = reinterpret_cast<uint8_t*>(dst);
+  for (size_t i = 0; i < n; ++i)
+    to[i] = from[i];
+}
+
+void __attribute__((noinline)) Capture(CapturedSample* sample) {
+  const char* stackend = GetThreadStackRange().end;
+  const char* stackptr = reinterpret_cast<char*>(__builtin_frame_address(0));
+  memset(sample->metadata.register_data, 0,
+         sizeof(sample->metadata.register_data));
+  unwindstack::AsmGetRegs(sample->metadata.register_data);
+  PERFETTO_CHECK(stackptr < stackend);
+  size_t stack_size = static_cast<size_t>(stackend - stackptr);
+
+  sample->metadata.alloc_size = 10;
+  sample->metadata.alloc_address = 0x10;
+  sample->metadata.stack_pointer = reinterpret_cast<uint64_t>(stackptr);
+  sample->metadata.arch = unwindstack::Regs::CurrentArch();
+  sample->metadata.sequence_number = 1;
+
+  sample->payload.reset(new uint8_t[stack_size]);
+  UnsafeMemcpy(sample->payload.get(), stackptr, stack_size);
+
+  sample->msg = {};
+  sample->msg.alloc_header = &sample->metadata;
+  sample->msg.payload = reinterpret_cast<char*>(sample->payload.get());
+  sample->msg.payload_size = stack_size;
+}
+
+// Recurses before capturing the sample, for a callstack of a realistic depth.
+void __attribute__((noinline)) CaptureAtDepth(CapturedSample* sample,
+                                              int depth) {
+  if (depth == 0) {
+    Capture(sample);
+  } else {
+    CaptureAtDepth(sample, depth - 1);
+  }
+  benchmark::ClobberMemory();
+}
+
+void BM_DoUnwind(benchmark::State& state, bool cached) {
+  UnwindingMetadata metadata(base::OpenFile("/proc/self/maps", O_RDONLY),
+                             base::OpenFile("/proc/self/mem", O_RDONLY));
+  CapturedSample sample;
+  CaptureAtDepth(&sample, static_cast<int>(state.range(0)));
+  AllocRecord out;
+  for (auto _ : state) {
+    if (!cached)
+      metadata.unwinding_cache.Clear();
+    DoUnwind(&sample.msg, &metadata, &out);
+    benchmark::DoNotOptimize(out.frames.data());
+  }
+  state.counters["frames"] = static_cast<double>(out.frames.size());
+  state.counters["cache_hits"] =
+      static_cast<double>(metadata.unwinding_cache.hits());
+}
+
+void BM_DoUnwindUncached(benchmark::State& state) {
+  BM_DoUnwind(state, /*cached=*/false);
+}
+
+void BM_DoUnwindCached(benchmark::State& state) {
+  BM_DoUnwind(state, /*cached=*/true);
+}
+
+}  // namespace
+
+BENCHMARK(BM_DoUnwindUncached)->Arg(8)->Arg(32);
+BENCHMARK(BM_DoUnwindCached)->Arg(8)->Arg(32);
+
+}  // namespace profiling
+}  // namespace perfetto
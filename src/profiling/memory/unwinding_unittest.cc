@@ -182,6 +182,29 @@ TEST(UnwindingTest, DoUnwindReparse) {
                "namespace)::GetRecord(perfetto::profiling::WireMessage*)");
 }
 
+TEST(UnwindingTest, DoUnwindCached) {
+  base::ScopedFile proc_maps(base::OpenFile("/proc/self/maps", O_RDONLY));
+  base::ScopedFile proc_mem(base::OpenFile("/proc/self/mem", O_RDONLY));
+  UnwindingMetadata metadata(std::move(proc_maps), std::move(proc_mem));
+  WireMessage msg;
+  auto record = GetRecord(&msg);
+  AllocRecord out;
+  ASSERT_TRUE(DoUnwind(&msg, &metadata, &out));
+  EXPECT_FALSE(out.unwinding_cache_hit);
+  AllocRecord cached_out;
+  ASSERT_TRUE(DoUnwind(&msg, &metadata, &cached_out));
+  EXPECT_EQ(metadata.unwinding_cache.hits() + metadata.unwinding_cache.misses(),
+            2u);
+  ASSERT_EQ(cached_out.frames.size(), out.frames.size());
+  for (size_t i = 0; i < out.frames.size(); ++i) {
+    EXPECT_EQ(cached_out.frames[i].pc, out.frames[i].pc);
+    EXPECT_EQ(cached_out.frames[i].function_name,
+              out.frames[i].function_name);
+  }
+  EXPECT_EQ(cached_out.build_ids, out.build_ids);
+  EXPECT_EQ(cached_out.error, out.error);
+}
+
 TEST(AllocRecordArenaTest, Smoke) {
   AllocRecordArena a;
   auto borrowed = a.BorrowAllocRecord();
@@ -63,7 +63,9 @@ int64_t WithBuffer(SharedRingBuffer* shmem, size_t total_size, F fn) {
     return -1;
   }
   SharedRingBuffer::Buffer buf;
-  {
+  if (shmem->lock_free_writes()) {
+    buf = shmem->BeginWrite(total_size);
+  } else {
     ScopedSpinlock lock = shmem->AcquireLock(ScopedSpinlock::Mode::Try);
     if (!lock.locked()) {
       PERFETTO_DLOG("Failed to acquire spinlock.");
@@ -59,19 +59,17 @@ struct ParsedSample {
 };
 
 // Entry in an unwinding queue. Either a sample that requires unwinding, or a
-// tombstoned entry (valid == false).
+// tombstoned entry (valid == false). The entries are preallocated by the queue,
+// and samples are parsed into them in place.
 struct UnwindEntry {
   static UnwindEntry Invalid() { return UnwindEntry{}; }
 
   UnwindEntry() = default;  // for initial unwinding queue entries' state
 
-  UnwindEntry(uint64_t _data_source_id, ParsedSample _sample)
-      : valid(true),
-        data_source_id(_data_source_id),
-        sample(std::move(_sample)) {}
-
   bool valid = false;
   uint64_t data_source_id = 0;
+  // Monotonic time at which the sample was pushed into the queue.
+  uint64_t enqueue_time_ns = 0;
   ParsedSample sample;
 };
 
@@ -88,6 +86,11 @@ struct CompletedSample {
   std::vector<unwindstack::FrameData> frames;
   std::vector<std::string> build_ids;
   unwindstack::ErrorCode unwind_error = unwindstack::ERROR_NONE;
+  // The userspace frames were taken from the UnwindingCache of the process.
+  bool unwinding_cache_hit = false;
+  // Time that the sample spent in the unwinding queue, and being unwound.
+  uint64_t unwind_queue_latency_ns = 0;
+  uint64_t unwind_duration_ns = 0;
 };
 
 }  // namespace profiling
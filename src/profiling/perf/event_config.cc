@@ -450,6 +450,13 @@ std::optional<EventConfig> EventConfig::Create(
     pe.sample_period = sampling_period;
   }
 
+  // Make the perf fd readable once the ring buffer is half full, so that the
+  // reader is woken up in time under bursts of samples, instead of relying
+  // only on the periodic reads.
+  pe.watermark = 1;
+  pe.wakeup_watermark =
+      static_cast<uint32_t>(ring_buffer_pages.value() * base::kPageSize / 2);
+
   // What the samples will contain.
   pe.sample_type = PERF_SAMPLE_TID | PERF_SAMPLE_TIME | PERF_SAMPLE_READ;
   // PERF_SAMPLE_TIME:
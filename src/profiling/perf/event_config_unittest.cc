@@ -22,6 +22,7 @@
 #include <optional>
 
 #include "perfetto/base/logging.h"
+#include "perfetto/ext/base/utils.h"
 #include "test/gtest_and_gmock.h"
 
 #include "protos/perfetto/common/perf_events.gen.h"
@@ -84,6 +85,17 @@ TEST(EventConfigTest, RingBufferPagesValidated) {
   }
 }
 
+TEST(EventConfigTest, WakeupWatermarkIsHalfOfRingBuffer) {
+  protos::gen::PerfEventConfig cfg;
+  cfg.set_ring_buffer_pages(128);
+  std::optional<EventConfig> event_config = CreateEventConfig(cfg);
+
+  ASSERT_TRUE(event_config.has_value());
+  EXPECT_TRUE(event_config->perf_attr()->watermark);
+  EXPECT_EQ(event_config->perf_attr()->wakeup_watermark,
+            128u * base::kPageSize / 2);
+}
+
 TEST(EventConfigTest, ReadTickPeriodDefaultedIfUnset) {
   {  // if unset, a default is used
     protos::gen::PerfEventConfig cfg;
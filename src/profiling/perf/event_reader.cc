@@ -37,13 +37,6 @@ const char* ReadValue(T* value_out, const char* ptr) {
   return ptr + sizeof(T);
 }
 
-template <typename T>
-const char* ReadValues(T* out, const char* ptr, size_t num_values) {
-  size_t sz = sizeof(T) * num_values;
-  memcpy(out, reinterpret_cast<const void*>(ptr), sz);
-  return ptr + sz;
-}
-
 bool IsPowerOfTwo(size_t v) {
   return (v != 0 && ((v & (v - 1)) == 0));
 }
@@ -147,26 +140,25 @@ std::optional<PerfRingBuffer> PerfRingBuffer::Allocate(int perf_fd,
 // TODO(rsavitski): is there false sharing between |data_tail| and |data_head|?
 // Is there an argument for maintaining our own copy of |data_tail| instead of
 // reloading it?
-char* PerfRingBuffer::ReadRecordNonconsuming() {
-  static_assert(sizeof(std::atomic<uint64_t>) == sizeof(uint64_t), "");
-
+uint64_t PerfRingBuffer::read_offset() const {
   PERFETTO_DCHECK(valid());
-
   // |data_tail| is written only by this userspace thread, so we can safely read
   // it without any synchronization.
-  uint64_t read_offset = metadata_page_->data_tail;
+  return metadata_page_->data_tail;
+}
 
+uint64_t PerfRingBuffer::LoadWriteOffset() const {
+  static_assert(sizeof(std::atomic<uint64_t>) == sizeof(uint64_t), "");
+  PERFETTO_DCHECK(valid());
   // |data_head| is written by the kernel, perform an acquiring load such that
-  // the payload reads below are ordered after this load.
-  uint64_t write_offset =
-      reinterpret_cast<std::atomic<uint64_t>*>(&metadata_page_->data_head)
-          ->load(std::memory_order_acquire);
-
-  PERFETTO_DCHECK(read_offset <= write_offset);
-  if (write_offset == read_offset)
-    return nullptr;  // no new data
+  // the payload reads of the records before it are ordered after this load.
+  return reinterpret_cast<std::atomic<uint64_t>*>(&metadata_page_->data_head)
+      ->load(std::memory_order_acquire);
+}
 
-  size_t read_pos = static_cast<size_t>(read_offset & (data_buf_sz_ - 1));
+char* PerfRingBuffer::ReadRecordAt(uint64_t offset) {
+  PERFETTO_DCHECK(valid());
+  size_t read_pos = static_cast<size_t>(offset & (data_buf_sz_ - 1));
 
   // event header (64 bits) guaranteed to be contiguous
   PERFETTO_DCHECK(read_pos <= data_buf_sz_ - sizeof(perf_event_header));
@@ -192,17 +184,32 @@ char* PerfRingBuffer::ReadRecordNonconsuming() {
   }
 }
 
-void PerfRingBuffer::Consume(size_t bytes) {
+void PerfRingBuffer::ConsumeUntil(uint64_t offset) {
   PERFETTO_DCHECK(valid());
+  PERFETTO_DCHECK(offset >= metadata_page_->data_tail);
 
   // Advance |data_tail|, which is written only by this thread. The store of the
   // updated value needs to have release semantics such that the preceding
   // payload reads are ordered before it. The reader in this case is the kernel,
   // which reads |data_tail| to calculate the available ring buffer capacity
   // before trying to store a new record.
-  uint64_t updated_tail = metadata_page_->data_tail + bytes;
   reinterpret_cast<std::atomic<uint64_t>*>(&metadata_page_->data_tail)
-      ->store(updated_tail, std::memory_order_release);
+      ->store(offset, std::memory_order_release);
+}
+
+void SampleRecord::ParseInto(ParsedSample* sample) const {
+  sample->common = common_;
+  // assign() rather than resize() + memcpy(), to not zero-fill the buffers.
+  const uint64_t* ips = reinterpret_cast<const uint64_t*>(callchain_);
+  sample->kernel_ips.assign(ips, ips + callchain_len_);
+  if (has_user_regs_) {
+    const char* parse_pos = regs_;
+    sample->regs = ReadPerfUserRegsData(&parse_pos);
+  } else {
+    sample->regs.reset();
+  }
+  sample->stack.assign(stack_, stack_ + stack_size_);
+  sample->stack_maxed = stack_maxed_;
 }
 
 EventReader::EventReader(uint32_t cpu,
@@ -243,19 +250,27 @@ std::optional<EventReader> EventReader::ConfigureEvents(
                      std::move(ring_buffer.value()));
 }
 
-std::optional<ParsedSample> EventReader::ReadUntilSample(
-    std::function<void(uint64_t)> records_lost_callback) {
-  for (;;) {
-    char* event = ring_buffer_.ReadRecordNonconsuming();
-    if (!event)
-      return std::nullopt;  // caught up with the writer
-
+bool EventReader::ReadSamples(
+    uint64_t max_samples,
+    const std::function<void(const SampleRecord&)>& sample_callback,
+    const std::function<void(uint64_t)>& records_lost_callback) {
+  // Use a single snapshot of the writer position, and give the space back to
+  // the kernel once for the whole batch.
+  const uint64_t start_offset = ring_buffer_.read_offset();
+  const uint64_t write_offset = ring_buffer_.LoadWriteOffset();
+  PERFETTO_DCHECK(start_offset <= write_offset);
+
+  uint64_t read_offset = start_offset;
+  for (uint64_t samples = 0;
+       read_offset < write_offset && samples < max_samples;) {
+    const char* event = ring_buffer_.ReadRecordAt(read_offset);
     auto* event_hdr = reinterpret_cast<const perf_event_header*>(event);
+    read_offset += event_hdr->size;
 
     if (event_hdr->type == PERF_RECORD_SAMPLE) {
-      ParsedSample sample = ParseSampleRecord(cpu_, event);
-      ring_buffer_.Consume(event_hdr->size);
-      return std::make_optional(std::move(sample));
+      sample_callback(DecodeSampleRecord(event));
+      samples++;
+      continue;
     }
 
     if (event_hdr->type == PERF_RECORD_LOST) {
@@ -271,28 +286,28 @@ std::optional<ParsedSample> EventReader::ReadUntilSample(
           event + sizeof(perf_event_header) + sizeof(uint64_t));
 
       records_lost_callback(records_lost);
-      ring_buffer_.Consume(event_hdr->size);
       continue;  // keep looking for a sample
     }
 
     // Kernel had to throttle irqs.
     if (event_hdr->type == PERF_RECORD_THROTTLE ||
         event_hdr->type == PERF_RECORD_UNTHROTTLE) {
-      ring_buffer_.Consume(event_hdr->size);
       continue;  // keep looking for a sample
     }
 
     PERFETTO_DFATAL_OR_ELOG("Unsupported event type [%zu]",
                             static_cast<size_t>(event_hdr->type));
-    ring_buffer_.Consume(event_hdr->size);
   }
+
+  if (read_offset != start_offset)
+    ring_buffer_.ConsumeUntil(read_offset);
+  return read_offset < write_offset;
 }
 
 // Generally, samples can belong to any cpu (which can be recorded with
 // PERF_SAMPLE_CPU). However, this producer uses only cpu-scoped events,
 // therefore it is already known.
-ParsedSample EventReader::ParseSampleRecord(uint32_t cpu,
-                                            const char* record_start) {
+SampleRecord EventReader::DecodeSampleRecord(const char* record_start) {
   if (event_attr_.sample_type &
       (~uint64_t(PERF_SAMPLE_TID | PERF_SAMPLE_TIME | PERF_SAMPLE_STACK_USER |
                  PERF_SAMPLE_REGS_USER | PERF_SAMPLE_CALLCHAIN |
@@ -303,9 +318,9 @@ ParsedSample EventReader::ParseSampleRecord(uint32_t cpu,
   auto* event_hdr = reinterpret_cast<const perf_event_header*>(record_start);
   size_t sample_size = event_hdr->size;
 
-  ParsedSample sample = {};
-  sample.common.cpu = cpu;
-  sample.common.cpu_mode = event_hdr->misc & PERF_RECORD_MISC_CPUMODE_MASK;
+  SampleRecord sample;
+  sample.common_.cpu = cpu_;
+  sample.common_.cpu_mode = event_hdr->misc & PERF_RECORD_MISC_CPUMODE_MASK;
 
   // Parse the payload, which consists of concatenated data for each
   // |attr.sample_type| flag.
@@ -316,29 +331,37 @@ ParsedSample EventReader::ParseSampleRecord(uint32_t cpu,
     uint32_t tid = 0;
     parse_pos = ReadValue(&pid, parse_pos);
     parse_pos = ReadValue(&tid, parse_pos);
-    sample.common.pid = static_cast<pid_t>(pid);
-    sample.common.tid = static_cast<pid_t>(tid);
+    sample.common_.pid = static_cast<pid_t>(pid);
+    sample.common_.tid = static_cast<pid_t>(tid);
   }
 
   if (event_attr_.sample_type & PERF_SAMPLE_TIME) {
-    parse_pos = ReadValue(&sample.common.timestamp, parse_pos);
+    parse_pos = ReadValue(&sample.common_.timestamp, parse_pos);
   }
 
   if (event_attr_.sample_type & PERF_SAMPLE_READ) {
-    parse_pos = ReadValue(&sample.common.timebase_count, parse_pos);
+    parse_pos = ReadValue(&sample.common_.timebase_count, parse_pos);
   }
 
   if (event_attr_.sample_type & PERF_SAMPLE_CALLCHAIN) {
     uint64_t chain_len = 0;
     parse_pos = ReadValue(&chain_len, parse_pos);
-    sample.kernel_ips.resize(static_cast<size_t>(chain_len));
-    parse_pos = ReadValues<uint64_t>(sample.kernel_ips.data(), parse_pos,
-                                     static_cast<size_t>(chain_len));
+    sample.callchain_ = parse_pos;
+    sample.callchain_len_ = static_cast<size_t>(chain_len);
+    parse_pos += sizeof(uint64_t) * sample.callchain_len_;
   }
 
   if (event_attr_.sample_type & PERF_SAMPLE_REGS_USER) {
-    // Can be empty, e.g. if we sampled a kernel thread.
-    sample.regs = ReadPerfUserRegsData(&parse_pos);
+    // Can be empty, e.g. if we sampled a kernel thread. Otherwise, there is a
+    // value for each register of the mask.
+    sample.regs_ = parse_pos;
+    uint64_t sampled_abi;
+    parse_pos = ReadValue(&sampled_abi, parse_pos);
+    if (sampled_abi != PERF_SAMPLE_REGS_ABI_NONE) {
+      sample.has_user_regs_ = true;
+      parse_pos += sizeof(uint64_t) * static_cast<size_t>(__builtin_popcountll(
+                                          event_attr_.sample_regs_user));
+    }
   }
 
   if (event_attr_.sample_type & PERF_SAMPLE_STACK_USER) {
@@ -357,13 +380,11 @@ ParsedSample EventReader::ParseSampleRecord(uint32_t cpu,
       uint64_t filled_stack_size;
       parse_pos = ReadValue(&filled_stack_size, parse_pos);
 
-      // copy stack bytes into a vector
-      size_t payload_sz = static_cast<size_t>(filled_stack_size);
-      sample.stack.resize(payload_sz);
-      memcpy(sample.stack.data(), stack_start, payload_sz);
+      sample.stack_ = stack_start;
+      sample.stack_size_ = static_cast<size_t>(filled_stack_size);
 
       // remember whether the stack sample is (most likely) truncated
-      sample.stack_maxed = (filled_stack_size == max_stack_size);
+      sample.stack_maxed_ = (filled_stack_size == max_stack_size);
     }
   }
 
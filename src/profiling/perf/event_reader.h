@@ -21,6 +21,7 @@
 #include <stdint.h>
 #include <sys/mman.h>
 #include <sys/types.h>
+#include <functional>
 #include <optional>
 
 #include "perfetto/ext/base/scoped_file.h"
@@ -44,8 +45,16 @@ class PerfRingBuffer {
   PerfRingBuffer(PerfRingBuffer&& other) noexcept;
   PerfRingBuffer& operator=(PerfRingBuffer&& other) noexcept;
 
-  char* ReadRecordNonconsuming();
-  void Consume(size_t bytes);
+  // The records in [read_offset(), LoadWriteOffset()) are ready to be read.
+  uint64_t read_offset() const;
+  uint64_t LoadWriteOffset() const;
+
+  // Returns a pointer to the record at |offset|, which must be in the readable
+  // range. The pointer is valid until the next call.
+  char* ReadRecordAt(uint64_t offset);
+
+  // Gives the space of the records before |offset| back to the kernel.
+  void ConsumeUntil(uint64_t offset);
 
  private:
   PerfRingBuffer() = default;
@@ -69,23 +78,57 @@ class PerfRingBuffer {
   alignas(uint64_t) char reconstructed_record_[kMaxPerfRecordSize];
 };
 
+// A PERF_RECORD_SAMPLE, still in the kernel ring buffer. The fields common to
+// all samples are decoded upfront, while the variable-sized payload (callchain,
+// registers and stack) is copied out only by ParseInto(), so that the samples
+// that are going to be dropped cost no copies.
+class SampleRecord {
+ public:
+  const CommonSampleData& common() const { return common_; }
+  // False if sampling a kernel thread (or not sampling registers).
+  bool has_user_regs() const { return has_user_regs_; }
+  size_t stack_size() const { return stack_size_; }
+
+  // Fills |sample| with the contents of the record, reusing its buffers.
+  void ParseInto(ParsedSample* sample) const;
+
+ private:
+  friend class EventReader;
+
+  CommonSampleData common_;
+  const char* callchain_ = nullptr;
+  size_t callchain_len_ = 0;
+  const char* regs_ = nullptr;
+  bool has_user_regs_ = false;
+  const char* stack_ = nullptr;
+  size_t stack_size_ = 0;
+  bool stack_maxed_ = false;
+};
+
 class EventReader {
  public:
   static std::optional<EventReader> ConfigureEvents(
       uint32_t cpu,
       const EventConfig& event_cfg);
 
-  // Consumes records from the ring buffer until either encountering a sample,
-  // or catching up to the writer. The other record of interest
-  // (PERF_RECORD_LOST) is handled via the given callback.
-  std::optional<ParsedSample> ReadUntilSample(
-      std::function<void(uint64_t)> lost_events_callback);
+  // Reads records from the ring buffer until either |max_samples| samples have
+  // been read, or catching up to the writer. Samples are passed to
+  // |sample_callback|, and are only valid for the duration of the call. The
+  // other record of interest (PERF_RECORD_LOST) is handled via
+  // |lost_events_callback|. The records are given back to the kernel in one go
+  // at the end. Returns false if the reader has caught up with the writer.
+  bool ReadSamples(
+      uint64_t max_samples,
+      const std::function<void(const SampleRecord&)>& sample_callback,
+      const std::function<void(uint64_t)>& lost_events_callback);
 
   void EnableEvents();
   // Pauses the event counting, without invalidating existing samples.
   void DisableEvents();
 
   uint32_t cpu() const { return cpu_; }
+  // Becomes readable when the ring buffer fills past the configured watermark.
+  int perf_fd() const { return perf_fd_.get(); }
 
   ~EventReader() = default;
 
@@ -101,7 +144,7 @@ class EventReader {
               base::ScopedFile perf_fd,
               PerfRingBuffer ring_buffer);
 
-  ParsedSample ParseSampleRecord(uint32_t cpu, const char* record_start);
+  SampleRecord DecodeSampleRecord(const char* record_start);
 
   // All events are cpu-bound (thread-scoped events not supported).
   const uint32_t cpu_;
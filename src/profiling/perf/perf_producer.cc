@@ -16,6 +16,7 @@
 
 #include "src/profiling/perf/perf_producer.h"
 
+#include <algorithm>
 #include <optional>
 #include <random>
 #include <utility>
@@ -366,14 +367,27 @@ bool PerfProducer::ShouldRejectDueToFilter(
 }
 
 PerfProducer::PerfProducer(ProcDescriptorGetter* proc_fd_getter,
-                           base::TaskRunner* task_runner)
+                           base::TaskRunner* task_runner,
+                           size_t unwinder_threads,
+                           uint32_t unwind_queue_capacity)
     : task_runner_(task_runner),
       proc_fd_getter_(proc_fd_getter),
-      unwinding_worker_(this),
+      unwinder_threads_(unwinder_threads),
+      unwind_queue_capacity_(unwind_queue_capacity),
       weak_factory_(this) {
+  PERFETTO_CHECK(unwinder_threads_ > 0);
+  for (size_t i = 0; i < unwinder_threads_; i++) {
+    unwinding_workers_.emplace_back(
+        new UnwinderHandle(this, unwind_queue_capacity));
+  }
   proc_fd_getter->SetDelegate(this);
 }
 
+PerfProducer::~PerfProducer() {
+  for (auto& it : data_sources_)
+    UnwatchRingBuffers(&it.second);
+}
+
 void PerfProducer::SetupDataSource(DataSourceInstanceID,
                                    const DataSourceConfig&) {}
 
@@ -464,6 +478,17 @@ void PerfProducer::StartDataSource(DataSourceInstanceID ds_id,
     per_cpu_reader.EnableEvents();
   }
 
+  // Besides the periodic reads, read a cpu's buffer as soon as the kernel
+  // signals that it filled past the wakeup watermark.
+  auto weak_this = weak_factory_.GetWeakPtr();
+  for (size_t i = 0; i < ds.per_cpu_readers.size(); i++) {
+    task_runner_->AddFileDescriptorWatch(
+        ds.per_cpu_readers[i].perf_fd(), [weak_this, ds_id, i] {
+          if (weak_this)
+            weak_this->ReadPerCpuBufferOnWakeup(ds_id, i);
+        });
+  }
+
   WritePerfEventDefaultsPacket(ds.event_config, ds.trace_writer.get());
 
   InterningOutputTracker::WriteFixedInterningsPacket(
@@ -472,16 +497,16 @@ void PerfProducer::StartDataSource(DataSourceInstanceID ds_id,
 
   // Inform unwinder of the new data source instance, and optionally start a
   // periodic task to clear its cached state.
-  unwinding_worker_->PostStartDataSource(ds_id,
-                                         ds.event_config.kernel_frames());
-  if (ds.event_config.unwind_state_clear_period_ms()) {
-    unwinding_worker_->PostClearCachedStatePeriodic(
-        ds_id, ds.event_config.unwind_state_clear_period_ms());
+  for (auto& unwinder : unwinding_workers_) {
+    (*unwinder)->PostStartDataSource(ds_id, ds.event_config.kernel_frames());
+    if (ds.event_config.unwind_state_clear_period_ms()) {
+      (*unwinder)->PostClearCachedStatePeriodic(
+          ds_id, ds.event_config.unwind_state_clear_period_ms());
+    }
   }
 
   // Kick off periodic read task.
   auto tick_period_ms = ds.event_config.read_tick_period_ms();
-  auto weak_this = weak_factory_.GetWeakPtr();
   task_runner_->PostDelayedTask(
       [weak_this, ds_id] {
         if (weak_this)
@@ -571,6 +596,10 @@ void PerfProducer::Flush(FlushRequestID flush_id,
     if (meta_it != metatrace_writers_.end()) {
       meta_it->second.WriteAllAndFlushTraceWriter([] {});
     }
+
+    auto ds_it = data_sources_.find(ds_id);
+    if (ds_it != data_sources_.end())
+      EmitProfilerStats(&ds_it->second);
   }
 
   endpoint_->NotifyFlushComplete(flush_id);
@@ -634,12 +663,15 @@ void PerfProducer::TickDataSourceRead(DataSourceInstanceID ds_id) {
     }
   }
 
-  // Wake up the unwinder as we've (likely) pushed samples into its queue.
-  unwinding_worker_->PostProcessQueue();
+  // Wake up the unwinders as we've (likely) pushed samples into their queues.
+  for (auto& unwinder : unwinding_workers_)
+    (*unwinder)->PostProcessQueue();
 
   if (PERFETTO_UNLIKELY(ds.status == DataSourceState::Status::kShuttingDown) &&
       !more_records_available) {
-    unwinding_worker_->PostInitiateDataSourceStop(ds_id);
+    ds.unwinders_stopping = unwinding_workers_.size();
+    for (auto& unwinder : unwinding_workers_)
+      (*unwinder)->PostInitiateDataSourceStop(ds_id);
   } else {
     // otherwise, keep reading
     auto tick_period_ms = it->second.event_config.read_tick_period_ms();
@@ -653,6 +685,20 @@ void PerfProducer::TickDataSourceRead(DataSourceInstanceID ds_id) {
   }
 }
 
+void PerfProducer::ReadPerCpuBufferOnWakeup(DataSourceInstanceID ds_id,
+                                            size_t reader_index) {
+  auto it = data_sources_.find(ds_id);
+  if (it == data_sources_.end())
+    return;
+  DataSourceState& ds = it->second;
+
+  ReadAndParsePerCpuBuffer(&ds.per_cpu_readers[reader_index],
+                           ds.event_config.samples_per_tick_limit(), ds_id,
+                           &ds);
+  for (auto& unwinder : unwinding_workers_)
+    (*unwinder)->PostProcessQueue();
+}
+
 bool PerfProducer::ReadAndParsePerCpuBuffer(EventReader* reader,
                                             uint64_t max_samples,
                                             DataSourceInstanceID ds_id,
@@ -669,41 +715,34 @@ bool PerfProducer::ReadAndParsePerCpuBuffer(EventReader* reader,
     });
   };
 
-  for (uint64_t i = 0; i < max_samples; i++) {
-    std::optional<ParsedSample> sample =
-        reader->ReadUntilSample(records_lost_callback);
-    if (!sample) {
-      return false;  // caught up to the writer
-    }
-
+  auto sample_callback = [this, ds_id, ds](const SampleRecord& record) {
     // Counter-only mode: skip the unwinding stage, serialise the sample
     // immediately.
     const EventConfig& event_config = ds->event_config;
     if (!event_config.sample_callstacks()) {
       CompletedSample output;
-      output.common = sample->common;
+      output.common = record.common();
       EmitSample(ds_id, std::move(output));
-      continue;
+      return;
     }
 
     // Sampling either or both of userspace and kernel callstacks.
-    pid_t pid = sample->common.pid;
+    pid_t pid = record.common().pid;
     auto& process_state = ds->process_states[pid];  // insert if new
 
     // Asynchronous proc-fd lookup timed out.
     if (process_state == ProcessTrackingStatus::kFdsTimedOut) {
       PERFETTO_DLOG("Skipping sample for pid [%d]: kFdsTimedOut",
                     static_cast<int>(pid));
-      EmitSkippedSample(ds_id, std::move(sample.value()),
-                        SampleSkipReason::kReadStage);
-      continue;
+      EmitSkippedSample(ds_id, record.common(), SampleSkipReason::kReadStage);
+      return;
     }
 
     // Previously excluded, e.g. due to failing the target filter check.
     if (process_state == ProcessTrackingStatus::kRejected) {
       PERFETTO_DLOG("Skipping sample for pid [%d]: kRejected",
                     static_cast<int>(pid));
-      continue;
+      return;
     }
 
     // Seeing pid for the first time. We need to consider whether the process
@@ -723,10 +762,10 @@ bool PerfProducer::ReadAndParsePerCpuBuffer(EventReader* reader,
 
       // Kernel threads (which have no userspace state) are never relevant if
       // we're not recording kernel callchains.
-      bool is_kthread = !sample->regs;  // no userspace regs
+      bool is_kthread = !record.has_user_regs();  // no userspace regs
       if (is_kthread && !event_config.kernel_frames()) {
         process_state = ProcessTrackingStatus::kRejected;
-        continue;
+        return;
       }
 
       // Check whether samples for this new process should be dropped due to
@@ -738,7 +777,7 @@ bool PerfProducer::ReadAndParsePerCpuBuffer(EventReader* reader,
                 return glob_aware::ReadProcCmdlineForPID(pid, cmdline);
               })) {
         process_state = ProcessTrackingStatus::kRejected;
-        continue;
+        return;
       }
 
       // At this point, sampled process is known to be of interest.
@@ -752,7 +791,7 @@ bool PerfProducer::ReadAndParsePerCpuBuffer(EventReader* reader,
         // Either a kernel thread (no need to obtain proc-fds), or a userspace
         // process but we're not recording userspace callstacks.
         process_state = ProcessTrackingStatus::kAccepted;
-        unwinding_worker_->PostRecordNoUserspaceProcess(ds_id, pid);
+        UnwinderForPid(pid)->PostRecordNoUserspaceProcess(ds_id, pid);
         // note: fallthrough
       }
     }
@@ -764,43 +803,51 @@ bool PerfProducer::ReadAndParsePerCpuBuffer(EventReader* reader,
     // process samples are relevant only if they were sampled during kernel
     // context.
     if (!event_config.user_frames() &&
-        sample->common.cpu_mode == PERF_RECORD_MISC_USER) {
+        record.common().cpu_mode == PERF_RECORD_MISC_USER) {
       PERFETTO_DLOG("Skipping usermode sample for kernel-only config");
-      continue;
+      return;
     }
 
     // Optionally: drop sample if above a given threshold of sampled stacks
     // that are waiting in the unwinding queue.
     uint64_t max_footprint_bytes = event_config.max_enqueued_footprint_bytes();
-    uint64_t sample_stack_size = sample->stack.size();
+    uint64_t sample_stack_size = record.stack_size();
     if (max_footprint_bytes) {
-      uint64_t footprint_bytes = unwinding_worker_->GetEnqueuedFootprint();
+      uint64_t footprint_bytes = GetEnqueuedFootprint();
       if (footprint_bytes + sample_stack_size >= max_footprint_bytes) {
         PERFETTO_DLOG("Skipping sample enqueueing due to footprint limit.");
-        EmitSkippedSample(ds_id, std::move(sample.value()),
+        EmitSkippedSample(ds_id, record.common(),
                           SampleSkipReason::kUnwindEnqueue);
-        continue;
+        return;
       }
     }
 
-    // Push the sample into the unwinding queue if there is room.
-    auto& queue = unwinding_worker_->unwind_queue();
+    // Push the sample into the process' unwinding queue if there is room. The
+    // sample is copied out of the kernel buffer straight into the queue's
+    // entry, reusing the stack buffer of an already unwound sample if the
+    // unwinder has one.
+    Unwinder* unwinder = UnwinderForPid(pid);
+    auto& queue = unwinder->unwind_queue();
     WriteView write_view = queue.BeginWrite();
     if (write_view.valid) {
-      queue.at(write_view.write_pos) =
-          UnwindEntry{ds_id, std::move(sample.value())};
+      UnwindEntry& entry = queue.at(write_view.write_pos);
+      entry.sample.stack = unwinder->TakeStackBuffer();
+      record.ParseInto(&entry.sample);
+      entry.valid = true;
+      entry.data_source_id = ds_id;
+      entry.enqueue_time_ns =
+          static_cast<uint64_t>(base::GetWallTimeNs().count());
       queue.CommitWrite();
-      unwinding_worker_->IncrementEnqueuedFootprint(sample_stack_size);
+      unwinder->IncrementEnqueuedFootprint(sample_stack_size);
     } else {
       PERFETTO_DLOG("Unwinder queue full, skipping sample");
-      EmitSkippedSample(ds_id, std::move(sample.value()),
+      EmitSkippedSample(ds_id, record.common(),
                         SampleSkipReason::kUnwindEnqueue);
     }
-  }  // for (i < max_samples)
+  };
 
-  // Most likely more events in the kernel buffer. Though we might be exactly on
-  // the boundary due to |max_samples|.
-  return true;
+  return reader->ReadSamples(max_samples, sample_callback,
+                             records_lost_callback);
 }
 
 // Note: first-fit makes descriptor request fulfillment not true FIFO. But the
@@ -836,7 +883,7 @@ void PerfProducer::OnProcDescriptors(pid_t pid,
                     static_cast<int>(pid), static_cast<size_t>(it.first));
 
       proc_status_it->second = ProcessTrackingStatus::kAccepted;
-      unwinding_worker_->PostAdoptProcDescriptors(
+      UnwinderForPid(pid)->PostAdoptProcDescriptors(
           it.first, pid, std::move(maps_fd), std::move(mem_fd));
       return;  // done
     }
@@ -899,7 +946,7 @@ void PerfProducer::EvaluateDescriptorLookupTimeout(DataSourceInstanceID ds_id,
     proc_status_it->second = ProcessTrackingStatus::kFdsTimedOut;
     // Also inform the unwinder of the state change (so that it can discard any
     // of the already-enqueued samples).
-    unwinding_worker_->PostRecordTimedOutProcDescriptors(ds_id, pid);
+    UnwinderForPid(pid)->PostRecordTimedOutProcDescriptors(ds_id, pid);
   }
 }
 
@@ -925,6 +972,19 @@ void PerfProducer::EmitSample(DataSourceInstanceID ds_id,
   }
   DataSourceState& ds = ds_it->second;
 
+  // Samples emitted directly by the reader (counter-only mode) have not been
+  // through the unwinding stage.
+  if (ds.event_config.sample_callstacks()) {
+    ProfilerStats& stats = ds.stats;
+    stats.samples_unwound++;
+    stats.unwind_queue_latency_total_ns += sample.unwind_queue_latency_ns;
+    stats.unwind_queue_latency_max_ns = std::max(
+        stats.unwind_queue_latency_max_ns, sample.unwind_queue_latency_ns);
+    stats.unwind_duration_total_ns += sample.unwind_duration_ns;
+    stats.unwind_duration_max_ns =
+        std::max(stats.unwind_duration_max_ns, sample.unwind_duration_ns);
+  }
+
   // intern callsite
   GlobalCallstackTrie::Node* callstack_root =
       callstack_trie_.CreateCallsite(sample.frames, sample.build_ids);
@@ -950,6 +1010,8 @@ void PerfProducer::EmitSample(DataSourceInstanceID ds_id,
   if (sample.unwind_error != unwindstack::ERROR_NONE) {
     perf_sample->set_unwind_error(ToProtoEnum(sample.unwind_error));
   }
+  if (sample.unwinding_cache_hit)
+    perf_sample->set_unwinding_cache_hit(true);
 }
 
 void PerfProducer::EmitRingBufferLoss(DataSourceInstanceID ds_id,
@@ -987,18 +1049,17 @@ void PerfProducer::PostEmitUnwinderSkippedSample(DataSourceInstanceID ds_id,
 void PerfProducer::PostEmitSkippedSample(DataSourceInstanceID ds_id,
                                          ParsedSample sample,
                                          SampleSkipReason reason) {
-  // hack: c++11 lambdas can't be moved into, so stash the sample on the heap.
-  ParsedSample* raw_sample = new ParsedSample(std::move(sample));
+  // Only the common fields are emitted.
+  CommonSampleData common = sample.common;
   auto weak_this = weak_factory_.GetWeakPtr();
-  task_runner_->PostTask([weak_this, ds_id, raw_sample, reason] {
+  task_runner_->PostTask([weak_this, ds_id, common, reason] {
     if (weak_this)
-      weak_this->EmitSkippedSample(ds_id, std::move(*raw_sample), reason);
-    delete raw_sample;
+      weak_this->EmitSkippedSample(ds_id, common, reason);
   });
 }
 
 void PerfProducer::EmitSkippedSample(DataSourceInstanceID ds_id,
-                                     ParsedSample sample,
+                                     const CommonSampleData& sample,
                                      SampleSkipReason reason) {
   auto ds_it = data_sources_.find(ds_id);
   if (ds_it == data_sources_.end())
@@ -1007,31 +1068,64 @@ void PerfProducer::EmitSkippedSample(DataSourceInstanceID ds_id,
 
   // Note: timestamp defaults to the monotonic_raw domain.
   auto packet = StartTracePacket(ds.trace_writer.get());
-  packet->set_timestamp(sample.common.timestamp);
+  packet->set_timestamp(sample.timestamp);
   auto* perf_sample = packet->set_perf_sample();
-  perf_sample->set_cpu(sample.common.cpu);
-  perf_sample->set_pid(static_cast<uint32_t>(sample.common.pid));
-  perf_sample->set_tid(static_cast<uint32_t>(sample.common.tid));
-  perf_sample->set_cpu_mode(ToCpuModeEnum(sample.common.cpu_mode));
-  perf_sample->set_timebase_count(sample.common.timebase_count);
+  perf_sample->set_cpu(sample.cpu);
+  perf_sample->set_pid(static_cast<uint32_t>(sample.pid));
+  perf_sample->set_tid(static_cast<uint32_t>(sample.tid));
+  perf_sample->set_cpu_mode(ToCpuModeEnum(sample.cpu_mode));
+  perf_sample->set_timebase_count(sample.timebase_count);
 
   using PerfSample = protos::pbzero::PerfSample;
   switch (reason) {
     case SampleSkipReason::kReadStage:
       perf_sample->set_sample_skipped_reason(
           PerfSample::PROFILER_SKIP_READ_STAGE);
+      ds.stats.read_stage_skipped++;
       break;
     case SampleSkipReason::kUnwindEnqueue:
       perf_sample->set_sample_skipped_reason(
           PerfSample::PROFILER_SKIP_UNWIND_ENQUEUE);
+      ds.stats.unwind_enqueue_skipped++;
       break;
     case SampleSkipReason::kUnwindStage:
       perf_sample->set_sample_skipped_reason(
           PerfSample::PROFILER_SKIP_UNWIND_STAGE);
+      ds.stats.unwind_stage_skipped++;
       break;
   }
 }
 
+void PerfProducer::EmitProfilerStats(DataSourceState* ds) {
+  if (!ds->event_config.sample_callstacks())
+    return;
+
+  auto packet = StartTracePacket(ds->trace_writer.get());
+  packet->set_timestamp(static_cast<uint64_t>(base::GetBootTimeNs().count()));
+  packet->set_timestamp_clock_id(
+      protos::pbzero::BuiltinClock::BUILTIN_CLOCK_BOOTTIME);
+
+  const ProfilerStats& stats = ds->stats;
+  auto* out = packet->set_perf_sample()->set_profiler_stats();
+  out->set_read_stage_skipped(stats.read_stage_skipped);
+  out->set_unwind_enqueue_skipped(stats.unwind_enqueue_skipped);
+  out->set_unwind_stage_skipped(stats.unwind_stage_skipped);
+  out->set_samples_unwound(stats.samples_unwound);
+  out->set_unwind_queue_latency_total_ns(stats.unwind_queue_latency_total_ns);
+  out->set_unwind_queue_latency_max_ns(stats.unwind_queue_latency_max_ns);
+  out->set_unwind_duration_total_ns(stats.unwind_duration_total_ns);
+  out->set_unwind_duration_max_ns(stats.unwind_duration_max_ns);
+  out->set_unwinder_threads(static_cast<uint32_t>(unwinder_threads_));
+  out->set_unwind_queue_capacity(unwind_queue_capacity_);
+}
+
+uint64_t PerfProducer::GetEnqueuedFootprint() {
+  uint64_t footprint = 0;
+  for (auto& unwinder : unwinding_workers_)
+    footprint += (*unwinder)->GetEnqueuedFootprint();
+  return footprint;
+}
+
 void PerfProducer::InitiateReaderStop(DataSourceState* ds) {
   PERFETTO_DLOG("InitiateReaderStop");
   PERFETTO_CHECK(ds->status != DataSourceState::Status::kShuttingDown);
@@ -1061,7 +1155,14 @@ void PerfProducer::FinishDataSourceStop(DataSourceInstanceID ds_id) {
   DataSourceState& ds = ds_it->second;
   PERFETTO_CHECK(ds.status == DataSourceState::Status::kShuttingDown);
 
+  // Wait for all the unwinders to be done with the source.
+  PERFETTO_DCHECK(ds.unwinders_stopping > 0);
+  if (--ds.unwinders_stopping > 0)
+    return;
+
+  EmitProfilerStats(&ds);
   ds.trace_writer->Flush();
+  UnwatchRingBuffers(&ds);
   data_sources_.erase(ds_it);
 
   endpoint_->NotifyDataSourceStopped(ds_id);
@@ -1069,6 +1170,7 @@ void PerfProducer::FinishDataSourceStop(DataSourceInstanceID ds_id) {
   // Clean up resources if there are no more active sources.
   if (data_sources_.empty()) {
     callstack_trie_.ClearTrie();  // purge internings
+    ReleaseUnwinderStackBuffers();
     base::MaybeReleaseAllocatorMemToOS();
   }
 }
@@ -1091,7 +1193,8 @@ void PerfProducer::PurgeDataSource(DataSourceInstanceID ds_id) {
   PERFETTO_LOG("Stopping DataSource(%zu) prematurely",
                static_cast<size_t>(ds_id));
 
-  unwinding_worker_->PostPurgeDataSource(ds_id);
+  for (auto& unwinder : unwinding_workers_)
+    (*unwinder)->PostPurgeDataSource(ds_id);
 
   // Write a packet indicating the abrupt stop.
   {
@@ -1106,15 +1209,27 @@ void PerfProducer::PurgeDataSource(DataSourceInstanceID ds_id) {
   }
 
   ds.trace_writer->Flush();
+  UnwatchRingBuffers(&ds);
   data_sources_.erase(ds_it);
 
   // Clean up resources if there are no more active sources.
   if (data_sources_.empty()) {
     callstack_trie_.ClearTrie();  // purge internings
+    ReleaseUnwinderStackBuffers();
     base::MaybeReleaseAllocatorMemToOS();
   }
 }
 
+void PerfProducer::UnwatchRingBuffers(DataSourceState* ds) {
+  for (const EventReader& reader : ds->per_cpu_readers)
+    task_runner_->RemoveFileDescriptorWatch(reader.perf_fd());
+}
+
+void PerfProducer::ReleaseUnwinderStackBuffers() {
+  for (auto& unwinder : unwinding_workers_)
+    (*unwinder)->ReleaseStackBuffers();
+}
+
 // Either:
 // * choose a random number up to |shard_count|.
 // * reuse a choice made previously by a data source within this tracing
@@ -1248,10 +1363,13 @@ void PerfProducer::Restart() {
   base::TaskRunner* task_runner = task_runner_;
   const char* socket_name = producer_socket_name_;
   ProcDescriptorGetter* proc_fd_getter = proc_fd_getter_;
+  size_t unwinder_threads = unwinder_threads_;
+  uint32_t unwind_queue_capacity = unwind_queue_capacity_;
 
   // Invoke destructor and then the constructor again.
   this->~PerfProducer();
-  new (this) PerfProducer(proc_fd_getter, task_runner);
+  new (this) PerfProducer(proc_fd_getter, task_runner, unwinder_threads,
+                          unwind_queue_capacity);
 
   ConnectWithRetries(socket_name);
 }
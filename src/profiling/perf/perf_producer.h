@@ -21,6 +21,7 @@
 #include <map>
 #include <memory>
 #include <optional>
+#include <vector>
 
 #include <unwindstack/Error.h>
 #include <unwindstack/Regs.h>
@@ -51,15 +52,20 @@ namespace profiling {
 // TODO(rsavitski): describe the high-level architecture and threading. Rough
 // summary in the mean time: three stages: (1) kernel buffer reader that parses
 // the samples -> (2) callstack unwinder -> (3) interning and serialization of
-// samples. This class handles stages (1) and (3) on the main thread. Unwinding
-// is done by |Unwinder| on a dedicated thread.
+// samples. This class handles stages (1) and (3) on the main thread, reading
+// the kernel buffers periodically and whenever they fill past the wakeup
+// watermark. Samples are parsed in place into the unwinding queues. Unwinding
+// is done by a pool of |Unwinder|s, each on a dedicated thread, with the
+// samples sharded by pid.
 class PerfProducer : public Producer,
                      public ProcDescriptorDelegate,
                      public Unwinder::Delegate {
  public:
   PerfProducer(ProcDescriptorGetter* proc_fd_getter,
-               base::TaskRunner* task_runner);
-  ~PerfProducer() override = default;
+               base::TaskRunner* task_runner,
+               size_t unwinder_threads = kDefaultUnwinderThreads,
+               uint32_t unwind_queue_capacity = kDefaultUnwindQueueCapacity);
+  ~PerfProducer() override;
 
   PerfProducer(const PerfProducer&) = delete;
   PerfProducer& operator=(const PerfProducer&) = delete;
@@ -109,6 +115,8 @@ class PerfProducer : public Producer,
       std::function<bool(std::string*)> read_proc_pid_cmdline);
 
  private:
+  friend class PerfProducerUnwinderTest;
+
   // State of the producer's connection to tracing service (traced).
   enum State {
     kNotStarted = 0,
@@ -139,6 +147,19 @@ class PerfProducer : public Producer,
     kRejected       // process not considered relevant for the data source
   };
 
+  // Counters for PerfSample.ProfilerStats, cumulative over the lifetime of a
+  // data source.
+  struct ProfilerStats {
+    uint64_t read_stage_skipped = 0;
+    uint64_t unwind_enqueue_skipped = 0;
+    uint64_t unwind_stage_skipped = 0;
+    uint64_t samples_unwound = 0;
+    uint64_t unwind_queue_latency_total_ns = 0;
+    uint64_t unwind_queue_latency_max_ns = 0;
+    uint64_t unwind_duration_total_ns = 0;
+    uint64_t unwind_duration_max_ns = 0;
+  };
+
   struct DataSourceState {
     enum class Status { kActive, kShuttingDown };
 
@@ -167,6 +188,9 @@ class PerfProducer : public Producer,
     // Additional state for EventConfig.TargetFilter: command lines we have
     // decided to unwind, up to a total of additional_cmdline_count values.
     base::FlatSet<std::string> additional_cmdlines;
+    // Number of unwinders that have yet to finish their part of the stop.
+    size_t unwinders_stopping = 0;
+    ProfilerStats stats;
   };
 
   // For |EmitSkippedSample|.
@@ -184,6 +208,10 @@ class PerfProducer : public Producer,
   // Periodic read task which reads a batch of samples from all kernel ring
   // buffers associated with the given data source.
   void TickDataSourceRead(DataSourceInstanceID ds_id);
+  // Reads a batch of samples from a single kernel ring buffer, when it has
+  // filled past its wakeup watermark between two ticks.
+  void ReadPerCpuBufferOnWakeup(DataSourceInstanceID ds_id,
+                                size_t reader_index);
   // Returns *false* if the reader has caught up with the writer position, true
   // otherwise. Return value is only useful if the underlying perf_event has
   // been paused (to identify when the buffer is empty). |max_samples| is a cap
@@ -203,7 +231,16 @@ class PerfProducer : public Producer,
                              uint32_t timeout_ms);
   void EvaluateDescriptorLookupTimeout(DataSourceInstanceID ds_id, pid_t pid);
 
+  // Returns the unwinder that handles the samples of the given process.
+  Unwinder* UnwinderForPid(pid_t pid) {
+    size_t shard = static_cast<uint32_t>(pid) % unwinding_workers_.size();
+    return unwinding_workers_[shard]->get();
+  }
+  // Total heap footprint of the samples in all unwinding queues.
+  uint64_t GetEnqueuedFootprint();
+
   void EmitSample(DataSourceInstanceID ds_id, CompletedSample sample);
+  void EmitProfilerStats(DataSourceState* ds);
   void EmitRingBufferLoss(DataSourceInstanceID ds_id,
                           size_t cpu,
                           uint64_t records_lost);
@@ -214,7 +251,7 @@ class PerfProducer : public Producer,
   // Emit a packet indicating that a sample was relevant, but skipped as it was
   // considered to be not unwindable (e.g. the process no longer exists).
   void EmitSkippedSample(DataSourceInstanceID ds_id,
-                         ParsedSample sample,
+                         const CommonSampleData& sample,
                          SampleSkipReason reason);
 
   // Starts the shutdown of the given data source instance, starting with
@@ -230,6 +267,11 @@ class PerfProducer : public Producer,
   // Immediately destroys the data source state, and instructs the unwinder to
   // do the same. This is used for abrupt stops.
   void PurgeDataSource(DataSourceInstanceID ds_id);
+  // Stops watching the perf fds of the data source for wakeups.
+  void UnwatchRingBuffers(DataSourceState* ds);
+  // Frees the stack buffers kept for reuse by the unwinders, for when no data
+  // sources are left.
+  void ReleaseUnwinderStackBuffers();
 
   // Immediately stops the data source if this daemon's overall memory footprint
   // is above the given threshold. This periodic task is started only for data
@@ -274,8 +316,10 @@ class PerfProducer : public Producer,
   // State associated with perf-sampling data sources.
   std::map<DataSourceInstanceID, DataSourceState> data_sources_;
 
-  // Unwinding stage, running on a dedicated thread.
-  UnwinderHandle unwinding_worker_;
+  // Unwinding stage, running on dedicated threads.
+  const size_t unwinder_threads_;
+  const uint32_t unwind_queue_capacity_;
+  std::vector<std::unique_ptr<UnwinderHandle>> unwinding_workers_;
 
   // Used for tracepoint name -> id lookups. Initialized lazily, and in general
   // best effort - can be null if tracefs isn't accessible.
@@ -18,14 +18,31 @@
 
 #include <stdint.h>
 #include <optional>
+#include <set>
+#include <thread>
 
 #include "perfetto/base/logging.h"
+#include "perfetto/tracing/core/data_source_config.h"
+#include "src/base/test/test_task_runner.h"
+#include "src/tracing/core/null_trace_writer.h"
+#include "src/tracing/test/mock_producer_endpoint.h"
 #include "test/gtest_and_gmock.h"
 
+#include "protos/perfetto/config/profiling/perf_event_config.gen.h"
+
 namespace perfetto {
 namespace profiling {
 namespace {
 
+using ::testing::InvokeWithoutArgs;
+using ::testing::StrictMock;
+
+class FakeDescriptorGetter : public ProcDescriptorGetter {
+ public:
+  void GetDescriptorsForPid(pid_t) override {}
+  void SetDelegate(ProcDescriptorDelegate*) override {}
+};
+
 bool ShouldReject(pid_t pid,
                   std::string cmdline,
                   const TargetFilter& filter,
@@ -198,5 +215,167 @@ TEST(TargetFilterTest, AdditionalCmdlines) {
 }
 
 }  // namespace
+
+class PerfProducerUnwinderTest : public ::testing::Test {
+ protected:
+  static constexpr size_t kUnwinderThreads = 3;
+
+  void SetUp() override {
+    endpoint_ = new StrictMock<MockProducerEndpoint>();
+    producer_.endpoint_.reset(endpoint_);
+  }
+
+  Unwinder* UnwinderForPid(pid_t pid) { return producer_.UnwinderForPid(pid); }
+  Unwinder* UnwinderAt(size_t i) {
+    return producer_.unwinding_workers_[i]->get();
+  }
+
+  // Adds a data source without any perf events. If |on_unwinders| is false,
+  // the unwinders don't know about the source, and the test acks their part of
+  // the stop with |FinishDataSourceStop|.
+  void AddDataSource(DataSourceInstanceID ds_id, bool on_unwinders) {
+    protos::gen::PerfEventConfig perf_cfg;
+    DataSourceConfig ds_cfg;
+    ds_cfg.set_perf_event_config_raw(perf_cfg.SerializeAsString());
+    std::optional<EventConfig> event_config = EventConfig::Create(
+        perf_cfg, ds_cfg, /*process_sharding=*/std::nullopt,
+        [](const std::string&, const std::string&) { return 0; });
+    ASSERT_TRUE(event_config.has_value());
+    producer_.data_sources_.emplace(
+        std::piecewise_construct, std::forward_as_tuple(ds_id),
+        std::forward_as_tuple(event_config.value(), /*tracing_session_id=*/1,
+                              std::unique_ptr<TraceWriter>(new NullTraceWriter),
+                              std::vector<EventReader>()));
+    if (on_unwinders) {
+      for (auto& unwinder : producer_.unwinding_workers_)
+        (*unwinder)->PostStartDataSource(ds_id, /*kernel_frames=*/false);
+    }
+  }
+  bool HasDataSource(DataSourceInstanceID ds_id) {
+    return producer_.data_sources_.count(ds_id) > 0;
+  }
+  size_t UnwindersStopping(DataSourceInstanceID ds_id) {
+    return producer_.data_sources_.at(ds_id).unwinders_stopping;
+  }
+  // With no kernel buffers to drain, the read tick of a stopping source hands
+  // the stop over to the unwinders.
+  void TickDataSourceRead(DataSourceInstanceID ds_id) {
+    producer_.TickDataSourceRead(ds_id);
+  }
+  void FinishDataSourceStop(DataSourceInstanceID ds_id) {
+    producer_.FinishDataSourceStop(ds_id);
+  }
+  void PurgeDataSource(DataSourceInstanceID ds_id) {
+    producer_.PurgeDataSource(ds_id);
+  }
+  // Enqueues a sample of |pid| with the given stack, as the kernel buffer
+  // reader does.
+  void EnqueueSample(DataSourceInstanceID ds_id,
+                     pid_t pid,
+                     std::vector<char> stack) {
+    Unwinder* unwinder = UnwinderForPid(pid);
+    WriteView write_view = unwinder->unwind_queue().BeginWrite();
+    ASSERT_TRUE(write_view.valid);
+    UnwindEntry& entry = unwinder->unwind_queue().at(write_view.write_pos);
+    entry.valid = true;
+    entry.data_source_id = ds_id;
+    entry.sample.common.pid = pid;
+    entry.sample.stack = std::move(stack);
+    unwinder->unwind_queue().CommitWrite();
+    unwinder->IncrementEnqueuedFootprint(entry.sample.stack.size());
+  }
+
+  base::TestTaskRunner task_runner_;
+  FakeDescriptorGetter proc_fd_getter_;
+  PerfProducer producer_{&proc_fd_getter_, &task_runner_, kUnwinderThreads,
+                         /*unwind_queue_capacity=*/16};
+  StrictMock<MockProducerEndpoint>* endpoint_ = nullptr;
+};
+
+// The samples of a process always go to the same unwinder, and the processes
+// are spread over all of them.
+TEST_F(PerfProducerUnwinderTest, AssignsProcessesToUnwinders) {
+  std::set<Unwinder*> unwinders;
+  for (pid_t pid = 1; pid <= 10; pid++) {
+    Unwinder* unwinder = UnwinderForPid(pid);
+    EXPECT_EQ(unwinder, UnwinderForPid(pid));
+    EXPECT_EQ(unwinder, UnwinderAt(static_cast<size_t>(pid) % kUnwinderThreads));
+    unwinders.insert(unwinder);
+  }
+  EXPECT_EQ(unwinders.size(), kUnwinderThreads);
+}
+
+// The stop is acked to the service only once every unwinder is done.
+TEST_F(PerfProducerUnwinderTest, StopWaitsForAllUnwinders) {
+  AddDataSource(1, /*on_unwinders=*/false);
+  producer_.StopDataSource(1);
+  TickDataSourceRead(1);
+  ASSERT_EQ(UnwindersStopping(1), kUnwinderThreads);
+
+  for (size_t i = 1; i < kUnwinderThreads; i++) {
+    FinishDataSourceStop(1);
+    ASSERT_TRUE(HasDataSource(1));
+    EXPECT_EQ(UnwindersStopping(1), kUnwinderThreads - i);
+  }
+
+  EXPECT_CALL(*endpoint_, NotifyDataSourceStopped(1));
+  FinishDataSourceStop(1);
+  EXPECT_FALSE(HasDataSource(1));
+}
+
+TEST_F(PerfProducerUnwinderTest, StopThroughUnwinderThreads) {
+  AddDataSource(1, /*on_unwinders=*/true);
+  producer_.StopDataSource(1);
+  TickDataSourceRead(1);
+
+  auto stopped = task_runner_.CreateCheckpoint("stopped");
+  EXPECT_CALL(*endpoint_, NotifyDataSourceStopped(1))
+      .WillOnce(InvokeWithoutArgs(stopped));
+  task_runner_.RunUntilCheckpoint("stopped");
+  EXPECT_FALSE(HasDataSource(1));
+}
+
+// Unwinders that finish their part of the stop after a purge don't ack the
+// source again.
+TEST_F(PerfProducerUnwinderTest, PurgeDuringStop) {
+  AddDataSource(1, /*on_unwinders=*/false);
+  producer_.StopDataSource(1);
+  TickDataSourceRead(1);
+  FinishDataSourceStop(1);
+  ASSERT_EQ(UnwindersStopping(1), kUnwinderThreads - 1);
+
+  PurgeDataSource(1);
+  EXPECT_FALSE(HasDataSource(1));
+  for (size_t i = 1; i < kUnwinderThreads; i++)
+    FinishDataSourceStop(1);
+}
+
+// The stack buffer of an unwound sample is handed back to the main thread, for
+// the next sample to be parsed into.
+TEST_F(PerfProducerUnwinderTest, ReusesStackBuffers) {
+  static constexpr pid_t kPid = 42;
+  AddDataSource(1, /*on_unwinders=*/true);
+  Unwinder* unwinder = UnwinderForPid(kPid);
+  unwinder->PostRecordNoUserspaceProcess(1, kPid);
+
+  std::vector<char> stack = unwinder->TakeStackBuffer();
+  EXPECT_EQ(stack.capacity(), 0u);
+  stack.resize(16 * 1024);
+  const char* stack_data = stack.data();
+  EnqueueSample(1, kPid, std::move(stack));
+  unwinder->PostProcessQueue();
+  while (unwinder->GetEnqueuedFootprint() > 0)
+    std::this_thread::yield();
+
+  std::vector<char> reused = unwinder->TakeStackBuffer();
+  EXPECT_EQ(reused.data(), stack_data);
+  EXPECT_GE(reused.capacity(), 16u * 1024);
+  EXPECT_TRUE(reused.empty());
+  EXPECT_EQ(unwinder->TakeStackBuffer().capacity(), 0u);
+
+  // Let the unwound sample be emitted.
+  task_runner_.RunUntilIdle();
+}
+
 }  // namespace profiling
 }  // namespace perfetto
@@ -15,7 +15,13 @@
  */
 
 #include "src/profiling/perf/traced_perf.h"
+
+#include <cinttypes>
+#include <optional>
+
 #include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/getopt.h"
+#include "perfetto/ext/base/string_utils.h"
 #include "perfetto/ext/base/unix_task_runner.h"
 #include "perfetto/ext/tracing/ipc/default_socket.h"
 #include "src/profiling/perf/perf_producer.h"
@@ -41,7 +47,46 @@ int GetRawInheritedListeningSocket() {
 }  // namespace
 
 // TODO(rsavitski): watchdog.
-int TracedPerfMain(int, char**) {
+int TracedPerfMain(int argc, char** argv) {
+  size_t unwinder_threads = profiling::kDefaultUnwinderThreads;
+  uint32_t unwind_queue_capacity = profiling::kDefaultUnwindQueueCapacity;
+
+  enum { kUnwinderThreads = 256, kUnwindQueueCapacity };
+  static option long_options[] = {
+      {"unwinder-threads", required_argument, nullptr, kUnwinderThreads},
+      {"unwind-queue-capacity", required_argument, nullptr,
+       kUnwindQueueCapacity},
+      {nullptr, 0, nullptr, 0}};
+  int c;
+  while ((c = getopt_long(argc, argv, "", long_options, nullptr)) != -1) {
+    switch (c) {
+      case kUnwinderThreads: {
+        std::optional<uint32_t> threads = base::CStringToUInt32(optarg);
+        if (!threads || *threads == 0 ||
+            *threads > profiling::kMaxUnwinderThreads) {
+          PERFETTO_ELOG("--unwinder-threads must be between 1 and %zu.",
+                        profiling::kMaxUnwinderThreads);
+          return 1;
+        }
+        unwinder_threads = *threads;
+        break;
+      }
+      case kUnwindQueueCapacity: {
+        std::optional<uint32_t> capacity = base::CStringToUInt32(optarg);
+        if (!capacity || *capacity == 0 || (*capacity & (*capacity - 1)) ||
+            *capacity > profiling::kMaxUnwindQueueCapacity) {
+          PERFETTO_ELOG(
+              "--unwind-queue-capacity must be a power of two, at most %" PRIu32
+              ".",
+              profiling::kMaxUnwindQueueCapacity);
+          return 1;
+        }
+        unwind_queue_capacity = *capacity;
+        break;
+      }
+    }
+  }
+
   base::UnixTaskRunner task_runner;
 
 // TODO(rsavitski): support standalone --root or similar on android.
@@ -52,7 +97,8 @@ int TracedPerfMain(int, char**) {
   DirectDescriptorGetter proc_fd_getter;
 #endif
 
-  profiling::PerfProducer producer(&proc_fd_getter, &task_runner);
+  profiling::PerfProducer producer(&proc_fd_getter, &task_runner,
+                                   unwinder_threads, unwind_queue_capacity);
   const char* env_notif = getenv("TRACED_PERF_NOTIFY_FD");
   if (env_notif) {
     int notif_fd = atoi(env_notif);
@@ -17,8 +17,10 @@
 #ifndef SRC_PROFILING_PERF_UNWIND_QUEUE_H_
 #define SRC_PROFILING_PERF_UNWIND_QUEUE_H_
 
-#include <array>
+#include <stdint.h>
+
 #include <atomic>
+#include <memory>
 
 #include "perfetto/base/logging.h"
 
@@ -36,18 +38,18 @@ struct ReadView {
 };
 
 // Single-writer, single-reader ring buffer of fixed-size entries (of any
-// default-constructible type). Size of the buffer is static for the lifetime of
-// UnwindQueue, and must be a power of two.
+// default-constructible type). Capacity of the buffer is chosen at construction
+// and fixed for the lifetime of UnwindQueue, and must be a power of two.
 // Writer side appends entries one at a time, and must stop if there
 // is no available capacity.
 // Reader side sees all unconsumed entries, and can advance the reader position
 // by any amount.
-template <typename T, uint32_t QueueSize>
+template <typename T>
 class UnwindQueue {
  public:
-  UnwindQueue() {
-    static_assert(QueueSize != 0 && ((QueueSize & (QueueSize - 1)) == 0),
-                  "not a power of two");
+  explicit UnwindQueue(uint32_t capacity)
+      : capacity_(capacity), data_(new T[capacity]) {
+    PERFETTO_CHECK(capacity != 0 && ((capacity & (capacity - 1)) == 0));
   }
 
   UnwindQueue(const UnwindQueue&) = delete;
@@ -55,14 +57,16 @@ class UnwindQueue {
   UnwindQueue(UnwindQueue&&) = delete;
   UnwindQueue& operator=(UnwindQueue&&) = delete;
 
-  T& at(uint64_t pos) { return data_[pos % QueueSize]; }
+  T& at(uint64_t pos) { return data_[pos & (capacity_ - 1)]; }
+
+  uint32_t capacity() const { return capacity_; }
 
   WriteView BeginWrite() {
     uint64_t rd = rd_pos_.load(std::memory_order_acquire);
     uint64_t wr = wr_pos_.load(std::memory_order_relaxed);
 
     PERFETTO_DCHECK(wr >= rd);
-    if (wr - rd >= QueueSize)
+    if (wr - rd >= capacity_)
       return WriteView{false, 0};  // buffer fully occupied
 
     return WriteView{true, wr};
@@ -74,7 +78,7 @@ class UnwindQueue {
     uint64_t wr = wr_pos_.load(std::memory_order_acquire);
     uint64_t rd = rd_pos_.load(std::memory_order_relaxed);
 
-    PERFETTO_DCHECK(wr >= rd && wr - rd <= QueueSize);
+    PERFETTO_DCHECK(wr >= rd && wr - rd <= capacity_);
     return ReadView{rd, wr};
   }
 
@@ -83,7 +87,8 @@ class UnwindQueue {
   }
 
  private:
-  std::array<T, QueueSize> data_;
+  const uint32_t capacity_;
+  std::unique_ptr<T[]> data_;
   std::atomic<uint64_t> wr_pos_{0};
   std::atomic<uint64_t> rd_pos_{0};
 };
@@ -24,7 +24,7 @@ namespace {
 
 TEST(UnwindQueueTest, SinglePass) {
   static constexpr uint32_t kCapacity = 4;
-  UnwindQueue<int, kCapacity> queue;
+  UnwindQueue<int> queue(kCapacity);
 
   // write kCapacity entries
   for (int i = 0; i < static_cast<int>(kCapacity); i++) {
@@ -60,7 +60,7 @@ TEST(UnwindQueueTest, SinglePass) {
 
 TEST(UnwindQueueTest, Wrapped) {
   static constexpr uint32_t kCapacity = 4;
-  UnwindQueue<int, kCapacity> queue;
+  UnwindQueue<int> queue(kCapacity);
 
   // write kCapacity entries
   for (int i = 0; i < static_cast<int>(kCapacity); i++) {
@@ -111,6 +111,26 @@ TEST(UnwindQueueTest, Wrapped) {
   ASSERT_TRUE(queue.BeginRead().read_pos == queue.BeginRead().write_pos);
 }
 
+TEST(UnwindQueueTest, LargeCapacity) {
+  static constexpr uint32_t kCapacity = 1 << 16;
+  UnwindQueue<int> queue(kCapacity);
+  ASSERT_EQ(queue.capacity(), kCapacity);
+
+  for (int i = 0; i < static_cast<int>(kCapacity); i++) {
+    WriteView v = queue.BeginWrite();
+    ASSERT_TRUE(v.valid);
+    queue.at(v.write_pos) = i;
+    queue.CommitWrite();
+  }
+  ASSERT_FALSE(queue.BeginWrite().valid);
+
+  ReadView v = queue.BeginRead();
+  ASSERT_EQ(v.write_pos - v.read_pos, kCapacity);
+  ASSERT_EQ(queue.at(v.write_pos - 1), static_cast<int>(kCapacity) - 1);
+  queue.CommitNewReadPosition(v.write_pos);
+  ASSERT_TRUE(queue.BeginWrite().valid);
+}
+
 }  // namespace
 }  // namespace profiling
 }  // namespace perfetto
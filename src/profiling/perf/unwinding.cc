@@ -18,9 +18,11 @@
 
 #include <cinttypes>
 #include <mutex>
+#include <shared_mutex>
 
 #include <unwindstack/Unwinder.h>
 
+#include "perfetto/base/time.h"
 #include "perfetto/ext/base/metatrace.h"
 #include "perfetto/ext/base/no_destructor.h"
 #include "perfetto/ext/base/thread_utils.h"
@@ -29,6 +31,14 @@
 namespace {
 constexpr size_t kUnwindingMaxFrames = 1000;
 constexpr uint32_t kDataSourceShutdownRetryDelayMs = 400;
+
+// Libunwindstack's Elf cache is global, and toggling it frees the cache's own
+// lock. Therefore it must not be reset while any unwinder thread is unwinding:
+// unwinds hold this lock in shared mode, resets in exclusive mode.
+std::shared_mutex& UnwindstackCacheLock() {
+  static perfetto::base::NoDestructor<std::shared_mutex> lock;
+  return lock.ref();
+}
 }  // namespace
 
 namespace perfetto {
@@ -36,8 +46,12 @@ namespace profiling {
 
 Unwinder::Delegate::~Delegate() = default;
 
-Unwinder::Unwinder(Delegate* delegate, base::UnixTaskRunner* task_runner)
-    : task_runner_(task_runner), delegate_(delegate) {
+Unwinder::Unwinder(Delegate* delegate,
+                   base::UnixTaskRunner* task_runner,
+                   uint32_t queue_capacity)
+    : task_runner_(task_runner),
+      delegate_(delegate),
+      unwind_queue_(queue_capacity) {
   ResetAndEnableUnwindstackCache();
   base::MaybeSetThreadName("stack-unwinding");
 }
@@ -225,7 +239,7 @@ base::FlatSet<DataSourceInstanceID> Unwinder::ConsumeAndUnwindReadySamples() {
     // Data source might be gone due to an abrupt stop.
     auto it = data_sources_.find(entry.data_source_id);
     if (it == data_sources_.end()) {
-      entry = UnwindEntry::Invalid();
+      entry = UnwindEntry::Invalid();  // also frees the buffers
       DecrementEnqueuedFootprint(sampled_stack_bytes);
       continue;
     }
@@ -239,9 +253,9 @@ base::FlatSet<DataSourceInstanceID> Unwinder::ConsumeAndUnwindReadySamples() {
       PERFETTO_DLOG("Unwinder skipping sample for pid [%d]: kFdsTimedOut",
                     static_cast<int>(pid));
 
-      // free up the sampled stack as the main thread has no use for it
-      entry.sample.stack.clear();
-      entry.sample.stack.shrink_to_fit();
+      // the main thread has no use for the sampled stack, keep its buffer for
+      // the next samples instead
+      RecycleStackBuffer(std::move(entry.sample.stack));
 
       delegate_->PostEmitUnwinderSkippedSample(entry.data_source_id,
                                                std::move(entry.sample));
@@ -275,14 +289,26 @@ base::FlatSet<DataSourceInstanceID> Unwinder::ConsumeAndUnwindReadySamples() {
           (proc_state.unwind_state.has_value()
                ? &proc_state.unwind_state.value()
                : nullptr);
-      CompletedSample unwound_sample = UnwindSample(
-          entry.sample, opt_user_state, proc_state.attempted_unwinding);
+      uint64_t unwind_start_ns =
+          static_cast<uint64_t>(base::GetWallTimeNs().count());
+      CompletedSample unwound_sample;
+      {
+        std::shared_lock<std::shared_mutex> cache_lock(UnwindstackCacheLock());
+        unwound_sample = UnwindSample(entry.sample, opt_user_state,
+                                      proc_state.attempted_unwinding);
+      }
       proc_state.attempted_unwinding = true;
+      uint64_t unwind_end_ns =
+          static_cast<uint64_t>(base::GetWallTimeNs().count());
+      unwound_sample.unwind_queue_latency_ns =
+          unwind_start_ns - entry.enqueue_time_ns;
+      unwound_sample.unwind_duration_ns = unwind_end_ns - unwind_start_ns;
 
       PERFETTO_METATRACE_COUNTER(TAG_PRODUCER, PROFILER_UNWIND_CURRENT_PID, 0);
 
       delegate_->PostEmitSample(entry.data_source_id,
                                 std::move(unwound_sample));
+      RecycleStackBuffer(std::move(entry.sample.stack));
       entry = UnwindEntry::Invalid();
       DecrementEnqueuedFootprint(sampled_stack_bytes);
       continue;
@@ -310,6 +336,37 @@ base::FlatSet<DataSourceInstanceID> Unwinder::ConsumeAndUnwindReadySamples() {
   return pending_sample_sources;
 }
 
+std::vector<char> Unwinder::TakeStackBuffer() {
+  std::lock_guard<std::mutex> lock(free_stacks_lock_);
+  if (free_stacks_.empty())
+    return std::vector<char>();
+  // The most recently freed buffer, the most likely to still be in cache.
+  std::vector<char> stack = std::move(free_stacks_.back());
+  free_stacks_.pop_back();
+  free_stacks_bytes_ -= stack.capacity();
+  return stack;
+}
+
+void Unwinder::RecycleStackBuffer(std::vector<char> stack) {
+  stack.clear();
+  std::lock_guard<std::mutex> lock(free_stacks_lock_);
+  if (stack.capacity() == 0 ||
+      free_stacks_bytes_ + stack.capacity() > kMaxFreeStackBufferBytes) {
+    return;  // |stack| is freed once the lock is released
+  }
+  free_stacks_bytes_ += stack.capacity();
+  free_stacks_.push_back(std::move(stack));
+}
+
+void Unwinder::ReleaseStackBuffers() {
+  std::vector<std::vector<char>> free_stacks;
+  {
+    std::lock_guard<std::mutex> lock(free_stacks_lock_);
+    free_stacks.swap(free_stacks_);
+    free_stacks_bytes_ = 0;
+  }
+}
+
 CompletedSample Unwinder::UnwindSample(const ParsedSample& sample,
                                        UnwindingMetadata* opt_user_state,
                                        bool pid_unwound_before) {
@@ -330,13 +387,31 @@ CompletedSample Unwinder::UnwindSample(const ParsedSample& sample,
   if (!opt_user_state)
     return ret;
 
-  // Overlay the stack bytes over /proc/<pid>/mem.
   UnwindingMetadata* unwind_state = opt_user_state;
-  std::shared_ptr<unwindstack::Memory> overlay_memory =
+  UnwindingCache::Sample cache_sample(
+      sample.regs.get(), sample.regs->sp(),
+      reinterpret_cast<const uint8_t*>(sample.stack.data()),
+      sample.stack.size());
+  if (const std::vector<unwindstack::FrameData>* frames =
+          unwind_state->unwinding_cache.Lookup(cache_sample)) {
+    ret.build_ids.reserve(kernel_frames_size + frames->size());
+    ret.frames.reserve(kernel_frames_size + frames->size());
+    for (const unwindstack::FrameData& frame : *frames) {
+      ret.build_ids.emplace_back(unwind_state->GetBuildId(frame));
+      ret.frames.emplace_back(frame);
+    }
+    ret.unwinding_cache_hit = true;
+    return ret;
+  }
+
+  // Overlay the stack bytes over /proc/<pid>/mem, recording the reads of the
+  // sampled stack for the cache.
+  auto overlay_memory = std::make_shared<UnwindingCache::RecordingMemory>(
       std::make_shared<StackOverlayMemory>(
           unwind_state->fd_mem, sample.regs->sp(),
           reinterpret_cast<const uint8_t*>(sample.stack.data()),
-          sample.stack.size());
+          sample.stack.size()),
+      sample.regs->sp(), sample.stack.size());
 
   struct UnwindResult {
     unwindstack::ErrorCode error_code;
@@ -403,6 +478,10 @@ CompletedSample Unwinder::UnwindSample(const ParsedSample& sample,
     unwind = attempt_unwind();
   }
 
+  if (unwind.error_code == unwindstack::ERROR_NONE)
+    unwind_state->unwinding_cache.Insert(cache_sample, *overlay_memory,
+                                         unwind.frames);
+
   ret.build_ids.reserve(kernel_frames_size + unwind.frames.size());
   ret.frames.reserve(kernel_frames_size + unwind.frames.size());
   for (unwindstack::FrameData& frame : unwind.frames) {
@@ -448,14 +527,20 @@ std::vector<unwindstack::FrameData> Unwinder::SymbolizeKernelCallchain(
   auto* kernel_map = kernel_symbolizer_.GetOrCreateKernelSymbolMap();
   PERFETTO_DCHECK(kernel_map);
   ret.reserve(sample.kernel_ips.size());
-  for (size_t i = 1; i < sample.kernel_ips.size(); i++) {
-    std::string function_name = kernel_map->Lookup(sample.kernel_ips[i]);
+  const size_t num_ips = sample.kernel_ips.size() - 1;
+  kernel_symbol_ids_.resize(num_ips);
+  kernel_map->LookupBatch(sample.kernel_ips.data() + 1, num_ips,
+                          kernel_symbol_ids_.data());
+  for (KernelSymbolMap::SymbolId id : kernel_symbol_ids_) {
+    auto it_and_inserted = kernel_symbol_names_.emplace(id, std::string());
+    if (it_and_inserted.second)
+      kernel_map->GetSymbolName(id, &it_and_inserted.first->second);
 
     // Synthesise a partially-valid libunwindstack frame struct for the kernel
     // frame. We reuse the type for convenience. The kernel frames are marked by
     // a magical "kernel" MapInfo object as their containing mapping.
     unwindstack::FrameData frame{};
-    frame.function_name = std::move(function_name);
+    frame.function_name = it_and_inserted.first->second;
     frame.map_info = kernel_map_info.ref();
     ret.emplace_back(std::move(frame));
   }
@@ -501,6 +586,7 @@ void Unwinder::FinishDataSourceStop(DataSourceInstanceID ds_id) {
   // Clean up state if there are no more active sources.
   if (data_sources_.empty()) {
     kernel_symbolizer_.Destroy();
+    kernel_symbol_names_.clear();
     ResetAndEnableUnwindstackCache();
   }
 
@@ -525,6 +611,7 @@ void Unwinder::PurgeDataSource(DataSourceInstanceID ds_id) {
   // Clean up state if there are no more active sources.
   if (data_sources_.empty()) {
     kernel_symbolizer_.Destroy();
+    kernel_symbol_names_.clear();
     ResetAndEnableUnwindstackCache();
     // Also purge scudo on Android, which would normally be done by the service
     // thread in |FinishDataSourceStop|. This is important as most of the scudo
@@ -570,10 +657,11 @@ void Unwinder::ResetAndEnableUnwindstackCache() {
   // the cache is enabled. Therefore unwinding and cache toggling should stay on
   // the same thread, but we might be moving unwinding across threads if we're
   // recreating |Unwinder| instances (during a reconnect to traced). Therefore,
-  // use our own static lock to synchronize the cache toggling.
+  // use our own static lock to synchronize the cache toggling. The same lock
+  // keeps the other unwinder threads from unwinding while the cache is
+  // recreated.
   // TODO(rsavitski): consider fixing this in libunwindstack itself.
-  static std::mutex* lock = new std::mutex{};
-  std::lock_guard<std::mutex> guard{*lock};
+  std::unique_lock<std::shared_mutex> guard(UnwindstackCacheLock());
   unwindstack::Elf::SetCachingEnabled(false);  // free any existing state
   unwindstack::Elf::SetCachingEnabled(true);   // reallocate a fresh cache
 }
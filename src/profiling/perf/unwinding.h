@@ -20,8 +20,12 @@
 #include <stdint.h>
 #include <condition_variable>
 #include <map>
+#include <mutex>
 #include <optional>
+#include <string>
 #include <thread>
+#include <unordered_map>
+#include <vector>
 
 #include <linux/perf_event.h>
 #include <unwindstack/Error.h>
@@ -40,7 +44,13 @@
 namespace perfetto {
 namespace profiling {
 
-constexpr static uint32_t kUnwindQueueCapacity = 1024;
+constexpr static uint32_t kDefaultUnwindQueueCapacity = 1024;
+constexpr static uint32_t kMaxUnwindQueueCapacity = 1 << 20;
+constexpr static size_t kDefaultUnwinderThreads = 1;
+constexpr static size_t kMaxUnwinderThreads = 64;
+// Upper bound on the sampled stack buffers that an unwinder keeps for reuse by
+// the next samples. These aren't part of the enqueued footprint.
+constexpr static size_t kMaxFreeStackBufferBytes = 4 * 1024 * 1024;
 
 // Unwinds and symbolises callstacks. For userspace this uses the sampled stack
 // and register state (see |ParsedSample|). For kernelspace, the kernel itself
@@ -48,6 +58,11 @@ constexpr static uint32_t kUnwindQueueCapacity = 1024;
 // symbolisation using /proc/kallsyms is necessary. Has a single unwinding ring
 // queue, shared across all data sources.
 //
+// The producer can run several unwinders, in which case the samples are sharded
+// by pid: all samples (and proc-fds) of a given process go to the same
+// unwinder, which keeps the process' unwinding state. Data source lifecycle
+// events are sent to all of them.
+//
 // Userspace samples cannot be unwound without having /proc/<pid>/{maps,mem}
 // file descriptors for that process. This lookup can be asynchronous (e.g. on
 // Android), so the unwinder might have to wait before it can process (or
@@ -103,9 +118,7 @@ class Unwinder {
   void PostClearCachedStatePeriodic(DataSourceInstanceID ds_id,
                                     uint32_t period_ms);
 
-  UnwindQueue<UnwindEntry, kUnwindQueueCapacity>& unwind_queue() {
-    return unwind_queue_;
-  }
+  UnwindQueue<UnwindEntry>& unwind_queue() { return unwind_queue_; }
 
   uint64_t GetEnqueuedFootprint() {
     uint64_t freed =
@@ -123,6 +136,15 @@ class Unwinder {
         increment, std::memory_order_relaxed);
   }
 
+  // Main thread: returns the sampled stack buffer of an already processed
+  // sample, or an empty buffer if there is none. Parsing the next sample into
+  // it saves allocating and faulting in a new buffer for every sample.
+  std::vector<char> TakeStackBuffer();
+
+  // Main thread: frees the stack buffers kept for reuse, for when no data
+  // sources are left.
+  void ReleaseStackBuffers();
+
  private:
   struct ProcessState {
     // kInitial: unwinder waiting for more info on the process (proc-fds, their
@@ -159,7 +181,9 @@ class Unwinder {
   };
 
   // Must be instantiated via the |UnwinderHandle|.
-  Unwinder(Delegate* delegate, base::UnixTaskRunner* task_runner);
+  Unwinder(Delegate* delegate,
+           base::UnixTaskRunner* task_runner,
+           uint32_t queue_capacity);
 
   // Marks the data source as valid and active at the unwinding stage.
   // Initializes kernel address symbolization if needed.
@@ -209,6 +233,10 @@ class Unwinder {
                                                    std::memory_order_relaxed);
   }
 
+  // Keeps the sampled stack buffer of a processed sample for reuse by the main
+  // thread, unless |kMaxFreeStackBufferBytes| are already kept.
+  void RecycleStackBuffer(std::vector<char> stack);
+
   // Clears the parsed maps for all previously-sampled processes, and resets the
   // libunwindstack cache. This has the effect of deallocating the cached Elf
   // objects within libunwindstack, which take up non-trivial amounts of memory.
@@ -243,10 +271,21 @@ class Unwinder {
 
   base::UnixTaskRunner* const task_runner_;
   Delegate* const delegate_;
-  UnwindQueue<UnwindEntry, kUnwindQueueCapacity> unwind_queue_;
+  UnwindQueue<UnwindEntry> unwind_queue_;
   QueueFootprintTracker footprint_tracker_;
+  // Stack buffers of the processed samples, handed back to the main thread.
+  // Shared by both threads.
+  std::mutex free_stacks_lock_;
+  std::vector<std::vector<char>> free_stacks_;
+  size_t free_stacks_bytes_ = 0;
   std::map<DataSourceInstanceID, DataSourceState> data_sources_;
   LazyKernelSymbolizer kernel_symbolizer_;
+  // Kernel callchains share most of their frames (e.g. syscall entry), so the
+  // names of the symbols seen so far are kept until |kernel_symbolizer_| is
+  // destroyed, which invalidates the ids.
+  std::unordered_map<KernelSymbolMap::SymbolId, std::string>
+      kernel_symbol_names_;
+  std::vector<KernelSymbolMap::SymbolId> kernel_symbol_ids_;  // Scratch.
 
   PERFETTO_THREAD_CHECKER(thread_checker_)
 };
@@ -257,7 +296,7 @@ class Unwinder {
 // owned state, and consolidate.
 class UnwinderHandle {
  public:
-  explicit UnwinderHandle(Unwinder::Delegate* delegate) {
+  UnwinderHandle(Unwinder::Delegate* delegate, uint32_t queue_capacity) {
     std::mutex init_lock;
     std::condition_variable init_cv;
 
@@ -275,7 +314,7 @@ class UnwinderHandle {
         };
 
     thread_ = std::thread(&UnwinderHandle::RunTaskThread, this,
-                          std::move(initializer), delegate);
+                          std::move(initializer), delegate, queue_capacity);
 
     std::unique_lock<std::mutex> lock(init_lock);
     init_cv.wait(lock, [this] { return !!task_runner_ && !!unwinder_; });
@@ -293,13 +332,15 @@ class UnwinderHandle {
   }
 
   Unwinder* operator->() { return unwinder_; }
+  Unwinder* get() { return unwinder_; }
 
  private:
   void RunTaskThread(
       std::function<void(base::UnixTaskRunner*, Unwinder*)> initializer,
-      Unwinder::Delegate* delegate) {
+      Unwinder::Delegate* delegate,
+      uint32_t queue_capacity) {
     base::UnixTaskRunner task_runner;
-    Unwinder unwinder(delegate, &task_runner);
+    Unwinder unwinder(delegate, &task_runner, queue_capacity);
     task_runner.PostTask(
         std::bind(std::move(initializer), &task_runner, &unwinder));
     task_runner.Run();
@@ -0,0 +1,510 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/profiling/symbolizer/dwarf_line_table.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <cinttypes>
+#include <limits>
+
+#include "perfetto/base/logging.h"
+
+namespace perfetto {
+namespace profiling {
+namespace {
+
+// Line number opcodes, see section 6.2.5 of the DWARF 5 specification.
+constexpr uint8_t kDwLnsCopy = 1;
+constexpr uint8_t kDwLnsAdvancePc = 2;
+constexpr uint8_t kDwLnsAdvanceLine = 3;
+constexpr uint8_t kDwLnsSetFile = 4;
+constexpr uint8_t kDwLnsConstAddPc = 8;
+constexpr uint8_t kDwLnsFixedAdvancePc = 9;
+constexpr uint8_t kDwLneEndSequence = 1;
+constexpr uint8_t kDwLneSetAddress = 2;
+constexpr uint8_t kDwLneDefineFile = 3;
+
+// Line number header entry formats, only used by DWARF 5.
+constexpr uint64_t kDwLnctPath = 1;
+constexpr uint64_t kDwLnctDirectoryIndex = 2;
+constexpr uint64_t kDwFormBlock = 0x09;
+constexpr uint64_t kDwFormData1 = 0x0b;
+constexpr uint64_t kDwFormData2 = 0x05;
+constexpr uint64_t kDwFormData4 = 0x06;
+constexpr uint64_t kDwFormData8 = 0x07;
+constexpr uint64_t kDwFormData16 = 0x1e;
+constexpr uint64_t kDwFormSdata = 0x0d;
+constexpr uint64_t kDwFormString = 0x08;
+constexpr uint64_t kDwFormStrp = 0x0e;
+constexpr uint64_t kDwFormLineStrp = 0x1f;
+constexpr uint64_t kDwFormUdata = 0x0f;
+
+// Bounds checked reader of little endian DWARF data. Reads past the end set
+// the error flag and return zero.
+class Reader {
+ public:
+  Reader(const uint8_t* data, size_t size) : ptr_(data), end_(data + size) {}
+
+  bool ok() const { return !error_; }
+  bool empty() const { return ptr_ >= end_; }
+  const uint8_t* ptr() const { return ptr_; }
+  size_t remaining() const { return static_cast<size_t>(end_ - ptr_); }
+
+  template <typename T>
+  T Read() {
+    T value{};
+    if (sizeof(T) > remaining()) {
+      error_ = true;
+      ptr_ = end_;
+      return value;
+    }
+    memcpy(&value, ptr_, sizeof(T));
+    ptr_ += sizeof(T);
+    return value;
+  }
+
+  uint64_t ReadUleb128() {
+    uint64_t value = 0;
+    for (uint32_t shift = 0;; shift += 7) {
+      uint8_t byte = Read<uint8_t>();
+      if (shift < 64)
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      if (!(byte & 0x80) || error_)
+        return value;
+    }
+  }
+
+  int64_t ReadSleb128() {
+    uint64_t value = 0;
+    uint32_t shift = 0;
+    uint8_t byte;
+    do {
+      byte = Read<uint8_t>();
+      if (shift < 64)
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      shift += 7;
+    } while ((byte & 0x80) && !error_);
+    if (shift < 64 && (byte & 0x40))
+      value |= ~uint64_t{0} << shift;
+    return static_cast<int64_t>(value);
+  }
+
+  uint64_t ReadOffset(bool dwarf64) {
+    return dwarf64 ? Read<uint64_t>() : Read<uint32_t>();
+  }
+
+  uint64_t ReadAddress(size_t size) {
+    switch (size) {
+      case 4:
+        return Read<uint32_t>();
+      case 8:
+        return Read<uint64_t>();
+      default:
+        Skip(size);
+        return 0;
+    }
+  }
+
+  const char* ReadCString() {
+    const void* nul = memchr(ptr_, '\0', remaining());
+    if (!nul) {
+      error_ = true;
+      ptr_ = end_;
+      return "";
+    }
+    const char* str = reinterpret_cast<const char*>(ptr_);
+    ptr_ = static_cast<const uint8_t*>(nul) + 1;
+    return str;
+  }
+
+  void Skip(uint64_t size) {
+    if (size > remaining()) {
+      error_ = true;
+      ptr_ = end_;
+      return;
+    }
+    ptr_ += size;
+  }
+
+ private:
+  const uint8_t* ptr_;
+  const uint8_t* end_;
+  bool error_ = false;
+};
+
+const char* StringAt(const uint8_t* section, size_t size, uint64_t offset) {
+  if (offset >= size || !memchr(section + offset, '\0', size - offset))
+    return nullptr;
+  return reinterpret_cast<const char*>(section + offset);
+}
+
+bool IsAbsolute(const std::string& path) {
+  return !path.empty() &&
+         (path[0] == '/' || (path.size() > 1 && path[1] == ':'));
+}
+
+}  // namespace
+
+// Decodes a single line program (the header and the opcodes of a unit) into
+// a DwarfLineTable.
+class DwarfLineProgram {
+ public:
+  DwarfLineProgram(const DwarfLineTable::Sections& sections,
+                   DwarfLineTable* table)
+      : sections_(sections), table_(table) {}
+
+  bool Parse(Reader* unit, uint16_t version, bool dwarf64);
+
+ private:
+  struct File {
+    std::string name;
+    uint64_t dir;
+  };
+
+  bool ParseV5EntryFormat(Reader* reader,
+                          bool dwarf64,
+                          std::vector<std::string>* dirs,
+                          std::vector<File>* files,
+                          bool is_dirs);
+  void EmitRow(uint64_t address, uint64_t file, int64_t line);
+  void EndSequence(uint64_t address);
+
+  const DwarfLineTable::Sections& sections_;
+  DwarfLineTable* table_;
+  // The index of each file of this unit in |table_->files_|.
+  std::vector<uint32_t> file_indices_;
+  uint32_t first_file_ = 1;
+  size_t sequence_start_row_ = 0;
+};
+
+bool DwarfLineProgram::ParseV5EntryFormat(Reader* reader,
+                                          bool dwarf64,
+                                          std::vector<std::string>* dirs,
+                                          std::vector<File>* files,
+                                          bool is_dirs) {
+  uint8_t format_count = reader->Read<uint8_t>();
+  std::vector<std::pair<uint64_t, uint64_t>> format;
+  for (uint8_t i = 0; i < format_count; i++) {
+    uint64_t content_type = reader->ReadUleb128();
+    uint64_t form = reader->ReadUleb128();
+    format.emplace_back(content_type, form);
+  }
+  uint64_t count = reader->ReadUleb128();
+  // Each field of an entry takes at least one byte. Reject counts that can't
+  // fit in the header rather than looping on them.
+  if (count > 0 &&
+      (format.empty() || count > reader->remaining() / format.size())) {
+    return false;
+  }
+  for (uint64_t i = 0; i < count && reader->ok(); i++) {
+    std::string path;
+    uint64_t dir = 0;
+    for (const auto& content_type_and_form : format) {
+      uint64_t content_type = content_type_and_form.first;
+      uint64_t value = 0;
+      const char* str = nullptr;
+      switch (content_type_and_form.second) {
+        case kDwFormString:
+          str = reader->ReadCString();
+          break;
+        case kDwFormLineStrp:
+          str = StringAt(sections_.debug_line_str,
+                         sections_.debug_line_str_size,
+                         reader->ReadOffset(dwarf64));
+          break;
+        case kDwFormStrp:
+          str = StringAt(sections_.debug_str, sections_.debug_str_size,
+                         reader->ReadOffset(dwarf64));
+          break;
+        case kDwFormUdata:
+          value = reader->ReadUleb128();
+          break;
+        case kDwFormSdata:
+          value = static_cast<uint64_t>(reader->ReadSleb128());
+          break;
+        case kDwFormData1:
+          value = reader->Read<uint8_t>();
+          break;
+        case kDwFormData2:
+          value = reader->Read<uint16_t>();
+          break;
+        case kDwFormData4:
+          value = reader->Read<uint32_t>();
+          break;
+        case kDwFormData8:
+          value = reader->Read<uint64_t>();
+          break;
+        case kDwFormData16:
+          reader->Skip(16);
+          break;
+        case kDwFormBlock:
+          reader->Skip(reader->ReadUleb128());
+          break;
+        default:
+          // E.g. DW_FORM_strx, which needs .debug_str_offsets.
+          PERFETTO_DLOG("Unsupported DWARF form %" PRIu64,
+                        content_type_and_form.second);
+          return false;
+      }
+      if (content_type == kDwLnctPath && str)
+        path = str;
+      else if (content_type == kDwLnctDirectoryIndex)
+        dir = value;
+    }
+    if (is_dirs)
+      dirs->emplace_back(std::move(path));
+    else
+      files->push_back({std::move(path), dir});
+  }
+  return reader->ok();
+}
+
+bool DwarfLineProgram::Parse(Reader* unit, uint16_t version, bool dwarf64) {
+  size_t address_size = 0;
+  if (version >= 5) {
+    address_size = unit->Read<uint8_t>();
+    unit->Read<uint8_t>();  // segment_selector_size
+  }
+  uint64_t header_length = unit->ReadOffset(dwarf64);
+  if (!unit->ok() || header_length > unit->remaining())
+    return false;
+  Reader program(unit->ptr() + header_length,
+                 unit->remaining() - static_cast<size_t>(header_length));
+  Reader header(unit->ptr(), static_cast<size_t>(header_length));
+
+  uint8_t min_inst_length = header.Read<uint8_t>();
+  if (version >= 4)
+    header.Read<uint8_t>();  // maximum_operations_per_instruction (VLIW only)
+  header.Read<uint8_t>();    // default_is_stmt
+  int8_t line_base = header.Read<int8_t>();
+  uint8_t line_range = header.Read<uint8_t>();
+  uint8_t opcode_base = header.Read<uint8_t>();
+  if (!header.ok() || line_range == 0 || opcode_base == 0)
+    return false;
+  std::vector<uint8_t> standard_opcode_lengths(opcode_base);
+  for (uint8_t i = 1; i < opcode_base; i++)
+    standard_opcode_lengths[i] = header.Read<uint8_t>();
+
+  std::vector<std::string> dirs;
+  std::vector<File> files;
+  if (version >= 5) {
+    if (!ParseV5EntryFormat(&header, dwarf64, &dirs, &files, true) ||
+        !ParseV5EntryFormat(&header, dwarf64, &dirs, &files, false)) {
+      return false;
+    }
+    first_file_ = 0;
+  } else {
+    // Directory 0 is the compilation directory, which is not listed.
+    dirs.emplace_back();
+    for (;;) {
+      const char* dir = header.ReadCString();
+      if (!header.ok() || !*dir)
+        break;
+      dirs.emplace_back(dir);
+    }
+    for (;;) {
+      const char* name = header.ReadCString();
+      if (!header.ok() || !*name)
+        break;
+      uint64_t dir = header.ReadUleb128();
+      header.ReadUleb128();  // mtime
+      header.ReadUleb128();  // length
+      files.push_back({name, dir});
+    }
+    first_file_ = 1;
+  }
+  if (!header.ok())
+    return false;
+
+  auto add_file = [this, &dirs](const File& file) {
+    std::string path = file.name;
+    if (!IsAbsolute(path) && file.dir < dirs.size() && !dirs[file.dir].empty())
+      path = dirs[file.dir] + "/" + path;
+    file_indices_.push_back(static_cast<uint32_t>(table_->files_.size()));
+    table_->files_.emplace_back(std::move(path));
+  };
+  for (const File& file : files)
+    add_file(file);
+
+  // The state machine registers, see section 6.2.2 of the DWARF 5 spec.
+  uint64_t address = 0;
+  uint64_t file = 1;
+  int64_t line = 1;
+  sequence_start_row_ = table_->rows_.size();
+  while (!program.empty() && program.ok()) {
+    uint8_t opcode = program.Read<uint8_t>();
+    if (opcode >= opcode_base) {
+      // Special opcode: advance address and line, then emit a row.
+      uint8_t adjusted = static_cast<uint8_t>(opcode - opcode_base);
+      address += uint64_t{min_inst_length} * (adjusted / line_range);
+      line += line_base + adjusted % line_range;
+      EmitRow(address, file, line);
+      continue;
+    }
+    switch (opcode) {
+      case 0: {
+        uint64_t length = program.ReadUleb128();
+        if (length == 0 || length > program.remaining())
+          return false;
+        Reader extended(program.ptr(), static_cast<size_t>(length));
+        program.Skip(length);
+        uint8_t sub_opcode = extended.Read<uint8_t>();
+        if (sub_opcode == kDwLneEndSequence) {
+          EndSequence(address);
+          address = 0;
+          file = 1;
+          line = 1;
+        } else if (sub_opcode == kDwLneSetAddress) {
+          address = extended.ReadAddress(address_size ? address_size
+                                                       : extended.remaining());
+        } else if (sub_opcode == kDwLneDefineFile) {
+          File defined;
+          defined.name = extended.ReadCString();
+          defined.dir = extended.ReadUleb128();
+          add_file(defined);
+        }
+        break;
+      }
+      case kDwLnsCopy:
+        EmitRow(address, file, line);
+        break;
+      case kDwLnsAdvancePc:
+        address += program.ReadUleb128() * min_inst_length;
+        break;
+      case kDwLnsAdvanceLine:
+        line += program.ReadSleb128();
+        break;
+      case kDwLnsSetFile:
+        file = program.ReadUleb128();
+        break;
+      case kDwLnsConstAddPc:
+        address += uint64_t{min_inst_length} *
+                   (static_cast<uint8_t>(255 - opcode_base) / line_range);
+        break;
+      case kDwLnsFixedAdvancePc:
+        address += program.Read<uint16_t>();
+        break;
+      default:
+        // Other standard opcodes only change registers that we do not track.
+        for (uint8_t i = 0; i < standard_opcode_lengths[opcode]; i++)
+          program.ReadUleb128();
+        break;
+    }
+  }
+  // Drop the rows of an unterminated sequence.
+  table_->rows_.resize(sequence_start_row_);
+  return program.ok();
+}
+
+void DwarfLineProgram::EmitRow(uint64_t address, uint64_t file, int64_t line) {
+  uint32_t file_index = std::numeric_limits<uint32_t>::max();
+  if (file >= first_file_ && file - first_file_ < file_indices_.size())
+    file_index = file_indices_[file - first_file_];
+  uint32_t line_no = line > 0 ? static_cast<uint32_t>(line) : 0;
+  table_->rows_.push_back({address, file_index, line_no});
+}
+
+void DwarfLineProgram::EndSequence(uint64_t address) {
+  std::vector<DwarfLineTable::Row>& rows = table_->rows_;
+  size_t num_rows = rows.size() - sequence_start_row_;
+  auto begin = rows.begin() + static_cast<ptrdiff_t>(sequence_start_row_);
+  auto by_address = [](const DwarfLineTable::Row& a,
+                       const DwarfLineTable::Row& b) {
+    return a.address < b.address;
+  };
+  if (!std::is_sorted(begin, rows.end(), by_address))
+    std::stable_sort(begin, rows.end(), by_address);
+  // The sequence starts at its lowest address, which isn't necessarily the
+  // one of its first row. Functions removed by the linker have their
+  // sequences relocated to 0 (or to -1 with newer linkers), where they would
+  // shadow each other.
+  uint64_t start = num_rows ? rows[sequence_start_row_].address : 0;
+  if (num_rows == 0 || start == 0 || start >= address) {
+    rows.resize(sequence_start_row_);
+    return;
+  }
+  table_->sequences_.push_back({start, address, sequence_start_row_, num_rows});
+  sequence_start_row_ = rows.size();
+}
+
+// static
+DwarfLineTable DwarfLineTable::Parse(const Sections& sections) {
+  DwarfLineTable table;
+  Reader section(sections.debug_line, sections.debug_line_size);
+  while (!section.empty()) {
+    bool dwarf64 = false;
+    uint64_t unit_length = section.Read<uint32_t>();
+    if (unit_length == 0xffffffff) {
+      dwarf64 = true;
+      unit_length = section.Read<uint64_t>();
+    }
+    if (!section.ok() || unit_length > section.remaining()) {
+      PERFETTO_DLOG("Truncated .debug_line unit");
+      break;
+    }
+    Reader unit(section.ptr(), static_cast<size_t>(unit_length));
+    section.Skip(unit_length);
+
+    uint16_t version = unit.Read<uint16_t>();
+    if (version < 2 || version > 5) {
+      PERFETTO_DLOG("Unsupported .debug_line version %u", version);
+      continue;
+    }
+    size_t num_rows = table.rows_.size();
+    size_t num_sequences = table.sequences_.size();
+    size_t num_files = table.files_.size();
+    DwarfLineProgram program(sections, &table);
+    if (!program.Parse(&unit, version, dwarf64)) {
+      PERFETTO_DLOG("Failed to parse .debug_line unit");
+      table.rows_.resize(num_rows);
+      table.sequences_.resize(num_sequences);
+      table.files_.resize(num_files);
+    }
+  }
+  std::sort(table.sequences_.begin(), table.sequences_.end(),
+            [](const Sequence& a, const Sequence& b) {
+              return a.start < b.start;
+            });
+  return table;
+}
+
+bool DwarfLineTable::Lookup(uint64_t address,
+                            std::string* file_name,
+                            uint32_t* line) const {
+  auto seq = std::upper_bound(
+      sequences_.begin(), sequences_.end(), address,
+      [](uint64_t addr, const Sequence& s) { return addr < s.start; });
+  if (seq == sequences_.begin())
+    return false;
+  --seq;
+  if (address >= seq->end)
+    return false;
+  auto first = rows_.begin() + static_cast<ptrdiff_t>(seq->first_row);
+  auto last = first + static_cast<ptrdiff_t>(seq->num_rows);
+  auto row = std::upper_bound(
+      first, last, address,
+      [](uint64_t addr, const Row& r) { return addr < r.address; });
+  PERFETTO_DCHECK(row != first);
+  --row;
+  *file_name = row->file < files_.size() ? files_[row->file] : "";
+  *line = row->line;
+  return true;
+}
+
+}  // namespace profiling
+}  // namespace perfetto
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_PROFILING_SYMBOLIZER_DWARF_LINE_TABLE_H_
+#define SRC_PROFILING_SYMBOLIZER_DWARF_LINE_TABLE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+namespace perfetto {
+namespace profiling {
+
+// The contents of a .debug_line section (DWARF versions 2 to 5), decoded into
+// address-sorted rows.
+class DwarfLineTable {
+ public:
+  // The sections referred to by .debug_line. |debug_line_str| and |debug_str|
+  // can be empty, if the binary does not have them.
+  struct Sections {
+    const uint8_t* debug_line = nullptr;
+    size_t debug_line_size = 0;
+    const uint8_t* debug_line_str = nullptr;
+    size_t debug_line_str_size = 0;
+    const uint8_t* debug_str = nullptr;
+    size_t debug_str_size = 0;
+  };
+
+  // Decodes all the line programs in |sections|. Units which cannot be decoded
+  // are skipped.
+  static DwarfLineTable Parse(const Sections& sections);
+
+  // Returns false if |address| is not covered by any line program.
+  bool Lookup(uint64_t address, std::string* file_name, uint32_t* line) const;
+
+  size_t num_rows() const { return rows_.size(); }
+
+ private:
+  struct Row {
+    uint64_t address;
+    uint32_t file;
+    uint32_t line;
+  };
+
+  // The rows of a contiguous range of addresses, [start, end).
+  struct Sequence {
+    uint64_t start;
+    uint64_t end;
+    size_t first_row;
+    size_t num_rows;
+  };
+
+  friend class DwarfLineProgram;
+
+  std::vector<Row> rows_;
+  std::vector<Sequence> sequences_;
+  // The full path of the files referred to by the rows.
+  std::vector<std::string> files_;
+};
+
+}  // namespace profiling
+}  // namespace perfetto
+
+#endif  // SRC_PROFILING_SYMBOLIZER_DWARF_LINE_TABLE_H_
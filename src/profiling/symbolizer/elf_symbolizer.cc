@@ -0,0 +1,292 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/profiling/symbolizer/elf_symbolizer.h"
+
+#include "perfetto/base/build_config.h"
+
+#if PERFETTO_BUILDFLAG(PERFETTO_LOCAL_SYMBOLIZER)
+
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cinttypes>
+#include <optional>
+#include <thread>
+
+#include "perfetto/base/logging.h"
+#include "perfetto/ext/trace_processor/demangle.h"
+#include "src/profiling/symbolizer/elf.h"
+#include "src/profiling/symbolizer/filesystem.h"
+
+namespace perfetto {
+namespace profiling {
+namespace {
+
+constexpr auto EM_ARM = 40;
+
+bool InRange(size_t size, uint64_t offset, uint64_t length) {
+  return offset <= size && length <= size - offset;
+}
+
+}  // namespace
+
+// static
+std::unique_ptr<ElfSymbolTable> ElfSymbolTable::Open(
+    const std::string& file_name) {
+  size_t size = GetFileSize(file_name);
+  if (size <= EI_CLASS)
+    return nullptr;
+  std::unique_ptr<ScopedReadMmap> map(
+      new ScopedReadMmap(file_name.c_str(), size));
+  if (!map->IsValid()) {
+    PERFETTO_PLOG("Failed to map %s", file_name.c_str());
+    return nullptr;
+  }
+  const char* mem = static_cast<const char*>(**map);
+  if (mem[EI_MAG0] != ELFMAG0 || mem[EI_MAG1] != ELFMAG1 ||
+      mem[EI_MAG2] != ELFMAG2 || mem[EI_MAG3] != ELFMAG3 ||
+      mem[EI_DATA] != ELFDATA2LSB) {
+    PERFETTO_ELOG("%s is not a little endian ELF file.", file_name.c_str());
+    return nullptr;
+  }
+  char elf_class = mem[EI_CLASS];
+
+  std::unique_ptr<ElfSymbolTable> table(new ElfSymbolTable(std::move(map)));
+  bool ok = false;
+  if (elf_class == ELFCLASS32)
+    ok = table->Parse<Elf32>(size);
+  else if (elf_class == ELFCLASS64)
+    ok = table->Parse<Elf64>(size);
+  if (!ok) {
+    PERFETTO_ELOG("Corrupted ELF %s.", file_name.c_str());
+    return nullptr;
+  }
+  return table;
+}
+
+ElfSymbolTable::ElfSymbolTable(std::unique_ptr<ScopedReadMmap> map)
+    : map_(std::move(map)) {}
+
+ElfSymbolTable::~ElfSymbolTable() = default;
+
+template <typename E>
+bool ElfSymbolTable::Parse(size_t size) {
+  char* mem = static_cast<char*>(**map_);
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(mem);
+  if (size < sizeof(typename E::Ehdr))
+    return false;
+  const typename E::Ehdr* ehdr = reinterpret_cast<typename E::Ehdr*>(mem);
+  if (!InRange(size, ehdr->e_shoff,
+               uint64_t{ehdr->e_shnum} * sizeof(typename E::Shdr)) ||
+      (ehdr->e_shnum && ehdr->e_shstrndx >= ehdr->e_shnum)) {
+    return false;
+  }
+
+  const typename E::Shdr* symtab = nullptr;
+  const typename E::Shdr* dynsym = nullptr;
+  DwarfLineTable::Sections debug_sections;
+  const typename E::Shdr* shstrtab =
+      ehdr->e_shnum ? GetShdr<E>(mem, ehdr, ehdr->e_shstrndx) : nullptr;
+  for (size_t i = 0; i < ehdr->e_shnum; ++i) {
+    const typename E::Shdr* shdr = GetShdr<E>(mem, ehdr, i);
+    if (shdr->sh_type == SHT_NOBITS ||
+        !InRange(size, shdr->sh_offset, shdr->sh_size)) {
+      continue;
+    }
+    if (shdr->sh_type == SHT_SYMTAB)
+      symtab = shdr;
+    else if (shdr->sh_type == SHT_DYNSYM)
+      dynsym = shdr;
+    if (!shstrtab || shdr->sh_name >= shstrtab->sh_size ||
+        !InRange(size, shstrtab->sh_offset, shstrtab->sh_size)) {
+      continue;
+    }
+    const char* name = mem + shstrtab->sh_offset + shdr->sh_name;
+    if (!memchr(name, '\0', shstrtab->sh_size - shdr->sh_name))
+      continue;
+    const uint8_t* data = bytes + shdr->sh_offset;
+    size_t data_size = static_cast<size_t>(shdr->sh_size);
+    const uint8_t** section = nullptr;
+    size_t* section_size = nullptr;
+    if (strcmp(name, ".debug_line") == 0) {
+      section = &debug_sections.debug_line;
+      section_size = &debug_sections.debug_line_size;
+    } else if (strcmp(name, ".debug_line_str") == 0) {
+      section = &debug_sections.debug_line_str;
+      section_size = &debug_sections.debug_line_str_size;
+    } else if (strcmp(name, ".debug_str") == 0) {
+      section = &debug_sections.debug_str;
+      section_size = &debug_sections.debug_str_size;
+    }
+    if (!section)
+      continue;
+    if (shdr->sh_flags & SHF_COMPRESSED) {
+      PERFETTO_DLOG("Ignoring compressed debug section %s", name);
+      continue;
+    }
+    *section = data;
+    *section_size = data_size;
+  }
+
+  // .dynsym only has the exported functions, use it for stripped binaries.
+  const typename E::Shdr* sym_section = symtab ? symtab : dynsym;
+  if (sym_section && sym_section->sh_link < ehdr->e_shnum) {
+    const typename E::Shdr* strtab = GetShdr<E>(mem, ehdr, sym_section->sh_link);
+    if (InRange(size, strtab->sh_offset, strtab->sh_size)) {
+      const char* strings = mem + strtab->sh_offset;
+      size_t num_syms = static_cast<size_t>(sym_section->sh_size /
+                                            sizeof(typename E::Sym));
+      for (size_t i = 0; i < num_syms; ++i) {
+        typename E::Sym sym;
+        memcpy(&sym, mem + sym_section->sh_offset + i * sizeof(sym),
+               sizeof(sym));
+        if ((sym.st_info & 0xf) != STT_FUNC || sym.st_shndx == SHN_UNDEF ||
+            sym.st_name >= strtab->sh_size ||
+            !memchr(strings + sym.st_name, '\0',
+                    strtab->sh_size - sym.st_name)) {
+          continue;
+        }
+        uint64_t address = sym.st_value;
+        // The lowest bit of Thumb function addresses is set.
+        if (ehdr->e_machine == EM_ARM)
+          address &= ~uint64_t{1};
+        functions_.push_back({address, sym.st_size, strings + sym.st_name});
+      }
+    }
+  }
+  // Of the aliases of a function, keep the one with the largest size.
+  std::sort(functions_.begin(), functions_.end(),
+            [](const Function& a, const Function& b) {
+              if (a.address != b.address)
+                return a.address < b.address;
+              return a.size > b.size;
+            });
+  functions_.erase(std::unique(functions_.begin(), functions_.end(),
+                               [](const Function& a, const Function& b) {
+                                 return a.address == b.address;
+                               }),
+                   functions_.end());
+
+  if (debug_sections.debug_line)
+    line_table_ = DwarfLineTable::Parse(debug_sections);
+  return true;
+}
+
+std::vector<SymbolizedFrame> ElfSymbolTable::Symbolize(
+    uint64_t address) const {
+  std::vector<SymbolizedFrame> result;
+  auto it = std::upper_bound(
+      functions_.begin(), functions_.end(), address,
+      [](uint64_t addr, const Function& f) { return addr < f.address; });
+  if (it == functions_.begin())
+    return result;
+  --it;
+  // Symbols without a size (e.g. from assembly) extend to the next one.
+  if (it->size && address - it->address >= it->size)
+    return result;
+
+  SymbolizedFrame frame;
+  std::unique_ptr<char, base::FreeDeleter> demangled =
+      trace_processor::demangle::Demangle(it->name);
+  frame.function_name = demangled ? demangled.get() : it->name;
+  if (!line_table_.Lookup(address, &frame.file_name, &frame.line)) {
+    frame.file_name = "";
+    frame.line = 0;
+  }
+  result.emplace_back(std::move(frame));
+  return result;
+}
+
+ElfSymbolizer::ElfSymbolizer(std::unique_ptr<BinaryFinder> finder)
+    : finder_(std::move(finder)) {}
+
+ElfSymbolizer::~ElfSymbolizer() = default;
+
+std::vector<std::vector<SymbolizedFrame>> ElfSymbolizer::Symbolize(
+    const std::string& mapping_name,
+    const std::string& build_id,
+    uint64_t load_bias,
+    const std::vector<uint64_t>& addresses) {
+  SymbolizeRequest request;
+  request.mapping_name = mapping_name;
+  request.build_id = build_id;
+  request.load_bias = load_bias;
+  request.addresses = addresses;
+  return std::move(SymbolizeBatch({std::move(request)})[0]);
+}
+
+std::vector<std::vector<std::vector<SymbolizedFrame>>>
+ElfSymbolizer::SymbolizeBatch(const std::vector<SymbolizeRequest>& requests) {
+  std::vector<std::vector<std::vector<SymbolizedFrame>>> result(
+      requests.size());
+
+  std::vector<std::optional<FoundBinary>> found(requests.size());
+  std::vector<std::string> to_load;
+  for (size_t i = 0; i < requests.size(); i++) {
+    found[i] =
+        finder_->FindBinary(requests[i].mapping_name, requests[i].build_id);
+    if (found[i] && binaries_.count(found[i]->file_name) == 0) {
+      binaries_[found[i]->file_name] = nullptr;
+      to_load.push_back(found[i]->file_name);
+    }
+  }
+
+  // Parsing the line tables dominates, and is independent for each binary.
+  std::vector<std::unique_ptr<ElfSymbolTable>> loaded(to_load.size());
+  std::atomic<size_t> next{0};
+  auto load = [&] {
+    for (size_t i = next++; i < to_load.size(); i = next++)
+      loaded[i] = ElfSymbolTable::Open(to_load[i]);
+  };
+  size_t num_threads = std::min<size_t>(
+      {to_load.size(), kMaxLoaderThreads,
+       std::max(std::thread::hardware_concurrency(), 1u)});
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < num_threads; i++)
+    threads.emplace_back(load);
+  load();
+  for (std::thread& thread : threads)
+    thread.join();
+  for (size_t i = 0; i < to_load.size(); i++)
+    binaries_[to_load[i]] = std::move(loaded[i]);
+
+  for (size_t i = 0; i < requests.size(); i++) {
+    if (!found[i])
+      continue;
+    const ElfSymbolTable* binary = binaries_[found[i]->file_name].get();
+    if (!binary)
+      continue;
+    const SymbolizeRequest& request = requests[i];
+    uint64_t load_bias_correction = 0;
+    if (found[i]->load_bias > request.load_bias) {
+      // See LocalSymbolizer::Symbolize().
+      load_bias_correction = found[i]->load_bias - request.load_bias;
+      PERFETTO_LOG("Correcting load bias by %" PRIu64 " for %s",
+                   load_bias_correction, request.mapping_name.c_str());
+    }
+    result[i].reserve(request.addresses.size());
+    for (uint64_t address : request.addresses)
+      result[i].emplace_back(binary->Symbolize(address + load_bias_correction));
+  }
+  return result;
+}
+
+}  // namespace profiling
+}  // namespace perfetto
+
+#endif  // PERFETTO_BUILDFLAG(PERFETTO_LOCAL_SYMBOLIZER)
@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_PROFILING_SYMBOLIZER_ELF_SYMBOLIZER_H_
+#define SRC_PROFILING_SYMBOLIZER_ELF_SYMBOLIZER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "src/profiling/symbolizer/dwarf_line_table.h"
+#include "src/profiling/symbolizer/local_symbolizer.h"
+#include "src/profiling/symbolizer/scoped_read_mmap.h"
+#include "src/profiling/symbolizer/symbolizer.h"
+
+namespace perfetto {
+namespace profiling {
+
+// The symbols of an ELF file: its functions, from .symtab or .dynsym, and its
+// line table, from .debug_line. The file stays mapped while this is alive, as
+// function names point into it.
+class ElfSymbolTable {
+ public:
+  // Returns nullptr if |file_name| is not a valid ELF file.
+  static std::unique_ptr<ElfSymbolTable> Open(const std::string& file_name);
+  ~ElfSymbolTable();
+
+  // Returns the frame of the virtual address |address|, or an empty vector if
+  // it is not in a known function. Inlined functions are not reported.
+  std::vector<SymbolizedFrame> Symbolize(uint64_t address) const;
+
+  size_t num_functions() const { return functions_.size(); }
+  const DwarfLineTable& line_table() const { return line_table_; }
+
+ private:
+  struct Function {
+    uint64_t address;
+    uint64_t size;
+    const char* name;
+  };
+
+  explicit ElfSymbolTable(std::unique_ptr<ScopedReadMmap> map);
+  template <typename E>
+  bool Parse(size_t size);
+
+  std::unique_ptr<ScopedReadMmap> map_;
+  // Sorted by address.
+  std::vector<Function> functions_;
+  DwarfLineTable line_table_;
+};
+
+// Symbolizer which reads the symbols and line tables of the binaries itself,
+// instead of going through llvm-symbolizer. This saves a round-trip to a
+// subprocess per address, at the cost of not reporting inlined frames.
+class ElfSymbolizer : public Symbolizer {
+ public:
+  explicit ElfSymbolizer(std::unique_ptr<BinaryFinder> finder);
+  ~ElfSymbolizer() override;
+
+  std::vector<std::vector<SymbolizedFrame>> Symbolize(
+      const std::string& mapping_name,
+      const std::string& build_id,
+      uint64_t load_bias,
+      const std::vector<uint64_t>& address) override;
+
+  // Loads the binaries of the requests in parallel, on up to
+  // kMaxLoaderThreads threads.
+  std::vector<std::vector<std::vector<SymbolizedFrame>>> SymbolizeBatch(
+      const std::vector<SymbolizeRequest>& requests) override;
+
+  bool BuildIdNeedsHexConversion() override { return true; }
+
+  static constexpr size_t kMaxLoaderThreads = 8;
+
+ private:
+  std::unique_ptr<BinaryFinder> finder_;
+  // Binaries are kept loaded, as a trace usually has several mappings of the
+  // same file. nullptr if the file could not be loaded.
+  std::map<std::string, std::unique_ptr<ElfSymbolTable>> binaries_;
+};
+
+}  // namespace profiling
+}  // namespace perfetto
+
+#endif  // SRC_PROFILING_SYMBOLIZER_ELF_SYMBOLIZER_H_
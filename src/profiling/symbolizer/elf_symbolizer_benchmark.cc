@@ -0,0 +1,105 @@
+// Copyright (C) 2023 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <benchmark/benchmark.h>
+
+#include "perfetto/base/build_config.h"
+
+// Symbolizes this benchmark binary, which must be an ELF file.
+#if PERFETTO_BUILDFLAG(PERFETTO_LOCAL_SYMBOLIZER) && \
+    PERFETTO_BUILDFLAG(PERFETTO_OS_LINUX)
+
+#include <link.h>
+
+#include "perfetto/ext/base/utils.h"
+#include "src/profiling/symbolizer/elf_symbolizer.h"
+#include "src/profiling/symbolizer/local_symbolizer.h"
+
+namespace perfetto {
+namespace profiling {
+namespace {
+
+class SelfBinaryFinder : public BinaryFinder {
+ public:
+  std::optional<FoundBinary> FindBinary(const std::string&,
+                                        const std::string&) override {
+    // Not /proc/self/exe, which would be llvm-symbolizer itself for it.
+    return FoundBinary{base::GetCurExecutablePath(), 0};
+  }
+};
+
+// Virtual addresses of functions of this binary, as in a profile.
+std::vector<uint64_t> GetAddresses(size_t count) {
+  uint64_t load_bias = 0;
+  dl_iterate_phdr(
+      [](struct dl_phdr_info* info, size_t, void* data) {
+        *static_cast<uint64_t*>(data) = info->dlpi_addr;
+        return 1;
+      },
+      &load_bias);
+  std::vector<uint64_t> addresses;
+  const void* functions[] = {
+      reinterpret_cast<const void*>(&GetAddresses),
+      reinterpret_cast<const void*>(&ElfSymbolTable::Open),
+      reinterpret_cast<const void*>(&DwarfLineTable::Parse),
+      reinterpret_cast<const void*>(&benchmark::Initialize),
+  };
+  for (size_t i = 0; i < count; i++) {
+    const void* function = functions[i % base::ArraySize(functions)];
+    addresses.push_back(reinterpret_cast<uint64_t>(function) - load_bias +
+                        (i / base::ArraySize(functions)) % 64);
+  }
+  return addresses;
+}
+
+void BM_Symbolize(benchmark::State& state, Symbolizer* symbolizer) {
+  std::vector<uint64_t> addresses =
+      GetAddresses(static_cast<size_t>(state.range(0)));
+  // Exclude loading the binary.
+  symbolizer->Symbolize("self", "", 0, {addresses[0]});
+  for (auto _ : state)
+    benchmark::DoNotOptimize(symbolizer->Symbolize("self", "", 0, addresses));
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          state.range(0));
+}
+
+void BM_ElfSymbolizer(benchmark::State& state) {
+  ElfSymbolizer symbolizer(
+      std::unique_ptr<BinaryFinder>(new SelfBinaryFinder()));
+  BM_Symbolize(state, &symbolizer);
+}
+
+// Requires llvm-symbolizer in the PATH.
+void BM_LlvmSymbolizer(benchmark::State& state) {
+  LocalSymbolizer symbolizer(
+      std::unique_ptr<BinaryFinder>(new SelfBinaryFinder()));
+  BM_Symbolize(state, &symbolizer);
+}
+
+void BM_ElfSymbolTableOpen(benchmark::State& state) {
+  for (auto _ : state)
+    benchmark::DoNotOptimize(
+        ElfSymbolTable::Open(base::GetCurExecutablePath()));
+}
+
+}  // namespace
+
+BENCHMARK(BM_ElfSymbolizer)->Arg(1024);
+BENCHMARK(BM_LlvmSymbolizer)->Arg(1024);
+BENCHMARK(BM_ElfSymbolTableOpen);
+
+}  // namespace profiling
+}  // namespace perfetto
+
+#endif
@@ -0,0 +1,410 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "perfetto/base/build_config.h"
+#include "test/gtest_and_gmock.h"
+
+// This translation unit is built only on Linux and MacOS. See //gn/BUILD.gn.
+#if PERFETTO_BUILDFLAG(PERFETTO_LOCAL_SYMBOLIZER)
+
+#include <string.h>
+
+#include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/temp_file.h"
+#include "src/profiling/symbolizer/dwarf_line_table.h"
+#include "src/profiling/symbolizer/elf_symbolizer.h"
+
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_LINUX)
+#include <link.h>
+#endif
+
+namespace perfetto {
+namespace profiling {
+namespace {
+
+using ::testing::EndsWith;
+using ::testing::HasSubstr;
+using ::testing::IsEmpty;
+using ::testing::SizeIs;
+
+class DebugLineBuilder {
+ public:
+  template <typename T>
+  void Append(T value) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+    data_.insert(data_.end(), bytes, bytes + sizeof(T));
+  }
+  void AppendBytes(std::vector<uint8_t> bytes) {
+    data_.insert(data_.end(), bytes.begin(), bytes.end());
+  }
+  void AppendString(const std::string& str) {
+    data_.insert(data_.end(), str.begin(), str.end());
+    data_.push_back('\0');
+  }
+  // Reserves a 32-bit length, patched by EndLength() with the size of the
+  // data appended in between.
+  size_t BeginLength() {
+    Append(uint32_t{0});
+    return data_.size();
+  }
+  void EndLength(size_t start) {
+    uint32_t length = static_cast<uint32_t>(data_.size() - start);
+    memcpy(&data_[start - sizeof(length)], &length, sizeof(length));
+  }
+  void AppendStandardOpcodeLengths() {
+    AppendBytes({13 /* opcode_base */, 0, 1, 1, 1, 1, 0, 0, 0, 1, 0, 0, 1});
+  }
+  void AppendSetAddress(uint64_t address) {
+    AppendBytes({0, 9, 2});
+    Append(address);
+  }
+  void AppendEndSequence() { AppendBytes({0, 1, 1}); }
+  // Appends a ULEB128 that does not fit in 64 bits.
+  void AppendHugeUleb128() {
+    AppendBytes({0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x01});
+  }
+
+  const std::vector<uint8_t>& data() const { return data_; }
+
+  DwarfLineTable Parse() {
+    DwarfLineTable::Sections sections;
+    sections.debug_line = data_.data();
+    sections.debug_line_size = data_.size();
+    return DwarfLineTable::Parse(sections);
+  }
+
+ private:
+  std::vector<uint8_t> data_;
+};
+
+// Header fields common to all versions, after header_length.
+void AppendLineProgramParameters(DebugLineBuilder* builder, uint16_t version) {
+  builder->AppendBytes({1 /* minimum_instruction_length */});
+  if (version >= 4)
+    builder->AppendBytes({1 /* maximum_operations_per_instruction */});
+  builder->AppendBytes({1 /* default_is_stmt */, static_cast<uint8_t>(-5),
+                        14 /* line_range */});
+  builder->AppendStandardOpcodeLengths();
+}
+
+TEST(DwarfLineTableTest, Version4) {
+  DebugLineBuilder builder;
+  size_t unit = builder.BeginLength();
+  builder.Append(uint16_t{4});
+  size_t header = builder.BeginLength();
+  AppendLineProgramParameters(&builder, 4);
+  builder.AppendString("src");
+  builder.AppendString("");
+  builder.AppendString("a.cc");
+  builder.AppendBytes({1 /* dir */, 0 /* mtime */, 0 /* length */});
+  builder.AppendString("/abs/b.h");
+  builder.AppendBytes({1, 0, 0});
+  builder.AppendString("");
+  builder.EndLength(header);
+
+  builder.AppendSetAddress(0x1000);
+  builder.AppendBytes({3 /* advance_line */, 9, 1 /* copy */});
+  // Special opcode: address += 4, line += 1.
+  builder.AppendBytes({13 + 4 * 14 + (1 + 5)});
+  builder.AppendBytes({4 /* set_file */, 2, 1 /* copy */});
+  builder.AppendBytes({2 /* advance_pc */, 8});
+  builder.AppendEndSequence();
+  // Sequences of functions removed by the linker are ignored.
+  builder.AppendSetAddress(0);
+  builder.AppendBytes({1, 2, 8});
+  builder.AppendEndSequence();
+  builder.EndLength(unit);
+
+  DwarfLineTable table = builder.Parse();
+  EXPECT_EQ(table.num_rows(), 3u);
+  std::string file;
+  uint32_t line;
+  ASSERT_TRUE(table.Lookup(0x1003, &file, &line));
+  EXPECT_EQ(file, "src/a.cc");
+  EXPECT_EQ(line, 10u);
+  ASSERT_TRUE(table.Lookup(0x1004, &file, &line));
+  EXPECT_EQ(file, "/abs/b.h");
+  EXPECT_EQ(line, 11u);
+  ASSERT_TRUE(table.Lookup(0x100b, &file, &line));
+  EXPECT_EQ(line, 11u);
+  EXPECT_FALSE(table.Lookup(0x100c, &file, &line));
+  EXPECT_FALSE(table.Lookup(0xfff, &file, &line));
+  EXPECT_FALSE(table.Lookup(0x4, &file, &line));
+}
+
+TEST(DwarfLineTableTest, UnsortedSequence) {
+  DebugLineBuilder builder;
+  size_t unit = builder.BeginLength();
+  builder.Append(uint16_t{4});
+  size_t header = builder.BeginLength();
+  AppendLineProgramParameters(&builder, 4);
+  builder.AppendString("");
+  builder.AppendString("a.cc");
+  builder.AppendBytes({0 /* dir */, 0 /* mtime */, 0 /* length */});
+  builder.AppendString("");
+  builder.EndLength(header);
+
+  // The first row of the sequence isn't the one with the lowest address.
+  builder.AppendSetAddress(0x1010);
+  builder.AppendBytes({3 /* advance_line */, 9, 1 /* copy */});
+  builder.AppendSetAddress(0x1000);
+  builder.AppendBytes({3 /* advance_line */, 10, 1 /* copy */});
+  builder.AppendSetAddress(0x1020);
+  builder.AppendEndSequence();
+  builder.EndLength(unit);
+
+  DwarfLineTable table = builder.Parse();
+  std::string file;
+  uint32_t line;
+  ASSERT_TRUE(table.Lookup(0x1004, &file, &line));
+  EXPECT_EQ(file, "a.cc");
+  EXPECT_EQ(line, 20u);
+  ASSERT_TRUE(table.Lookup(0x1014, &file, &line));
+  EXPECT_EQ(line, 10u);
+  EXPECT_FALSE(table.Lookup(0xfff, &file, &line));
+}
+
+TEST(DwarfLineTableTest, Version5) {
+  DebugLineBuilder builder;
+  size_t unit = builder.BeginLength();
+  builder.Append(uint16_t{5});
+  builder.AppendBytes({8 /* address_size */, 0 /* segment_selector_size */});
+  size_t header = builder.BeginLength();
+  AppendLineProgramParameters(&builder, 5);
+  // Directories: DW_LNCT_path as DW_FORM_string.
+  builder.AppendBytes({1, 1, 0x08, 1});
+  builder.AppendString("/root");
+  // Files: DW_LNCT_path as DW_FORM_string, DW_LNCT_directory_index as
+  // DW_FORM_data1.
+  builder.AppendBytes({2, 1, 0x08, 2, 0x0b, 1});
+  builder.AppendString("b.cc");
+  builder.AppendBytes({0});
+  builder.EndLength(header);
+
+  builder.AppendSetAddress(0x2000);
+  builder.AppendBytes({4 /* set_file */, 0, 3 /* advance_line */, 4, 1});
+  builder.AppendBytes({2 /* advance_pc */, 2});
+  builder.AppendEndSequence();
+  builder.EndLength(unit);
+
+  // A truncated unit after a valid one.
+  builder.AppendBytes({0xff, 0, 0, 0, 5, 0});
+
+  DwarfLineTable table = builder.Parse();
+  std::string file;
+  uint32_t line;
+  ASSERT_TRUE(table.Lookup(0x2001, &file, &line));
+  EXPECT_EQ(file, "/root/b.cc");
+  EXPECT_EQ(line, 5u);
+  EXPECT_FALSE(table.Lookup(0x2002, &file, &line));
+}
+
+DwarfLineTable ParseDebugLine(const std::vector<uint8_t>& debug_line) {
+  DwarfLineTable::Sections sections;
+  sections.debug_line = debug_line.data();
+  sections.debug_line_size = debug_line.size();
+  return DwarfLineTable::Parse(sections);
+}
+
+// A DWARF 5 unit with one directory, whose entry |format| (pairs of content
+// type and form) and count are given. The count is either 100 or too large for
+// 64 bits.
+DebugLineBuilder Version5WithDirectories(std::vector<uint8_t> format,
+                                         bool huge_count) {
+  DebugLineBuilder builder;
+  size_t unit = builder.BeginLength();
+  builder.Append(uint16_t{5});
+  builder.AppendBytes({8 /* address_size */, 0 /* segment_selector_size */});
+  size_t header = builder.BeginLength();
+  AppendLineProgramParameters(&builder, 5);
+  builder.AppendBytes({static_cast<uint8_t>(format.size() / 2)});
+  builder.AppendBytes(format);
+  if (huge_count)
+    builder.AppendHugeUleb128();
+  else
+    builder.AppendBytes({100});
+  builder.AppendString("/root");
+  builder.AppendBytes({0 /* file_name_entry_format_count */, 0});
+  builder.EndLength(header);
+  builder.AppendSetAddress(0x2000);
+  builder.AppendBytes({1 /* copy */, 2 /* advance_pc */, 2});
+  builder.AppendEndSequence();
+  builder.EndLength(unit);
+  return builder;
+}
+
+TEST(DwarfLineTableTest, Version5EmptyEntryFormat) {
+  // No fields per entry, so the entries take no space.
+  DwarfLineTable table =
+      Version5WithDirectories(/*format=*/{}, /*huge_count=*/true).Parse();
+  EXPECT_EQ(table.num_rows(), 0u);
+}
+
+TEST(DwarfLineTableTest, Version5EntryCountPastHeader) {
+  // DW_LNCT_path as DW_FORM_string.
+  EXPECT_EQ(Version5WithDirectories({1, 0x08}, /*huge_count=*/true)
+                .Parse()
+                .num_rows(),
+            0u);
+  EXPECT_EQ(Version5WithDirectories({1, 0x08}, /*huge_count=*/false)
+                .Parse()
+                .num_rows(),
+            0u);
+}
+
+// Units cut at every byte, with a consistent unit length, fail to parse
+// without reading out of bounds.
+TEST(DwarfLineTableTest, TruncatedUnits) {
+  for (uint16_t version : {uint16_t{4}, uint16_t{5}}) {
+    DebugLineBuilder builder;
+    builder.Append(version);
+    if (version >= 5)
+      builder.AppendBytes({8, 0});
+    size_t header = builder.BeginLength();
+    AppendLineProgramParameters(&builder, version);
+    if (version >= 5) {
+      builder.AppendBytes({1, 1, 0x08, 1});
+      builder.AppendString("/root");
+      builder.AppendBytes({2, 1, 0x08, 2, 0x0b, 1});
+      builder.AppendString("b.cc");
+      builder.AppendBytes({0});
+    } else {
+      builder.AppendString("src");
+      builder.AppendString("");
+      builder.AppendString("a.cc");
+      builder.AppendBytes({1, 0, 0});
+      builder.AppendString("");
+    }
+    builder.EndLength(header);
+    builder.AppendSetAddress(0x1000);
+    builder.AppendBytes({3 /* advance_line */, 9, 1 /* copy */});
+    builder.AppendBytes({2 /* advance_pc */, 8});
+    builder.AppendEndSequence();
+    const std::vector<uint8_t>& body = builder.data();
+
+    for (size_t size = 0; size <= body.size(); size++) {
+      std::vector<uint8_t> unit(sizeof(uint32_t));
+      uint32_t length = static_cast<uint32_t>(size);
+      memcpy(unit.data(), &length, sizeof(length));
+      unit.insert(unit.end(), body.begin(),
+                  body.begin() + static_cast<ptrdiff_t>(size));
+      DwarfLineTable table = ParseDebugLine(unit);
+      std::string file;
+      uint32_t line;
+      if (size < body.size()) {
+        EXPECT_EQ(table.num_rows(), 0u) << "version " << version << ", size "
+                                        << size;
+        EXPECT_FALSE(table.Lookup(0x1000, &file, &line));
+      } else {
+        EXPECT_EQ(table.num_rows(), 1u);
+        EXPECT_TRUE(table.Lookup(0x1000, &file, &line));
+      }
+    }
+  }
+}
+
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_LINUX)
+
+void __attribute__((noinline)) ElfSymbolizerTestFunction() {
+  asm volatile("");
+}
+
+// Returns the virtual address of |ptr| in the main executable.
+uint64_t GetVirtualAddress(const void* ptr) {
+  uint64_t load_bias = 0;
+  dl_iterate_phdr(
+      [](struct dl_phdr_info* info, size_t, void* data) {
+        *static_cast<uint64_t*>(data) = info->dlpi_addr;
+        return 1;  // The first object is the main executable.
+      },
+      &load_bias);
+  return reinterpret_cast<uint64_t>(ptr) - load_bias;
+}
+
+TEST(ElfSymbolTableTest, SymbolizeSelf) {
+  std::unique_ptr<ElfSymbolTable> table =
+      ElfSymbolTable::Open("/proc/self/exe");
+  ASSERT_TRUE(table);
+  if (table->num_functions() == 0)
+    GTEST_SKIP() << "Test binary is stripped";
+
+  uint64_t address = GetVirtualAddress(
+      reinterpret_cast<const void*>(&ElfSymbolizerTestFunction));
+  std::vector<SymbolizedFrame> frames = table->Symbolize(address);
+  ASSERT_THAT(frames, SizeIs(1));
+  EXPECT_THAT(frames[0].function_name, HasSubstr("ElfSymbolizerTestFunction"));
+  if (table->line_table().num_rows() > 0) {
+    EXPECT_THAT(frames[0].file_name, EndsWith("elf_symbolizer_unittest.cc"));
+    EXPECT_GT(frames[0].line, 0u);
+  }
+  EXPECT_THAT(table->Symbolize(0), IsEmpty());
+}
+
+// Prefixes of a valid ELF file are rejected or loaded without reading past
+// their end.
+TEST(ElfSymbolTableTest, TruncatedFile) {
+  std::string exe;
+  ASSERT_TRUE(base::ReadFile("/proc/self/exe", &exe));
+  for (size_t size : {size_t{0}, size_t{4}, size_t{16}, size_t{64},
+                      size_t{4096}, exe.size() / 2, exe.size() - 1}) {
+    base::TempFile file = base::TempFile::Create();
+    ASSERT_TRUE(base::WriteAll(file.fd(), exe.data(), size) ==
+                static_cast<ssize_t>(size));
+    std::unique_ptr<ElfSymbolTable> table = ElfSymbolTable::Open(file.path());
+    if (table)
+      table->Symbolize(0x1000);
+  }
+}
+
+class FixedBinaryFinder : public BinaryFinder {
+ public:
+  std::optional<FoundBinary> FindBinary(const std::string& abspath,
+                                        const std::string&) override {
+    if (abspath != "self")
+      return std::nullopt;
+    return FoundBinary{"/proc/self/exe", 0};
+  }
+};
+
+TEST(ElfSymbolizerTest, SymbolizeBatch) {
+  ElfSymbolizer symbolizer(
+      std::unique_ptr<BinaryFinder>(new FixedBinaryFinder()));
+  uint64_t address = GetVirtualAddress(
+      reinterpret_cast<const void*>(&ElfSymbolizerTestFunction));
+  SymbolizeRequest self;
+  self.mapping_name = "self";
+  self.addresses = {address, 0};
+  SymbolizeRequest missing;
+  missing.mapping_name = "missing";
+  missing.addresses = {address};
+  auto result = symbolizer.SymbolizeBatch({self, missing});
+  ASSERT_THAT(result, SizeIs(2));
+  ASSERT_THAT(result[0], SizeIs(2));
+  if (!result[0][0].empty()) {
+    EXPECT_THAT(result[0][0][0].function_name,
+                HasSubstr("ElfSymbolizerTestFunction"));
+  }
+  EXPECT_THAT(result[0][1], IsEmpty());
+  EXPECT_THAT(result[1], IsEmpty());
+}
+
+#endif  // PERFETTO_BUILDFLAG(PERFETTO_OS_LINUX)
+
+}  // namespace
+}  // namespace profiling
+}  // namespace perfetto
+
+#endif  // PERFETTO_BUILDFLAG(PERFETTO_LOCAL_SYMBOLIZER)
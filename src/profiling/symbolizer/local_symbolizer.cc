@@ -18,11 +18,14 @@
 
 #include <fcntl.h>
 
+#include <algorithm>
+#include <atomic>
 #include <cinttypes>
 #include <memory>
 #include <optional>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "perfetto/base/build_config.h"
@@ -32,6 +35,7 @@
 #include "perfetto/ext/base/scoped_file.h"
 #include "perfetto/ext/base/string_utils.h"
 #include "src/profiling/symbolizer/elf.h"
+#include "src/profiling/symbolizer/elf_symbolizer.h"
 #include "src/profiling/symbolizer/filesystem.h"
 #include "src/profiling/symbolizer/scoped_read_mmap.h"
 
@@ -42,7 +46,8 @@ namespace profiling {
 // dies, which isn't the case.
 std::unique_ptr<Symbolizer> LocalSymbolizerOrDie(
     std::vector<std::string> binary_path,
-    const char* mode) {
+    const char* mode,
+    const char* backend) {
   std::unique_ptr<Symbolizer> symbolizer;
 
   if (!binary_path.empty()) {
@@ -54,9 +59,15 @@ std::unique_ptr<Symbolizer> LocalSymbolizerOrDie(
       finder.reset(new LocalBinaryIndexer(std::move(binary_path)));
     else
       PERFETTO_FATAL("Invalid symbolizer mode [find | index]: %s", mode);
-    symbolizer.reset(new LocalSymbolizer(std::move(finder)));
+    if (!backend || strcmp(backend, "llvm") == 0)
+      symbolizer.reset(new LocalSymbolizer(std::move(finder)));
+    else if (strcmp(backend, "native") == 0)
+      symbolizer.reset(new ElfSymbolizer(std::move(finder)));
+    else
+      PERFETTO_FATAL("Invalid symbolizer backend [llvm | native]: %s", backend);
 #else
     base::ignore_result(mode);
+    base::ignore_result(backend);
     PERFETTO_FATAL("This build does not support local symbolization.");
 #endif
   }
@@ -529,9 +540,71 @@ std::vector<std::vector<SymbolizedFrame>> LocalSymbolizer::Symbolize(
   return result;
 }
 
+std::vector<std::vector<std::vector<SymbolizedFrame>>>
+LocalSymbolizer::SymbolizeBatch(const std::vector<SymbolizeRequest>& requests) {
+  std::vector<std::vector<std::vector<SymbolizedFrame>>> result(
+      requests.size());
+
+  // Binaries are looked up upfront, as finders are not thread safe.
+  struct Job {
+    size_t request_idx;
+    std::string binary;
+    uint64_t load_bias_correction;
+  };
+  std::vector<Job> jobs;
+  for (size_t i = 0; i < requests.size(); i++) {
+    const SymbolizeRequest& request = requests[i];
+    std::optional<FoundBinary> binary =
+        finder_->FindBinary(request.mapping_name, request.build_id);
+    if (!binary)
+      continue;
+    uint64_t load_bias_correction = 0;
+    if (binary->load_bias > request.load_bias) {
+      // See Symbolize().
+      load_bias_correction = binary->load_bias - request.load_bias;
+      PERFETTO_LOG("Correcting load bias by %" PRIu64 " for %s",
+                   load_bias_correction, request.mapping_name.c_str());
+    }
+    jobs.push_back({i, std::move(binary->file_name), load_bias_correction});
+  }
+  if (jobs.empty())
+    return result;
+
+  size_t num_processes = std::min<size_t>(
+      {jobs.size(), kMaxSymbolizerProcesses,
+       std::max(std::thread::hardware_concurrency(), 1u)});
+  while (extra_symbolizers_.size() + 1 < num_processes) {
+    extra_symbolizers_.emplace_back(
+        new LLVMSymbolizerProcess(symbolizer_path_));
+  }
+
+  std::atomic<size_t> next_job{0};
+  auto run = [&](LLVMSymbolizerProcess* process) {
+    for (size_t j = next_job++; j < jobs.size(); j = next_job++) {
+      const Job& job = jobs[j];
+      const SymbolizeRequest& request = requests[job.request_idx];
+      auto& frames = result[job.request_idx];
+      frames.reserve(request.addresses.size());
+      for (uint64_t address : request.addresses) {
+        frames.emplace_back(process->Symbolize(
+            job.binary, address + job.load_bias_correction));
+      }
+    }
+  };
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i + 1 < num_processes; i++)
+    threads.emplace_back(run, extra_symbolizers_[i].get());
+  run(&llvm_symbolizer_);
+  for (std::thread& thread : threads)
+    thread.join();
+  return result;
+}
+
 LocalSymbolizer::LocalSymbolizer(const std::string& symbolizer_path,
                                  std::unique_ptr<BinaryFinder> finder)
-    : llvm_symbolizer_(symbolizer_path), finder_(std::move(finder)) {}
+    : symbolizer_path_(symbolizer_path),
+      llvm_symbolizer_(symbolizer_path),
+      finder_(std::move(finder)) {}
 
 LocalSymbolizer::LocalSymbolizer(std::unique_ptr<BinaryFinder> finder)
     : LocalSymbolizer(kDefaultSymbolizer, std::move(finder)) {}
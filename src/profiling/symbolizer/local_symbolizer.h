@@ -108,18 +108,33 @@ class LocalSymbolizer : public Symbolizer {
       uint64_t load_bias,
       const std::vector<uint64_t>& address) override;
 
+  // Symbolizes the requests in parallel, using up to
+  // kMaxSymbolizerProcesses llvm-symbolizer processes. Each process handles
+  // whole requests, so that it only loads the binaries it needs.
+  std::vector<std::vector<std::vector<SymbolizedFrame>>> SymbolizeBatch(
+      const std::vector<SymbolizeRequest>& requests) override;
+
   bool BuildIdNeedsHexConversion() override { return true; }
 
   ~LocalSymbolizer() override;
 
+  static constexpr size_t kMaxSymbolizerProcesses = 8;
+
  private:
+  const std::string symbolizer_path_;
   LLVMSymbolizerProcess llvm_symbolizer_;
+  // Additional processes used by SymbolizeBatch(), spawned on demand.
+  std::vector<std::unique_ptr<LLVMSymbolizerProcess>> extra_symbolizers_;
   std::unique_ptr<BinaryFinder> finder_;
 };
 
+// |mode| selects how binaries are found ("find" or "index"), and |backend|
+// how they are symbolized: "llvm" (the default) through llvm-symbolizer,
+// "native" with ElfSymbolizer.
 std::unique_ptr<Symbolizer> LocalSymbolizerOrDie(
     std::vector<std::string> binary_path,
-    const char* mode);
+    const char* mode,
+    const char* backend);
 
 }  // namespace profiling
 }  // namespace perfetto
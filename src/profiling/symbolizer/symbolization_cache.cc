@@ -0,0 +1,466 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/profiling/symbolizer/symbolization_cache.h"
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <unordered_map>
+#include <utility>
+
+#include "perfetto/base/logging.h"
+#include "perfetto/base/proc_utils.h"
+#include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/scoped_file.h"
+
+namespace perfetto {
+namespace profiling {
+
+// File layout, in native byte order:
+// [Header] [Entry x num_entries] [Frame x num_frames] [strings]
+// Entries are sorted by (build id, load bias, address). Each entry refers to
+// a contiguous range of frames, and strings are referred to by their offset
+// and size in the string table.
+struct SymbolizationCache::Header {
+  char magic[8];
+  uint32_t num_entries;
+  uint32_t num_frames;
+  uint64_t strings_size;
+  uint64_t file_size;
+};
+
+struct SymbolizationCache::Entry {
+  uint64_t load_bias;
+  uint64_t address;
+  uint32_t build_id;
+  uint32_t build_id_size;
+  uint32_t first_frame;
+  uint32_t num_frames;
+};
+
+struct SymbolizationCache::Frame {
+  uint32_t function_name;
+  uint32_t function_name_size;
+  uint32_t file_name;
+  uint32_t file_name_size;
+  uint32_t line;
+};
+
+namespace {
+
+// Bumped whenever the layout changes; older files are then ignored.
+constexpr char kMagic[8] = {'P', 'F', 'S', 'Y', 'M', 'C', '0', '1'};
+
+int CompareKey(const std::string& a_build_id,
+               uint64_t a_load_bias,
+               uint64_t a_address,
+               const std::string& b_build_id,
+               uint64_t b_load_bias,
+               uint64_t b_address) {
+  int cmp = a_build_id.compare(b_build_id);
+  if (cmp)
+    return cmp;
+  if (a_load_bias != b_load_bias)
+    return a_load_bias < b_load_bias ? -1 : 1;
+  if (a_address != b_address)
+    return a_address < b_address ? -1 : 1;
+  return 0;
+}
+
+// Accumulates the tables of a new cache file.
+class TableBuilder {
+ public:
+  template <typename Entry, typename Frame>
+  void Add(const std::string& build_id,
+           uint64_t load_bias,
+           uint64_t address,
+           const std::vector<SymbolizedFrame>& frames,
+           std::vector<Entry>* entries,
+           std::vector<Frame>* out_frames) {
+    Entry entry{};
+    entry.load_bias = load_bias;
+    entry.address = address;
+    std::tie(entry.build_id, entry.build_id_size) = AddString(build_id);
+    entry.first_frame = static_cast<uint32_t>(out_frames->size());
+    entry.num_frames = static_cast<uint32_t>(frames.size());
+    for (const SymbolizedFrame& frame : frames) {
+      Frame f{};
+      std::tie(f.function_name, f.function_name_size) =
+          AddString(frame.function_name);
+      std::tie(f.file_name, f.file_name_size) = AddString(frame.file_name);
+      f.line = frame.line;
+      out_frames->push_back(f);
+    }
+    entries->push_back(entry);
+  }
+
+  const std::string& strings() const { return strings_; }
+
+ private:
+  std::pair<uint32_t, uint32_t> AddString(const std::string& str) {
+    auto it_and_inserted =
+        offsets_.emplace(str, static_cast<uint32_t>(strings_.size()));
+    if (it_and_inserted.second)
+      strings_.append(str);
+    return {it_and_inserted.first->second, static_cast<uint32_t>(str.size())};
+  }
+
+  std::string strings_;
+  std::unordered_map<std::string, uint32_t> offsets_;
+};
+
+}  // namespace
+
+SymbolizationCache::SymbolizationCache(std::string path)
+    : path_(std::move(path)) {
+  static_assert(sizeof(Header) == 32, "Header size");
+  static_assert(sizeof(Entry) == 32, "Entry size");
+  static_assert(sizeof(Frame) == 20, "Frame size");
+  Map();
+}
+
+SymbolizationCache::~SymbolizationCache() = default;
+
+void SymbolizationCache::Map() {
+  size_t file_size;
+  // Scope file access. On windows OpenFile opens an exclusive lock, which
+  // needs to be released before mapping the file.
+  {
+    base::ScopedFile fd(base::OpenFile(path_, O_RDONLY));
+    if (!fd)
+      return;  // No cache yet.
+    struct stat buf {};
+    if (fstat(*fd, &buf) == -1 || buf.st_size < 0)
+      return;
+    file_size = static_cast<size_t>(buf.st_size);
+  }
+  if (file_size == 0)
+    return;
+  if (file_size < sizeof(Header)) {
+    PERFETTO_ELOG("Ignoring invalid symbolization cache %s", path_.c_str());
+    return;
+  }
+
+  std::unique_ptr<ScopedReadMmap> mmap(
+      new ScopedReadMmap(path_.c_str(), file_size));
+  if (!mmap->IsValid()) {
+    PERFETTO_ELOG("Failed to map symbolization cache %s", path_.c_str());
+    return;
+  }
+  const char* base = static_cast<const char*>(**mmap);
+
+  Header header;
+  memcpy(&header, base, sizeof(header));
+  uint64_t entries_size = uint64_t{header.num_entries} * sizeof(Entry);
+  uint64_t frames_size = uint64_t{header.num_frames} * sizeof(Frame);
+  if (memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+      header.file_size != file_size ||
+      sizeof(Header) + entries_size + frames_size + header.strings_size !=
+          file_size) {
+    PERFETTO_ELOG("Ignoring invalid symbolization cache %s", path_.c_str());
+    return;
+  }
+
+  // Lookups compare build ids in place, so validate them upfront.
+  const Entry* entries = reinterpret_cast<const Entry*>(base + sizeof(Header));
+  for (uint32_t i = 0; i < header.num_entries; i++) {
+    if (uint64_t{entries[i].build_id} + entries[i].build_id_size >
+        header.strings_size) {
+      PERFETTO_ELOG("Ignoring invalid symbolization cache %s", path_.c_str());
+      return;
+    }
+  }
+
+  entries_ = entries;
+  num_mapped_entries_ = header.num_entries;
+  frames_ = reinterpret_cast<const Frame*>(base + sizeof(Header) +
+                                           entries_size);
+  num_mapped_frames_ = header.num_frames;
+  strings_ = base + sizeof(Header) + entries_size + frames_size;
+  strings_size_ = static_cast<size_t>(header.strings_size);
+  mmap_ = std::move(mmap);
+}
+
+void SymbolizationCache::Unmap() {
+  entries_ = nullptr;
+  num_mapped_entries_ = 0;
+  frames_ = nullptr;
+  num_mapped_frames_ = 0;
+  strings_ = nullptr;
+  strings_size_ = 0;
+  mmap_.reset();
+}
+
+std::string SymbolizationCache::StringAt(uint32_t offset, uint32_t size) const {
+  if (uint64_t{offset} + size > strings_size_)
+    return "";
+  return std::string(strings_ + offset, size);
+}
+
+std::vector<SymbolizedFrame> SymbolizationCache::FramesOf(
+    const Entry& entry) const {
+  std::vector<SymbolizedFrame> frames;
+  if (uint64_t{entry.first_frame} + entry.num_frames > num_mapped_frames_)
+    return frames;
+  frames.reserve(entry.num_frames);
+  for (uint32_t i = 0; i < entry.num_frames; i++) {
+    const Frame& f = frames_[entry.first_frame + i];
+    SymbolizedFrame frame;
+    frame.function_name = StringAt(f.function_name, f.function_name_size);
+    frame.file_name = StringAt(f.file_name, f.file_name_size);
+    frame.line = f.line;
+    frames.emplace_back(std::move(frame));
+  }
+  return frames;
+}
+
+bool SymbolizationCache::Lookup(const std::string& build_id,
+                                uint64_t load_bias,
+                                uint64_t address,
+                                std::vector<SymbolizedFrame>* frames) {
+  auto it = new_entries_.find(Key(build_id, load_bias, address));
+  if (it != new_entries_.end()) {
+    hits_++;
+    *frames = it->second;
+    return true;
+  }
+
+  auto compare = [this](const Entry& entry, const Key& key) {
+    int cmp = memcmp(strings_ + entry.build_id, std::get<0>(key).data(),
+                     std::min<size_t>(entry.build_id_size,
+                                      std::get<0>(key).size()));
+    if (cmp)
+      return cmp < 0;
+    if (entry.build_id_size != std::get<0>(key).size())
+      return entry.build_id_size < std::get<0>(key).size();
+    return std::tie(entry.load_bias, entry.address) <
+           std::tie(std::get<1>(key), std::get<2>(key));
+  };
+  const Entry* end = entries_ + num_mapped_entries_;
+  Key key(build_id, load_bias, address);
+  const Entry* entry = std::lower_bound(entries_, end, key, compare);
+  if (entry == end || entry->load_bias != load_bias ||
+      entry->address != address ||
+      StringAt(entry->build_id, entry->build_id_size) != build_id) {
+    misses_++;
+    return false;
+  }
+  hits_++;
+  *frames = FramesOf(*entry);
+  return true;
+}
+
+void SymbolizationCache::Insert(const std::string& build_id,
+                                uint64_t load_bias,
+                                uint64_t address,
+                                std::vector<SymbolizedFrame> frames) {
+  if (frames.empty())
+    return;
+  new_entries_[Key(build_id, load_bias, address)] = std::move(frames);
+}
+
+bool SymbolizationCache::Write() {
+  if (new_entries_.empty())
+    return true;
+
+  // Pick up the entries that other processes wrote since the file was mapped.
+  Unmap();
+  Map();
+
+  // Merge the mapped entries and the new ones, which are both sorted.
+  std::vector<Entry> entries;
+  std::vector<Frame> frames;
+  TableBuilder builder;
+  auto new_it = new_entries_.begin();
+  for (size_t i = 0; i < num_mapped_entries_; i++) {
+    const Entry& entry = entries_[i];
+    std::string build_id = StringAt(entry.build_id, entry.build_id_size);
+    for (; new_it != new_entries_.end(); ++new_it) {
+      const Key& key = new_it->first;
+      int cmp = CompareKey(std::get<0>(key), std::get<1>(key), std::get<2>(key),
+                           build_id, entry.load_bias, entry.address);
+      if (cmp > 0)
+        break;
+      builder.Add(std::get<0>(key), std::get<1>(key), std::get<2>(key),
+                  new_it->second, &entries, &frames);
+      if (cmp == 0) {
+        ++new_it;
+        break;
+      }
+    }
+    if (!entries.empty() && entries.back().address == entry.address &&
+        entries.back().load_bias == entry.load_bias &&
+        builder.strings().compare(entries.back().build_id,
+                                  entries.back().build_id_size,
+                                  build_id) == 0) {
+      continue;  // Replaced by a new entry.
+    }
+    builder.Add(build_id, entry.load_bias, entry.address, FramesOf(entry),
+                &entries, &frames);
+  }
+  for (; new_it != new_entries_.end(); ++new_it) {
+    const Key& key = new_it->first;
+    builder.Add(std::get<0>(key), std::get<1>(key), std::get<2>(key),
+                new_it->second, &entries, &frames);
+  }
+
+  Header header{};
+  memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.num_entries = static_cast<uint32_t>(entries.size());
+  header.num_frames = static_cast<uint32_t>(frames.size());
+  header.strings_size = builder.strings().size();
+  header.file_size = sizeof(Header) + entries.size() * sizeof(Entry) +
+                     frames.size() * sizeof(Frame) + builder.strings().size();
+
+  // The old file must not be mapped while it is replaced (on Windows).
+  Unmap();
+
+  // A temporary file per process, so that concurrent writers don't interleave.
+  std::string tmp_path =
+      path_ + "." + std::to_string(base::GetProcessId()) + ".tmp";
+  {
+    base::ScopedFile fd(
+        base::OpenFile(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644));
+    if (!fd) {
+      PERFETTO_PLOG("Failed to write symbolization cache %s", tmp_path.c_str());
+      Map();
+      return false;
+    }
+    bool ok =
+        base::WriteAll(*fd, &header, sizeof(header)) ==
+            static_cast<ssize_t>(sizeof(header)) &&
+        base::WriteAll(*fd, entries.data(), entries.size() * sizeof(Entry)) ==
+            static_cast<ssize_t>(entries.size() * sizeof(Entry)) &&
+        base::WriteAll(*fd, frames.data(), frames.size() * sizeof(Frame)) ==
+            static_cast<ssize_t>(frames.size() * sizeof(Frame)) &&
+        base::WriteAll(*fd, builder.strings().data(),
+                       builder.strings().size()) ==
+            static_cast<ssize_t>(builder.strings().size());
+    if (!ok) {
+      PERFETTO_PLOG("Failed to write symbolization cache %s", tmp_path.c_str());
+      fd.reset();
+      remove(tmp_path.c_str());
+      Map();
+      return false;
+    }
+  }
+  // rename() does not replace existing files on Windows.
+  if (rename(tmp_path.c_str(), path_.c_str()) != 0 &&
+      (remove(path_.c_str()) != 0 ||
+       rename(tmp_path.c_str(), path_.c_str()) != 0)) {
+    PERFETTO_PLOG("Failed to replace symbolization cache %s", path_.c_str());
+    remove(tmp_path.c_str());
+    Map();
+    return false;
+  }
+
+  new_entries_.clear();
+  Map();
+  return true;
+}
+
+CachingSymbolizer::CachingSymbolizer(std::unique_ptr<Symbolizer> symbolizer,
+                                     std::unique_ptr<SymbolizationCache> cache)
+    : symbolizer_(std::move(symbolizer)), cache_(std::move(cache)) {}
+
+CachingSymbolizer::~CachingSymbolizer() {
+  PERFETTO_DLOG("Symbolization cache: %" PRIu64 " hits, %" PRIu64 " misses",
+                cache_->hits(), cache_->misses());
+  cache_->Write();
+}
+
+std::vector<std::vector<SymbolizedFrame>> CachingSymbolizer::Symbolize(
+    const std::string& mapping_name,
+    const std::string& build_id,
+    uint64_t load_bias,
+    const std::vector<uint64_t>& addresses) {
+  SymbolizeRequest request;
+  request.mapping_name = mapping_name;
+  request.build_id = build_id;
+  request.load_bias = load_bias;
+  request.addresses = addresses;
+  return std::move(SymbolizeBatch({std::move(request)})[0]);
+}
+
+std::vector<std::vector<std::vector<SymbolizedFrame>>>
+CachingSymbolizer::SymbolizeBatch(
+    const std::vector<SymbolizeRequest>& requests) {
+  std::vector<std::vector<std::vector<SymbolizedFrame>>> result(
+      requests.size());
+
+  // Look up all the addresses, and forward the misses in one batch.
+  std::vector<SymbolizeRequest> misses;
+  // For each request in |misses|, its index in |requests| and, for each of its
+  // addresses, the index in the original request.
+  std::vector<size_t> miss_request_idx;
+  std::vector<std::vector<size_t>> miss_address_idx;
+  for (size_t i = 0; i < requests.size(); i++) {
+    const SymbolizeRequest& request = requests[i];
+    result[i].resize(request.addresses.size());
+    SymbolizeRequest miss;
+    std::vector<size_t> address_idx;
+    for (size_t j = 0; j < request.addresses.size(); j++) {
+      if (!cache_->Lookup(request.build_id, request.load_bias,
+                          request.addresses[j], &result[i][j])) {
+        miss.addresses.push_back(request.addresses[j]);
+        address_idx.push_back(j);
+      }
+    }
+    if (miss.addresses.empty())
+      continue;
+    miss.mapping_name = request.mapping_name;
+    miss.build_id = request.build_id;
+    miss.load_bias = request.load_bias;
+    misses.emplace_back(std::move(miss));
+    miss_request_idx.push_back(i);
+    miss_address_idx.emplace_back(std::move(address_idx));
+  }
+  if (misses.empty())
+    return result;
+
+  auto symbolized = symbolizer_->SymbolizeBatch(misses);
+  PERFETTO_CHECK(symbolized.size() == misses.size());
+  for (size_t k = 0; k < misses.size(); k++) {
+    size_t i = miss_request_idx[k];
+    // The symbolizer failed for the whole mapping (e.g. the binary was not
+    // found). Keep the result empty like the symbolizer's, unless some
+    // addresses were cached.
+    if (symbolized[k].empty()) {
+      bool any_cached = false;
+      for (const auto& frames : result[i])
+        any_cached |= !frames.empty();
+      if (!any_cached)
+        result[i].clear();
+      continue;
+    }
+    PERFETTO_DCHECK(symbolized[k].size() == misses[k].addresses.size());
+    for (size_t m = 0; m < symbolized[k].size(); m++) {
+      size_t j = miss_address_idx[k][m];
+      cache_->Insert(requests[i].build_id, requests[i].load_bias,
+                     requests[i].addresses[j], symbolized[k][m]);
+      result[i][j] = std::move(symbolized[k][m]);
+    }
+  }
+  return result;
+}
+
+}  // namespace profiling
+}  // namespace perfetto
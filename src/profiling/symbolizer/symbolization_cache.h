@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_PROFILING_SYMBOLIZER_SYMBOLIZATION_CACHE_H_
+#define SRC_PROFILING_SYMBOLIZER_SYMBOLIZATION_CACHE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "src/profiling/symbolizer/scoped_read_mmap.h"
+#include "src/profiling/symbolizer/symbolizer.h"
+
+namespace perfetto {
+namespace profiling {
+
+// Persistent cache of the frames of (build id, load bias, address) tuples,
+// so that symbolizing many profiles of the same binaries does not resolve the
+// same addresses over and over.
+//
+// The cache is stored in a single file, which is mapped in memory and looked
+// up in place. It consists of a header, a table of entries sorted by key, a
+// table of frames and a table of strings (see the .cc file). Entries inserted
+// in this session are kept in memory until Write(), which merges them with the
+// current contents of the file into a new file, replacing the old one.
+// Processes writing the same cache concurrently each write their own temporary
+// file, and the last rename wins.
+//
+// Only non-empty results are cached: an address that could not be symbolized
+// may be symbolizable once the right binary is provided.
+class SymbolizationCache {
+ public:
+  // Opens the cache stored at |path|. A missing or invalid file results in an
+  // empty cache, which Write() creates.
+  explicit SymbolizationCache(std::string path);
+  ~SymbolizationCache();
+
+  SymbolizationCache(const SymbolizationCache&) = delete;
+  SymbolizationCache& operator=(const SymbolizationCache&) = delete;
+
+  // Returns true and fills |frames| if the address is in the cache.
+  bool Lookup(const std::string& build_id,
+              uint64_t load_bias,
+              uint64_t address,
+              std::vector<SymbolizedFrame>* frames);
+
+  void Insert(const std::string& build_id,
+              uint64_t load_bias,
+              uint64_t address,
+              std::vector<SymbolizedFrame> frames);
+
+  // Writes the cache back to its file, if any entries were inserted.
+  bool Write();
+
+  size_t size() const { return num_mapped_entries_ + new_entries_.size(); }
+  uint64_t hits() const { return hits_; }
+  uint64_t misses() const { return misses_; }
+
+ private:
+  struct Header;
+  struct Entry;
+  struct Frame;
+  using Key = std::tuple<std::string, uint64_t, uint64_t>;
+
+  void Map();
+  void Unmap();
+  std::string StringAt(uint32_t offset, uint32_t size) const;
+  std::vector<SymbolizedFrame> FramesOf(const Entry& entry) const;
+
+  const std::string path_;
+  std::unique_ptr<ScopedReadMmap> mmap_;
+  const Entry* entries_ = nullptr;
+  size_t num_mapped_entries_ = 0;
+  const Frame* frames_ = nullptr;
+  size_t num_mapped_frames_ = 0;
+  const char* strings_ = nullptr;
+  size_t strings_size_ = 0;
+
+  std::map<Key, std::vector<SymbolizedFrame>> new_entries_;
+  uint64_t hits_ = 0;
+  uint64_t misses_ = 0;
+};
+
+// Symbolizer which looks up addresses in a SymbolizationCache before
+// forwarding the remaining ones to another symbolizer, and caches its results.
+// The cache is written back to disk on destruction.
+class CachingSymbolizer : public Symbolizer {
+ public:
+  CachingSymbolizer(std::unique_ptr<Symbolizer> symbolizer,
+                    std::unique_ptr<SymbolizationCache> cache);
+  ~CachingSymbolizer() override;
+
+  std::vector<std::vector<SymbolizedFrame>> Symbolize(
+      const std::string& mapping_name,
+      const std::string& build_id,
+      uint64_t load_bias,
+      const std::vector<uint64_t>& address) override;
+
+  std::vector<std::vector<std::vector<SymbolizedFrame>>> SymbolizeBatch(
+      const std::vector<SymbolizeRequest>& requests) override;
+
+  bool BuildIdNeedsHexConversion() override {
+    return symbolizer_->BuildIdNeedsHexConversion();
+  }
+
+  SymbolizationCache* cache() { return cache_.get(); }
+
+ private:
+  std::unique_ptr<Symbolizer> symbolizer_;
+  std::unique_ptr<SymbolizationCache> cache_;
+};
+
+}  // namespace profiling
+}  // namespace perfetto
+
+#endif  // SRC_PROFILING_SYMBOLIZER_SYMBOLIZATION_CACHE_H_
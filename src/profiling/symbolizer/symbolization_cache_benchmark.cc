@@ -0,0 +1,147 @@
+// Copyright (C) 2023 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <benchmark/benchmark.h>
+
+#include <stdio.h>
+
+#include <random>
+
+#include "perfetto/ext/base/temp_file.h"
+#include "src/profiling/symbolizer/symbolization_cache.h"
+
+namespace perfetto {
+namespace profiling {
+namespace {
+
+constexpr size_t kBinaries = 64;
+constexpr size_t kProfiles = 16;
+constexpr size_t kMappingsPerProfile = 32;
+constexpr size_t kAddressesPerMapping = 256;
+
+// Stands in for llvm-symbolizer, which is orders of magnitude slower than
+// this: the benchmark measures the overhead of the cache, and the counters
+// report how much symbolization it saves.
+class FakeSymbolizer : public Symbolizer {
+ public:
+  std::vector<std::vector<SymbolizedFrame>> Symbolize(
+      const std::string& mapping_name,
+      const std::string&,
+      uint64_t,
+      const std::vector<uint64_t>& addresses) override {
+    std::vector<std::vector<SymbolizedFrame>> result(addresses.size());
+    for (size_t i = 0; i < addresses.size(); i++) {
+      SymbolizedFrame frame;
+      frame.function_name = "function_" + std::to_string(addresses[i] / 64);
+      frame.file_name = mapping_name + ".cc";
+      frame.line = static_cast<uint32_t>(addresses[i] % 1000);
+      result[i].push_back(std::move(frame));
+    }
+    symbolized += addresses.size();
+    return result;
+  }
+
+  bool BuildIdNeedsHexConversion() override { return false; }
+
+  uint64_t symbolized = 0;
+};
+
+// Profiles of different processes share most of their binaries (libc, the
+// framework, ...) and their hot addresses.
+std::vector<std::vector<SymbolizeRequest>> CreateCorpus() {
+  std::minstd_rand rng(42);
+  std::vector<std::vector<SymbolizeRequest>> corpus(kProfiles);
+  for (auto& profile : corpus) {
+    for (size_t m = 0; m < kMappingsPerProfile; m++) {
+      size_t binary = rng() % kBinaries;
+      SymbolizeRequest request;
+      request.mapping_name = "/system/lib64/lib" + std::to_string(binary);
+      request.build_id = "build_id_" + std::to_string(binary);
+      for (size_t a = 0; a < kAddressesPerMapping; a++)
+        request.addresses.push_back((rng() % 4096) * 16);
+      profile.emplace_back(std::move(request));
+    }
+  }
+  return corpus;
+}
+
+// Symbolizes all the profiles, as consecutive traceconv invocations would, and
+// returns the number of addresses that had to be symbolized.
+uint64_t SymbolizeCorpus(
+    const std::vector<std::vector<SymbolizeRequest>>& corpus,
+    const std::string& cache_path) {
+  uint64_t symbolized = 0;
+  for (const auto& profile : corpus) {
+    FakeSymbolizer* fake = new FakeSymbolizer();
+    CachingSymbolizer symbolizer(
+        std::unique_ptr<Symbolizer>(fake),
+        std::unique_ptr<SymbolizationCache>(
+            new SymbolizationCache(cache_path)));
+    benchmark::DoNotOptimize(symbolizer.SymbolizeBatch(profile));
+    symbolized += fake->symbolized;
+  }
+  return symbolized;
+}
+
+void BM_SymbolizeCorpusColdCache(benchmark::State& state) {
+  auto corpus = CreateCorpus();
+  base::TempFile file = base::TempFile::Create();
+  uint64_t symbolized = 0;
+  for (auto _ : state) {
+    state.PauseTiming();
+    remove(file.path().c_str());
+    state.ResumeTiming();
+    symbolized = SymbolizeCorpus(corpus, file.path());
+  }
+  state.counters["symbolized"] = static_cast<double>(symbolized);
+  state.counters["addresses"] = static_cast<double>(
+      kProfiles * kMappingsPerProfile * kAddressesPerMapping);
+}
+
+void BM_SymbolizeCorpusWarmCache(benchmark::State& state) {
+  auto corpus = CreateCorpus();
+  base::TempFile file = base::TempFile::Create();
+  SymbolizeCorpus(corpus, file.path());
+  uint64_t symbolized = 0;
+  for (auto _ : state)
+    symbolized = SymbolizeCorpus(corpus, file.path());
+  state.counters["symbolized"] = static_cast<double>(symbolized);
+  state.counters["addresses"] = static_cast<double>(
+      kProfiles * kMappingsPerProfile * kAddressesPerMapping);
+}
+
+void BM_SymbolizationCacheLookup(benchmark::State& state) {
+  auto corpus = CreateCorpus();
+  base::TempFile file = base::TempFile::Create();
+  SymbolizeCorpus(corpus, file.path());
+  SymbolizationCache cache(file.path());
+  const SymbolizeRequest& request = corpus[0][0];
+  std::vector<SymbolizedFrame> frames;
+  size_t i = 0;
+  for (auto _ : state) {
+    cache.Lookup(request.build_id, request.load_bias,
+                 request.addresses[i++ % request.addresses.size()], &frames);
+    benchmark::DoNotOptimize(frames.data());
+  }
+  state.counters["entries"] = static_cast<double>(cache.size());
+}
+
+}  // namespace
+
+BENCHMARK(BM_SymbolizeCorpusColdCache)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_SymbolizeCorpusWarmCache)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_SymbolizationCacheLookup);
+
+}  // namespace profiling
+}  // namespace perfetto
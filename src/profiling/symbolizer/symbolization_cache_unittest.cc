@@ -0,0 +1,227 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/profiling/symbolizer/symbolization_cache.h"
+
+#include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/temp_file.h"
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace profiling {
+
+bool operator==(const SymbolizedFrame& a, const SymbolizedFrame& b) {
+  return std::tie(a.function_name, a.file_name, a.line) ==
+         std::tie(b.function_name, b.file_name, b.line);
+}
+
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::IsEmpty;
+
+SymbolizedFrame Frame(std::string function_name,
+                      std::string file_name,
+                      uint32_t line) {
+  SymbolizedFrame frame;
+  frame.function_name = std::move(function_name);
+  frame.file_name = std::move(file_name);
+  frame.line = line;
+  return frame;
+}
+
+// Symbolizes address X to a function named "fX", and records the requests.
+class FakeSymbolizer : public Symbolizer {
+ public:
+  std::vector<std::vector<SymbolizedFrame>> Symbolize(
+      const std::string& mapping_name,
+      const std::string&,
+      uint64_t,
+      const std::vector<uint64_t>& addresses) override {
+    std::vector<std::vector<SymbolizedFrame>> result;
+    if (mapping_name == "missing")
+      return result;
+    for (uint64_t address : addresses) {
+      symbolized_.push_back(address);
+      result.push_back(
+          {Frame("f" + std::to_string(address), mapping_name + ".cc", 1)});
+    }
+    return result;
+  }
+
+  bool BuildIdNeedsHexConversion() override { return false; }
+
+  const std::vector<uint64_t>& symbolized() const { return symbolized_; }
+
+ private:
+  std::vector<uint64_t> symbolized_;
+};
+
+TEST(SymbolizationCacheTest, EmptyFile) {
+  base::TempFile file = base::TempFile::Create();
+  SymbolizationCache cache(file.path());
+  std::vector<SymbolizedFrame> frames;
+  EXPECT_FALSE(cache.Lookup("buildid", 0, 0x1000, &frames));
+  EXPECT_EQ(cache.size(), 0u);
+  EXPECT_EQ(cache.misses(), 1u);
+}
+
+TEST(SymbolizationCacheTest, WriteAndReopen) {
+  base::TempFile file = base::TempFile::Create();
+  {
+    SymbolizationCache cache(file.path());
+    cache.Insert("buildid2", 0, 0x1000, {Frame("main", "main.cc", 10)});
+    cache.Insert("buildid1", 0, 0x2000,
+                 {Frame("inlined", "foo.h", 2), Frame("foo", "foo.cc", 3)});
+    cache.Insert("buildid1", 0x100, 0x2000, {Frame("bar", "foo.cc", 4)});
+    // Empty results are not cached.
+    cache.Insert("buildid1", 0, 0x3000, {});
+    std::vector<SymbolizedFrame> frames;
+    ASSERT_TRUE(cache.Lookup("buildid2", 0, 0x1000, &frames));
+    EXPECT_THAT(frames, ElementsAre(Frame("main", "main.cc", 10)));
+    ASSERT_TRUE(cache.Write());
+  }
+
+  SymbolizationCache cache(file.path());
+  EXPECT_EQ(cache.size(), 3u);
+  std::vector<SymbolizedFrame> frames;
+  ASSERT_TRUE(cache.Lookup("buildid2", 0, 0x1000, &frames));
+  EXPECT_THAT(frames, ElementsAre(Frame("main", "main.cc", 10)));
+  ASSERT_TRUE(cache.Lookup("buildid1", 0, 0x2000, &frames));
+  EXPECT_THAT(frames, ElementsAre(Frame("inlined", "foo.h", 2),
+                                  Frame("foo", "foo.cc", 3)));
+  ASSERT_TRUE(cache.Lookup("buildid1", 0x100, 0x2000, &frames));
+  EXPECT_THAT(frames, ElementsAre(Frame("bar", "foo.cc", 4)));
+  EXPECT_FALSE(cache.Lookup("buildid1", 0, 0x3000, &frames));
+  EXPECT_FALSE(cache.Lookup("buildid", 0, 0x2000, &frames));
+  EXPECT_FALSE(cache.Lookup("buildid3", 0, 0x1000, &frames));
+  EXPECT_EQ(cache.hits(), 3u);
+  EXPECT_EQ(cache.misses(), 3u);
+}
+
+TEST(SymbolizationCacheTest, MergeWithExistingEntries) {
+  base::TempFile file = base::TempFile::Create();
+  {
+    SymbolizationCache cache(file.path());
+    cache.Insert("a", 0, 1, {Frame("a1", "a.cc", 1)});
+    cache.Insert("b", 0, 1, {Frame("b1", "b.cc", 1)});
+    cache.Insert("c", 0, 1, {Frame("c1", "c.cc", 1)});
+    ASSERT_TRUE(cache.Write());
+  }
+  {
+    SymbolizationCache cache(file.path());
+    cache.Insert("b", 0, 0, {Frame("b0", "b.cc", 0)});
+    cache.Insert("b", 0, 1, {Frame("b1_new", "b.cc", 2)});
+    cache.Insert("d", 0, 1, {Frame("d1", "d.cc", 1)});
+    ASSERT_TRUE(cache.Write());
+    // The cache is remapped after writing.
+    EXPECT_EQ(cache.size(), 5u);
+  }
+
+  SymbolizationCache cache(file.path());
+  EXPECT_EQ(cache.size(), 5u);
+  std::vector<SymbolizedFrame> frames;
+  ASSERT_TRUE(cache.Lookup("a", 0, 1, &frames));
+  EXPECT_THAT(frames, ElementsAre(Frame("a1", "a.cc", 1)));
+  ASSERT_TRUE(cache.Lookup("b", 0, 0, &frames));
+  EXPECT_THAT(frames, ElementsAre(Frame("b0", "b.cc", 0)));
+  ASSERT_TRUE(cache.Lookup("b", 0, 1, &frames));
+  EXPECT_THAT(frames, ElementsAre(Frame("b1_new", "b.cc", 2)));
+  ASSERT_TRUE(cache.Lookup("c", 0, 1, &frames));
+  EXPECT_THAT(frames, ElementsAre(Frame("c1", "c.cc", 1)));
+  ASSERT_TRUE(cache.Lookup("d", 0, 1, &frames));
+  EXPECT_THAT(frames, ElementsAre(Frame("d1", "d.cc", 1)));
+}
+
+// Two caches open on the same file, as with two processes symbolizing at the
+// same time: the second write keeps the entries of the first one.
+TEST(SymbolizationCacheTest, ConcurrentWriters) {
+  base::TempFile file = base::TempFile::Create();
+  SymbolizationCache first(file.path());
+  SymbolizationCache second(file.path());
+  first.Insert("a", 0, 1, {Frame("a1", "a.cc", 1)});
+  second.Insert("b", 0, 1, {Frame("b1", "b.cc", 1)});
+  ASSERT_TRUE(first.Write());
+  ASSERT_TRUE(second.Write());
+
+  SymbolizationCache cache(file.path());
+  EXPECT_EQ(cache.size(), 2u);
+  std::vector<SymbolizedFrame> frames;
+  ASSERT_TRUE(cache.Lookup("a", 0, 1, &frames));
+  EXPECT_THAT(frames, ElementsAre(Frame("a1", "a.cc", 1)));
+  ASSERT_TRUE(cache.Lookup("b", 0, 1, &frames));
+  EXPECT_THAT(frames, ElementsAre(Frame("b1", "b.cc", 1)));
+}
+
+TEST(SymbolizationCacheTest, CorruptFile) {
+  base::TempFile file = base::TempFile::Create();
+  std::string garbage(100, 'x');
+  ASSERT_EQ(base::WriteAll(file.fd(), garbage.data(), garbage.size()),
+            static_cast<ssize_t>(garbage.size()));
+
+  SymbolizationCache cache(file.path());
+  EXPECT_EQ(cache.size(), 0u);
+  cache.Insert("a", 0, 1, {Frame("a1", "a.cc", 1)});
+  ASSERT_TRUE(cache.Write());
+
+  SymbolizationCache reopened(file.path());
+  EXPECT_EQ(reopened.size(), 1u);
+}
+
+TEST(CachingSymbolizerTest, OnlySymbolizesMisses) {
+  base::TempFile file = base::TempFile::Create();
+  {
+    auto* fake = new FakeSymbolizer();
+    CachingSymbolizer symbolizer(
+        std::unique_ptr<Symbolizer>(fake),
+        std::unique_ptr<SymbolizationCache>(
+            new SymbolizationCache(file.path())));
+    auto result = symbolizer.Symbolize("lib", "buildid", 0, {1, 2});
+    ASSERT_EQ(result.size(), 2u);
+    EXPECT_THAT(result[1], ElementsAre(Frame("f2", "lib.cc", 1)));
+    result = symbolizer.Symbolize("lib", "buildid", 0, {2, 3});
+    ASSERT_EQ(result.size(), 2u);
+    EXPECT_THAT(result[0], ElementsAre(Frame("f2", "lib.cc", 1)));
+    EXPECT_THAT(result[1], ElementsAre(Frame("f3", "lib.cc", 1)));
+    EXPECT_THAT(fake->symbolized(), ElementsAre(1, 2, 3));
+  }
+
+  // The cache is persisted on destruction.
+  auto* fake = new FakeSymbolizer();
+  CachingSymbolizer symbolizer(
+      std::unique_ptr<Symbolizer>(fake),
+      std::unique_ptr<SymbolizationCache>(new SymbolizationCache(file.path())));
+  SymbolizeRequest lib;
+  lib.mapping_name = "lib";
+  lib.build_id = "buildid";
+  lib.addresses = {3, 4};
+  SymbolizeRequest missing;
+  missing.mapping_name = "missing";
+  missing.build_id = "otherid";
+  missing.addresses = {1};
+  auto result = symbolizer.SymbolizeBatch({lib, missing});
+  ASSERT_EQ(result.size(), 2u);
+  ASSERT_EQ(result[0].size(), 2u);
+  EXPECT_THAT(result[0][0], ElementsAre(Frame("f3", "lib.cc", 1)));
+  EXPECT_THAT(result[0][1], ElementsAre(Frame("f4", "lib.cc", 1)));
+  EXPECT_THAT(result[1], IsEmpty());
+  EXPECT_THAT(fake->symbolized(), ElementsAre(4));
+  EXPECT_EQ(symbolizer.cache()->hits(), 1u);
+}
+
+}  // namespace
+}  // namespace profiling
+}  // namespace perfetto
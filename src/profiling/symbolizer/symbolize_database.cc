@@ -16,6 +16,8 @@
 
 #include "src/profiling/symbolizer/symbolize_database.h"
 
+#include <string.h>
+
 #include <map>
 #include <utility>
 #include <vector>
@@ -24,6 +26,7 @@
 #include "perfetto/ext/base/string_utils.h"
 #include "perfetto/protozero/scattered_heap_buffer.h"
 #include "perfetto/trace_processor/trace_processor.h"
+#include "src/profiling/symbolizer/symbolization_cache.h"
 
 #include "protos/perfetto/trace/profiling/profile_common.pbzero.h"
 #include "protos/perfetto/trace/trace.pbzero.h"
@@ -120,20 +123,31 @@ void SymbolizeDatabase(trace_processor::TraceProcessor* tp,
   PERFETTO_CHECK(symbolizer);
   auto unsymbolized =
       GetUnsymbolizedFrames(tp, symbolizer->BuildIdNeedsHexConversion());
-  for (auto it = unsymbolized.cbegin(); it != unsymbolized.cend(); ++it) {
-    const auto& unsymbolized_mapping = it->first;
-    const std::vector<uint64_t>& rel_pcs = it->second;
-    auto res = symbolizer->Symbolize(unsymbolized_mapping.name,
-                                     unsymbolized_mapping.build_id,
-                                     unsymbolized_mapping.load_bias, rel_pcs);
+  std::vector<SymbolizeRequest> requests;
+  requests.reserve(unsymbolized.size());
+  for (auto it = unsymbolized.begin(); it != unsymbolized.end(); ++it) {
+    SymbolizeRequest request;
+    request.mapping_name = it->first.name;
+    request.build_id = it->first.build_id;
+    request.load_bias = it->first.load_bias;
+    request.addresses = std::move(it->second);
+    requests.emplace_back(std::move(request));
+  }
+
+  auto results = symbolizer->SymbolizeBatch(requests);
+  PERFETTO_CHECK(results.size() == requests.size());
+  for (size_t r = 0; r < requests.size(); ++r) {
+    const SymbolizeRequest& request = requests[r];
+    const std::vector<uint64_t>& rel_pcs = request.addresses;
+    const auto& res = results[r];
     if (res.empty())
       continue;
 
     protozero::HeapBuffered<perfetto::protos::pbzero::Trace> trace;
     auto* packet = trace->add_packet();
     auto* module_symbols = packet->set_module_symbols();
-    module_symbols->set_path(unsymbolized_mapping.name);
-    module_symbols->set_build_id(unsymbolized_mapping.build_id);
+    module_symbols->set_path(request.mapping_name);
+    module_symbols->set_build_id(request.build_id);
     PERFETTO_DCHECK(res.size() == rel_pcs.size());
     for (size_t i = 0; i < res.size(); ++i) {
       auto* address_symbols = module_symbols->add_address_symbols();
@@ -156,5 +170,19 @@ std::vector<std::string> GetPerfettoBinaryPath() {
   return {};
 }
 
+std::unique_ptr<Symbolizer> MaybeAddSymbolizationCache(
+    std::unique_ptr<Symbolizer> symbolizer,
+    const char* backend) {
+  const char* path = getenv("PERFETTO_SYMBOLIZER_CACHE");
+  if (!symbolizer || path == nullptr || *path == '\0')
+    return symbolizer;
+  std::string cache_path = path;
+  if (backend && strcmp(backend, "llvm") != 0)
+    cache_path += std::string(".") + backend;
+  return std::unique_ptr<Symbolizer>(new CachingSymbolizer(
+      std::move(symbolizer), std::unique_ptr<SymbolizationCache>(
+                                 new SymbolizationCache(cache_path))));
+}
+
 }  // namespace profiling
 }  // namespace perfetto
@@ -20,6 +20,7 @@
 #include "src/profiling/symbolizer/symbolizer.h"
 
 #include <functional>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -29,6 +30,14 @@ class TraceProcessor;
 }
 namespace profiling {
 std::vector<std::string> GetPerfettoBinaryPath();
+// Wraps |symbolizer| in a CachingSymbolizer if the PERFETTO_SYMBOLIZER_CACHE
+// environment variable is set to the path of the cache file. |backend| names
+// the symbolizer ("llvm" if null). Backends other than llvm-symbolizer return
+// different frames for the same address, e.g. without inlined functions, so
+// they are cached in a separate "<path>.<backend>" file.
+std::unique_ptr<Symbolizer> MaybeAddSymbolizationCache(
+    std::unique_ptr<Symbolizer> symbolizer,
+    const char* backend);
 // Generate ModuleSymbol protos for all unsymbolized frames in the database.
 // Wrap them in proto-encoded TracePackets messages and call callback.
 void SymbolizeDatabase(trace_processor::TraceProcessor* tp,
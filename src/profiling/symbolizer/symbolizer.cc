@@ -21,5 +21,16 @@ namespace profiling {
 
 Symbolizer::~Symbolizer() = default;
 
+std::vector<std::vector<std::vector<SymbolizedFrame>>>
+Symbolizer::SymbolizeBatch(const std::vector<SymbolizeRequest>& requests) {
+  std::vector<std::vector<std::vector<SymbolizedFrame>>> result;
+  result.reserve(requests.size());
+  for (const SymbolizeRequest& request : requests) {
+    result.emplace_back(Symbolize(request.mapping_name, request.build_id,
+                                  request.load_bias, request.addresses));
+  }
+  return result;
+}
+
 }  // namespace profiling
 }  // namespace perfetto
@@ -17,6 +17,8 @@
 #ifndef SRC_PROFILING_SYMBOLIZER_SYMBOLIZER_H_
 #define SRC_PROFILING_SYMBOLIZER_SYMBOLIZER_H_
 
+#include <stdint.h>
+
 #include <map>
 #include <string>
 #include <vector>
@@ -30,6 +32,14 @@ struct SymbolizedFrame {
   uint32_t line = 0;
 };
 
+// The addresses of a mapping to symbolize.
+struct SymbolizeRequest {
+  std::string mapping_name;
+  std::string build_id;
+  uint64_t load_bias = 0;
+  std::vector<uint64_t> addresses;
+};
+
 class Symbolizer {
  public:
   // For each address in the input vector, output a vector of SymbolizedFrame
@@ -44,6 +54,13 @@ class Symbolizer {
       const std::vector<uint64_t>& address) = 0;
   virtual ~Symbolizer();
 
+  // Symbolizes the addresses of several mappings. The result for each request
+  // is the same as the one of Symbolize(). Implementations can process the
+  // requests in parallel; the default implementation calls Symbolize() for
+  // each of them in turn.
+  virtual std::vector<std::vector<std::vector<SymbolizedFrame>>>
+  SymbolizeBatch(const std::vector<SymbolizeRequest>& requests);
+
   // LocalSymbolizer uses a specific conversion of a symbol file's |build_id| to
   // bytes, but BreakpadSymbolizer requires the |build_id| as given. Return true
   // if the |build_id| passed to Symbolize() requires the conversion to bytes
@@ -198,9 +198,9 @@ bool FilterBytecodeParser::LoadInternal(const uint8_t* bytecode_data,
   return true;
 }
 
-FilterBytecodeParser::QueryResult FilterBytecodeParser::Query(
+FilterBytecodeParser::QueryResult FilterBytecodeParser::QuerySlow(
     uint32_t msg_index,
-    uint32_t field_id) {
+    uint32_t field_id) const {
   FilterBytecodeParser::QueryResult res{false, 0u};
   if (static_cast<uint64_t>(msg_index) + 1 >=
       static_cast<uint64_t>(message_offset_.size())) {
@@ -219,7 +219,7 @@ FilterBytecodeParser::QueryResult FilterBytecodeParser::Query(
   PERFETTO_DCHECK(num_directly_indexed <= kDirectlyIndexLimit);
   PERFETTO_DCHECK(word + num_directly_indexed <= end);
   uint32_t field_state = 0;
-  if (PERFETTO_LIKELY(field_id < num_directly_indexed)) {
+  if (field_id < num_directly_indexed) {
     PERFETTO_DCHECK(&word[field_id] < end);
     field_state = word[field_id];
   } else {
@@ -234,8 +234,7 @@ FilterBytecodeParser::QueryResult FilterBytecodeParser::Query(
     }  // for (word in ranges)
   }    // if (field_id >= num_directly_indexed)
 
-  res.allowed = (field_state & kAllowed) != 0;
-  res.nested_msg_index = field_state & ~kAllowed;
+  res = MakeQueryResult(field_state);
   PERFETTO_DCHECK(!res.nested_msg_field() ||
                   res.nested_msg_index < message_offset_.size() - 1);
   return res;
@@ -23,6 +23,8 @@
 #include <optional>
 #include <vector>
 
+#include "perfetto/base/compiler.h"
+
 namespace protozero {
 
 // Loads the proto-encoded bytecode in memory and allows fast lookups for tuples
@@ -79,7 +81,18 @@ class FilterBytecodeParser {
   // Checks wheter a given field is allowed or not.
   // msg_index = 0 is the index of the root message, where all queries should
   // start from (typically perfetto.protos.Trace).
-  QueryResult Query(uint32_t msg_index, uint32_t field_id);
+  // The lookup of directly indexed fields is inlined, as this is called for
+  // every field of every filtered message.
+  QueryResult Query(uint32_t msg_index, uint32_t field_id) const {
+    if (PERFETTO_LIKELY(static_cast<uint64_t>(msg_index) + 1 <
+                        static_cast<uint64_t>(message_offset_.size()))) {
+      const uint32_t* word = &words_[message_offset_[msg_index]];
+      const uint32_t num_directly_indexed = word[0];
+      if (PERFETTO_LIKELY(field_id < num_directly_indexed))
+        return MakeQueryResult(word[1 + field_id]);
+    }
+    return QuerySlow(msg_index, field_id);
+  }
 
   void Reset();
   void set_suppress_logs_for_fuzzer(bool x) { suppress_logs_for_fuzzer_ = x; }
@@ -92,6 +105,16 @@ class FilterBytecodeParser {
 
   bool LoadInternal(const uint8_t* filter_data, size_t len);
 
+  // Looks up the fields that are not directly indexed.
+  QueryResult QuerySlow(uint32_t msg_index, uint32_t field_id) const;
+
+  static QueryResult MakeQueryResult(uint32_t field_state) {
+    QueryResult res;
+    res.allowed = (field_state & kAllowed) != 0;
+    res.nested_msg_index = field_state & ~kAllowed;
+    return res;
+  }
+
   // The state of all fields for all messages is stored in one contiguous array.
   // This is to avoid memory fragmentation and allocator overhead.
   // We expect a high number of messages (hundreds), but each message is small.
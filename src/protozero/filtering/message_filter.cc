@@ -16,6 +16,10 @@
 
 #include "src/protozero/filtering/message_filter.h"
 
+#include <string.h>
+
+#include <algorithm>
+
 #include "perfetto/base/logging.h"
 #include "perfetto/protozero/proto_utils.h"
 #include "src/protozero/filtering/string_filter.h"
@@ -127,12 +131,22 @@ MessageFilter::FilteredMessage MessageFilter::FilterMessageFragments(
   stack_[1].in_bytes_limit = total_len;
   stack_[1].msg_index = root_msg_index_;
 
-  // Process the input data and write the output.
+  // Process the input data and write the output. The fast path handles the
+  // fields that are entirely within a slice, FilterOneByte() the rest. The
+  // fast path doesn't do usage tracking.
+  const bool use_fast_path = !track_field_usage_;
   for (size_t slice_idx = 0; slice_idx < num_slices; ++slice_idx) {
     const InputSlice& slice = slices[slice_idx];
-    const uint8_t* data = static_cast<const uint8_t*>(slice.data);
-    for (size_t i = 0; i < slice.len; ++i)
-      FilterOneByte(data[i]);
+    const uint8_t* ptr = static_cast<const uint8_t*>(slice.data);
+    const uint8_t* const end = ptr + slice.len;
+    while (ptr < end) {
+      if (use_fast_path) {
+        ptr = FilterFieldsFast(ptr, end);
+        if (ptr == end)
+          break;
+      }
+      FilterOneByte(*(ptr++));
+    }
   }
 
   // Construct the output object.
@@ -147,6 +161,24 @@ MessageFilter::FilteredMessage MessageFilter::FilterMessageFragments(
   return res;
 }
 
+void MessageFilter::PopState() {
+  StackState* state = &stack_.back();
+
+  // We can't possibly write more than we read.
+  const uint32_t msg_bytes_written =
+      static_cast<uint32_t>(out_written() - state->out_bytes_written_at_start);
+  PERFETTO_DCHECK(msg_bytes_written <= state->in_bytes_limit);
+
+  // Backfill the length field of the submessage.
+  proto_utils::WriteRedundantVarInt(msg_bytes_written, state->size_field,
+                                    state->size_field_len);
+
+  const uint32_t in_bytes_processes_for_last_msg = state->in_bytes;
+  stack_.pop_back();
+  PERFETTO_CHECK(!stack_.empty());
+  stack_.back().in_bytes += in_bytes_processes_for_last_msg;
+}
+
 void MessageFilter::FilterOneByte(uint8_t octet) {
   PERFETTO_DCHECK(!stack_.empty());
 
@@ -259,21 +291,8 @@ void MessageFilter::FilterOneByte(uint8_t octet) {
   while (state->in_bytes >= state->in_bytes_limit) {
     PERFETTO_DCHECK(state->in_bytes == state->in_bytes_limit);
     push_next_state = false;
-
-    // We can't possibly write more than we read.
-    const uint32_t msg_bytes_written = static_cast<uint32_t>(
-        out_written() - state->out_bytes_written_at_start);
-    PERFETTO_DCHECK(msg_bytes_written <= state->in_bytes_limit);
-
-    // Backfill the length field of the
-    proto_utils::WriteRedundantVarInt(msg_bytes_written, state->size_field,
-                                      state->size_field_len);
-
-    const uint32_t in_bytes_processes_for_last_msg = state->in_bytes;
-    stack_.pop_back();
-    PERFETTO_CHECK(!stack_.empty());
+    PopState();
     state = &stack_.back();
-    state->in_bytes += in_bytes_processes_for_last_msg;
     if (PERFETTO_UNLIKELY(!tokenizer_.idle())) {
       // If we hit this case, it means that we got to the end of a submessage
       // while decoding a field. We can't recover from this and we don't want to
@@ -289,6 +308,164 @@ void MessageFilter::FilterOneByte(uint8_t octet) {
   }
 }
 
+const uint8_t* MessageFilter::FilterFieldsFast(const uint8_t* ptr,
+                                               const uint8_t* end) {
+  using proto_utils::ProtoWireType;
+  if (!tokenizer_.idle())
+    return ptr;
+
+  StackState* state = &stack_.back();
+  if (state->eat_next_bytes > 0) {
+    // The payload of a string or bytes field (or of a dropped submessage).
+    // Consume all of it but the last byte in one go: FilterOneByte() takes
+    // care of the end of the field (string filtering and popping).
+    const uint32_t n = static_cast<uint32_t>(std::min(
+        static_cast<size_t>(state->eat_next_bytes - 1),
+        static_cast<size_t>(end - ptr)));
+    if (state->action != StackState::kDrop) {
+      memcpy(out_, ptr, n);
+      out_ += n;
+    }
+    state->eat_next_bytes -= n;
+    state->in_bytes += n;
+    return ptr + n;
+  }
+
+  // [copy_start, ptr) contains fields that are allowed as they are and still
+  // need to be copied in output.
+  const uint8_t* copy_start = ptr;
+  auto flush = [this, &copy_start](const uint8_t* copy_end) {
+    const size_t len = static_cast<size_t>(copy_end - copy_start);
+    memcpy(out_, copy_start, len);
+    out_ += len;
+    copy_start = copy_end;
+  };
+
+  // stack_[0] is only left after the end of the root message, or on errors.
+  while (ptr < end && stack_.size() > 1) {
+    state = &stack_.back();
+    const size_t msg_bytes_left = state->in_bytes_limit - state->in_bytes;
+    const uint8_t* const limit =
+        ptr + std::min(msg_bytes_left, static_cast<size_t>(end - ptr));
+
+    uint64_t preamble;
+    const uint8_t* pos = proto_utils::ParseVarInt(ptr, limit, &preamble);
+    const auto field_id = static_cast<uint32_t>(preamble >> 3);
+    if (pos == ptr || field_id == 0)
+      break;
+    auto filter = filter_.Query(state->msg_index, field_id);
+
+    bool copy = false;
+    bool stop = false;
+    switch (static_cast<uint32_t>(preamble & 7u)) {
+      case static_cast<uint32_t>(ProtoWireType::kVarInt): {
+        uint64_t value;
+        const uint8_t* value_end = proto_utils::ParseVarInt(pos, limit, &value);
+        stop = value_end == pos;
+        pos = value_end;
+        copy = filter.allowed && filter.simple_field();
+        break;
+      }
+      case static_cast<uint32_t>(ProtoWireType::kFixed32):
+      case static_cast<uint32_t>(ProtoWireType::kFixed64): {
+        const size_t size =
+            (preamble & 7u) == static_cast<uint32_t>(ProtoWireType::kFixed32)
+                ? sizeof(uint32_t)
+                : sizeof(uint64_t);
+        stop = static_cast<size_t>(limit - pos) < size;
+        pos += stop ? 0 : size;
+        copy = filter.allowed && filter.simple_field();
+        break;
+      }
+      case static_cast<uint32_t>(ProtoWireType::kLengthDelimited): {
+        uint64_t len;
+        const uint8_t* payload = proto_utils::ParseVarInt(pos, limit, &len);
+        // Leave the malformed fields to the slow path, which fails.
+        const size_t header_len = static_cast<size_t>(payload - ptr);
+        if (payload == pos || len > proto_utils::kMaxMessageLength ||
+            len > msg_bytes_left - header_len) {
+          stop = true;
+          break;
+        }
+        const auto payload_len = static_cast<uint32_t>(len);
+        const bool in_slice = payload_len <= static_cast<size_t>(end - payload);
+        if (filter.allowed && filter.nested_msg_field() && payload_len > 0) {
+          // Recurse into the submessage, as FilterOneByte() does.
+          flush(ptr);
+          auto size_field = AppendLenDelim(field_id, payload_len, &out_);
+          state->in_bytes += static_cast<uint32_t>(header_len);
+          StackState next_state{};
+          next_state.field_id = field_id;
+          next_state.msg_index = filter.nested_msg_index;
+          next_state.in_bytes_limit = payload_len;
+          next_state.size_field = size_field.first;
+          next_state.size_field_len = size_field.second;
+          next_state.out_bytes_written_at_start = out_written();
+          stack_.emplace_back(std::move(next_state));
+          ptr = copy_start = payload;
+          continue;
+        }
+        StackState::FilterAction action = StackState::kDrop;
+        if (filter.allowed && filter.filter_string_field()) {
+          action = StackState::kFilterString;
+          flush(ptr);
+          AppendLenDelim(field_id, payload_len, &out_);
+          state->filter_string_ptr = out_;
+          if (in_slice) {
+            memcpy(out_, payload, payload_len);
+            out_ += payload_len;
+            if (payload_len > 0) {
+              string_filter_.MaybeFilter(
+                  reinterpret_cast<char*>(state->filter_string_ptr),
+                  payload_len);
+            }
+          }
+        } else if (filter.allowed) {
+          // A string or bytes field, or a 0 length submessage.
+          action = StackState::kPassthrough;
+          copy = true;
+        }
+        if (!in_slice) {
+          // Let the next calls eat the payload.
+          if (action != StackState::kFilterString) {
+            flush(ptr);
+            if (action == StackState::kPassthrough)
+              AppendLenDelim(field_id, payload_len, &out_);
+          }
+          state->eat_next_bytes = payload_len;
+          state->action = action;
+          state->in_bytes += static_cast<uint32_t>(header_len);
+          return payload;
+        }
+        pos = payload + payload_len;
+        break;
+      }
+      default:
+        stop = true;
+        break;
+    }
+    if (stop)
+      break;
+
+    // The field [ptr, pos) has been consumed.
+    if (!copy) {
+      flush(ptr);
+      copy_start = pos;
+    }
+    state->in_bytes += static_cast<uint32_t>(pos - ptr);
+    ptr = pos;
+    if (state->in_bytes >= state->in_bytes_limit) {
+      flush(ptr);
+      while (stack_.back().in_bytes >= stack_.back().in_bytes_limit) {
+        PERFETTO_DCHECK(stack_.back().in_bytes == stack_.back().in_bytes_limit);
+        PopState();
+      }
+    }
+  }
+  flush(ptr);
+  return ptr;
+}
+
 void MessageFilter::SetUnrecoverableErrorState() {
   error_ = true;
   stack_.clear();
@@ -44,10 +44,11 @@ namespace protozero {
 // The filtering operation is based on rewriting a copy of the message into a
 // self-allocated buffer, which is then returned in the output. The input buffer
 // is NOT altered.
-// Note also that the process of rewriting the protos gets rid of most redundant
-// varint encoding (if present). So even if all fields are allow-listed, the
-// output might NOT be bitwise identical to the input (but it will be
-// semantically equivalent).
+// Note also that the process of rewriting the protos gets rid of the redundant
+// varint encoding of the submessage preambles (if present). So even if all
+// fields are allow-listed, the output might NOT be bitwise identical to the
+// input (but it will be semantically equivalent). Simple fields and strings
+// are instead copied as they are, when possible.
 // Furthermore the enable_field_usage_tracking() method allows to keep track of
 // a histogram of allowed / denied fields. It slows down filtering and is
 // intended only on host tools.
@@ -128,6 +129,18 @@ class MessageFilter {
   // It gives a 20-25% speedup (265ms vs 215ms for a 25MB trace).
   void FilterOneByte(uint8_t octet) PERFETTO_ALWAYS_INLINE;
 
+  // Filters, starting at |ptr|, the fields that are entirely within [ptr, end)
+  // without going through the byte-by-byte tokenizer. Consecutive fields that
+  // are allowed as they are (simple fields and strings/bytes) are copied in
+  // output with a single memcpy, without re-encoding them. Stops at the first
+  // field that needs the slow path (e.g. split across input slices, or
+  // malformed) and returns the pointer to it.
+  const uint8_t* FilterFieldsFast(const uint8_t* ptr, const uint8_t* end);
+
+  // Pops the current message, whose input has been fully consumed, and
+  // backfills its length in output.
+  void PopState() PERFETTO_ALWAYS_INLINE;
+
   // No-inline because this is a slowpath (only when usage tracking is enabled).
   void IncrementCurrentFieldUsage(uint32_t field_id,
                                   bool allowed) PERFETTO_NO_INLINE;
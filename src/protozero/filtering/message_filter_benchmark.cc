@@ -16,22 +16,37 @@
 
 #include <algorithm>
 #include <string>
+#include <vector>
 
 #include "perfetto/ext/base/file_utils.h"
+#include "perfetto/protozero/proto_decoder.h"
 #include "src/base/test/utils.h"
 #include "src/protozero/filtering/message_filter.h"
 
-static void BM_ProtozeroMessageFilter(benchmark::State& state) {
+namespace {
+
+std::string ReadTestTrace() {
   std::string trace_data;
   static const char kTestTrace[] = "test/data/example_android_trace_30s.pb";
   perfetto::base::ReadFile(perfetto::base::GetTestDataPath(kTestTrace),
                            &trace_data);
   PERFETTO_CHECK(!trace_data.empty());
+  return trace_data;
+}
 
+std::string ReadFullTraceFilter() {
   std::string filter;
   static const char kFullTraceFilter[] = "test/data/full_trace_filter.bytecode";
   perfetto::base::ReadFile(kFullTraceFilter, &filter);
   PERFETTO_CHECK(!filter.empty());
+  return filter;
+}
+
+}  // namespace
+
+static void BM_ProtozeroMessageFilter(benchmark::State& state) {
+  std::string trace_data = ReadTestTrace();
+  std::string filter = ReadFullTraceFilter();
 
   protozero::MessageFilter filt;
   filt.LoadFilterBytecode(filter.data(), filter.size());
@@ -46,3 +61,40 @@ static void BM_ProtozeroMessageFilter(benchmark::State& state) {
 }
 
 BENCHMARK(BM_ProtozeroMessageFilter);
+
+// Filters the trace one TracePacket at a time, as TracingServiceImpl does,
+// with each packet split in slices of |state.range(0)| bytes, like the chunks
+// of the shared memory buffer.
+static void BM_ProtozeroMessageFilterPackets(benchmark::State& state) {
+  std::string trace_data = ReadTestTrace();
+  std::string filter = ReadFullTraceFilter();
+
+  protozero::MessageFilter filt;
+  filt.LoadFilterBytecode(filter.data(), filter.size());
+  static const uint32_t kTracePacketField[] = {1};
+  PERFETTO_CHECK(filt.SetFilterRoot(kTracePacketField, 1));
+
+  const size_t slice_size = static_cast<size_t>(state.range(0));
+  std::vector<std::vector<protozero::MessageFilter::InputSlice>> packets;
+  protozero::ProtoDecoder trace(trace_data.data(), trace_data.size());
+  for (auto field = trace.ReadField(); field.valid();
+       field = trace.ReadField()) {
+    packets.emplace_back();
+    for (size_t off = 0; off < field.size(); off += slice_size) {
+      packets.back().push_back(
+          {field.data() + off, std::min(slice_size, field.size() - off)});
+    }
+  }
+
+  for (auto _ : state) {
+    for (const auto& slices : packets) {
+      auto res = filt.FilterMessageFragments(slices.data(), slices.size());
+      benchmark::DoNotOptimize(res);
+    }
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(
+      static_cast<int64_t>(state.iterations() * trace_data.size()));
+}
+
+BENCHMARK(BM_ProtozeroMessageFilterPackets)->Arg(256)->Arg(4096);
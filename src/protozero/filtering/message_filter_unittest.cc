@@ -25,6 +25,7 @@
 #include "perfetto/protozero/proto_utils.h"
 #include "perfetto/protozero/scattered_heap_buffer.h"
 #include "protos/perfetto/trace/trace.pb.h"
+#include "src/protozero/filtering/filter_bytecode_generator.h"
 #include "src/protozero/filtering/filter_util.h"
 #include "src/protozero/filtering/message_filter.h"
 
@@ -354,6 +355,91 @@ TEST(MessageFilterTest, MalformedInput) {
   }
 }
 
+// Filters the same message split in slices of all the sizes, so that fields
+// go through both the fast path (fields entirely within a slice) and the
+// byte-by-byte slow path (fields split across slices).
+TEST(MessageFilterTest, FragmentedInput) {
+  FilterBytecodeGenerator gen;
+  gen.AddSimpleField(1);
+  gen.AddSimpleField(2);
+  gen.AddNestedField(3, 1);
+  gen.AddSimpleField(5);
+  gen.EndMessage();
+  gen.AddSimpleField(1);
+  gen.AddNestedField(2, 1);
+  gen.EndMessage();
+  std::string bytecode = gen.Serialize();
+
+  HeapBuffered<Message> msg;
+  msg->AppendVarInt(/*field_id=*/1, 42);
+  msg->AppendString(/*field_id=*/2, "a string that spans some slices");
+  msg->AppendVarInt(/*field_id=*/4, 99);  // Not allowed.
+  auto* nest = msg->BeginNestedMessage<Message>(/*field_id=*/3);
+  nest->AppendVarInt(/*field_id=*/1, 1000);
+  nest->AppendString(/*field_id=*/3, "not allowed");
+  auto* nest2 = nest->BeginNestedMessage<Message>(/*field_id=*/2);
+  nest2->AppendFixed(/*field_id=*/1, static_cast<uint64_t>(-1));
+  nest2->Finalize();
+  nest->Finalize();
+  msg->AppendFixed(/*field_id=*/5, 123u);
+  msg->AppendString(/*field_id=*/6, "not allowed");
+  std::vector<uint8_t> encoded = msg.SerializeAsArray();
+
+  MessageFilter flt;
+  ASSERT_TRUE(flt.LoadFilterBytecode(bytecode.data(), bytecode.size()));
+  auto expected = flt.FilterMessage(encoded.data(), encoded.size());
+  ASSERT_FALSE(expected.error);
+
+  ProtoDecoder dec(expected.data.get(), expected.size);
+  EXPECT_EQ(dec.FindField(1).as_uint32(), 42u);
+  EXPECT_EQ(dec.FindField(2).as_std_string(), "a string that spans some slices");
+  EXPECT_FALSE(dec.FindField(4).valid());
+  EXPECT_EQ(dec.FindField(5).as_uint32(), 123u);
+  EXPECT_FALSE(dec.FindField(6).valid());
+  ProtoDecoder nest_dec(dec.FindField(3).as_bytes());
+  EXPECT_EQ(nest_dec.FindField(1).as_uint32(), 1000u);
+  EXPECT_FALSE(nest_dec.FindField(3).valid());
+  ProtoDecoder nest2_dec(nest_dec.FindField(2).as_bytes());
+  EXPECT_EQ(nest2_dec.FindField(1).as_uint64(), static_cast<uint64_t>(-1));
+
+  for (size_t slice_size = 1; slice_size < encoded.size(); ++slice_size) {
+    std::vector<MessageFilter::InputSlice> slices;
+    for (size_t i = 0; i < encoded.size(); i += slice_size) {
+      slices.push_back(MessageFilter::InputSlice{
+          encoded.data() + i, std::min(slice_size, encoded.size() - i)});
+    }
+    auto filtered = flt.FilterMessageFragments(slices.data(), slices.size());
+    ASSERT_FALSE(filtered.error) << slice_size;
+    ASSERT_EQ(filtered.size, expected.size) << slice_size;
+    EXPECT_EQ(memcmp(filtered.data.get(), expected.data.get(), filtered.size),
+              0)
+        << slice_size;
+  }
+}
+
+// Simple fields and strings are passed through as they are, including the
+// redundant varint encodings.
+TEST(MessageFilterTest, RedundantVarIntPassthrough) {
+  FilterBytecodeGenerator gen;
+  gen.AddSimpleField(1);
+  gen.AddSimpleField(2);
+  gen.EndMessage();
+  std::string bytecode = gen.Serialize();
+
+  static const uint8_t kData[]{
+      0x08, 0xAA, 0x80, 0x00,  // Field id=1 value=42, redundant varint.
+      0x88, 0x00, 0x01,        // Field id=1 value=1, redundant preamble.
+      0x12, 0x82, 0x00, 0x61, 0x62,  // String id=2 "ab", redundant length.
+      0x18, 0x01,                    // Not allowed varint field id=3.
+  };
+  MessageFilter flt;
+  ASSERT_TRUE(flt.LoadFilterBytecode(bytecode.data(), bytecode.size()));
+  auto res = flt.FilterMessage(kData, sizeof(kData));
+  EXPECT_FALSE(res.error);
+  ASSERT_EQ(res.size, sizeof(kData) - 2);
+  EXPECT_EQ(memcmp(kData, res.data.get(), res.size), 0);
+}
+
 // It processes a real test trace with a real filter. The filter has been
 // obtained from the full upstream perfetto proto (+ re-adding the for_testing
 // field which got removed after adding most test traces). This covers the most
@@ -156,6 +156,17 @@ ParseFieldResult ParseOneField(const uint8_t* const buffer,
   return res;
 }
 
+// Returns the index of the lowest set bit of |x|, which must be != 0.
+inline uint32_t CountTrailingZeros(uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+  return static_cast<uint32_t>(__builtin_ctzll(x));
+#else
+  unsigned long index;
+  _BitScanForward64(&index, x);
+  return static_cast<uint32_t>(index);
+#endif
+}
+
 }  // namespace
 
 Field ProtoDecoder::FindField(uint32_t field_id) {
@@ -261,4 +272,73 @@ void TypedProtoDecoderBase::ExpandHeapStorage() {
   size_ = new_size;
 }
 
+size_t PackedVarIntDecoder::Decode(uint64_t* out, size_t max_values) {
+  constexpr uint64_t kContinuationBits = 0x8080808080808080ULL;
+  const uint8_t* ptr = read_ptr_;
+  size_t num_values = 0;
+  while (num_values < max_values && ptr != end_) {
+    // While at least 8 bytes are left, decode the varints with a single load
+    // rather than a byte at a time. Only the varints of at most 8 bytes (i.e.
+    // values < 2^56) take this path.
+    if (PERFETTO_LIKELY(end_ - ptr >= 8)) {
+      uint64_t word;
+      memcpy(&word, ptr, sizeof(word));
+      // The high bit of each byte which terminates a varint.
+      uint64_t stop_bits = ~word & kContinuationBits;
+      if (stop_bits == kContinuationBits && max_values - num_values >= 8) {
+        // A run of single-byte varints, common for small enums and deltas.
+        // Stay in this loop for the whole run rather than going back through
+        // the checks of the outer one for every word.
+        do {
+          for (size_t i = 0; i < 8; i++)
+            out[num_values + i] = ptr[i];
+          num_values += 8;
+          ptr += 8;
+          if (end_ - ptr < 8 || max_values - num_values < 8)
+            break;
+          memcpy(&word, ptr, sizeof(word));
+        } while ((word & kContinuationBits) == 0);
+        continue;
+      }
+      if (PERFETTO_LIKELY(stop_bits)) {
+        // Decode all the varints which end within the word. Only the read
+        // pointer update depends on the previous load, so the decoding of
+        // consecutive words can overlap.
+        uint32_t consumed_bits = 0;
+        do {
+          const uint32_t end_bit = CountTrailingZeros(stop_bits) + 1;
+          uint64_t x = (word & ~kContinuationBits) >> consumed_bits;
+          const uint32_t num_bits = end_bit - consumed_bits;
+          if (num_bits < 64)
+            x &= (1ULL << num_bits) - 1;
+          // Squeeze out the continuation bits: first within each pair of
+          // bytes, then within each 32-bit half and finally in the whole word.
+          x = (x & 0x007f007f007f007fULL) | ((x & 0x7f007f007f007f00ULL) >> 1);
+          x = (x & 0x00003fff00003fffULL) | ((x & 0x3fff00003fff0000ULL) >> 2);
+          x = (x & 0x000000000fffffffULL) | ((x & 0x0fffffff00000000ULL) >> 4);
+          out[num_values++] = x;
+          consumed_bits = end_bit;
+          stop_bits &= stop_bits - 1;
+        } while (stop_bits && num_values < max_values);
+        ptr += consumed_bits / 8;
+        continue;
+      }
+    }
+
+    // Varints longer than 8 bytes, or close to the end of the buffer.
+    uint64_t value = 0;
+    const uint8_t* next = ParseVarInt(ptr, end_, &value);
+    if (PERFETTO_UNLIKELY(next == ptr)) {
+      // Truncated varint: give up on the rest of the field.
+      parse_error_ = true;
+      ptr = end_;
+      break;
+    }
+    out[num_values++] = value;
+    ptr = next;
+  }
+  read_ptr_ = ptr;
+  return num_values;
+}
+
 }  // namespace protozero
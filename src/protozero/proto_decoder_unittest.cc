@@ -16,6 +16,10 @@
 
 #include "perfetto/protozero/proto_decoder.h"
 
+#include <limits>
+#include <random>
+#include <vector>
+
 #include "perfetto/ext/base/utils.h"
 #include "perfetto/protozero/message.h"
 #include "perfetto/protozero/proto_utils.h"
@@ -533,6 +537,54 @@ TEST(ProtoDecoderTest, MalformedPackedVarIntBuffer) {
   ASSERT_TRUE(parse_error);
 }
 
+TEST(ProtoDecoderTest, PackedVarIntDecoder) {
+  // Values of every encoded length (1 to 10 bytes), in runs of single-byte
+  // varints and mixed with each other.
+  std::minstd_rand rnd(0);
+  std::vector<uint64_t> expected;
+  for (int i = 0; i < 100; i++)
+    expected.push_back(static_cast<uint64_t>(i));
+  for (int i = 0; i < 1000; i++) {
+    uint64_t value = (static_cast<uint64_t>(rnd()) << 32) | rnd();
+    expected.push_back(value >> (rnd() % 64));
+  }
+  expected.push_back(std::numeric_limits<uint64_t>::max());
+  PackedVarInt buf;
+  for (uint64_t value : expected)
+    buf.Append(value);
+
+  for (size_t batch_size : {1u, 7u, 8u, 64u, 2000u}) {
+    PackedVarIntDecoder decoder(buf.data(), buf.size());
+    std::vector<uint64_t> values(batch_size);
+    std::vector<uint64_t> decoded;
+    while (size_t n = decoder.Decode(values.data(), batch_size))
+      decoded.insert(decoded.end(), values.begin(), values.begin() + n);
+    EXPECT_TRUE(decoder.done());
+    EXPECT_FALSE(decoder.parse_error());
+    EXPECT_EQ(decoded, expected) << batch_size;
+  }
+
+  // An unset field decodes to nothing.
+  PackedVarIntDecoder empty(ConstBytes{nullptr, 0});
+  uint64_t value;
+  EXPECT_EQ(empty.Decode(&value, 1), 0u);
+  EXPECT_TRUE(empty.done());
+  EXPECT_FALSE(empty.parse_error());
+}
+
+TEST(ProtoDecoderTest, PackedVarIntDecoderTruncated) {
+  PackedVarInt buf;
+  for (uint64_t i = 0; i < 16; i++)
+    buf.Append(i << 20);
+
+  PackedVarIntDecoder decoder(buf.data(), buf.size() - 1);
+  uint64_t values[32];
+  EXPECT_EQ(decoder.Decode(values, 32), 15u);
+  EXPECT_EQ(values[14], 14u << 20);
+  EXPECT_TRUE(decoder.parse_error());
+  EXPECT_EQ(decoder.Decode(values, 32), 0u);
+}
+
 // Tests that big field ids (> 0xffff) are just skipped but don't fail parsing.
 // This is a regression test for b/145339282 (DataSourceConfig.for_testing
 // having a very large ID == 268435455 until Android R).
@@ -0,0 +1,90 @@
+// Copyright (C) 2023 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <benchmark/benchmark.h>
+
+#include <random>
+#include <vector>
+
+#include "perfetto/protozero/packed_repeated_fields.h"
+#include "perfetto/protozero/proto_decoder.h"
+
+namespace {
+
+constexpr size_t kNumValues = 1 << 16;
+
+// Packs |kNumValues| random values of 1 to |max_bits| bits, e.g. 7 for the
+// single-byte varints of small enums, 30 for the timestamp deltas of the
+// compact sched events.
+std::vector<uint8_t> MakePackedVarInts(int max_bits) {
+  std::minstd_rand rnd(0);
+  protozero::PackedVarInt packed;
+  for (size_t i = 0; i < kNumValues; i++) {
+    uint64_t value = (static_cast<uint64_t>(rnd()) << 32) | rnd();
+    packed.Append(value >> (64 - 1 - rnd() % static_cast<uint32_t>(max_bits)));
+  }
+  return std::vector<uint8_t>(packed.data(), packed.data() + packed.size());
+}
+
+void BM_ProtoDecoderPackedVarIntIterator(benchmark::State& state) {
+  std::vector<uint8_t> packed =
+      MakePackedVarInts(static_cast<int>(state.range(0)));
+  for (auto _ : state) {
+    bool parse_error = false;
+    uint64_t sum = 0;
+    for (protozero::PackedRepeatedFieldIterator<
+             protozero::proto_utils::ProtoWireType::kVarInt, uint64_t>
+             it(packed.data(), packed.size(), &parse_error);
+         it; ++it) {
+      sum += *it;
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations() *
+                                               packed.size()));
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations() *
+                                               kNumValues));
+}
+
+void BM_ProtoDecoderPackedVarIntDecoder(benchmark::State& state) {
+  std::vector<uint8_t> packed =
+      MakePackedVarInts(static_cast<int>(state.range(0)));
+  uint64_t values[64];
+  for (auto _ : state) {
+    protozero::PackedVarIntDecoder decoder(packed.data(), packed.size());
+    uint64_t sum = 0;
+    while (size_t n = decoder.Decode(values, 64)) {
+      for (size_t i = 0; i < n; i++)
+        sum += values[i];
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations() *
+                                               packed.size()));
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations() *
+                                               kNumValues));
+}
+
+}  // namespace
+
+BENCHMARK(BM_ProtoDecoderPackedVarIntIterator)
+    ->Arg(7)
+    ->Arg(14)
+    ->Arg(30)
+    ->Arg(63);
+BENCHMARK(BM_ProtoDecoderPackedVarIntDecoder)
+    ->Arg(7)
+    ->Arg(14)
+    ->Arg(30)
+    ->Arg(63);
@@ -16,9 +16,13 @@
 
 #include "src/trace_processor/importers/ftrace/ftrace_tokenizer.h"
 
+#include <algorithm>
+#include <array>
+
 #include "perfetto/base/logging.h"
 #include "perfetto/protozero/proto_decoder.h"
 #include "perfetto/protozero/proto_utils.h"
+#include "perfetto/trace_processor/trace_blob.h"
 #include "src/trace_processor/importers/proto/packet_sequence_state.h"
 #include "src/trace_processor/sorter/trace_sorter.h"
 #include "src/trace_processor/storage/stats.h"
@@ -32,8 +36,12 @@ namespace perfetto {
 namespace trace_processor {
 
 using protozero::ProtoDecoder;
+using protozero::proto_utils::MakeTagLengthDelimited;
 using protozero::proto_utils::MakeTagVarInt;
 using protozero::proto_utils::ParseVarInt;
+using protozero::proto_utils::WriteRedundantVarInt;
+using protozero::proto_utils::WriteVarInt;
+using protozero::proto_utils::ZigZagDecode;
 
 using protos::pbzero::BuiltinClock;
 using protos::pbzero::FtraceClock;
@@ -53,6 +61,53 @@ PERFETTO_ALWAYS_INLINE base::StatusOr<int64_t> ResolveTraceTime(
   return context->clock_tracker->ToTraceTime(clock_id, ts);
 }
 
+// The compact sched events' fields are stored in a structure-of-arrays style,
+// using a packed repeated field per event field. Decodes all the fields in
+// step, a batch of events at a time, which is much faster than walking a
+// PackedRepeatedFieldIterator per field.
+class CompactSchedFieldsDecoder {
+ public:
+  static constexpr size_t kNumFields = 5;
+  static constexpr size_t kBatchSize = 64;
+
+  explicit CompactSchedFieldsDecoder(
+      std::array<protozero::PackedVarIntDecoder, kNumFields> fields)
+      : fields_(fields) {}
+
+  // Decodes the fields of the next batch of events into values(). Returns the
+  // number of events decoded, 0 once any of the fields is exhausted.
+  size_t DecodeNextBatch() {
+    if (size_mismatch_)
+      return 0;
+    size_t num_events = fields_[0].Decode(values_[0], kBatchSize);
+    for (size_t i = 1; i < kNumFields; i++) {
+      size_t num_values = fields_[i].Decode(values_[i], num_events);
+      if (PERFETTO_UNLIKELY(num_values != num_events)) {
+        // Only the events with all their fields can be recovered.
+        size_mismatch_ = true;
+        num_events = std::min(num_events, num_values);
+      }
+    }
+    return num_events;
+  }
+
+  const uint64_t* values(size_t field) const { return values_[field]; }
+
+  // Whether all the packed buffers were decoded correctly, and fully.
+  bool ok() const {
+    for (const auto& field : fields_) {
+      if (field.parse_error() || !field.done())
+        return false;
+    }
+    return !size_mismatch_;
+  }
+
+ private:
+  std::array<protozero::PackedVarIntDecoder, kNumFields> fields_;
+  uint64_t values_[kNumFields][kBatchSize];
+  bool size_mismatch_ = false;
+};
+
 }  // namespace
 
 PERFETTO_ALWAYS_INLINE
@@ -107,6 +162,10 @@ base::Status FtraceTokenizer::TokenizeFtraceBundle(
     TokenizeFtraceCompactSched(cpu, clock_id, decoder.compact_sched());
   }
 
+  if (decoder.has_compact_events()) {
+    TokenizeFtraceCompactEvents(cpu, clock_id, decoder.compact_events(), state);
+  }
+
   for (auto it = decoder.event(); it; ++it) {
     TokenizeFtraceEvent(cpu, clock_id, bundle.slice(it->data(), it->size()),
                         state);
@@ -186,47 +245,50 @@ void FtraceTokenizer::TokenizeFtraceCompactSchedSwitch(
     ClockTracker::ClockId clock_id,
     const FtraceEventBundle::CompactSched::Decoder& compact,
     const std::vector<StringId>& string_table) {
+  using CompactSched = FtraceEventBundle::CompactSched;
+
   // Accumulator for timestamp deltas.
   int64_t timestamp_acc = 0;
 
-  // The events' fields are stored in a structure-of-arrays style, using packed
-  // repeated fields. Walk each repeated field in step to recover individual
-  // events.
-  bool parse_error = false;
-  auto timestamp_it = compact.switch_timestamp(&parse_error);
-  auto pstate_it = compact.switch_prev_state(&parse_error);
-  auto npid_it = compact.switch_next_pid(&parse_error);
-  auto nprio_it = compact.switch_next_prio(&parse_error);
-  auto comm_it = compact.switch_next_comm_index(&parse_error);
-  for (; timestamp_it && pstate_it && npid_it && nprio_it && comm_it;
-       ++timestamp_it, ++pstate_it, ++npid_it, ++nprio_it, ++comm_it) {
-    InlineSchedSwitch event{};
-
-    // delta-encoded timestamp
-    timestamp_acc += static_cast<int64_t>(*timestamp_it);
-    int64_t event_timestamp = timestamp_acc;
-
-    // index into the interned string table
-    PERFETTO_DCHECK(*comm_it < string_table.size());
-    event.next_comm = string_table[*comm_it];
-
-    event.prev_state = *pstate_it;
-    event.next_pid = *npid_it;
-    event.next_prio = *nprio_it;
-
-    base::StatusOr<int64_t> timestamp =
-        ResolveTraceTime(context_, clock_id, event_timestamp);
-    if (!timestamp.ok()) {
-      DlogWithLimit(timestamp.status());
-      return;
+  CompactSchedFieldsDecoder fields({
+      compact.GetPackedVarInts(CompactSched::kSwitchTimestampFieldNumber),
+      compact.GetPackedVarInts(CompactSched::kSwitchPrevStateFieldNumber),
+      compact.GetPackedVarInts(CompactSched::kSwitchNextPidFieldNumber),
+      compact.GetPackedVarInts(CompactSched::kSwitchNextPrioFieldNumber),
+      compact.GetPackedVarInts(CompactSched::kSwitchNextCommIndexFieldNumber),
+  });
+  while (size_t num_events = fields.DecodeNextBatch()) {
+    const uint64_t* timestamps = fields.values(0);
+    const uint64_t* prev_states = fields.values(1);
+    const uint64_t* next_pids = fields.values(2);
+    const uint64_t* next_prios = fields.values(3);
+    const uint64_t* comm_indices = fields.values(4);
+    for (size_t i = 0; i < num_events; i++) {
+      InlineSchedSwitch event{};
+
+      // delta-encoded timestamp
+      timestamp_acc += static_cast<int64_t>(timestamps[i]);
+      int64_t event_timestamp = timestamp_acc;
+
+      // index into the interned string table
+      PERFETTO_DCHECK(comm_indices[i] < string_table.size());
+      event.next_comm = string_table[static_cast<uint32_t>(comm_indices[i])];
+
+      event.prev_state = static_cast<int64_t>(prev_states[i]);
+      event.next_pid = static_cast<int32_t>(next_pids[i]);
+      event.next_prio = static_cast<int32_t>(next_prios[i]);
+
+      base::StatusOr<int64_t> timestamp =
+          ResolveTraceTime(context_, clock_id, event_timestamp);
+      if (!timestamp.ok()) {
+        DlogWithLimit(timestamp.status());
+        return;
+      }
+      context_->sorter->PushInlineFtraceEvent(cpu, *timestamp, event);
     }
-    context_->sorter->PushInlineFtraceEvent(cpu, *timestamp, event);
   }
 
-  // Check that all packed buffers were decoded correctly, and fully.
-  bool sizes_match =
-      !timestamp_it && !pstate_it && !npid_it && !nprio_it && !comm_it;
-  if (parse_error || !sizes_match)
+  if (!fields.ok())
     context_->storage->IncrementStats(stats::compact_sched_has_parse_errors);
 }
 
@@ -235,49 +297,212 @@ void FtraceTokenizer::TokenizeFtraceCompactSchedWaking(
     ClockTracker::ClockId clock_id,
     const FtraceEventBundle::CompactSched::Decoder& compact,
     const std::vector<StringId>& string_table) {
+  using CompactSched = FtraceEventBundle::CompactSched;
+
   // Accumulator for timestamp deltas.
   int64_t timestamp_acc = 0;
 
-  // The events' fields are stored in a structure-of-arrays style, using packed
-  // repeated fields. Walk each repeated field in step to recover individual
-  // events.
+  CompactSchedFieldsDecoder fields({
+      compact.GetPackedVarInts(CompactSched::kWakingTimestampFieldNumber),
+      compact.GetPackedVarInts(CompactSched::kWakingPidFieldNumber),
+      compact.GetPackedVarInts(CompactSched::kWakingTargetCpuFieldNumber),
+      compact.GetPackedVarInts(CompactSched::kWakingPrioFieldNumber),
+      compact.GetPackedVarInts(CompactSched::kWakingCommIndexFieldNumber),
+  });
+  while (size_t num_events = fields.DecodeNextBatch()) {
+    const uint64_t* timestamps = fields.values(0);
+    const uint64_t* pids = fields.values(1);
+    const uint64_t* target_cpus = fields.values(2);
+    const uint64_t* prios = fields.values(3);
+    const uint64_t* comm_indices = fields.values(4);
+    for (size_t i = 0; i < num_events; i++) {
+      InlineSchedWaking event{};
+
+      // delta-encoded timestamp
+      timestamp_acc += static_cast<int64_t>(timestamps[i]);
+      int64_t event_timestamp = timestamp_acc;
+
+      // index into the interned string table
+      PERFETTO_DCHECK(comm_indices[i] < string_table.size());
+      event.comm = string_table[static_cast<uint32_t>(comm_indices[i])];
+
+      event.pid = static_cast<int32_t>(pids[i]);
+      event.target_cpu = static_cast<int32_t>(target_cpus[i]);
+      event.prio = static_cast<int32_t>(prios[i]);
+
+      base::StatusOr<int64_t> timestamp =
+          ResolveTraceTime(context_, clock_id, event_timestamp);
+      if (!timestamp.ok()) {
+        DlogWithLimit(timestamp.status());
+        return;
+      }
+      context_->sorter->PushInlineFtraceEvent(cpu, *timestamp, event);
+    }
+  }
+
+  if (!fields.ok())
+    context_->storage->IncrementStats(stats::compact_sched_has_parse_errors);
+}
+
+PERFETTO_ALWAYS_INLINE
+void FtraceTokenizer::TokenizeFtraceCompactEvents(
+    uint32_t cpu,
+    ClockTracker::ClockId clock_id,
+    protozero::ConstBytes packet,
+    PacketSequenceState* state) {
+  FtraceEventBundle::CompactEvents::Decoder compact_events(packet);
+  for (auto it = compact_events.batch(); it; ++it) {
+    TokenizeFtraceCompactEventsBatch(cpu, clock_id, *it, state);
+  }
+}
+
+// Rebuilds the FtraceEvent protos of a batch in the compact format (see
+// FtraceEventBundle.CompactEvents), so that they go through the same parsing
+// as the events that were recorded in the normal form. All the events of the
+// batch are written into a single blob, that is shared by their views.
+void FtraceTokenizer::TokenizeFtraceCompactEventsBatch(
+    uint32_t cpu,
+    ClockTracker::ClockId clock_id,
+    protozero::ConstBytes packet,
+    PacketSequenceState* state) {
+  using protos::pbzero::FtraceEvent;
+  using ValueIterator = protozero::PackedRepeatedFieldIterator<
+      protozero::proto_utils::ProtoWireType::kVarInt, uint64_t>;
+  using Batch = FtraceEventBundle::CompactEvents::Batch;
+  using Column = FtraceEventBundle::CompactEvents::Column;
+
+  // Field ids must fit in the 29 bits of a proto tag.
+  constexpr uint32_t kMaxFieldId = (1u << 29) - 1;
+
+  struct ColumnIterator {
+    uint32_t field_id;
+    bool is_signed;
+    ValueIterator value_it;
+  };
+  struct EventSlice {
+    int64_t timestamp;
+    size_t offset;
+    size_t size;
+  };
+
+  Batch::Decoder batch(packet);
   bool parse_error = false;
-  auto timestamp_it = compact.waking_timestamp(&parse_error);
-  auto pid_it = compact.waking_pid(&parse_error);
-  auto tcpu_it = compact.waking_target_cpu(&parse_error);
-  auto prio_it = compact.waking_prio(&parse_error);
-  auto comm_it = compact.waking_comm_index(&parse_error);
+  uint32_t event_id = batch.event_id();
+  if (event_id == 0 || event_id > kMaxFieldId ||
+      event_id == FtraceEvent::kTimestampFieldNumber ||
+      event_id == FtraceEvent::kPidFieldNumber) {
+    context_->storage->IncrementStats(stats::compact_events_has_parse_errors);
+    return;
+  }
 
-  for (; timestamp_it && pid_it && tcpu_it && prio_it && comm_it;
-       ++timestamp_it, ++pid_it, ++tcpu_it, ++prio_it, ++comm_it) {
-    InlineSchedWaking event{};
+  std::vector<ColumnIterator> columns;
+  for (auto it = batch.column(); it; ++it) {
+    Column::Decoder column(*it);
+    if (column.field_id() == 0 || column.field_id() > kMaxFieldId)
+      parse_error = true;
+    columns.push_back(ColumnIterator{column.field_id(), column.is_signed(),
+                                     column.value(&parse_error)});
+  }
+
+  size_t num_events = 0;
+  for (auto it = batch.timestamp(&parse_error); it; ++it)
+    num_events++;
+  if (parse_error) {
+    context_->storage->IncrementStats(stats::compact_events_has_parse_errors);
+    return;
+  }
+  if (num_events == 0)
+    return;
+
+  // Upper bound of the size of an event: the pid and the tag and the length
+  // of the event's message, plus each of the fields.
+  const size_t kMaxEventSize =
+      protozero::proto_utils::kMaxSimpleFieldEncodedSize +
+      protozero::proto_utils::kMaxTagEncodedSize +
+      protozero::proto_utils::kMessageLengthFieldSize +
+      columns.size() * protozero::proto_utils::kMaxSimpleFieldEncodedSize;
+  TraceBlob blob = TraceBlob::Allocate(num_events * kMaxEventSize);
+  uint8_t* const blob_start = blob.data();
+  uint8_t* write_ptr = blob_start;
+
+  // Events are sliced out of the blob once it has been fully written.
+  std::vector<EventSlice> events;
+  events.reserve(num_events);
+
+  // Accumulator for timestamp deltas.
+  int64_t timestamp_acc = 0;
+  auto timestamp_it = batch.timestamp(&parse_error);
+  auto pid_it = batch.pid(&parse_error);
+  const bool has_pid = static_cast<bool>(pid_it);
+  bool sizes_match = true;
+  for (; timestamp_it; ++timestamp_it) {
+    uint8_t* const event_start = write_ptr;
 
     // delta-encoded timestamp
     timestamp_acc += static_cast<int64_t>(*timestamp_it);
-    int64_t event_timestamp = timestamp_acc;
 
-    // index into the interned string table
-    PERFETTO_DCHECK(*comm_it < string_table.size());
-    event.comm = string_table[*comm_it];
+    if (has_pid) {
+      if (!pid_it) {
+        sizes_match = false;
+        break;
+      }
+      write_ptr = WriteVarInt(MakeTagVarInt(FtraceEvent::kPidFieldNumber),
+                              write_ptr);
+      write_ptr = WriteVarInt(*pid_it, write_ptr);
+      ++pid_it;
+    }
 
-    event.pid = *pid_it;
-    event.target_cpu = *tcpu_it;
-    event.prio = *prio_it;
+    write_ptr = WriteVarInt(MakeTagLengthDelimited(event_id), write_ptr);
+    uint8_t* const size_field = write_ptr;
+    write_ptr += protozero::proto_utils::kMessageLengthFieldSize;
+    uint8_t* const event_fields_start = write_ptr;
+    for (ColumnIterator& column : columns) {
+      if (!column.value_it) {
+        sizes_match = false;
+        break;
+      }
+      write_ptr = WriteVarInt(MakeTagVarInt(column.field_id), write_ptr);
+      uint64_t value = *column.value_it;
+      if (column.is_signed) {
+        write_ptr = WriteVarInt(ZigZagDecode(value), write_ptr);
+      } else {
+        write_ptr = WriteVarInt(value, write_ptr);
+      }
+      ++column.value_it;
+    }
+    if (!sizes_match)
+      break;
+    WriteRedundantVarInt(static_cast<uint32_t>(write_ptr - event_fields_start),
+                         size_field);
 
+    events.push_back(
+        EventSlice{timestamp_acc, static_cast<size_t>(event_start - blob_start),
+                   static_cast<size_t>(write_ptr - event_start)});
+  }
+  PERFETTO_DCHECK(write_ptr <= blob_start + blob.size());
+
+  TraceBlobView blob_view(std::move(blob));
+  for (const EventSlice& event : events) {
     base::StatusOr<int64_t> timestamp =
-        ResolveTraceTime(context_, clock_id, event_timestamp);
+        ResolveTraceTime(context_, clock_id, event.timestamp);
     if (!timestamp.ok()) {
       DlogWithLimit(timestamp.status());
       return;
     }
-    context_->sorter->PushInlineFtraceEvent(cpu, *timestamp, event);
+    context_->sorter->PushFtraceEvent(
+        cpu, *timestamp, blob_view.slice_off(event.offset, event.size),
+        state->current_generation());
   }
 
   // Check that all packed buffers were decoded correctly, and fully.
-  bool sizes_match =
-      !timestamp_it && !pid_it && !tcpu_it && !prio_it && !comm_it;
+  if (pid_it)
+    sizes_match = false;
+  for (const ColumnIterator& column : columns) {
+    if (column.value_it)
+      sizes_match = false;
+  }
   if (parse_error || !sizes_match)
-    context_->storage->IncrementStats(stats::compact_sched_has_parse_errors);
+    context_->storage->IncrementStats(stats::compact_events_has_parse_errors);
 }
 
 void FtraceTokenizer::HandleFtraceClockSnapshot(int64_t ftrace_ts,
@@ -241,6 +241,29 @@ void ProfileModule::ParsePerfSample(
     return;
   }
 
+  // Not a sample, but the producer's counters for the data source, cumulative
+  // since its start.
+  if (sample.has_profiler_stats()) {
+    PerfSample::ProfilerStats::Decoder stats(sample.profiler_stats());
+    int session_id = static_cast<int>(sampling_stream.perf_session_id);
+    TraceStorage* storage = context_->storage.get();
+    storage->SetIndexedStats(stats::perf_samples_unwound, session_id,
+                             static_cast<int64_t>(stats.samples_unwound()));
+    storage->SetIndexedStats(
+        stats::perf_unwind_queue_latency_total_ns, session_id,
+        static_cast<int64_t>(stats.unwind_queue_latency_total_ns()));
+    storage->SetIndexedStats(
+        stats::perf_unwind_queue_latency_max_ns, session_id,
+        static_cast<int64_t>(stats.unwind_queue_latency_max_ns()));
+    storage->SetIndexedStats(
+        stats::perf_unwind_duration_total_ns, session_id,
+        static_cast<int64_t>(stats.unwind_duration_total_ns()));
+    storage->SetIndexedStats(
+        stats::perf_unwind_duration_max_ns, session_id,
+        static_cast<int64_t>(stats.unwind_duration_max_ns()));
+    return;
+  }
+
   // Proper sample, populate the |perf_sample| table with everything except the
   // recorded counter values, which go to |counter|.
   context_->event_tracker->PushCounter(
@@ -292,6 +315,9 @@ void ProfileModule::ParsePerfSample(
     unwind_error_id = storage->InternString(
         ProfilePacketUtils::StringifyStackUnwindError(unwind_error));
   }
+  if (sample.unwinding_cache_hit())
+    storage->IncrementStats(stats::perf_unwinding_cache_hits);
+
   tables::PerfSampleTable::Row sample_row(ts, utid, sample.cpu(), cpu_mode_id,
                                           cs_id, unwind_error_id,
                                           sampling_stream.perf_session_id);
@@ -394,6 +420,9 @@ void ProfileModule::ParseProfilePacket(
     context_->storage->IncrementIndexedStats(
         stats::heapprofd_unwind_samples, static_cast<int>(entry.pid()),
         static_cast<int64_t>(stats.heap_samples()));
+    context_->storage->IncrementIndexedStats(
+        stats::heapprofd_unwinding_cache_hits, static_cast<int>(entry.pid()),
+        static_cast<int64_t>(stats.unwinding_cache_hits()));
     context_->storage->IncrementIndexedStats(
         stats::heapprofd_client_spinlock_blocked, static_cast<int>(entry.pid()),
         static_cast<int64_t>(stats.client_spinlock_blocked_us()));
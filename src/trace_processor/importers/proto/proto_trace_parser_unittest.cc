@@ -18,6 +18,7 @@
 
 #include "perfetto/base/logging.h"
 #include "perfetto/ext/base/string_view.h"
+#include "perfetto/protozero/packed_repeated_fields.h"
 #include "perfetto/protozero/scattered_heap_buffer.h"
 #include "perfetto/trace_processor/trace_blob.h"
 #include "src/trace_processor/importers/common/args_tracker.h"
@@ -610,6 +611,75 @@ TEST_F(ProtoTraceParserTest, LoadCpuFreq) {
   EXPECT_EQ(context_.storage->cpu_counter_track_table().cpu()[0], 10u);
 }
 
+TEST_F(ProtoTraceParserTest, LoadCompactCpuFreq) {
+  auto* bundle = trace_->add_packet()->set_ftrace_events();
+  bundle->set_cpu(12);
+  auto* batch = bundle->set_compact_events()->add_batch();
+  batch->set_event_id(protos::pbzero::FtraceEvent::kCpuFrequencyFieldNumber);
+
+  // Timestamps are delta-encoded.
+  protozero::PackedVarInt timestamp;
+  timestamp.Append(1000);
+  timestamp.Append(500);
+  batch->set_timestamp(timestamp);
+  protozero::PackedVarInt pid;
+  pid.Append(12);
+  pid.Append(12);
+  batch->set_pid(pid);
+
+  auto* cpu_id = batch->add_column();
+  cpu_id->set_field_id(protos::pbzero::CpuFrequencyFtraceEvent::kCpuIdFieldNumber);
+  protozero::PackedVarInt cpu_id_value;
+  cpu_id_value.Append(10);
+  cpu_id_value.Append(10);
+  cpu_id->set_value(cpu_id_value);
+
+  auto* state = batch->add_column();
+  state->set_field_id(protos::pbzero::CpuFrequencyFtraceEvent::kStateFieldNumber);
+  protozero::PackedVarInt state_value;
+  state_value.Append(2000);
+  state_value.Append(3000);
+  state->set_value(state_value);
+
+  EXPECT_CALL(*event_, PushCounter(1000, DoubleEq(2000), TrackId{0}));
+  EXPECT_CALL(*event_, PushCounter(1500, DoubleEq(3000), TrackId{0}));
+  Tokenize();
+  context_.sorter->ExtractEventsForced();
+
+  EXPECT_EQ(context_.storage->cpu_counter_track_table().cpu()[0], 10u);
+  EXPECT_EQ(context_.storage->stats()[stats::compact_events_has_parse_errors]
+                .value,
+            0);
+}
+
+TEST_F(ProtoTraceParserTest, LoadCompactEventsWithMismatchedColumns) {
+  auto* bundle = trace_->add_packet()->set_ftrace_events();
+  bundle->set_cpu(12);
+  auto* batch = bundle->set_compact_events()->add_batch();
+  batch->set_event_id(protos::pbzero::FtraceEvent::kCpuFrequencyFieldNumber);
+
+  protozero::PackedVarInt timestamp;
+  timestamp.Append(1000);
+  timestamp.Append(500);
+  batch->set_timestamp(timestamp);
+
+  // Only one value for two events.
+  auto* state = batch->add_column();
+  state->set_field_id(protos::pbzero::CpuFrequencyFtraceEvent::kStateFieldNumber);
+  protozero::PackedVarInt state_value;
+  state_value.Append(2000);
+  state->set_value(state_value);
+
+  // The events before the mismatch are still imported.
+  EXPECT_CALL(*event_, PushCounter(1000, DoubleEq(2000), TrackId{0}));
+  Tokenize();
+  context_.sorter->ExtractEventsForced();
+
+  EXPECT_EQ(context_.storage->stats()[stats::compact_events_has_parse_errors]
+                .value,
+            1);
+}
+
 TEST_F(ProtoTraceParserTest, LoadCpuFreqKHz) {
   auto* packet = trace_->add_packet();
   uint64_t ts = 1000;
@@ -196,6 +196,8 @@ namespace stats {
       "Time spent unwinding callstacks."),                                     \
   F(heapprofd_unwind_samples,             kIndexed, kInfo,     kTrace,         \
       "Number of samples unwound."),                                           \
+  F(heapprofd_unwinding_cache_hits,       kIndexed, kInfo,     kTrace,         \
+      "Number of samples whose callstack was reused without unwinding."),      \
   F(heapprofd_client_spinlock_blocked,    kIndexed, kInfo,     kTrace,         \
        "Time (us) the heapprofd client was blocked on the spinlock."),         \
   F(heapprofd_last_profile_timestamp,     kIndexed, kInfo,     kTrace,         \
@@ -214,6 +216,7 @@ namespace stats {
        "The file to be parsed can't be opened. This can happend when "         \
        "the file name is not found or no permission to access the file"),      \
   F(compact_sched_has_parse_errors,       kSingle,  kError,    kTrace,    ""), \
+  F(compact_events_has_parse_errors,      kSingle,  kError,    kTrace,    ""), \
   F(misplaced_end_event,                  kSingle,  kDataLoss, kAnalysis, ""), \
   F(truncated_sys_write_duration,         kSingle,  kDataLoss,  kAnalysis,     \
       "Count of sys_write slices that have a truncated duration to resolve "   \
@@ -230,6 +233,14 @@ namespace stats {
   F(perf_guardrail_stop_ts,               kIndexed, kDataLoss, kTrace,    ""), \
   F(perf_samples_skipped,                 kSingle,  kInfo,     kTrace,    ""), \
   F(perf_samples_skipped_dataloss,        kSingle,  kDataLoss, kTrace,    ""), \
+  F(perf_unwinding_cache_hits,            kSingle,  kInfo,     kTrace,         \
+      "Number of samples whose callstack was reused without unwinding."),      \
+  F(perf_samples_unwound,                 kIndexed, kInfo,     kTrace,         \
+      "Samples unwound by traced_perf, indexed by perf session id."),          \
+  F(perf_unwind_queue_latency_total_ns,   kIndexed, kInfo,     kTrace,    ""), \
+  F(perf_unwind_queue_latency_max_ns,     kIndexed, kInfo,     kTrace,    ""), \
+  F(perf_unwind_duration_total_ns,        kIndexed, kInfo,     kTrace,    ""), \
+  F(perf_unwind_duration_max_ns,          kIndexed, kInfo,     kTrace,    ""), \
   F(memory_snapshot_parser_failure,       kSingle,  kError,    kAnalysis, ""), \
   F(thread_time_in_state_out_of_order,    kSingle,  kError,    kAnalysis, ""), \
   F(thread_time_in_state_unknown_cpu_freq,                                     \
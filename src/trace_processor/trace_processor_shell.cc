@@ -1041,11 +1041,15 @@ base::Status LoadTrace(const std::string& trace_file_path, double* size_mb) {
                            trace_file_path.c_str(), read_status.c_message());
   }
 
+  const char* symbolizer_backend = getenv("PERFETTO_SYMBOLIZER_BACKEND");
   std::unique_ptr<profiling::Symbolizer> symbolizer =
       profiling::LocalSymbolizerOrDie(profiling::GetPerfettoBinaryPath(),
-                                      getenv("PERFETTO_SYMBOLIZER_MODE"));
+                                      getenv("PERFETTO_SYMBOLIZER_MODE"),
+                                      symbolizer_backend);
 
   if (symbolizer) {
+    symbolizer = profiling::MaybeAddSymbolizationCache(std::move(symbolizer),
+                                                       symbolizer_backend);
     profiling::SymbolizeDatabase(
         g_tp, symbolizer.get(), [](const std::string& trace_proto) {
           std::unique_ptr<uint8_t[]> buf(new uint8_t[trace_proto.size()]);
@@ -37,16 +37,22 @@ namespace trace_to_text {
 // be prepended to the profile to attach the symbol information.
 int SymbolizeProfile(std::istream* input, std::ostream* output) {
   std::unique_ptr<profiling::Symbolizer> symbolizer;
+  const char* backend = nullptr;
   const char* breakpad_dir = getenv("BREAKPAD_SYMBOL_DIR");
   if (breakpad_dir == nullptr) {
+    backend = getenv("PERFETTO_SYMBOLIZER_BACKEND");
     symbolizer = profiling::LocalSymbolizerOrDie(
-        profiling::GetPerfettoBinaryPath(), getenv("PERFETTO_SYMBOLIZER_MODE"));
+        profiling::GetPerfettoBinaryPath(), getenv("PERFETTO_SYMBOLIZER_MODE"),
+        backend);
   } else {
+    backend = "breakpad";
     symbolizer.reset(new profiling::BreakpadSymbolizer(breakpad_dir));
   }
 
   if (!symbolizer)
     PERFETTO_FATAL("No symbolizer selected");
+  symbolizer =
+      profiling::MaybeAddSymbolizationCache(std::move(symbolizer), backend);
   trace_processor::Config config;
   std::unique_ptr<trace_processor::TraceProcessor> tp =
       trace_processor::TraceProcessor::CreateInstance(config);
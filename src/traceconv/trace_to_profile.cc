@@ -67,11 +67,15 @@ std::string GetRandomString(size_t n) {
 }
 
 void MaybeSymbolize(trace_processor::TraceProcessor* tp) {
+  const char* backend = getenv("PERFETTO_SYMBOLIZER_BACKEND");
   std::unique_ptr<profiling::Symbolizer> symbolizer =
       profiling::LocalSymbolizerOrDie(profiling::GetPerfettoBinaryPath(),
-                                      getenv("PERFETTO_SYMBOLIZER_MODE"));
+                                      getenv("PERFETTO_SYMBOLIZER_MODE"),
+                                      backend);
   if (!symbolizer)
     return;
+  symbolizer =
+      profiling::MaybeAddSymbolizationCache(std::move(symbolizer), backend);
   profiling::SymbolizeDatabase(tp, symbolizer.get(),
                                [tp](const std::string& trace_proto) {
                                  IngestTraceOrDie(tp, trace_proto);
@@ -16,6 +16,7 @@
 
 #include "src/traced/probes/common/cpu_freq_info.h"
 
+#include <fcntl.h>
 #include <unistd.h>
 
 #include <set>
@@ -124,25 +125,40 @@ std::string CpuFreqInfo::ReadFile(std::string path) {
 const std::vector<uint32_t>& CpuFreqInfo::ReadCpuCurrFreq() {
   // Check if capacity of cpu_curr_freq_ is enough for all CPUs
   auto num_cpus = static_cast<size_t>(sysconf(_SC_NPROCESSORS_CONF));
-  if (cpu_curr_freq_.size() < num_cpus)
+  if (cpu_curr_freq_.size() < num_cpus) {
     cpu_curr_freq_.resize(num_cpus);
+    cpu_curr_freq_fds_.resize(num_cpus);
+  }
 
   for (uint32_t i = 0; i < cpu_curr_freq_.size(); i++) {
     // Read CPU current frequency. Set 0 for offline/disabled cpus.
-    std::string buf(ReadFile(sysfs_cpu_path_ + "/cpu" + std::to_string(i) +
-                             "/cpufreq/scaling_cur_freq"));
-    if (buf.empty()) {
-      cpu_curr_freq_[i] = 0;
-      continue;
-    }
-    auto freq = base::StringToUInt32(base::StripSuffix(buf, "\n"));
-    if (!freq.has_value()) {
-      cpu_curr_freq_[i] = 0;
-      continue;
-    }
-    cpu_curr_freq_[i] = freq.value();
+    cpu_curr_freq_[i] = ReadCpuCurrFreq(i);
   }
   return cpu_curr_freq_;
 }
 
+uint32_t CpuFreqInfo::ReadCpuCurrFreq(uint32_t cpu) {
+  base::ScopedFile& fd = cpu_curr_freq_fds_[cpu];
+  if (!fd) {
+    base::StackString<256> path("%s/cpu%" PRIu32 "/cpufreq/scaling_cur_freq",
+                                sysfs_cpu_path_.c_str(), cpu);
+    fd = base::OpenFile(path.c_str(), O_RDONLY);
+    if (!fd)
+      return 0;
+  }
+  char buf[32];
+  ssize_t rsize = pread(*fd, buf, sizeof(buf) - 1, 0);
+  if (rsize <= 0) {
+    // The cpufreq directory goes away when the CPU is hotplugged out, open it
+    // again on the next read.
+    fd.reset();
+    return 0;
+  }
+  size_t len = static_cast<size_t>(rsize);
+  if (buf[len - 1] == '\n')
+    len--;
+  buf[len] = '\0';
+  return base::CStringToUInt32(buf).value_or(0);
+}
+
 }  // namespace perfetto
@@ -48,8 +48,12 @@ class CpuFreqInfo {
   std::vector<size_t> frequencies_index_;
   // Placeholder for CPU current frequency, refresh in ReadCpuCurrFreq()
   std::vector<uint32_t> cpu_curr_freq_;
+  // cpu_curr_freq_fds_[cpu] is kept open across ReadCpuCurrFreq() calls and
+  // re-read with pread(), the kernel regenerates the contents each time.
+  std::vector<base::ScopedFile> cpu_curr_freq_fds_;
 
   std::string ReadFile(std::string path);
+  uint32_t ReadCpuCurrFreq(uint32_t cpu);
 };
 
 }  // namespace perfetto
@@ -60,5 +60,23 @@ TEST_F(CpuFreqInfoTest, CpuFreqInfo) {
   EXPECT_EQ(cpu_freq_info->GetCpuFreqIndex(1u, 5u), 0u);
 }
 
+TEST_F(CpuFreqInfoTest, ReadCpuCurrFreq) {
+  auto cpu_freq_info = GetCpuFreqInfo();
+
+  // The second read goes through the files kept open by the first one.
+  for (int i = 0; i < 2; i++) {
+    const std::vector<uint32_t>& freqs = cpu_freq_info->ReadCpuCurrFreq();
+    ASSERT_GE(freqs.size(), 1u);
+    EXPECT_EQ(freqs[0], 2650000u);
+    // The test system can have a single core.
+    if (freqs.size() > 1) {
+      EXPECT_EQ(freqs[1], 3698200u);
+    }
+    // The other CPUs have no cpufreq directory.
+    for (size_t cpu = 2; cpu < freqs.size(); cpu++)
+      EXPECT_EQ(freqs[cpu], 0u);
+  }
+}
+
 }  // namespace
 }  // namespace perfetto
@@ -18,8 +18,10 @@
 
 #include "perfetto/protozero/scattered_heap_buffer.h"
 #include "src/base/test/test_task_runner.h"
+#include "src/base/test/tmp_dir_tree.h"
 #include "src/base/test/utils.h"
 #include "src/traced/probes/filesystem/lru_inode_cache.h"
+#include "src/traced/probes/filesystem/persistent_inode_cache.h"
 #include "src/tracing/core/null_trace_writer.h"
 
 #include "test/gtest_and_gmock.h"
@@ -45,13 +47,15 @@ class TestInodeFileDataSource : public InodeFileDataSource {
       std::map<BlockDeviceID, std::unordered_map<Inode, InodeMapValue>>*
           static_file_map,
       LRUInodeCache* cache,
-      std::unique_ptr<TraceWriter> writer)
+      std::unique_ptr<TraceWriter> writer,
+      PersistentInodeCache* persistent_cache)
       : InodeFileDataSource(std::move(cfg),
                             task_runner,
                             tsid,
                             static_file_map,
                             cache,
-                            std::move(writer)) {
+                            std::move(writer),
+                            persistent_cache) {
     struct stat buf;
     PERFETTO_CHECK(
         lstat(base::GetTestDataPath("src/traced/probes/filesystem/testdata")
@@ -78,9 +82,13 @@ class InodeFileDataSourceTest : public ::testing::Test {
       DataSourceConfig cfg) {
     return std::unique_ptr<TestInodeFileDataSource>(new TestInodeFileDataSource(
         cfg, &task_runner_, 0, &static_file_map_, &cache_,
-        std::unique_ptr<NullTraceWriter>(new NullTraceWriter)));
+        std::unique_ptr<NullTraceWriter>(new NullTraceWriter),
+        &persistent_cache_));
   }
 
+  base::TmpDirTree tmp_dir_;
+  PersistentInodeCache persistent_cache_{tmp_dir_.AbsolutePath("cache")};
+
   LRUInodeCache cache_{100};
   std::map<BlockDeviceID, std::unordered_map<Inode, InodeMapValue>>
       static_file_map_;
@@ -162,5 +170,76 @@ TEST_F(InodeFileDataSourceTest, TestCache) {
   data_source->OnInodes({{buf.st_ino, buf.st_dev}});
 }
 
+TEST_F(InodeFileDataSourceTest, TestParallelFileSystemScan) {
+  DataSourceConfig ds_config;
+  protozero::HeapBuffered<protos::pbzero::InodeFileConfig> inode_cfg;
+  inode_cfg->set_scan_delay_ms(1);
+  inode_cfg->set_scan_threads(2);
+  ds_config.set_inode_file_config_raw(inode_cfg.SerializeAsString());
+  auto data_source = GetInodeFileDataSource(ds_config);
+
+  struct stat buf;
+  PERFETTO_CHECK(
+      lstat(base::GetTestDataPath(
+                "src/traced/probes/filesystem/testdata/dir1/file1")
+                .c_str(),
+            &buf) != -1);
+
+  auto done = task_runner_.CreateCheckpoint("done");
+  InodeMapValue value(protos::pbzero::InodeFileMap::Entry::Type::FILE,
+                      {base::GetTestDataPath(
+                          "src/traced/probes/filesystem/testdata/dir1/file1")});
+  EXPECT_CALL(*data_source, FillInodeEntry(_, buf.st_ino, Eq(value)))
+      .WillOnce(InvokeWithoutArgs(done));
+
+  data_source->OnInodes({{buf.st_ino, buf.st_dev}});
+  task_runner_.RunUntilCheckpoint("done");
+
+  EXPECT_THAT(cache_.Get(std::make_pair(buf.st_dev, buf.st_ino)),
+              Pointee(Eq(value)));
+}
+
+TEST_F(InodeFileDataSourceTest, TestPersistentCache) {
+  DataSourceConfig ds_config;
+  protozero::HeapBuffered<protos::pbzero::InodeFileConfig> inode_cfg;
+  inode_cfg->set_do_not_scan(true);
+  inode_cfg->set_use_persistent_cache(true);
+  ds_config.set_inode_file_config_raw(inode_cfg.SerializeAsString());
+  auto data_source = GetInodeFileDataSource(ds_config);
+
+  std::string path =
+      base::GetTestDataPath("src/traced/probes/filesystem/testdata/file2");
+  struct stat buf;
+  PERFETTO_CHECK(lstat(path.c_str(), &buf) != -1);
+  persistent_cache_.Insert(buf.st_dev, buf.st_ino,
+                           protos::pbzero::InodeFileMap::Entry::Type::FILE,
+                           path);
+
+  InodeMapValue value(protos::pbzero::InodeFileMap::Entry::Type::FILE, {path});
+  EXPECT_CALL(*data_source, FillInodeEntry(_, buf.st_ino, Eq(value)));
+
+  data_source->OnInodes({{buf.st_ino, buf.st_dev}});
+}
+
+TEST_F(InodeFileDataSourceTest, TestPersistentCacheNotEnabled) {
+  DataSourceConfig ds_config;
+  protozero::HeapBuffered<protos::pbzero::InodeFileConfig> inode_cfg;
+  inode_cfg->set_do_not_scan(true);
+  ds_config.set_inode_file_config_raw(inode_cfg.SerializeAsString());
+  auto data_source = GetInodeFileDataSource(ds_config);
+
+  std::string path =
+      base::GetTestDataPath("src/traced/probes/filesystem/testdata/file2");
+  struct stat buf;
+  PERFETTO_CHECK(lstat(path.c_str(), &buf) != -1);
+  persistent_cache_.Insert(buf.st_dev, buf.st_ino,
+                           protos::pbzero::InodeFileMap::Entry::Type::FILE,
+                           path);
+
+  EXPECT_CALL(*data_source, FillInodeEntry(_, buf.st_ino, _)).Times(0);
+
+  data_source->OnInodes({{buf.st_ino, buf.st_dev}});
+}
+
 }  // namespace
 }  // namespace perfetto
@@ -0,0 +1,204 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/traced/probes/filesystem/parallel_file_scanner.h"
+
+#include <dirent.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <algorithm>
+
+#include "perfetto/base/logging.h"
+#include "perfetto/ext/base/scoped_file.h"
+#include "protos/perfetto/trace/filesystem/inode_file_map.pbzero.h"
+
+namespace perfetto {
+namespace {
+
+std::string JoinPaths(const std::string& one, const char* other) {
+  std::string result;
+  result.reserve(one.size() + strlen(other) + 1);
+  result += one;
+  if (!result.empty() && result.back() != '/')
+    result += '/';
+  result += other;
+  return result;
+}
+
+}  // namespace
+
+ParallelFileScanner::ParallelFileScanner(
+    std::vector<std::string> root_directories,
+    FileScanner::Delegate* delegate,
+    base::TaskRunner* task_runner,
+    uint32_t num_threads,
+    uint32_t batch_size)
+    : delegate_(delegate),
+      task_runner_(task_runner),
+      num_threads_(std::max(num_threads, 1u)),
+      batch_size_(std::max(batch_size, 1u)),
+      queue_(std::move(root_directories)),
+      weak_factory_(this) {}
+
+ParallelFileScanner::~ParallelFileScanner() {
+  Stop();
+  // Joins the threads, once RunWorker() returns.
+  workers_.clear();
+}
+
+void ParallelFileScanner::Scan() {
+  PERFETTO_DCHECK(workers_.empty());
+  // Only dereferenced in the tasks posted back to |task_runner_|.
+  auto weak_this = weak_factory_.GetWeakPtr();
+  for (uint32_t i = 0; i < num_threads_; i++) {
+    workers_.emplace_back(new base::ThreadTaskRunner(
+        base::ThreadTaskRunner::CreateAndStart("inode_scan" +
+                                               std::to_string(i))));
+    workers_.back()->PostTask([this, weak_this] { RunWorker(weak_this); });
+  }
+}
+
+void ParallelFileScanner::Stop() {
+  stopped_.store(true, std::memory_order_relaxed);
+  std::lock_guard<std::mutex> lock(mutex_);
+  queue_cv_.notify_all();
+}
+
+void ParallelFileScanner::RunWorker(
+    base::WeakPtr<ParallelFileScanner> weak_this) {
+  std::vector<Entry> entries;
+  std::vector<std::string> subdirectories;
+  for (;;) {
+    std::string directory;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      queue_cv_.wait(lock, [this] {
+        return stopped_.load(std::memory_order_relaxed) || !queue_.empty() ||
+               busy_workers_ == 0;
+      });
+      // The scan is over when no directory is left, and no other worker can
+      // add more.
+      if (stopped_.load(std::memory_order_relaxed) || queue_.empty())
+        break;
+      directory = std::move(queue_.back());
+      queue_.pop_back();
+      busy_workers_++;
+    }
+
+    ScanDirectory(directory, &entries, &subdirectories);
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (std::string& subdirectory : subdirectories)
+        queue_.emplace_back(std::move(subdirectory));
+      busy_workers_--;
+      if (!subdirectories.empty() || busy_workers_ == 0)
+        queue_cv_.notify_all();
+    }
+    subdirectories.clear();
+
+    if (entries.size() >= batch_size_) {
+      PostEntries(weak_this, std::move(entries));
+      entries.clear();
+    }
+  }
+  if (!entries.empty())
+    PostEntries(weak_this, std::move(entries));
+
+  bool last_worker;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    last_worker = ++exited_workers_ == num_threads_;
+  }
+  // Posted after the entries of all the workers, as the task runner runs the
+  // tasks in order.
+  if (last_worker) {
+    task_runner_->PostTask([weak_this] {
+      if (weak_this)
+        weak_this->OnWorkersDone();
+    });
+  }
+}
+
+void ParallelFileScanner::ScanDirectory(
+    const std::string& directory,
+    std::vector<Entry>* entries,
+    std::vector<std::string>* subdirectories) {
+  base::ScopedDir dir(opendir(directory.c_str()));
+  if (!dir) {
+    PERFETTO_DPLOG("opendir %s", directory.c_str());
+    return;
+  }
+  struct stat buf;
+  if (fstat(dirfd(dir.get()), &buf) != 0) {
+    PERFETTO_DPLOG("fstat %s", directory.c_str());
+    return;
+  }
+  const BlockDeviceID block_device_id = buf.st_dev;
+
+  while (struct dirent* entry = readdir(dir.get())) {
+    if (stopped_.load(std::memory_order_relaxed))
+      return;
+    if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+      continue;
+    std::string path = JoinPaths(directory, entry->d_name);
+    protos::pbzero::InodeFileMap_Entry_Type type =
+        protos::pbzero::InodeFileMap::Entry::Type::UNKNOWN;
+    // Readdir and stat not guaranteed to have directory info for all systems
+    if (entry->d_type == DT_DIR) {
+      subdirectories->push_back(path);
+      type = protos::pbzero::InodeFileMap::Entry::Type::DIRECTORY;
+    } else if (entry->d_type == DT_REG) {
+      type = protos::pbzero::InodeFileMap::Entry::Type::FILE;
+    }
+    entries->push_back({block_device_id, entry->d_ino, std::move(path), type});
+  }
+}
+
+void ParallelFileScanner::PostEntries(
+    base::WeakPtr<ParallelFileScanner> weak_this,
+    std::vector<Entry> entries) {
+  // std::function needs a copyable lambda: share the entries instead of
+  // moving them in.
+  auto shared_entries =
+      std::make_shared<const std::vector<Entry>>(std::move(entries));
+  task_runner_->PostTask([weak_this, shared_entries] {
+    if (weak_this)
+      weak_this->OnEntries(*shared_entries);
+  });
+}
+
+void ParallelFileScanner::OnEntries(const std::vector<Entry>& entries) {
+  for (const Entry& entry : entries) {
+    if (stopped_.load(std::memory_order_relaxed))
+      return;
+    if (!delegate_->OnInodeFound(entry.block_device_id, entry.inode,
+                                 entry.path, entry.type)) {
+      Stop();
+    }
+  }
+}
+
+void ParallelFileScanner::OnWorkersDone() {
+  PERFETTO_DCHECK(!done_);
+  done_ = true;
+  // The delegate is allowed to destroy this object from here.
+  delegate_->OnInodeScanDone();
+}
+
+}  // namespace perfetto
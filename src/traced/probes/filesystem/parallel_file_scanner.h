@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACED_PROBES_FILESYSTEM_PARALLEL_FILE_SCANNER_H_
+#define SRC_TRACED_PROBES_FILESYSTEM_PARALLEL_FILE_SCANNER_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "perfetto/base/task_runner.h"
+#include "perfetto/ext/base/thread_task_runner.h"
+#include "perfetto/ext/base/weak_ptr.h"
+#include "perfetto/ext/traced/data_source_types.h"
+#include "src/traced/probes/filesystem/file_scanner.h"
+
+namespace perfetto {
+
+// Walks the same directory trees as FileScanner, but on worker threads that
+// share a queue of directories, so that the subtrees of a mount point are
+// read in parallel. The entries found are handed over to the delegate on
+// |task_runner|, in batches of |batch_size|. The delegate can stop the scan
+// by returning false from OnInodeFound(), and OnInodeScanDone() is called
+// once all the workers are idle.
+class ParallelFileScanner {
+ public:
+  ParallelFileScanner(std::vector<std::string> root_directories,
+                      FileScanner::Delegate* delegate,
+                      base::TaskRunner* task_runner,
+                      uint32_t num_threads,
+                      uint32_t batch_size);
+
+  // Stops the scan, if still running, and joins the worker threads.
+  ~ParallelFileScanner();
+
+  ParallelFileScanner(const ParallelFileScanner&) = delete;
+  ParallelFileScanner& operator=(const ParallelFileScanner&) = delete;
+
+  void Scan();
+
+ private:
+  struct Entry {
+    BlockDeviceID block_device_id;
+    Inode inode;
+    std::string path;
+    InodeFileMap_Entry_Type type;
+  };
+
+  // Worker threads.
+  void RunWorker(base::WeakPtr<ParallelFileScanner> weak_this);
+  void ScanDirectory(const std::string& directory,
+                     std::vector<Entry>* entries,
+                     std::vector<std::string>* subdirectories);
+  void PostEntries(base::WeakPtr<ParallelFileScanner> weak_this,
+                   std::vector<Entry> entries);
+
+  // Main thread.
+  void OnEntries(const std::vector<Entry>& entries);
+  void OnWorkersDone();
+  void Stop();
+
+  FileScanner::Delegate* const delegate_;
+  base::TaskRunner* const task_runner_;
+  const uint32_t num_threads_;
+  const uint32_t batch_size_;
+
+  std::atomic<bool> stopped_{false};
+
+  // Start of mutex protected members.
+  std::mutex mutex_;
+  std::condition_variable queue_cv_;
+  std::vector<std::string> queue_;
+  uint32_t busy_workers_ = 0;
+  uint32_t exited_workers_ = 0;
+  // End of mutex protected members.
+
+  std::vector<std::unique_ptr<base::ThreadTaskRunner>> workers_;
+  bool done_ = false;
+  base::WeakPtrFactory<ParallelFileScanner> weak_factory_;  // Keep last.
+};
+
+}  // namespace perfetto
+
+#endif  // SRC_TRACED_PROBES_FILESYSTEM_PARALLEL_FILE_SCANNER_H_
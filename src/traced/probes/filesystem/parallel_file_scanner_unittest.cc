@@ -0,0 +1,164 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/traced/probes/filesystem/parallel_file_scanner.h"
+
+#include <sys/stat.h>
+
+#include <set>
+#include <string>
+
+#include "perfetto/base/logging.h"
+#include "protos/perfetto/trace/filesystem/inode_file_map.pbzero.h"
+#include "src/base/test/test_task_runner.h"
+#include "src/base/test/tmp_dir_tree.h"
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace {
+
+using ::testing::_;
+using ::testing::InvokeWithoutArgs;
+using ::testing::Return;
+
+using EntryType = protos::pbzero::InodeFileMap::Entry::Type;
+
+class MockDelegate : public FileScanner::Delegate {
+ public:
+  MOCK_METHOD(bool,
+              OnInodeFound,
+              (BlockDeviceID, Inode, const std::string&, InodeFileMap_Entry_Type),
+              (override));
+  MOCK_METHOD(void, OnInodeScanDone, (), (override));
+};
+
+// A tree of |num_dirs| directories, each with |files_per_dir| files and one
+// subdirectory with one more file.
+class TestTree {
+ public:
+  TestTree(int num_dirs, int files_per_dir) {
+    for (int d = 0; d < num_dirs; d++) {
+      std::string dir = "dir" + std::to_string(d);
+      AddDir(dir);
+      for (int f = 0; f < files_per_dir; f++)
+        AddFile(dir + "/file" + std::to_string(f));
+      AddDir(dir + "/sub");
+      AddFile(dir + "/sub/file");
+    }
+  }
+
+  const std::string& path() const { return tree_.path(); }
+  const std::set<std::string>& files() const { return files_; }
+  const std::set<std::string>& dirs() const { return dirs_; }
+
+ private:
+  void AddDir(const std::string& dir) {
+    tree_.AddDir(dir);
+    dirs_.insert(tree_.AbsolutePath(dir));
+  }
+  void AddFile(const std::string& file) {
+    tree_.AddFile(file, "");
+    files_.insert(tree_.AbsolutePath(file));
+  }
+
+  base::TmpDirTree tree_;
+  std::set<std::string> files_;
+  std::set<std::string> dirs_;
+};
+
+TEST(ParallelFileScannerTest, FindFiles) {
+  TestTree tree(/*num_dirs=*/20, /*files_per_dir=*/10);
+  base::TestTaskRunner task_runner;
+  MockDelegate delegate;
+
+  std::set<std::string> files;
+  std::set<std::string> dirs;
+  EXPECT_CALL(delegate, OnInodeFound(_, _, _, _))
+      .WillRepeatedly([&](BlockDeviceID block_device_id, Inode inode,
+                          const std::string& path,
+                          InodeFileMap_Entry_Type type) {
+        struct stat buf;
+        PERFETTO_CHECK(lstat(path.c_str(), &buf) == 0);
+        EXPECT_EQ(block_device_id, buf.st_dev);
+        EXPECT_EQ(inode, buf.st_ino);
+        if (type == EntryType::DIRECTORY) {
+          EXPECT_TRUE(dirs.insert(path).second) << path;
+        } else {
+          EXPECT_EQ(type, EntryType::FILE);
+          EXPECT_TRUE(files.insert(path).second) << path;
+        }
+        return true;
+      });
+  EXPECT_CALL(delegate, OnInodeScanDone())
+      .WillOnce(InvokeWithoutArgs(task_runner.CreateCheckpoint("done")));
+
+  ParallelFileScanner scanner({tree.path()}, &delegate, &task_runner,
+                              /*num_threads=*/4, /*batch_size=*/16);
+  scanner.Scan();
+  task_runner.RunUntilCheckpoint("done");
+
+  EXPECT_EQ(files, tree.files());
+  EXPECT_EQ(dirs, tree.dirs());
+}
+
+TEST(ParallelFileScannerTest, Stop) {
+  TestTree tree(/*num_dirs=*/20, /*files_per_dir=*/10);
+  base::TestTaskRunner task_runner;
+  MockDelegate delegate;
+
+  // Stops as soon as the delegate returns false. Entries that were already
+  // found by the workers aren't handed over anymore.
+  EXPECT_CALL(delegate, OnInodeFound(_, _, _, _)).WillOnce(Return(false));
+  EXPECT_CALL(delegate, OnInodeScanDone())
+      .WillOnce(InvokeWithoutArgs(task_runner.CreateCheckpoint("done")));
+
+  ParallelFileScanner scanner({tree.path()}, &delegate, &task_runner,
+                              /*num_threads=*/4, /*batch_size=*/1);
+  scanner.Scan();
+  task_runner.RunUntilCheckpoint("done");
+}
+
+TEST(ParallelFileScannerTest, MissingRoot) {
+  base::TestTaskRunner task_runner;
+  MockDelegate delegate;
+  EXPECT_CALL(delegate, OnInodeFound(_, _, _, _)).Times(0);
+  EXPECT_CALL(delegate, OnInodeScanDone())
+      .WillOnce(InvokeWithoutArgs(task_runner.CreateCheckpoint("done")));
+
+  ParallelFileScanner scanner({"/does/not/exist"}, &delegate, &task_runner,
+                              /*num_threads=*/2, /*batch_size=*/1);
+  scanner.Scan();
+  task_runner.RunUntilCheckpoint("done");
+}
+
+TEST(ParallelFileScannerTest, DestroyWhileScanning) {
+  TestTree tree(/*num_dirs=*/20, /*files_per_dir=*/10);
+  base::TestTaskRunner task_runner;
+  MockDelegate delegate;
+  EXPECT_CALL(delegate, OnInodeFound(_, _, _, _)).Times(0);
+  EXPECT_CALL(delegate, OnInodeScanDone()).Times(0);
+
+  {
+    ParallelFileScanner scanner({tree.path()}, &delegate, &task_runner,
+                                /*num_threads=*/4, /*batch_size=*/1);
+    scanner.Scan();
+  }
+  // The tasks posted by the workers are no-ops once the scanner is gone.
+  task_runner.RunUntilIdle();
+}
+
+}  // namespace
+}  // namespace perfetto
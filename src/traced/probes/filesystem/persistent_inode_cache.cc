@@ -0,0 +1,207 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/traced/probes/filesystem/persistent_inode_cache.h"
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "perfetto/base/logging.h"
+#include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/scoped_file.h"
+
+namespace perfetto {
+namespace {
+
+// File layout, in host byte order (the file never leaves the device):
+//   char magic[8] = kMagic
+//   repeated {
+//     uint64_t block_device_id
+//     uint64_t inode
+//     int32_t type
+//     uint32_t num_paths
+//     repeated { uint32_t path_size; char path[path_size]; }
+//   }
+constexpr char kMagic[8] = {'P', 'F', 'I', 'N', 'O', 'D', 'E', '1'};
+
+// Sanity bound on the paths read from the file.
+constexpr uint32_t kMaxPathSize = 4096;
+
+template <typename T>
+void Append(std::string* buf, T value) {
+  buf->append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+bool Consume(const char** p, const char* end, T* value) {
+  if (static_cast<size_t>(end - *p) < sizeof(T))
+    return false;
+  memcpy(value, *p, sizeof(T));
+  *p += sizeof(T);
+  return true;
+}
+
+bool IsSameInode(const std::string& path,
+                 BlockDeviceID block_device_id,
+                 Inode inode) {
+  struct stat buf;
+  return lstat(path.c_str(), &buf) == 0 && buf.st_dev == block_device_id &&
+         buf.st_ino == inode;
+}
+
+}  // namespace
+
+PersistentInodeCache::PersistentInodeCache(std::string file_path,
+                                           size_t max_entries)
+    : file_path_(std::move(file_path)), max_entries_(max_entries) {}
+
+PersistentInodeCache::~PersistentInodeCache() = default;
+
+bool PersistentInodeCache::Load() {
+  entries_.clear();
+  dirty_ = false;
+  std::string contents;
+  if (!base::ReadFile(file_path_, &contents))
+    return false;
+  const char* p = contents.data();
+  const char* end = p + contents.size();
+  if (contents.size() < sizeof(kMagic) || memcmp(p, kMagic, sizeof(kMagic))) {
+    PERFETTO_ELOG("Ignoring %s: not an inode cache", file_path_.c_str());
+    return false;
+  }
+  p += sizeof(kMagic);
+  while (p < end && entries_.size() < max_entries_) {
+    uint64_t block_device_id;
+    uint64_t inode;
+    int32_t type;
+    uint32_t num_paths;
+    if (!Consume(&p, end, &block_device_id) || !Consume(&p, end, &inode) ||
+        !Consume(&p, end, &type) || !Consume(&p, end, &num_paths)) {
+      break;
+    }
+    InodeMapValue& value = entries_[{static_cast<BlockDeviceID>(block_device_id),
+                                     static_cast<Inode>(inode)}];
+    value.SetType(type);
+    for (uint32_t i = 0; i < num_paths; i++) {
+      uint32_t path_size;
+      if (!Consume(&p, end, &path_size) || path_size > kMaxPathSize ||
+          static_cast<size_t>(end - p) < path_size) {
+        p = nullptr;
+        break;
+      }
+      value.AddPath(std::string(p, path_size));
+      p += path_size;
+    }
+    if (!p)
+      break;
+  }
+  if (p != end) {
+    PERFETTO_ELOG("Ignoring %s: corrupted", file_path_.c_str());
+    entries_.clear();
+    return false;
+  }
+  return true;
+}
+
+bool PersistentInodeCache::Save() {
+  if (!dirty_)
+    return true;
+  std::string buf(kMagic, sizeof(kMagic));
+  for (const auto& kv : entries_) {
+    Append(&buf, static_cast<uint64_t>(kv.first.first));
+    Append(&buf, static_cast<uint64_t>(kv.first.second));
+    Append(&buf, static_cast<int32_t>(kv.second.type()));
+    Append(&buf, static_cast<uint32_t>(kv.second.paths().size()));
+    for (const std::string& path : kv.second.paths()) {
+      Append(&buf, static_cast<uint32_t>(path.size()));
+      buf.append(path);
+    }
+  }
+
+  // Write a temporary file and rename it, so that a crash can't leave a
+  // truncated cache behind. O_EXCL also prevents following a symlink.
+  std::string tmp_path = file_path_ + ".tmp";
+  unlink(tmp_path.c_str());
+  base::ScopedFile fd(
+      base::OpenFile(tmp_path, O_WRONLY | O_CREAT | O_EXCL, 0600));
+  if (!fd) {
+    PERFETTO_PLOG("Failed to create %s", tmp_path.c_str());
+    return false;
+  }
+  if (base::WriteAll(*fd, buf.data(), buf.size()) !=
+          static_cast<ssize_t>(buf.size()) ||
+      !base::FlushFile(*fd)) {
+    PERFETTO_PLOG("Failed to write %s", tmp_path.c_str());
+    unlink(tmp_path.c_str());
+    return false;
+  }
+  fd.reset();
+  if (rename(tmp_path.c_str(), file_path_.c_str()) != 0) {
+    PERFETTO_PLOG("Failed to rename %s", tmp_path.c_str());
+    unlink(tmp_path.c_str());
+    return false;
+  }
+  dirty_ = false;
+  return true;
+}
+
+const InodeMapValue* PersistentInodeCache::Get(BlockDeviceID block_device_id,
+                                               Inode inode) {
+  auto it = entries_.find({block_device_id, inode});
+  if (it == entries_.end())
+    return nullptr;
+  InodeMapValue& value = it->second;
+  std::set<std::string> valid_paths;
+  for (const std::string& path : value.paths()) {
+    if (IsSameInode(path, block_device_id, inode))
+      valid_paths.insert(path);
+  }
+  if (valid_paths.size() != value.paths().size()) {
+    dirty_ = true;
+    if (valid_paths.empty()) {
+      entries_.erase(it);
+      return nullptr;
+    }
+    value.SetPaths(std::move(valid_paths));
+  }
+  return &value;
+}
+
+void PersistentInodeCache::Insert(BlockDeviceID block_device_id,
+                                  Inode inode,
+                                  InodeFileMap_Entry_Type type,
+                                  const std::string& path) {
+  if (!IsSameInode(path, block_device_id, inode))
+    return;
+  auto it = entries_.find({block_device_id, inode});
+  if (it == entries_.end()) {
+    if (entries_.size() >= max_entries_)
+      return;
+    it = entries_.emplace(InodeKey(block_device_id, inode), InodeMapValue())
+             .first;
+  } else if (it->second.paths().count(path)) {
+    return;
+  }
+  it->second.SetType(type);
+  it->second.AddPath(path);
+  dirty_ = true;
+}
+
+}  // namespace perfetto
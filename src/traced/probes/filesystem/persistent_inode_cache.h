@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACED_PROBES_FILESYSTEM_PERSISTENT_INODE_CACHE_H_
+#define SRC_TRACED_PROBES_FILESYSTEM_PERSISTENT_INODE_CACHE_H_
+
+#include <stddef.h>
+
+#include <map>
+#include <string>
+
+#include "perfetto/ext/traced/data_source_types.h"
+
+namespace perfetto {
+
+// Keeps the inode -> path resolutions of the filesystem scans in a file, so
+// that the next tracing sessions, even after a reboot, can resolve the same
+// inodes without scanning.
+//
+// Entries are keyed by (block device, inode). Both numbers can be reused,
+// e.g. by a file created after a deletion or by the devices of the next boot,
+// so Get() only returns the paths that lstat() still maps to the same block
+// device and inode, and forgets the others. The mtime isn't part of the
+// check: the files written while tracing are the ones most likely to show up
+// in the trace, and they are still at the same path.
+class PersistentInodeCache {
+ public:
+  static constexpr size_t kDefaultMaxEntries = 100000;
+
+  explicit PersistentInodeCache(std::string file_path,
+                                size_t max_entries = kDefaultMaxEntries);
+  ~PersistentInodeCache();
+
+  // Replaces the entries with the ones of the file. Returns false, leaving the
+  // cache empty, if the file doesn't exist or is corrupted.
+  bool Load();
+
+  // Writes the entries to the file, if they changed since the last Load() or
+  // Save(). The file is replaced atomically.
+  bool Save();
+
+  // Returns the still valid paths of the inode, or nullptr.
+  const InodeMapValue* Get(BlockDeviceID block_device_id, Inode inode);
+
+  // Adds |path| to the paths of the inode. Does nothing if the path can't be
+  // lstat()-ed anymore, or if the cache is full.
+  void Insert(BlockDeviceID block_device_id,
+              Inode inode,
+              InodeFileMap_Entry_Type type,
+              const std::string& path);
+
+  size_t size() const { return entries_.size(); }
+  bool dirty() const { return dirty_; }
+
+ private:
+  using InodeKey = std::pair<BlockDeviceID, Inode>;
+
+  PersistentInodeCache(const PersistentInodeCache&) = delete;
+  PersistentInodeCache& operator=(const PersistentInodeCache&) = delete;
+
+  const std::string file_path_;
+  const size_t max_entries_;
+  std::map<InodeKey, InodeMapValue> entries_;
+  bool dirty_ = false;
+};
+
+}  // namespace perfetto
+
+#endif  // SRC_TRACED_PROBES_FILESYSTEM_PERSISTENT_INODE_CACHE_H_
@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/traced/probes/filesystem/persistent_inode_cache.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <string>
+
+#include "perfetto/base/logging.h"
+#include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/scoped_file.h"
+#include "protos/perfetto/trace/filesystem/inode_file_map.pbzero.h"
+#include "src/base/test/tmp_dir_tree.h"
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::IsNull;
+using ::testing::NotNull;
+
+using EntryType = protos::pbzero::InodeFileMap::Entry::Type;
+
+struct stat CheckStat(const std::string& path) {
+  struct stat buf;
+  PERFETTO_CHECK(lstat(path.c_str(), &buf) != -1);
+  return buf;
+}
+
+class PersistentInodeCacheTest : public ::testing::Test {
+ protected:
+  PersistentInodeCacheTest() {
+    tree_.AddFile("file1", "");
+    tree_.AddFile("file2", "");
+    cache_path_ = tree_.AbsolutePath("cache");
+  }
+
+  // Replaces the contents of the cache file, created by a previous Save().
+  void WriteCacheFile(const std::string& contents) {
+    base::ScopedFile fd = base::OpenFile(cache_path_, O_WRONLY | O_TRUNC);
+    PERFETTO_CHECK(fd);
+    PERFETTO_CHECK(base::WriteAll(*fd, contents.data(), contents.size()) ==
+                   static_cast<ssize_t>(contents.size()));
+  }
+
+  base::TmpDirTree tree_;
+  std::string cache_path_;
+};
+
+TEST_F(PersistentInodeCacheTest, SaveAndLoad) {
+  std::string file1 = tree_.AbsolutePath("file1");
+  std::string file2 = tree_.AbsolutePath("file2");
+  struct stat buf1 = CheckStat(file1);
+  struct stat buf2 = CheckStat(file2);
+  {
+    PersistentInodeCache cache(cache_path_);
+    EXPECT_FALSE(cache.Load());
+    cache.Insert(buf1.st_dev, buf1.st_ino, EntryType::FILE, file1);
+    cache.Insert(buf2.st_dev, buf2.st_ino, EntryType::FILE, file2);
+    // Paths that don't point to the inode are not added.
+    cache.Insert(buf1.st_dev, buf1.st_ino, EntryType::FILE, file2);
+    EXPECT_EQ(cache.size(), 2u);
+    EXPECT_TRUE(cache.dirty());
+    EXPECT_TRUE(cache.Save());
+    tree_.TrackFile("cache");
+    EXPECT_FALSE(cache.dirty());
+  }
+
+  PersistentInodeCache cache(cache_path_);
+  ASSERT_TRUE(cache.Load());
+  EXPECT_EQ(cache.size(), 2u);
+  const InodeMapValue* value = cache.Get(buf1.st_dev, buf1.st_ino);
+  ASSERT_THAT(value, NotNull());
+  EXPECT_EQ(value->type(), EntryType::FILE);
+  EXPECT_THAT(value->paths(), ElementsAre(file1));
+  value = cache.Get(buf2.st_dev, buf2.st_ino);
+  ASSERT_THAT(value, NotNull());
+  EXPECT_THAT(value->paths(), ElementsAre(file2));
+  EXPECT_THAT(cache.Get(buf1.st_dev, buf1.st_ino + buf2.st_ino), IsNull());
+  EXPECT_FALSE(cache.dirty());
+}
+
+TEST_F(PersistentInodeCacheTest, ForgetsStaleEntries) {
+  std::string file1 = tree_.AbsolutePath("file1");
+  std::string file2 = tree_.AbsolutePath("file2");
+  struct stat buf1 = CheckStat(file1);
+  PersistentInodeCache cache(cache_path_);
+  cache.Insert(buf1.st_dev, buf1.st_ino, EntryType::FILE, file1);
+  ASSERT_TRUE(cache.Save());
+  tree_.TrackFile("cache");
+
+  // Replace file1 with another file: the path now points to another inode.
+  ASSERT_EQ(rename(file2.c_str(), file1.c_str()), 0);
+  ASSERT_TRUE(base::OpenFile(file2, O_WRONLY | O_CREAT, 0600));
+
+  EXPECT_THAT(cache.Get(buf1.st_dev, buf1.st_ino), IsNull());
+  EXPECT_EQ(cache.size(), 0u);
+  EXPECT_TRUE(cache.dirty());
+}
+
+TEST_F(PersistentInodeCacheTest, MaxEntries) {
+  std::string file1 = tree_.AbsolutePath("file1");
+  std::string file2 = tree_.AbsolutePath("file2");
+  struct stat buf1 = CheckStat(file1);
+  struct stat buf2 = CheckStat(file2);
+  PersistentInodeCache cache(cache_path_, /*max_entries=*/1);
+  cache.Insert(buf1.st_dev, buf1.st_ino, EntryType::FILE, file1);
+  cache.Insert(buf2.st_dev, buf2.st_ino, EntryType::FILE, file2);
+  EXPECT_EQ(cache.size(), 1u);
+  EXPECT_THAT(cache.Get(buf2.st_dev, buf2.st_ino), IsNull());
+}
+
+TEST_F(PersistentInodeCacheTest, Corrupted) {
+  std::string file1 = tree_.AbsolutePath("file1");
+  struct stat buf1 = CheckStat(file1);
+  {
+    PersistentInodeCache cache(cache_path_);
+    cache.Insert(buf1.st_dev, buf1.st_ino, EntryType::FILE, file1);
+    ASSERT_TRUE(cache.Save());
+    tree_.TrackFile("cache");
+  }
+  std::string contents;
+  ASSERT_TRUE(base::ReadFile(cache_path_, &contents));
+
+  // Truncated.
+  WriteCacheFile(contents.substr(0, contents.size() - 1));
+  PersistentInodeCache cache(cache_path_);
+  EXPECT_FALSE(cache.Load());
+  EXPECT_EQ(cache.size(), 0u);
+
+  // Not a cache file.
+  WriteCacheFile("not a cache");
+  EXPECT_FALSE(cache.Load());
+  EXPECT_EQ(cache.size(), 0u);
+}
+
+}  // namespace
+}  // namespace perfetto
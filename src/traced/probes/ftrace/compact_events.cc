@@ -0,0 +1,217 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/traced/probes/ftrace/compact_events.h"
+
+#include "protos/perfetto/config/ftrace/ftrace_config.gen.h"
+#include "protos/perfetto/trace/ftrace/ftrace_event.pbzero.h"
+#include "src/traced/probes/ftrace/proto_translation_table.h"
+
+namespace perfetto {
+
+namespace {
+
+std::optional<CompactEventColumnFormat> ValidateColumnFormat(
+    const Field& field) {
+  CompactEventColumnFormat column{};
+  column.proto_field_id = field.proto_field_id;
+  column.ftrace_offset = field.ftrace_offset;
+  switch (field.strategy) {
+    case kUint8ToUint32:
+    case kUint8ToUint64:
+    case kBoolToUint32:
+    case kBoolToUint64:
+      column.ftrace_size = 1;
+      break;
+    case kUint16ToUint32:
+    case kUint16ToUint64:
+      column.ftrace_size = 2;
+      break;
+    case kUint32ToUint32:
+    case kUint32ToUint64:
+      column.ftrace_size = 4;
+      break;
+    case kUint64ToUint64:
+      column.ftrace_size = 8;
+      break;
+    case kInt8ToInt32:
+    case kInt8ToInt64:
+      column.ftrace_size = 1;
+      column.is_signed = true;
+      break;
+    case kInt16ToInt32:
+    case kInt16ToInt64:
+      column.ftrace_size = 2;
+      column.is_signed = true;
+      break;
+    case kInt32ToInt32:
+    case kInt32ToInt64:
+      column.ftrace_size = 4;
+      column.is_signed = true;
+      break;
+    case kInt64ToInt64:
+      column.ftrace_size = 8;
+      column.is_signed = true;
+      break;
+    case kPid32ToInt32:
+    case kPid32ToInt64:
+      column.ftrace_size = 4;
+      column.is_signed = true;
+      column.is_pid = true;
+      break;
+    // Strings, and values that are translated or collected into the metadata
+    // (inodes, devices, kernel symbols) are only supported by the normal path.
+    case kFixedCStringToString:
+    case kCStringToString:
+    case kStringPtrToString:
+    case kDataLocToString:
+    case kInode32ToUint64:
+    case kInode64ToUint64:
+    case kCommonPid32ToInt32:
+    case kCommonPid32ToInt64:
+    case kDevId32ToUint64:
+    case kDevId64ToUint64:
+    case kFtraceSymAddr64ToUint64:
+    case kInvalidTranslationStrategy:
+      return std::nullopt;
+  }
+  return column;
+}
+
+}  // namespace
+
+std::optional<CompactEventFormat> ValidateFormatForCompactEvent(
+    const Event& event) {
+  using protos::pbzero::FtraceEvent;
+
+  // Events whose parsing isn't a plain field by field translation, or that
+  // have a compact encoding of their own.
+  switch (event.proto_field_id) {
+    case FtraceEvent::kGenericFieldNumber:
+    case FtraceEvent::kSysEnterFieldNumber:
+    case FtraceEvent::kSysExitFieldNumber:
+    case FtraceEvent::kTaskRenameFieldNumber:
+    case FtraceEvent::kSchedSwitchFieldNumber:
+    case FtraceEvent::kSchedWakingFieldNumber:
+      return std::nullopt;
+    default:
+      break;
+  }
+  if (!event.ftrace_event_id || event.fields.empty())
+    return std::nullopt;
+
+  CompactEventFormat format{};
+  format.event_id = event.ftrace_event_id;
+  format.proto_field_id = event.proto_field_id;
+  format.size = event.size;
+  for (const Field& field : event.fields) {
+    std::optional<CompactEventColumnFormat> column = ValidateColumnFormat(field);
+    if (!column.has_value() ||
+        column->ftrace_offset + column->ftrace_size > event.size) {
+      return std::nullopt;
+    }
+    format.columns.push_back(*column);
+  }
+  return std::make_optional(std::move(format));
+}
+
+void CompactEventsConfig::AddEvent(CompactEventFormat format) {
+  if (GetFormat(format.event_id))
+    return;
+  format.batch_index = static_cast<uint32_t>(formats_.size());
+  if (format.event_id >= index_.size())
+    index_.resize(format.event_id + 1);
+  index_[format.event_id] = static_cast<uint32_t>(formats_.size() + 1);
+  formats_.push_back(std::move(format));
+}
+
+CompactEventsConfig CreateCompactEventsConfig(
+    const FtraceConfig& request,
+    const ProtoTranslationTable* table,
+    std::vector<std::string>* unsupported_events) {
+  CompactEventsConfig config;
+  for (const std::string& group_and_name : request.compact_events()) {
+    size_t slash_pos = group_and_name.find('/');
+    const Event* event = nullptr;
+    if (slash_pos != std::string::npos) {
+      event = table->GetEvent(GroupAndName(group_and_name.substr(0, slash_pos),
+                                           group_and_name.substr(slash_pos + 1)));
+    }
+    std::optional<CompactEventFormat> format;
+    if (event)
+      format = ValidateFormatForCompactEvent(*event);
+    if (!format.has_value()) {
+      if (unsupported_events)
+        unsupported_events->push_back(group_and_name);
+      continue;
+    }
+    config.AddEvent(std::move(format.value()));
+  }
+  return config;
+}
+
+CompactEventsBuffer::Batch::Batch(size_t num_columns)
+    : num_columns_(num_columns),
+      columns_(new protozero::PackedVarInt[num_columns]) {}
+
+CompactEventsBuffer::Batch::~Batch() = default;
+
+void CompactEventsBuffer::Batch::Write(
+    protos::pbzero::FtraceEventBundle::CompactEvents* compact_out,
+    const CompactEventFormat& format) const {
+  PERFETTO_DCHECK(format.columns.size() == num_columns_);
+  auto* batch_out = compact_out->add_batch();
+  batch_out->set_event_id(format.proto_field_id);
+  batch_out->set_timestamp(timestamp_);
+  if (pid_.size() > 0)
+    batch_out->set_pid(pid_);
+  for (size_t i = 0; i < num_columns_; i++) {
+    auto* column_out = batch_out->add_column();
+    column_out->set_field_id(format.columns[i].proto_field_id);
+    column_out->set_value(columns_[i]);
+    if (format.columns[i].is_signed)
+      column_out->set_is_signed(true);
+  }
+}
+
+void CompactEventsBuffer::Batch::Reset() {
+  last_timestamp_ = 0;
+  timestamp_.Reset();
+  pid_.Reset();
+  for (size_t i = 0; i < num_columns_; i++)
+    columns_[i].Reset();
+}
+
+CompactEventsBuffer::CompactEventsBuffer(const CompactEventsConfig* config)
+    : config_(config), batches_(config->formats().size()) {}
+
+CompactEventsBuffer::~CompactEventsBuffer() = default;
+
+void CompactEventsBuffer::WriteAndReset(
+    protos::pbzero::FtraceEventBundle* bundle) {
+  protos::pbzero::FtraceEventBundle::CompactEvents* compact_out = nullptr;
+  for (size_t i = 0; i < batches_.size(); i++) {
+    Batch* batch = batches_[i].get();
+    if (!batch || batch->size() == 0)
+      continue;
+    if (!compact_out)
+      compact_out = bundle->set_compact_events();
+    batch->Write(compact_out, config_->formats()[i]);
+    batch->Reset();
+  }
+}
+
+}  // namespace perfetto
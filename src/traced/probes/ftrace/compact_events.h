@@ -0,0 +1,161 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACED_PROBES_FTRACE_COMPACT_EVENTS_H_
+#define SRC_TRACED_PROBES_FTRACE_COMPACT_EVENTS_H_
+
+#include <stdint.h>
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "perfetto/base/compiler.h"
+#include "perfetto/protozero/packed_repeated_fields.h"
+#include "protos/perfetto/trace/ftrace/ftrace_event_bundle.pbzero.h"
+#include "src/traced/probes/ftrace/event_info_constants.h"
+#include "src/traced/probes/ftrace/ftrace_config_utils.h"
+
+namespace perfetto {
+
+class ProtoTranslationTable;
+
+// The subset of the format of an integer field that is used when encoding it
+// in the compact format.
+struct CompactEventColumnFormat {
+  uint32_t proto_field_id;
+  uint16_t ftrace_offset;
+  // 1, 2, 4 or 8 bytes.
+  uint8_t ftrace_size;
+  bool is_signed;
+  // The field holds a pid, that has to be reported in the FtraceMetadata.
+  bool is_pid;
+};
+
+// Pre-parsed format of an event that is recorded in the generic compact
+// format, see FtraceConfig.compact_events.
+struct CompactEventFormat {
+  uint32_t event_id;
+  uint32_t proto_field_id;
+  uint16_t size;
+  // Index of the event's batch in the |CompactEventsBuffer|.
+  uint32_t batch_index;
+  std::vector<CompactEventColumnFormat> columns;
+};
+
+// Returns the compact format of |event|, or nullopt if the event can't be
+// encoded in the compact format, i.e. if it has fields other than integers or
+// needs special handling at parsing time (e.g. sys_exit).
+std::optional<CompactEventFormat> ValidateFormatForCompactEvent(
+    const Event& event);
+
+// Compact encoding configuration used at ftrace reading & parsing time.
+class CompactEventsConfig {
+ public:
+  // Returns the format to use if the event with the given ftrace id is to be
+  // recorded in the compact format, nullptr otherwise.
+  const CompactEventFormat* GetFormat(size_t ftrace_event_id) const {
+    if (ftrace_event_id >= index_.size())
+      return nullptr;
+    uint32_t idx = index_[ftrace_event_id];
+    return idx ? &formats_[idx - 1] : nullptr;
+  }
+
+  bool enabled() const { return !formats_.empty(); }
+  const std::vector<CompactEventFormat>& formats() const { return formats_; }
+
+  void AddEvent(CompactEventFormat format);
+
+ private:
+  std::vector<CompactEventFormat> formats_;
+  // 1-based indices into |formats_| by ftrace event id, 0 if the event isn't
+  // compacted.
+  std::vector<uint32_t> index_;
+};
+
+// Creates the compact encoding configuration for the events listed in
+// |request.compact_events()|. Events that don't exist or can't be encoded in
+// the compact format are appended to |unsupported_events| (if not null) and
+// will be recorded in the normal form.
+CompactEventsConfig CreateCompactEventsConfig(
+    const FtraceConfig& request,
+    const ProtoTranslationTable* table,
+    std::vector<std::string>* unsupported_events);
+
+// Mutable state for buffering the events recorded in the compact format, that
+// can later be written out with |WriteAndReset|. Used by the ftrace reader.
+class CompactEventsBuffer {
+ public:
+  // Collects the fields of the events of a type.
+  class Batch {
+   public:
+    explicit Batch(size_t num_columns);
+    ~Batch();
+
+    inline void AppendTimestamp(uint64_t timestamp) {
+      timestamp_.Append(timestamp - last_timestamp_);
+      last_timestamp_ = timestamp;
+    }
+    protozero::PackedVarInt& pid() { return pid_; }
+    protozero::PackedVarInt& column(size_t i) { return columns_[i]; }
+
+    size_t size() const {
+      // Caller should fill all per-field buffers at the same rate.
+      return timestamp_.size();
+    }
+
+    void Write(protos::pbzero::FtraceEventBundle::CompactEvents* compact_out,
+               const CompactEventFormat& format) const;
+    void Reset();
+
+   private:
+    const size_t num_columns_;
+    // First timestamp in a bundle is absolute. The rest are all delta-encoded,
+    // each relative to the preceding event of the same type.
+    uint64_t last_timestamp_ = 0;
+
+    protozero::PackedVarInt timestamp_;
+    protozero::PackedVarInt pid_;
+    std::unique_ptr<protozero::PackedVarInt[]> columns_;
+  };
+
+  explicit CompactEventsBuffer(const CompactEventsConfig* config);
+  ~CompactEventsBuffer();
+
+  // Returns the batch for the events with the given format, allocating it on
+  // first use.
+  Batch* GetBatch(const CompactEventFormat& format) {
+    std::unique_ptr<Batch>& batch = batches_[format.batch_index];
+    if (PERFETTO_UNLIKELY(!batch)) {
+      batch.reset(new Batch(format.columns.size()));
+    }
+    return batch.get();
+  }
+
+  // Writes out the currently buffered events, and starts the next batch
+  // internally.
+  void WriteAndReset(protos::pbzero::FtraceEventBundle* bundle);
+
+ private:
+  const CompactEventsConfig* const config_;
+  // One per format of |config_|, indexed by |CompactEventFormat.batch_index|.
+  std::vector<std::unique_ptr<Batch>> batches_;
+};
+
+}  // namespace perfetto
+
+#endif  // SRC_TRACED_PROBES_FTRACE_COMPACT_EVENTS_H_
@@ -0,0 +1,264 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/traced/probes/ftrace/compact_events.h"
+
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "perfetto/protozero/proto_utils.h"
+#include "perfetto/protozero/scattered_heap_buffer.h"
+#include "protos/perfetto/config/ftrace/ftrace_config.gen.h"
+#include "protos/perfetto/trace/ftrace/ftrace_event_bundle.gen.h"
+#include "src/base/test/utils.h"
+#include "src/traced/probes/ftrace/cpu_reader.h"
+#include "src/traced/probes/ftrace/event_info.h"
+#include "src/traced/probes/ftrace/ftrace_metadata.h"
+#include "src/traced/probes/ftrace/ftrace_procfs.h"
+#include "src/traced/probes/ftrace/proto_translation_table.h"
+#include "test/gtest_and_gmock.h"
+
+#include "protos/perfetto/trace/ftrace/ftrace_event.pbzero.h"
+
+namespace perfetto {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::ElementsAreArray;
+
+std::unique_ptr<ProtoTranslationTable> CreateRavenTable(FtraceProcfs* ftrace) {
+  return ProtoTranslationTable::Create(ftrace, GetStaticEventInfo(),
+                                       GetStaticCommonFieldsInfo());
+}
+
+class CompactEventsTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    ftrace_.reset(new FtraceProcfs(base::GetTestDataPath(
+        "src/traced/probes/ftrace/test/data/"
+        "android_raven_AOSP.MASTER_5.10.43/")));
+    table_ = CreateRavenTable(ftrace_.get());
+    ASSERT_TRUE(table_);
+  }
+
+  const Event* GetEvent(const std::string& group, const std::string& name) {
+    return table_->GetEvent(GroupAndName(group, name));
+  }
+
+  std::unique_ptr<FtraceProcfs> ftrace_;
+  std::unique_ptr<ProtoTranslationTable> table_;
+};
+
+TEST_F(CompactEventsTest, ValidateFormat) {
+  for (const auto& group_and_name :
+       {GroupAndName("power", "cpu_idle"), GroupAndName("power", "cpu_frequency"),
+        GroupAndName("irq", "irq_handler_exit"),
+        GroupAndName("irq", "softirq_entry"),
+        GroupAndName("irq", "softirq_exit")}) {
+    const Event* event = table_->GetEvent(group_and_name);
+    ASSERT_TRUE(event) << group_and_name.ToString();
+    std::optional<CompactEventFormat> format =
+        ValidateFormatForCompactEvent(*event);
+    ASSERT_TRUE(format.has_value()) << group_and_name.ToString();
+    EXPECT_EQ(format->event_id, event->ftrace_event_id);
+    EXPECT_EQ(format->proto_field_id, event->proto_field_id);
+    EXPECT_EQ(format->columns.size(), event->fields.size());
+  }
+
+  // Events with strings, or with their own parsing or compact encoding.
+  for (const auto& group_and_name :
+       {GroupAndName("irq", "irq_handler_entry"),
+        GroupAndName("ftrace", "print"), GroupAndName("sched", "sched_switch"),
+        GroupAndName("sched", "sched_waking"),
+        GroupAndName("raw_syscalls", "sys_exit")}) {
+    const Event* event = table_->GetEvent(group_and_name);
+    ASSERT_TRUE(event) << group_and_name.ToString();
+    EXPECT_FALSE(ValidateFormatForCompactEvent(*event).has_value())
+        << group_and_name.ToString();
+  }
+}
+
+TEST_F(CompactEventsTest, CreateConfig) {
+  FtraceConfig request;
+  *request.add_compact_events() = "power/cpu_idle";
+  *request.add_compact_events() = "power/cpu_frequency";
+  *request.add_compact_events() = "power/cpu_idle";
+  *request.add_compact_events() = "ftrace/print";
+  *request.add_compact_events() = "cpu_idle";
+  *request.add_compact_events() = "power/not_an_event";
+  std::vector<std::string> unsupported;
+  CompactEventsConfig config =
+      CreateCompactEventsConfig(request, table_.get(), &unsupported);
+
+  EXPECT_TRUE(config.enabled());
+  ASSERT_EQ(config.formats().size(), 2u);
+  EXPECT_THAT(unsupported, ElementsAre("ftrace/print", "cpu_idle",
+                                       "power/not_an_event"));
+
+  const Event* cpu_idle = GetEvent("power", "cpu_idle");
+  const Event* cpu_frequency = GetEvent("power", "cpu_frequency");
+  const Event* print = GetEvent("ftrace", "print");
+  ASSERT_TRUE(cpu_idle && cpu_frequency && print);
+  ASSERT_TRUE(config.GetFormat(cpu_idle->ftrace_event_id));
+  EXPECT_EQ(config.GetFormat(cpu_idle->ftrace_event_id)->batch_index, 0u);
+  ASSERT_TRUE(config.GetFormat(cpu_frequency->ftrace_event_id));
+  EXPECT_EQ(config.GetFormat(cpu_frequency->ftrace_event_id)->batch_index, 1u);
+  EXPECT_FALSE(config.GetFormat(print->ftrace_event_id));
+  EXPECT_FALSE(config.GetFormat(0));
+  EXPECT_FALSE(config.GetFormat(table_->largest_id() + 1));
+
+  EXPECT_FALSE(
+      CreateCompactEventsConfig(FtraceConfig(), table_.get(), nullptr)
+          .enabled());
+}
+
+// Rebuilds the FtraceEvent protos out of a compact batch, as the trace
+// processor does.
+std::vector<std::string> DecodeBatch(
+    const protos::gen::FtraceEventBundle::CompactEvents::Batch& batch) {
+  using protozero::proto_utils::ZigZagDecode;
+  std::vector<std::string> events;
+  uint64_t timestamp = 0;
+  for (size_t i = 0; i < batch.timestamp().size(); i++) {
+    timestamp += batch.timestamp()[i];
+    protozero::HeapBuffered<protos::pbzero::FtraceEvent> event;
+    event->set_timestamp(timestamp);
+    if (!batch.pid().empty())
+      event->AppendVarInt(protos::pbzero::FtraceEvent::kPidFieldNumber,
+                          batch.pid()[i]);
+    protozero::Message* nested =
+        event->BeginNestedMessage<protozero::Message>(batch.event_id());
+    for (const auto& column : batch.column()) {
+      uint64_t value = column.value()[i];
+      if (column.is_signed()) {
+        nested->AppendVarInt(column.field_id(), ZigZagDecode(value));
+      } else {
+        nested->AppendVarInt(column.field_id(), value);
+      }
+    }
+    events.push_back(event.SerializeAsString());
+  }
+  return events;
+}
+
+// All the events that can be encoded in the compact format must decode to the
+// same protos as the normal encoding.
+TEST_F(CompactEventsTest, MatchesNormalEncoding) {
+  std::minstd_rand rnd(0);
+  size_t num_compacted = 0;
+  for (const Event& event : table_->events()) {
+    std::optional<CompactEventFormat> format;
+    if (event.ftrace_event_id)
+      format = ValidateFormatForCompactEvent(event);
+    if (!format.has_value())
+      continue;
+    num_compacted++;
+
+    CompactEventsConfig config;
+    config.AddEvent(std::move(format.value()));
+    const CompactEventFormat* event_format =
+        config.GetFormat(event.ftrace_event_id);
+    ASSERT_TRUE(event_format);
+
+    std::vector<std::string> expected;
+    FtraceMetadata expected_metadata;
+    FtraceMetadata metadata;
+    CompactEventsBuffer compact_buf(&config);
+    uint64_t timestamp = 1000;
+    for (int i = 0; i < 10; i++) {
+      std::vector<uint8_t> data(event.size);
+      for (uint8_t& byte : data)
+        byte = static_cast<uint8_t>(rnd());
+      timestamp += rnd() % 100000;
+
+      protozero::HeapBuffered<protos::pbzero::FtraceEvent> msg;
+      msg->set_timestamp(timestamp);
+      ASSERT_TRUE(CpuReader::ParseEvent(
+          static_cast<uint16_t>(event.ftrace_event_id), data.data(),
+          data.data() + data.size(), table_.get(), /*ds_config=*/nullptr,
+          msg.get(), &expected_metadata));
+      expected.push_back(msg.SerializeAsString());
+
+      CpuReader::ParseEventCompact(data.data(), timestamp, event_format,
+                                   table_.get(), &compact_buf, &metadata);
+    }
+
+    protozero::HeapBuffered<protos::pbzero::FtraceEventBundle> bundle;
+    compact_buf.WriteAndReset(bundle.get());
+    protos::gen::FtraceEventBundle parsed;
+    ASSERT_TRUE(parsed.ParseFromString(bundle.SerializeAsString()));
+    ASSERT_EQ(parsed.compact_events().batch().size(), 1u) << event.name;
+    EXPECT_THAT(DecodeBatch(parsed.compact_events().batch()[0]),
+                ElementsAreArray(expected))
+        << event.name;
+    EXPECT_THAT(metadata.pids, ElementsAreArray(expected_metadata.pids))
+        << event.name;
+  }
+  EXPECT_GT(num_compacted, 50u);
+}
+
+TEST_F(CompactEventsTest, WriteAndReset) {
+  FtraceConfig request;
+  *request.add_compact_events() = "power/cpu_idle";
+  *request.add_compact_events() = "power/cpu_frequency";
+  CompactEventsConfig config =
+      CreateCompactEventsConfig(request, table_.get(), nullptr);
+  const Event* cpu_frequency = GetEvent("power", "cpu_frequency");
+  ASSERT_TRUE(cpu_frequency);
+  const CompactEventFormat* format =
+      config.GetFormat(cpu_frequency->ftrace_event_id);
+  ASSERT_TRUE(format);
+
+  CompactEventsBuffer compact_buf(&config);
+  FtraceMetadata metadata;
+  std::vector<uint8_t> data(cpu_frequency->size);
+  CpuReader::ParseEventCompact(data.data(), 1000, format, table_.get(),
+                               &compact_buf, &metadata);
+  CpuReader::ParseEventCompact(data.data(), 1500, format, table_.get(),
+                               &compact_buf, &metadata);
+
+  // Only the batches with events are written, with delta-encoded timestamps.
+  protozero::HeapBuffered<protos::pbzero::FtraceEventBundle> bundle;
+  compact_buf.WriteAndReset(bundle.get());
+  protos::gen::FtraceEventBundle parsed;
+  ASSERT_TRUE(parsed.ParseFromString(bundle.SerializeAsString()));
+  ASSERT_EQ(parsed.compact_events().batch().size(), 1u);
+  const auto& batch = parsed.compact_events().batch()[0];
+  EXPECT_EQ(batch.event_id(), cpu_frequency->proto_field_id);
+  EXPECT_THAT(batch.timestamp(), ElementsAre(1000u, 500u));
+  EXPECT_THAT(batch.pid(), ElementsAre(0, 0));
+
+  // Nothing is written after the reset, and the timestamps are absolute again.
+  protozero::HeapBuffered<protos::pbzero::FtraceEventBundle> empty_bundle;
+  compact_buf.WriteAndReset(empty_bundle.get());
+  parsed = protos::gen::FtraceEventBundle();
+  ASSERT_TRUE(parsed.ParseFromString(empty_bundle.SerializeAsString()));
+  EXPECT_FALSE(parsed.has_compact_events());
+
+  CpuReader::ParseEventCompact(data.data(), 2000, format, table_.get(),
+                               &compact_buf, &metadata);
+  protozero::HeapBuffered<protos::pbzero::FtraceEventBundle> next_bundle;
+  compact_buf.WriteAndReset(next_bundle.get());
+  ASSERT_TRUE(parsed.ParseFromString(next_bundle.SerializeAsString()));
+  ASSERT_EQ(parsed.compact_events().batch().size(), 1u);
+  EXPECT_THAT(parsed.compact_events().batch()[0].timestamp(),
+              ElementsAre(2000u));
+}
+
+}  // namespace
+}  // namespace perfetto
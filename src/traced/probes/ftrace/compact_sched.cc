@@ -269,13 +269,14 @@ void CompactSchedWakingBuffer::Reset() {
 void CommInterner::Write(
     protos::pbzero::FtraceEventBundle::CompactSched* compact_out) const {
   for (size_t i = 0; i < interned_comms_size_; i++) {
-    compact_out->add_intern_table(interned_comms_[i].data(),
-                                  interned_comms_[i].size());
+    compact_out->add_intern_table(
+        reinterpret_cast<const char*>(comms_[i].words), comms_[i].size);
   }
 }
 
 void CommInterner::Reset() {
-  intern_buf_write_pos_ = 0;
+  for (size_t i = 0; i < interned_comms_size_; i++)
+    slots_[comm_slots_[i]] = 0;
   interned_comms_size_ = 0;
 }
 
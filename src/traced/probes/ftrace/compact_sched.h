@@ -18,8 +18,11 @@
 #define SRC_TRACED_PROBES_FTRACE_COMPACT_SCHED_H_
 
 #include <stdint.h>
+#include <string.h>
 
-#include "perfetto/ext/base/string_view.h"
+#include <array>
+
+#include "perfetto/base/logging.h"
 #include "perfetto/protozero/packed_repeated_fields.h"
 #include "protos/perfetto/trace/ftrace/ftrace_event_bundle.pbzero.h"
 #include "src/traced/probes/ftrace/event_info_constants.h"
@@ -165,32 +168,47 @@ class CompactSchedWakingBuffer {
   protozero::PackedVarInt common_flags_;
 };
 
+// Interns the comm strings of a compact_sched bundle. Lookups are done in a
+// fixed-size open-addressing hash table, so their cost doesn't depend on the
+// number of comms already interned.
 class CommInterner {
  public:
   static constexpr size_t kExpectedCommLength = 16;
 
+  // Maximum number of unique comms per bundle. The ftrace reader is expected
+  // to flush the compact buffer before this is reached.
+  static constexpr size_t kMaxElements = 4096;
+
+  // |ptr| must point to a |kExpectedCommLength| bytes comm field.
   size_t InternComm(const char* ptr) {
-    // Linearly scan existing string views, ftrace reader will
-    // make sure this set doesn't grow too large.
-    base::StringView transient_view(ptr);
-    for (size_t i = 0; i < interned_comms_size_; i++) {
-      if (transient_view == interned_comms_[i]) {
-        return i;
-      }
+    // Compare comms as two 64-bit words. The kernel doesn't guarantee that the
+    // bytes after the null terminator are zeroed, so clear them.
+    Comm comm;
+    memcpy(comm.words, ptr, kExpectedCommLength);
+    size_t size = TruncateAtNull(&comm.words[0]);
+    if (size < sizeof(uint64_t)) {
+      comm.words[1] = 0;
+    } else {
+      size += TruncateAtNull(&comm.words[1]);
     }
 
-    // Unique comm, intern it. Null byte is not copied over.
-    char* start = intern_buf_ + intern_buf_write_pos_;
-    size_t size = transient_view.size();
-    memcpy(start, ptr, size);
-    intern_buf_write_pos_ += size;
-
-    size_t idx = interned_comms_size_;
-    base::StringView safe_view(start, size);
-    interned_comms_[interned_comms_size_++] = safe_view;
+    size_t slot = Hash(comm);
+    for (;; slot = (slot + 1) & (kNumSlots - 1)) {
+      uint16_t idx_plus_one = slots_[slot];
+      if (idx_plus_one == 0)
+        break;
+      const Comm& other = comms_[idx_plus_one - 1];
+      if (comm.words[0] == other.words[0] && comm.words[1] == other.words[1])
+        return idx_plus_one - 1u;
+    }
 
-    PERFETTO_DCHECK(intern_buf_write_pos_ <= sizeof(intern_buf_));
+    // Unique comm, intern it.
     PERFETTO_DCHECK(interned_comms_size_ < kMaxElements);
+    size_t idx = interned_comms_size_++;
+    comm.size = static_cast<uint8_t>(size);
+    comms_[idx] = comm;
+    slots_[slot] = static_cast<uint16_t>(idx + 1);
+    comm_slots_[idx] = static_cast<uint16_t>(slot);
     return idx;
   }
 
@@ -201,20 +219,50 @@ class CommInterner {
   void Reset();
 
  private:
-  // TODO(rsavitski): Consider making the storage dynamically-expandable instead
-  // to not rely on sizing the buffer for the worst case.
-  static constexpr size_t kMaxElements = 4096;
+  // Twice the max number of elements, to keep the load factor <= 0.5.
+  static constexpr size_t kLog2NumSlots = 13;
+  static constexpr size_t kNumSlots = 1 << kLog2NumSlots;
+  static_assert(kNumSlots >= 2 * kMaxElements, "Hash table too small");
+  static_assert(kMaxElements < UINT16_MAX, "Slots hold 16-bit indices");
+
+  struct Comm {
+    uint64_t words[kExpectedCommLength / sizeof(uint64_t)];
+    uint8_t size;
+  };
+
+  // Clears the bytes of |word| from the first null byte onwards, assuming a
+  // little-endian layout. Returns the number of bytes before it (8 if none).
+  static size_t TruncateAtNull(uint64_t* word) {
+    constexpr uint64_t kLowBits = 0x0101010101010101ULL;
+    constexpr uint64_t kHighBits = 0x8080808080808080ULL;
+    // The lowest set bit of |zero_bytes| is the high bit of the first null
+    // byte. Bits for the following bytes can be wrong, but don't matter.
+    uint64_t zero_bytes = (*word - kLowBits) & ~*word & kHighBits;
+    if (zero_bytes == 0)
+      return sizeof(uint64_t);
+    size_t size = static_cast<size_t>(__builtin_ctzll(zero_bytes)) / 8;
+    *word &= (1ULL << (size * 8)) - 1;
+    return size;
+  }
 
-  char intern_buf_[kMaxElements * (kExpectedCommLength - 1)];
-  size_t intern_buf_write_pos_ = 0;
+  static size_t Hash(const Comm& comm) {
+    // Multiplicative hashing, using the top bits of the product.
+    uint64_t h = (comm.words[0] ^ (comm.words[1] * 0x9E3779B97F4A7C15ULL)) *
+                 0xC2B2AE3D27D4EB4FULL;
+    return static_cast<size_t>(h >> (64 - kLog2NumSlots));
+  }
 
-  // Views into unique interned comm strings. Even if every event carries a
-  // unique comm, the ftrace reader is expected to flush the compact buffer way
-  // before this reaches capacity. This is since the cost of processing each
-  // event grows with every unique interned comm (as the interning needs to
-  // search all existing internings).
-  std::array<base::StringView, kMaxElements> interned_comms_;
+  // Unique interned comms, in interning order.
+  std::array<Comm, kMaxElements> comms_;
   uint32_t interned_comms_size_ = 0;
+
+  // Open-addressing (linear probing) table of 1-based indices into |comms_|.
+  // 0 means empty.
+  std::array<uint16_t, kNumSlots> slots_{};
+
+  // The slot of each element of |comms_|, to clear only the used slots on
+  // Reset().
+  std::array<uint16_t, kMaxElements> comm_slots_;
 };
 
 // Mutable state for buffering parts of scheduling events, that can later be
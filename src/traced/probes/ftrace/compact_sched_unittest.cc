@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/traced/probes/ftrace/compact_sched.h"
+
+#include <string.h>
+
+#include <array>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "perfetto/protozero/scattered_heap_buffer.h"
+#include "protos/perfetto/trace/ftrace/ftrace_event_bundle.gen.h"
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace {
+
+using ::testing::ElementsAre;
+
+// Returns a comm field as laid out in the ftrace buffer. The bytes after the
+// null terminator are filled with |padding|.
+std::array<char, CommInterner::kExpectedCommLength> MakeComm(
+    const std::string& comm,
+    char padding = '\0') {
+  std::array<char, CommInterner::kExpectedCommLength> field;
+  field.fill(padding);
+  memcpy(field.data(), comm.c_str(), comm.size() + 1);
+  return field;
+}
+
+std::vector<std::string> WriteInternTable(const CommInterner& interner) {
+  protozero::HeapBuffered<protos::pbzero::FtraceEventBundle> bundle;
+  interner.Write(bundle->set_compact_sched());
+  protos::gen::FtraceEventBundle parsed;
+  parsed.ParseFromString(bundle.SerializeAsString());
+  return parsed.compact_sched().intern_table();
+}
+
+TEST(CommInternerTest, InternsUniqueComms) {
+  std::unique_ptr<CommInterner> interner(new CommInterner());
+  EXPECT_EQ(interner->InternComm(MakeComm("surfaceflinger").data()), 0u);
+  EXPECT_EQ(interner->InternComm(MakeComm("swapper/0").data()), 1u);
+  EXPECT_EQ(interner->InternComm(MakeComm("").data()), 2u);
+  EXPECT_EQ(interner->InternComm(MakeComm("surfaceflinger").data()), 0u);
+  EXPECT_EQ(interner->InternComm(MakeComm("").data()), 2u);
+  EXPECT_EQ(interner->interned_comms_size(), 3u);
+
+  EXPECT_THAT(WriteInternTable(*interner),
+              ElementsAre("surfaceflinger", "swapper/0", ""));
+}
+
+// The kernel doesn't always clear the bytes after the null terminator.
+TEST(CommInternerTest, IgnoresBytesAfterTerminator) {
+  std::unique_ptr<CommInterner> interner(new CommInterner());
+  EXPECT_EQ(interner->InternComm(MakeComm("EventThread").data()), 0u);
+  EXPECT_EQ(interner->InternComm(MakeComm("EventThread", 'x').data()), 0u);
+  EXPECT_EQ(interner->InternComm(MakeComm("Event", 'x').data()), 1u);
+  EXPECT_EQ(interner->InternComm(MakeComm("1234567", 'x').data()), 2u);
+  EXPECT_EQ(interner->InternComm(MakeComm("12345678", 'x').data()), 3u);
+  EXPECT_EQ(interner->InternComm(MakeComm("123456789012345").data()), 4u);
+  EXPECT_EQ(interner->InternComm(MakeComm("1234567").data()), 2u);
+  EXPECT_EQ(interner->InternComm(MakeComm("12345678").data()), 3u);
+
+  EXPECT_THAT(WriteInternTable(*interner),
+              ElementsAre("EventThread", "Event", "1234567", "12345678",
+                          "123456789012345"));
+}
+
+TEST(CommInternerTest, ManyCommsAndReset) {
+  std::unique_ptr<CommInterner> interner(new CommInterner());
+  for (int round = 0; round < 2; round++) {
+    for (size_t i = 0; i < CommInterner::kMaxElements - 1; i++) {
+      std::string comm = "task-" + std::to_string(i);
+      ASSERT_EQ(interner->InternComm(MakeComm(comm).data()), i);
+    }
+    for (size_t i = 0; i < CommInterner::kMaxElements - 1; i++) {
+      std::string comm = "task-" + std::to_string(i);
+      ASSERT_EQ(interner->InternComm(MakeComm(comm).data()), i);
+    }
+    std::vector<std::string> table = WriteInternTable(*interner);
+    ASSERT_EQ(table.size(), CommInterner::kMaxElements - 1);
+    EXPECT_EQ(table.back(),
+              "task-" + std::to_string(CommInterner::kMaxElements - 2));
+
+    interner->Reset();
+    EXPECT_EQ(interner->interned_comms_size(), 0u);
+  }
+}
+
+}  // namespace
+}  // namespace perfetto
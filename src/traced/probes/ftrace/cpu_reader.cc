@@ -31,6 +31,7 @@
 #include "perfetto/ext/base/string_utils.h"
 #include "perfetto/ext/base/utils.h"
 #include "perfetto/ext/tracing/core/trace_writer.h"
+#include "perfetto/protozero/proto_utils.h"
 #include "src/kallsyms/kernel_symbol_map.h"
 #include "src/kallsyms/lazy_kernel_symbolizer.h"
 #include "src/traced/probes/ftrace/cpu_stats_parser.h"
@@ -51,9 +52,20 @@ namespace perfetto {
 namespace {
 
 // If the compact_sched buffer accumulates more unique strings, the reader will
-// flush it to reset the interning state (and make it cheap again).
-// This is not an exact cap, since we check only at tracing page boundaries.
-constexpr size_t kCompactSchedInternerThreshold = 64;
+// flush it to reset the interning state. This is not an exact cap, since we
+// check only at tracing page boundaries.
+constexpr size_t kCompactSchedInternerThreshold = 1024;
+
+// Every compact event carries a 16 bytes comm, so a single page can't add more
+// than kPageSize / 16 comms after the threshold check.
+static_assert(kCompactSchedInternerThreshold +
+                      base::kPageSize / CommInterner::kExpectedCommLength <
+                  CommInterner::kMaxElements,
+              "kCompactSchedInternerThreshold too large");
+
+// Upper bound for the pages moved by a single splice() call. Matches the
+// parsing batch size of FtraceController.
+constexpr size_t kMaxSplicePages = 32;
 
 // For further documentation of these constants see the kernel source:
 //   linux/include/linux/ring_buffer.h
@@ -181,6 +193,25 @@ size_t CpuReader::ReadCycle(
     size_t parsing_buf_size_pages,
     size_t max_pages,
     const std::set<FtraceDataSource*>& started_data_sources) {
+  std::vector<ParsingTarget> targets;
+  targets.reserve(started_data_sources.size());
+  for (FtraceDataSource* data_source : started_data_sources) {
+    const FtraceDataSourceConfig* ds_config = data_source->parsing_config();
+    const KernelSymbolMap* symbol_map =
+        symbolizer_ && ds_config->symbolize_ksyms
+            ? symbolizer_->GetOrCreateKernelSymbolMap()
+            : nullptr;
+    targets.push_back(ParsingTarget{data_source->trace_writer(),
+                                    data_source->mutable_metadata(), ds_config,
+                                    symbol_map});
+  }
+  return ReadCycle(parsing_buf, parsing_buf_size_pages, max_pages, targets);
+}
+
+size_t CpuReader::ReadCycle(uint8_t* parsing_buf,
+                            size_t parsing_buf_size_pages,
+                            size_t max_pages,
+                            const std::vector<ParsingTarget>& targets) {
   PERFETTO_DCHECK(max_pages > 0 && parsing_buf_size_pages > 0);
   metatrace::ScopedEvent evt(metatrace::TAG_FTRACE,
                              metatrace::FTRACE_CPU_READ_CYCLE);
@@ -190,8 +221,8 @@ size_t CpuReader::ReadCycle(
   for (bool is_first_batch = true;; is_first_batch = false) {
     size_t batch_pages =
         std::min(parsing_buf_size_pages, max_pages - total_pages_read);
-    size_t pages_read = ReadAndProcessBatch(
-        parsing_buf, batch_pages, is_first_batch, started_data_sources);
+    size_t pages_read =
+        ReadAndProcessBatch(parsing_buf, batch_pages, is_first_batch, targets);
 
     PERFETTO_DCHECK(pages_read <= batch_pages);
     total_pages_read += pages_read;
@@ -217,11 +248,15 @@ size_t CpuReader::ReadAndProcessBatch(
     uint8_t* parsing_buf,
     size_t max_pages,
     bool first_batch_in_cycle,
-    const std::set<FtraceDataSource*>& started_data_sources) {
+    const std::vector<ParsingTarget>& targets) {
   size_t pages_read = 0;
   {
     metatrace::ScopedEvent evt(metatrace::TAG_FTRACE,
                                metatrace::FTRACE_CPU_READ_BATCH);
+    // Spliced pages are always full, the read() loop below takes care of the
+    // page that the kernel is currently writing into (if there is room).
+    if (splice_pipe_.rd)
+      pages_read = SplicePages(parsing_buf, max_pages);
     for (; pages_read < max_pages;) {
       uint8_t* curr_page = parsing_buf + (pages_read * base::kPageSize);
       ssize_t res =
@@ -290,11 +325,11 @@ size_t CpuReader::ReadAndProcessBatch(
   if (pages_read == 0)
     return pages_read;
 
-  for (FtraceDataSource* data_source : started_data_sources) {
+  for (const ParsingTarget& target : targets) {
     size_t pages_parsed_ok = ProcessPagesForDataSource(
-        data_source->trace_writer(), data_source->mutable_metadata(), cpu_,
-        data_source->parsing_config(), parsing_buf, pages_read, table_,
-        symbolizer_, ftrace_clock_snapshot_, ftrace_clock_);
+        target.trace_writer, target.metadata, cpu_, target.ds_config,
+        parsing_buf, pages_read, table_, target.symbol_map,
+        ftrace_clock_snapshot_, ftrace_clock_);
     // If this happens, it means that we did not know how to parse the kernel
     // binary format. This is a bug in either perfetto or the kernel, and must
     // be investigated. Hence we abort instead of recording a bit in the ftrace
@@ -311,6 +346,50 @@ size_t CpuReader::ReadAndProcessBatch(
   return pages_read;
 }
 
+bool CpuReader::EnableSplice() {
+  base::Pipe pipe = base::Pipe::Create(base::Pipe::kWrNonBlock);
+  if (!pipe.rd)
+    return false;
+  // Make room for a whole parsing batch. If this fails (e.g. because of the
+  // pipe-max-size limit) splice() transfers fewer pages per call.
+  int pipe_size = static_cast<int>(kMaxSplicePages * base::kPageSize);
+  if (fcntl(*pipe.wr, F_SETPIPE_SZ, pipe_size) < 0)
+    PERFETTO_DPLOG("[cpu%zu]: F_SETPIPE_SZ", cpu_);
+  splice_pipe_ = std::move(pipe);
+  return true;
+}
+
+size_t CpuReader::SplicePages(uint8_t* parsing_buf, size_t max_pages) {
+  max_pages = std::min(max_pages, kMaxSplicePages);
+  ssize_t res = PERFETTO_EINTR(
+      splice(*trace_fd_, nullptr, *splice_pipe_.wr, nullptr,
+             max_pages * base::kPageSize, SPLICE_F_MOVE | SPLICE_F_NONBLOCK));
+  if (res <= 0) {
+    // EAGAIN: there are no full pages to splice. The other expected errors
+    // are the same as for read(), see ReadAndProcessBatch(). On any other
+    // error, go back to read().
+    if (res < 0 && errno != EAGAIN && errno != ENOMEM && errno != EBUSY &&
+        errno != ENODEV) {
+      PERFETTO_PLOG("[cpu%zu]: splice() failed, falling back to read()",
+                    cpu_);
+      splice_pipe_ = base::Pipe();
+    }
+    return 0;
+  }
+
+  // The kernel only splices whole pages.
+  const size_t spliced_size = static_cast<size_t>(res);
+  PERFETTO_CHECK(spliced_size % base::kPageSize == 0);
+  for (size_t off = 0; off < spliced_size;) {
+    ssize_t rd = PERFETTO_EINTR(
+        read(*splice_pipe_.rd, parsing_buf + off, spliced_size - off));
+    // The data is already in the pipe, this can't block or fail.
+    PERFETTO_CHECK(rd > 0);
+    off += static_cast<size_t>(rd);
+  }
+  return spliced_size / base::kPageSize;
+}
+
 void CpuReader::Bundler::StartNewPacket(bool lost_events) {
   FinalizeAndRunSymbolizer();
   packet_ = trace_writer_->NewTracePacket();
@@ -338,13 +417,16 @@ void CpuReader::Bundler::FinalizeAndRunSymbolizer() {
   if (compact_sched_enabled_) {
     compact_sched_buffer_.WriteAndReset(bundle_);
   }
+  if (compact_events_enabled_) {
+    compact_events_buffer_.WriteAndReset(bundle_);
+  }
 
   bundle_->Finalize();
   bundle_ = nullptr;
   // Write the kernel symbol index (mangled address) -> name table.
   // |metadata| is shared across all cpus, is distinct per |data_source| (i.e.
   // tracing session) and is cleared after each FtraceController::ReadTick().
-  if (symbolizer_) {
+  if (symbol_map_) {
     // Symbol indexes are assigned mononically as |kernel_addrs.size()|,
     // starting from index 1 (no symbol has index 0). Here we remember the
     // size() (which is also == the highest value in |kernel_addrs|) at the
@@ -352,12 +434,12 @@ void CpuReader::Bundler::FinalizeAndRunSymbolizer() {
     uint32_t max_index_at_start = metadata_->last_kernel_addr_index_written;
     PERFETTO_DCHECK(max_index_at_start <= metadata_->kernel_addrs.size());
     protos::pbzero::InternedData* interned_data = nullptr;
-    auto* ksyms_map = symbolizer_->GetOrCreateKernelSymbolMap();
     bool wrote_at_least_one_symbol = false;
+    std::string sym_name;
     for (const FtraceMetadata::KernelAddr& kaddr : metadata_->kernel_addrs) {
       if (kaddr.index <= max_index_at_start)
         continue;
-      std::string sym_name = ksyms_map->Lookup(kaddr.addr);
+      symbol_map_->GetSymbolName(symbol_map_->LookupId(kaddr.addr), &sym_name);
       if (sym_name.empty()) {
         // Lookup failed. This can genuinely happen in many occasions. E.g.,
         // workqueue_execute_start has two pointers: one is a pointer to a
@@ -408,13 +490,12 @@ size_t CpuReader::ProcessPagesForDataSource(
     const uint8_t* parsing_buf,
     const size_t pages_read,
     const ProtoTranslationTable* table,
-    LazyKernelSymbolizer* symbolizer,
+    const KernelSymbolMap* symbol_map,
     const FtraceClockSnapshot* ftrace_clock_snapshot,
     protos::pbzero::FtraceClock ftrace_clock) {
-  Bundler bundler(trace_writer, metadata,
-                  ds_config->symbolize_ksyms ? symbolizer : nullptr, cpu,
-                  ftrace_clock_snapshot, ftrace_clock,
-                  ds_config->compact_sched.enabled);
+  Bundler bundler(trace_writer, metadata, symbol_map, cpu, ftrace_clock_snapshot,
+                  ftrace_clock, ds_config->compact_sched.enabled,
+                  &ds_config->compact_events);
 
   size_t pages_parsed = 0;
   bool compact_sched_enabled = ds_config->compact_sched.enabled;
@@ -436,8 +517,8 @@ size_t CpuReader::ProcessPagesForDataSource(
     //   buffer overrun since our last read from that per-cpu buffer. We have
     //   a single |lost_events| field per bundle, so start a new packet.
     // * The compact_sched buffer is holding more unique interned strings than
-    //   a threshold. We need to flush the compact buffer to make the
-    //   interning lookups cheap again.
+    //   a threshold. We need to flush the compact buffer before the interner
+    //   runs out of capacity.
     bool interner_past_threshold =
         compact_sched_enabled &&
         bundler.compact_sched_buffer()->interner().interned_comms_size() >
@@ -619,6 +700,9 @@ size_t CpuReader::ParsePagePayload(const uint8_t* start_of_payload,
           const CompactSchedWakingFormat& sched_waking_format =
               table->compact_sched_format().sched_waking;
 
+          const CompactEventFormat* compact_event_format =
+              ds_config->compact_events.GetFormat(ftrace_event_id);
+
           bool ftrace_print_filter_enabled =
               ds_config->print_filter.has_value();
 
@@ -640,6 +724,14 @@ size_t CpuReader::ParsePagePayload(const uint8_t* start_of_payload,
             ParseSchedWakingCompact(start, timestamp, &sched_waking_format,
                                     bundler->compact_sched_buffer(), metadata);
 
+            // generic compact encoding
+          } else if (compact_event_format) {
+            if (event_size < compact_event_format->size)
+              return 0;
+
+            ParseEventCompact(start, timestamp, compact_event_format, table,
+                              bundler->compact_events_buffer(), metadata);
+
           } else if (ftrace_print_filter_enabled &&
                      ftrace_event_id == ds_config->print_filter->event_id()) {
             if (ds_config->print_filter->IsEventInteresting(start, next)) {
@@ -649,6 +741,9 @@ size_t CpuReader::ParsePagePayload(const uint8_t* start_of_payload,
               if (!ParseEvent(ftrace_event_id, start, next, table, ds_config,
                               event, metadata))
                 return 0;
+            } else {
+              metadata->filtered_events++;
+              metadata->filtered_bytes += event_size;
             }
           } else {
             // Common case: parse all other types of enabled events.
@@ -700,9 +795,15 @@ bool CpuReader::ParseEvent(uint16_t ftrace_event_id,
   protozero::Message* nested =
       message->BeginNestedMessage<protozero::Message>(info.proto_field_id);
 
-  // Parse generic event.
-  if (PERFETTO_UNLIKELY(info.proto_field_id ==
-                        protos::pbzero::FtraceEvent::kGenericFieldNumber)) {
+  EventDecoderFn specialized_decoder =
+      table->GetSpecializedDecoder(ftrace_event_id);
+  if (PERFETTO_LIKELY(specialized_decoder)) {
+    // High-frequency event with a known layout.
+    success &= specialized_decoder(info, start, end, table, nested, metadata);
+  } else if (PERFETTO_UNLIKELY(
+                 info.proto_field_id ==
+                 protos::pbzero::FtraceEvent::kGenericFieldNumber)) {
+    // Parse generic event.
     nested->AppendString(GenericFtraceEvent::kEventNameFieldNumber, info.name);
     for (const Field& field : info.fields) {
       auto generic_field = nested->BeginNestedMessage<protozero::Message>(
@@ -997,4 +1098,69 @@ void CpuReader::ParseSchedWakingCompact(const uint8_t* start,
   compact_buf->sched_waking().common_flags().Append(common_flags);
 }
 
+// Parse an event according to its pre-validated compact format, and buffer
+// each field in its column of the current compact batch. The fields are read
+// as the generic path would read them, so that the trace processor can rebuild
+// the same FtraceEvent out of the columns.
+// static
+void CpuReader::ParseEventCompact(const uint8_t* start,
+                                  uint64_t timestamp,
+                                  const CompactEventFormat* format,
+                                  const ProtoTranslationTable* table,
+                                  CompactEventsBuffer* compact_buf,
+                                  FtraceMetadata* metadata) {
+  CompactEventsBuffer::Batch* batch = compact_buf->GetBatch(*format);
+  batch->AppendTimestamp(timestamp);
+
+  const Field* common_pid_field = table->common_pid();
+  if (PERFETTO_LIKELY(common_pid_field)) {
+    int32_t pid = ReadValue<int32_t>(start + common_pid_field->ftrace_offset);
+    batch->pid().Append(pid);
+    metadata->AddCommonPid(pid);
+  }
+
+  for (size_t i = 0; i < format->columns.size(); i++) {
+    const CompactEventColumnFormat& column = format->columns[i];
+    const uint8_t* field_start = start + column.ftrace_offset;
+    if (column.is_signed) {
+      int64_t value;
+      switch (column.ftrace_size) {
+        case 1:
+          value = ReadValue<int8_t>(field_start);
+          break;
+        case 2:
+          value = ReadValue<int16_t>(field_start);
+          break;
+        case 4:
+          value = ReadValue<int32_t>(field_start);
+          break;
+        default:
+          value = ReadValue<int64_t>(field_start);
+          break;
+      }
+      if (column.is_pid)
+        metadata->AddPid(static_cast<int32_t>(value));
+      batch->column(i).Append(protozero::proto_utils::ZigZagEncode(value));
+    } else {
+      uint64_t value;
+      switch (column.ftrace_size) {
+        case 1:
+          value = ReadValue<uint8_t>(field_start);
+          break;
+        case 2:
+          value = ReadValue<uint16_t>(field_start);
+          break;
+        case 4:
+          value = ReadValue<uint32_t>(field_start);
+          break;
+        default:
+          value = ReadValue<uint64_t>(field_start);
+          break;
+      }
+      batch->column(i).Append(value);
+    }
+  }
+  metadata->FinishEvent();
+}
+
 }  // namespace perfetto
@@ -26,6 +26,7 @@
 #include <optional>
 #include <set>
 #include <thread>
+#include <vector>
 
 #include "perfetto/ext/base/paged_memory.h"
 #include "perfetto/ext/base/pipe.h"
@@ -40,6 +41,7 @@
 #include "protos/perfetto/trace/trace_packet.pbzero.h"
 #include "src/kallsyms/kernel_symbol_map.h"
 #include "src/kallsyms/lazy_kernel_symbolizer.h"
+#include "src/traced/probes/ftrace/compact_events.h"
 #include "src/traced/probes/ftrace/compact_sched.h"
 #include "src/traced/probes/ftrace/ftrace_metadata.h"
 #include "src/traced/probes/ftrace/proto_translation_table.h"
@@ -70,18 +72,21 @@ class CpuReader {
    public:
     Bundler(TraceWriter* trace_writer,
             FtraceMetadata* metadata,
-            LazyKernelSymbolizer* symbolizer,
+            const KernelSymbolMap* symbol_map,
             size_t cpu,
             const FtraceClockSnapshot* ftrace_clock_snapshot,
             protos::pbzero::FtraceClock ftrace_clock,
-            bool compact_sched_enabled)
+            bool compact_sched_enabled,
+            const CompactEventsConfig* compact_events_config)
         : trace_writer_(trace_writer),
           metadata_(metadata),
-          symbolizer_(symbolizer),
+          symbol_map_(symbol_map),
           cpu_(cpu),
           ftrace_clock_snapshot_(ftrace_clock_snapshot),
           ftrace_clock_(ftrace_clock),
-          compact_sched_enabled_(compact_sched_enabled) {}
+          compact_sched_enabled_(compact_sched_enabled),
+          compact_events_enabled_(compact_events_config->enabled()),
+          compact_events_buffer_(compact_events_config) {}
 
     ~Bundler() { FinalizeAndRunSymbolizer(); }
 
@@ -105,20 +110,30 @@ class CpuReader {
       return &compact_sched_buffer_;
     }
 
+    CompactEventsBuffer* compact_events_buffer() {
+      // As above, the buffer is written out only if there is an open bundle.
+      GetOrCreateBundle();
+      return &compact_events_buffer_;
+    }
+
    private:
     TraceWriter* const trace_writer_;         // Never nullptr.
     FtraceMetadata* const metadata_;          // Never nullptr.
-    LazyKernelSymbolizer* const symbolizer_;  // Can be nullptr.
+    const KernelSymbolMap* const symbol_map_;  // Can be nullptr.
     const size_t cpu_;
     const FtraceClockSnapshot* const ftrace_clock_snapshot_;
     protos::pbzero::FtraceClock const ftrace_clock_;
     const bool compact_sched_enabled_;
+    const bool compact_events_enabled_;
 
     TraceWriter::TracePacketHandle packet_;
     protos::pbzero::FtraceEventBundle* bundle_ = nullptr;
     // Allocate the buffer for compact scheduler events (which will be unused if
     // the compact option isn't enabled).
     CompactSchedBuffer compact_sched_buffer_;
+    // Batches of the events recorded in the generic compact format, allocated
+    // on first use.
+    CompactEventsBuffer compact_events_buffer_;
   };
 
   struct PageHeader {
@@ -127,6 +142,19 @@ class CpuReader {
     bool lost_events;
   };
 
+  // Where the events parsed for a data source are written. Normally the
+  // writer and metadata of the data source itself, but the per-cpu reader
+  // threads use writers and metadata of their own (see FtraceController).
+  struct ParsingTarget {
+    TraceWriter* trace_writer;
+    FtraceMetadata* metadata;
+    const FtraceDataSourceConfig* ds_config;
+    // Set only if |ds_config| asks for kernel symbols. The map is created on
+    // the main thread (LazyKernelSymbolizer isn't thread-safe) and only read
+    // while parsing.
+    const KernelSymbolMap* symbol_map;
+  };
+
   CpuReader(size_t cpu,
             const ProtoTranslationTable* table,
             LazyKernelSymbolizer* symbolizer,
@@ -140,6 +168,17 @@ class CpuReader {
                    size_t parsing_buf_size_pages,
                    size_t max_pages,
                    const std::set<FtraceDataSource*>& started_data_sources);
+  size_t ReadCycle(uint8_t* parsing_buf,
+                   size_t parsing_buf_size_pages,
+                   size_t max_pages,
+                   const std::vector<ParsingTarget>& targets);
+
+  // Makes the reader move full pages out of the ftrace buffer with splice()
+  // into an internal pipe, which transfers a whole batch of pages with two
+  // syscalls rather than with one read() per page. The partially filled page
+  // that the kernel is writing into can't be spliced, and is still read().
+  // Returns false (and keeps using read()) if the pipe can't be created.
+  bool EnableSplice();
 
   template <typename T>
   static bool ReadAndAdvance(const uint8_t** ptr, const uint8_t* end, T* out) {
@@ -307,6 +346,15 @@ class CpuReader {
                                       CompactSchedBuffer* compact_buf,
                                       FtraceMetadata* metadata);
 
+  // Parse an event whose format was pre-validated for the generic compact
+  // encoding, and buffer its fields in the given compact encoding batch.
+  static void ParseEventCompact(const uint8_t* start,
+                                uint64_t timestamp,
+                                const CompactEventFormat* format,
+                                const ProtoTranslationTable* table,
+                                CompactEventsBuffer* compact_buf,
+                                FtraceMetadata* metadata);
+
   // Parses & encodes the given range of contiguous tracing pages. Called by
   // |ReadAndProcessBatch| for each active data source.
   //
@@ -323,7 +371,7 @@ class CpuReader {
       const uint8_t* parsing_buf,
       const size_t pages_read,
       const ProtoTranslationTable* table,
-      LazyKernelSymbolizer* symbolizer,
+      const KernelSymbolMap* symbol_map,
       const FtraceClockSnapshot*,
       protos::pbzero::FtraceClock);
 
@@ -339,17 +387,21 @@ class CpuReader {
   // into |started_data_sources|. Returns number of pages read.
   // See comment on ftrace_controller.cc:kMaxParsingWorkingSetPages for
   // rationale behind the batching.
-  size_t ReadAndProcessBatch(
-      uint8_t* parsing_buf,
-      size_t max_pages,
-      bool first_batch_in_cycle,
-      const std::set<FtraceDataSource*>& started_data_sources);
+  size_t ReadAndProcessBatch(uint8_t* parsing_buf,
+                             size_t max_pages,
+                             bool first_batch_in_cycle,
+                             const std::vector<ParsingTarget>& targets);
+
+  // Splices up to |max_pages| full pages into |parsing_buf|. Returns the
+  // number of pages transferred.
+  size_t SplicePages(uint8_t* parsing_buf, size_t max_pages);
 
   const size_t cpu_;
   const ProtoTranslationTable* const table_;
   LazyKernelSymbolizer* const symbolizer_;
   const FtraceClockSnapshot* const ftrace_clock_snapshot_;
   base::ScopedFile trace_fd_;
+  base::Pipe splice_pipe_;  // Only valid after EnableSplice().
   protos::pbzero::FtraceClock ftrace_clock_{};
 };
 
@@ -14,16 +14,29 @@
 
 #include <benchmark/benchmark.h>
 
+#include <fcntl.h>
+#include <stdio.h>
+
+#include <condition_variable>
+#include <mutex>
 #include <optional>
 
+#include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/pipe.h"
+#include "perfetto/ext/base/thread_task_runner.h"
 #include "perfetto/ext/base/utils.h"
 #include "perfetto/protozero/root_message.h"
+#include "perfetto/protozero/scattered_heap_buffer.h"
 #include "perfetto/protozero/scattered_stream_null_delegate.h"
 #include "perfetto/protozero/scattered_stream_writer.h"
+#include "protos/perfetto/trace/ftrace/ftrace_event.pbzero.h"
 #include "protos/perfetto/trace/ftrace/ftrace_event_bundle.pbzero.h"
+#include "src/base/test/utils.h"
 #include "src/traced/probes/ftrace/cpu_reader.h"
+#include "src/traced/probes/ftrace/event_info.h"
 #include "src/traced/probes/ftrace/ftrace_config_muxer.h"
 #include "src/traced/probes/ftrace/ftrace_print_filter.h"
+#include "src/traced/probes/ftrace/ftrace_procfs.h"
 #include "src/traced/probes/ftrace/proto_translation_table.h"
 #include "src/traced/probes/ftrace/test/cpu_reader_support.h"
 #include "src/tracing/core/null_trace_writer.h"
@@ -832,11 +845,6 @@ void DoParse(const ExamplePage& test_case,
              benchmark::State& state) {
   NullTraceWriter writer;
   FtraceMetadata metadata{};
-  CpuReader::Bundler bundler(
-      &writer, &metadata, /*symbolizer=*/nullptr, /*cpu=*/0,
-      /*ftrace_clock_snapshot=*/nullptr,
-      /*ftrace_clock=*/protos::pbzero::FTRACE_CLOCK_UNSPECIFIED,
-      /*compact_sched_enabled=*/false);
 
   ProtoTranslationTable* table = GetTable(test_case.name);
   auto page = PageFromXxd(test_case.data);
@@ -844,11 +852,13 @@ void DoParse(const ExamplePage& test_case,
   FtraceDataSourceConfig ds_config{EventFilter{},
                                    EventFilter{},
                                    DisabledCompactSchedConfigForTesting(),
+                                   CompactEventsConfig{},
                                    std::nullopt,
                                    {},
                                    {},
                                    false /*symbolize_ksyms*/,
                                    false /*preserve_ftrace_buffer*/,
+                                   {},
                                    {}};
   if (print_filter.has_value()) {
     ds_config.print_filter =
@@ -860,6 +870,12 @@ void DoParse(const ExamplePage& test_case,
         table->EventToFtraceId(enabled_event));
   }
 
+  CpuReader::Bundler bundler(
+      &writer, &metadata, /*symbol_map=*/nullptr, /*cpu=*/0,
+      /*ftrace_clock_snapshot=*/nullptr,
+      /*ftrace_clock=*/protos::pbzero::FTRACE_CLOCK_UNSPECIFIED,
+      /*compact_sched_enabled=*/false, &ds_config.compact_events);
+
   while (state.KeepRunning()) {
     std::unique_ptr<CompactSchedBuffer> compact_buffer(
         new CompactSchedBuffer());
@@ -922,6 +938,89 @@ void BM_ParsePageFullOfAtracePrintWithFilterRules(benchmark::State& state) {
 }
 BENCHMARK(BM_ParsePageFullOfAtracePrintWithFilterRules)->DenseRange(0, 16, 1);
 
+// Per event type benchmark for CpuReader::ParseEvent, comparing the
+// specialized decoders of event_decoders.cc with the generic decoding path.
+constexpr char kDecodersKernel[] = "android_raven_AOSP.MASTER_5.10.43";
+
+const GroupAndName kDecodersEvents[] = {
+    GroupAndName("sched", "sched_switch"),
+    GroupAndName("sched", "sched_waking"),
+    GroupAndName("sched", "sched_process_exit"),
+    GroupAndName("task", "task_newtask"),
+    GroupAndName("power", "cpu_frequency"),
+    GroupAndName("power", "cpu_idle"),
+    GroupAndName("power", "suspend_resume"),
+    GroupAndName("irq", "irq_handler_entry"),
+    GroupAndName("irq", "softirq_entry"),
+    GroupAndName("ipi", "ipi_raise"),
+    GroupAndName("workqueue", "workqueue_execute_start"),
+    GroupAndName("ftrace", "print"),
+};
+
+// As GetTable(kDecodersKernel), but without specialized decoders.
+ProtoTranslationTable* GetGenericDecodersTable() {
+  static FtraceProcfs* ftrace = new FtraceProcfs(base::GetTestDataPath(
+      std::string("src/traced/probes/ftrace/test/data/") + kDecodersKernel +
+      "/"));
+  static ProtoTranslationTable* table = [] {
+    auto t = ProtoTranslationTable::Create(ftrace, GetStaticEventInfo(),
+                                           GetStaticCommonFieldsInfo());
+    PERFETTO_CHECK(t);
+    t->DisableSpecializedDecodersForTesting();
+    return t.release();
+  }();
+  return table;
+}
+
+void DoParseEvent(bool specialized, benchmark::State& state) {
+  const GroupAndName& group_and_name =
+      kDecodersEvents[static_cast<size_t>(state.range(0))];
+  ProtoTranslationTable* table =
+      specialized ? GetTable(kDecodersKernel) : GetGenericDecodersTable();
+  const Event* event = table->GetEvent(group_and_name);
+  PERFETTO_CHECK(event);
+  PERFETTO_CHECK(specialized ==
+                 !!table->GetSpecializedDecoder(event->ftrace_event_id));
+  state.SetLabel(group_and_name.name());
+
+  // Printable fields, with a terminator for the strings. __data_loc fields
+  // point to a string after the fixed size fields.
+  constexpr uint16_t kDataLocSize = 16;
+  std::vector<uint8_t> data(event->size + kDataLocSize, 'a');
+  data.back() = '\0';
+  for (const Field& field : event->fields) {
+    if (field.strategy == kFixedCStringToString) {
+      data[field.ftrace_offset + field.ftrace_size - 1] = '\0';
+    } else if (field.strategy == kDataLocToString) {
+      uint32_t data_loc =
+          static_cast<uint32_t>(kDataLocSize << 16) | event->size;
+      memcpy(&data[field.ftrace_offset], &data_loc, sizeof(data_loc));
+    }
+  }
+
+  protozero::HeapBuffered<protos::pbzero::FtraceEvent> msg;
+  FtraceMetadata metadata{};
+  for (auto _ : state) {
+    CpuReader::ParseEvent(static_cast<uint16_t>(event->ftrace_event_id),
+                          data.data(), data.data() + data.size(), table,
+                          /*ds_config=*/nullptr, msg.get(), &metadata);
+    msg.Reset();
+    metadata.Clear();
+  }
+}
+
+void BM_ParseEventGeneric(benchmark::State& state) {
+  DoParseEvent(/*specialized=*/false, state);
+}
+BENCHMARK(BM_ParseEventGeneric)
+    ->DenseRange(0, std::size(kDecodersEvents) - 1, 1);
+
+void BM_ParseEventSpecialized(benchmark::State& state) {
+  DoParseEvent(/*specialized=*/true, state);
+}
+BENCHMARK(BM_ParseEventSpecialized)
+    ->DenseRange(0, std::size(kDecodersEvents) - 1, 1);
+
 // Higher level benchmark for the CpuReader::ProcessPagesForDataSource function.
 void DoProcessPages(const ExamplePage& test_case,
                     const size_t page_repetition,
@@ -944,11 +1043,13 @@ void DoProcessPages(const ExamplePage& test_case,
   FtraceDataSourceConfig ds_config{EventFilter{},
                                    EventFilter{},
                                    DisabledCompactSchedConfigForTesting(),
+                                   CompactEventsConfig{},
                                    std::nullopt,
                                    {},
                                    {},
                                    false /*symbolize_ksyms*/,
                                    false /*preserve_ftrace_buffer*/,
+                                   {},
                                    {}};
   if (print_filter.has_value()) {
     ds_config.print_filter =
@@ -965,7 +1066,7 @@ void DoProcessPages(const ExamplePage& test_case,
     CpuReader::ProcessPagesForDataSource(
         &writer, &metadata, /*cpu=*/0, &ds_config, repeated_pages.get(),
         page_repetition, table,
-        /*symbolizer=*/nullptr, /*ftrace_clock_snapshot=*/nullptr,
+        /*symbol_map=*/nullptr, /*ftrace_clock_snapshot=*/nullptr,
         /*ftrace_clock=*/protos::pbzero::FTRACE_CLOCK_UNSPECIFIED);
 
     metadata.Clear();
@@ -984,5 +1085,242 @@ void BM_ProcessPagesFullOfPrint(benchmark::State& state) {
 }
 BENCHMARK(BM_ProcessPagesFullOfPrint)->Range(1, 64);
 
+// Returns |num_pages| pages full of sched_switch events, switching to tasks
+// named after |num_comms| different comms in turn. This models workloads with
+// high process churn, e.g. builds. The first event of
+// |g_full_page_sched_switch| is used as template.
+std::unique_ptr<uint8_t[]> MakeSchedSwitchPages(
+    const ProtoTranslationTable* table,
+    size_t num_pages,
+    size_t num_comms) {
+  // The template event follows the 16 bytes page header, a time extend
+  // (8 bytes) and its own 4 bytes event header. Its payload is 64 bytes long.
+  constexpr size_t kTemplateOffset = 28;
+  constexpr uint32_t kEventSize = 64;
+  constexpr uint32_t kTimeDelta = 1000;
+  const CompactSchedSwitchFormat& format =
+      table->compact_sched_format().sched_switch;
+  PERFETTO_CHECK(table->compact_sched_format().format_valid);
+  PERFETTO_CHECK(format.size <= kEventSize);
+  PERFETTO_CHECK(table->page_header_size_len() <= sizeof(uint64_t));
+
+  auto example = PageFromXxd(g_full_page_sched_switch.data);
+  const size_t header_size = sizeof(uint64_t) + table->page_header_size_len();
+  const size_t events_per_page =
+      (base::kPageSize - header_size) / (sizeof(uint32_t) + kEventSize);
+  const uint64_t commit = events_per_page * (sizeof(uint32_t) + kEventSize);
+  const uint32_t event_header = (kTimeDelta << 5) | (kEventSize / 4);
+
+  auto pages = std::make_unique<uint8_t[]>(base::kPageSize * num_pages);
+  memset(pages.get(), 0, base::kPageSize * num_pages);
+  size_t event_idx = 0;
+  for (size_t i = 0; i < num_pages; i++) {
+    uint8_t* wptr = &pages[i * base::kPageSize];
+    uint64_t timestamp = i * events_per_page * kTimeDelta;
+    memcpy(wptr, &timestamp, sizeof(timestamp));
+    memcpy(wptr + sizeof(timestamp), &commit, table->page_header_size_len());
+    wptr += header_size;
+    for (size_t j = 0; j < events_per_page; j++, event_idx++) {
+      memcpy(wptr, &event_header, sizeof(event_header));
+      wptr += sizeof(event_header);
+      memcpy(wptr, &example[kTemplateOffset], kEventSize);
+      int32_t next_pid = static_cast<int32_t>(event_idx);
+      memcpy(wptr + format.next_pid_offset, &next_pid, sizeof(next_pid));
+      char comm[CommInterner::kExpectedCommLength] = {};
+      snprintf(comm, sizeof(comm), "task-%zu", event_idx % num_comms);
+      memcpy(wptr + format.next_comm_offset, comm, sizeof(comm));
+      wptr += kEventSize;
+    }
+  }
+  return pages;
+}
+
+// Benchmark for CpuReader::ProcessPagesForDataSource with compact sched
+// encoding, where sched_switch events switch to |state.range(0)| different
+// comms.
+void BM_ProcessPagesCompactSchedSwitchComms(benchmark::State& state) {
+  constexpr size_t kPages = 32;
+  const size_t num_comms = static_cast<size_t>(state.range(0));
+  perfetto::NullTraceWriter writer;
+  ProtoTranslationTable* table = GetTable(g_full_page_sched_switch.name);
+  auto pages = MakeSchedSwitchPages(table, kPages, num_comms);
+
+  FtraceDataSourceConfig ds_config{EventFilter{},
+                                   EventFilter{},
+                                   EnabledCompactSchedConfigForTesting(),
+                                   CompactEventsConfig{},
+                                   std::nullopt,
+                                   {},
+                                   {},
+                                   false /*symbolize_ksyms*/,
+                                   false /*preserve_ftrace_buffer*/,
+                                   {},
+                                   {}};
+  ds_config.event_filter.AddEnabledEvent(
+      table->EventToFtraceId(GroupAndName("sched", "sched_switch")));
+
+  FtraceMetadata metadata{};
+  for (auto _ : state) {
+    size_t pages_parsed = CpuReader::ProcessPagesForDataSource(
+        &writer, &metadata, /*cpu=*/0, &ds_config, pages.get(), kPages, table,
+        /*symbol_map=*/nullptr, /*ftrace_clock_snapshot=*/nullptr,
+        /*ftrace_clock=*/protos::pbzero::FTRACE_CLOCK_UNSPECIFIED);
+    PERFETTO_CHECK(pages_parsed == kPages);
+    metadata.Clear();
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(kPages * base::kPageSize));
+}
+BENCHMARK(BM_ProcessPagesCompactSchedSwitchComms)
+    ->Arg(1)
+    ->Arg(16)
+    ->Arg(256)
+    ->Arg(1024)
+    ->Arg(4096);
+
+FtraceDataSourceConfig SchedSwitchConfig(ProtoTranslationTable* table) {
+  FtraceDataSourceConfig ds_config{EventFilter{},
+                                   EventFilter{},
+                                   DisabledCompactSchedConfigForTesting(),
+                                   CompactEventsConfig{},
+                                   std::nullopt,
+                                   {},
+                                   {},
+                                   false /*symbolize_ksyms*/,
+                                   false /*preserve_ftrace_buffer*/,
+                                   {},
+                                   {}};
+  ds_config.event_filter.AddEnabledEvent(
+      table->EventToFtraceId(GroupAndName("sched", "sched_switch")));
+  return ds_config;
+}
+
+// Benchmark for CpuReader::ReadCycle(), including the transfer of the pages
+// out of the fd. A pipe stands in for trace_pipe_raw: this is representative
+// of the number of syscalls, not of the kernel side of the copy.
+void DoReadCycle(bool use_splice, benchmark::State& state) {
+  constexpr size_t kPages = 32;
+  ProtoTranslationTable* table = GetTable(g_full_page_sched_switch.name);
+  auto page = PageFromXxd(g_full_page_sched_switch.data);
+  FtraceDataSourceConfig ds_config = SchedSwitchConfig(table);
+
+  base::Pipe trace_pipe = base::Pipe::Create(base::Pipe::kBothNonBlock);
+  PERFETTO_CHECK(fcntl(*trace_pipe.wr, F_SETPIPE_SZ,
+                       static_cast<int>(kPages * base::kPageSize)) >= 0);
+  CpuReader reader(/*cpu=*/0, table, /*symbolizer=*/nullptr,
+                   /*ftrace_clock_snapshot=*/nullptr,
+                   base::ScopedFile(trace_pipe.rd.release()));
+  if (use_splice)
+    PERFETTO_CHECK(reader.EnableSplice());
+
+  perfetto::NullTraceWriter writer;
+  FtraceMetadata metadata{};
+  std::vector<CpuReader::ParsingTarget> targets{
+      CpuReader::ParsingTarget{&writer, &metadata, &ds_config, nullptr}};
+  auto parsing_buf = std::make_unique<uint8_t[]>(base::kPageSize * kPages);
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    for (size_t i = 0; i < kPages; i++) {
+      PERFETTO_CHECK(base::WriteAll(*trace_pipe.wr, &page[0],
+                                    base::kPageSize) == base::kPageSize);
+    }
+    state.ResumeTiming();
+
+    size_t pages_read =
+        reader.ReadCycle(parsing_buf.get(), kPages, kPages, targets);
+    PERFETTO_CHECK(pages_read == kPages);
+    metadata.Clear();
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(kPages * base::kPageSize));
+}
+
+void BM_ReadCycleWithRead(benchmark::State& state) {
+  DoReadCycle(/*use_splice=*/false, state);
+}
+BENCHMARK(BM_ReadCycleWithRead);
+
+void BM_ReadCycleWithSplice(benchmark::State& state) {
+  DoReadCycle(/*use_splice=*/true, state);
+}
+BENCHMARK(BM_ReadCycleWithSplice);
+
+// Parses |kPagesPerCpu| pages for each of |num_cpus| cpus, either all on the
+// calling thread (like FtraceController's ReadTick) or on one thread per cpu
+// (like FtraceConfig.use_cpu_reader_threads). Measures the wall time until
+// all the cpus are drained.
+void DoProcessPagesManyCpus(bool use_threads, benchmark::State& state) {
+  constexpr size_t kPagesPerCpu = 64;
+  const size_t num_cpus = static_cast<size_t>(state.range(0));
+  ProtoTranslationTable* table = GetTable(g_full_page_sched_switch.name);
+  FtraceDataSourceConfig ds_config = SchedSwitchConfig(table);
+
+  auto pages = std::make_unique<uint8_t[]>(base::kPageSize * kPagesPerCpu);
+  {
+    auto page = PageFromXxd(g_full_page_sched_switch.data);
+    for (size_t i = 0; i < kPagesPerCpu; i++)
+      memcpy(&pages[i * base::kPageSize], &page[0], base::kPageSize);
+  }
+
+  struct Cpu {
+    perfetto::NullTraceWriter writer;
+    FtraceMetadata metadata;
+    std::unique_ptr<base::ThreadTaskRunner> thread;
+  };
+  std::vector<Cpu> cpus(num_cpus);
+  auto process_cpu = [&](size_t cpu) {
+    CpuReader::ProcessPagesForDataSource(
+        &cpus[cpu].writer, &cpus[cpu].metadata, cpu, &ds_config, pages.get(),
+        kPagesPerCpu, table, /*symbol_map=*/nullptr,
+        /*ftrace_clock_snapshot=*/nullptr,
+        /*ftrace_clock=*/protos::pbzero::FTRACE_CLOCK_UNSPECIFIED);
+    cpus[cpu].metadata.Clear();
+  };
+  if (use_threads) {
+    for (Cpu& cpu : cpus) {
+      cpu.thread.reset(new base::ThreadTaskRunner(
+          base::ThreadTaskRunner::CreateAndStart()));
+    }
+  }
+
+  std::mutex mutex;
+  std::condition_variable cv;
+  for (auto _ : state) {
+    if (!use_threads) {
+      for (size_t cpu = 0; cpu < num_cpus; cpu++)
+        process_cpu(cpu);
+      continue;
+    }
+    size_t cpus_left = num_cpus;
+    for (size_t cpu = 0; cpu < num_cpus; cpu++) {
+      cpus[cpu].thread->PostTask([&, cpu] {
+        process_cpu(cpu);
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--cpus_left == 0)
+          cv.notify_one();
+      });
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [&] { return cpus_left == 0; });
+  }
+  state.SetBytesProcessed(
+      static_cast<int64_t>(state.iterations()) *
+      static_cast<int64_t>(num_cpus * kPagesPerCpu * base::kPageSize));
+}
+
+void BM_ProcessPagesManyCpusSequential(benchmark::State& state) {
+  DoProcessPagesManyCpus(/*use_threads=*/false, state);
+}
+BENCHMARK(BM_ProcessPagesManyCpusSequential)->RangeMultiplier(4)->Range(1, 64);
+
+void BM_ProcessPagesManyCpusThreads(benchmark::State& state) {
+  DoProcessPagesManyCpus(/*use_threads=*/true, state);
+}
+BENCHMARK(BM_ProcessPagesManyCpusThreads)
+    ->RangeMultiplier(4)
+    ->Range(1, 64)
+    ->UseRealTime();
+
 }  // namespace
 }  // namespace perfetto
@@ -57,11 +57,13 @@ void FuzzCpuReaderProcessPagesForDataSource(const uint8_t* data, size_t size) {
   FtraceDataSourceConfig ds_config{EventFilter{},
                                    EventFilter{},
                                    DisabledCompactSchedConfigForTesting(),
+                                   CompactEventsConfig{},
                                    std::nullopt,
                                    {},
                                    {},
                                    /*symbolize_ksyms=*/false,
                                    /*preserve_ftrace_buffer=*/false,
+                                   {},
                                    {}};
   ds_config.event_filter.AddEnabledEvent(
       table->EventToFtraceId(GroupAndName("sched", "sched_switch")));
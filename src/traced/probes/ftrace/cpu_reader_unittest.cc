@@ -73,11 +73,13 @@ FtraceDataSourceConfig EmptyConfig() {
   return FtraceDataSourceConfig{EventFilter{},
                                 EventFilter{},
                                 DisabledCompactSchedConfigForTesting(),
+                                CompactEventsConfig{},
                                 std::nullopt,
                                 {},
                                 {},
                                 false /*symbolize_ksyms*/,
                                 false /*preserve_ftrace_buffer*/,
+                                {},
                                 {}};
 }
 
@@ -394,11 +396,12 @@ class CpuReaderParsePagePayloadTest : public testing::Test {
   CpuReader::Bundler* CreateBundler(const FtraceDataSourceConfig& ds_config) {
     PERFETTO_CHECK(!bundler_.has_value());
     writer_.emplace();
-    bundler_.emplace(&writer_.value(), &metadata_, /*symbolizer=*/nullptr,
+    bundler_.emplace(&writer_.value(), &metadata_, /*symbol_map=*/nullptr,
                      /*cpu=*/0,
                      /*ftrace_clock_snapshot=*/nullptr,
                      /*ftrace_clock=*/protos::pbzero::FTRACE_CLOCK_UNSPECIFIED,
-                     ds_config.compact_sched.enabled);
+                     ds_config.compact_sched.enabled,
+                     &ds_config.compact_events);
     return &bundler_.value();
   }
 
@@ -887,7 +890,7 @@ TEST(CpuReaderTest, ProcessPagesForDataSourceNoEmptyPackets) {
     TraceWriterForTesting trace_writer;
     size_t processed_pages = CpuReader::ProcessPagesForDataSource(
         &trace_writer, &metadata, /*cpu=*/1, &with_filter, buf.get(),
-        kTestPages, table, /*symbolizer=*/nullptr,
+        kTestPages, table, /*symbol_map=*/nullptr,
         /*ftrace_clock_snapshot=*/nullptr,
         protos::pbzero::FTRACE_CLOCK_UNSPECIFIED);
 
@@ -896,6 +899,8 @@ TEST(CpuReaderTest, ProcessPagesForDataSourceNoEmptyPackets) {
     // Check that the data source doesn't emit any packet, not even empty
     // packets.
     EXPECT_THAT(trace_writer.GetAllTracePackets(), IsEmpty());
+    EXPECT_EQ(metadata.filtered_events, 8u * 3);
+    EXPECT_GT(metadata.filtered_bytes, 0u);
   }
 
   {
@@ -907,13 +912,14 @@ TEST(CpuReaderTest, ProcessPagesForDataSourceNoEmptyPackets) {
     TraceWriterForTesting trace_writer;
     size_t processed_pages = CpuReader::ProcessPagesForDataSource(
         &trace_writer, &metadata, /*cpu=*/1, &without_filter, buf.get(),
-        kTestPages, table, /*symbolizer=*/nullptr,
+        kTestPages, table, /*symbol_map=*/nullptr,
         /*ftrace_clock_snapshot=*/nullptr,
         protos::pbzero::FTRACE_CLOCK_UNSPECIFIED);
 
     EXPECT_EQ(processed_pages, 8u);
 
     EXPECT_THAT(trace_writer.GetAllTracePackets(), Not(IsEmpty()));
+    EXPECT_EQ(metadata.filtered_events, 0u);
   }
 }
 
@@ -1021,11 +1027,13 @@ TEST_F(CpuReaderParsePagePayloadTest, ParseSixSchedSwitchCompactFormat) {
   FtraceDataSourceConfig ds_config{EventFilter{},
                                    EventFilter{},
                                    EnabledCompactSchedConfigForTesting(),
+                                   CompactEventsConfig{},
                                    std::nullopt,
                                    {},
                                    {},
                                    false /* symbolize_ksyms*/,
                                    false /*preserve_ftrace_buffer*/,
+                                   {},
                                    {}};
   ds_config.event_filter.AddEnabledEvent(
       table->EventToFtraceId(GroupAndName("sched", "sched_switch")));
@@ -1134,11 +1142,13 @@ TEST_F(CpuReaderParsePagePayloadTest, ParseCompactSchedSwitchAndWaking) {
   FtraceDataSourceConfig ds_config{EventFilter{},
                                    EventFilter{},
                                    EnabledCompactSchedConfigForTesting(),
+                                   CompactEventsConfig{},
                                    std::nullopt,
                                    {},
                                    {},
                                    false /* symbolize_ksyms*/,
                                    false /*preserve_ftrace_buffer*/,
+                                   {},
                                    {}};
   ds_config.event_filter.AddEnabledEvent(
       table->EventToFtraceId(GroupAndName("sched", "sched_switch")));
@@ -1624,7 +1634,7 @@ TEST(CpuReaderTest, NewPacketOnLostEvents) {
   TraceWriterForTesting trace_writer;
   size_t processed_pages = CpuReader::ProcessPagesForDataSource(
       &trace_writer, &metadata, /*cpu=*/1, &ds_config, buf.get(), kTestPages,
-      table, /*symbolizer=*/nullptr, /*ftrace_clock_snapshot=*/nullptr,
+      table, /*symbol_map=*/nullptr, /*ftrace_clock_snapshot=*/nullptr,
       protos::pbzero::FTRACE_CLOCK_UNSPECIFIED);
 
   ASSERT_EQ(processed_pages, kTestPages);
@@ -1672,7 +1682,7 @@ TEST(CpuReaderTest, ProcessPagesForDataSourceError) {
   TraceWriterForTesting trace_writer;
   size_t processed_pages = CpuReader::ProcessPagesForDataSource(
       &trace_writer, &metadata, /*cpu=*/1, &ds_config, buf.get(), kTestPages,
-      table, /*symbolizer=*/nullptr, /*ftrace_clock_snapshot=*/nullptr,
+      table, /*symbol_map=*/nullptr, /*ftrace_clock_snapshot=*/nullptr,
       protos::pbzero::FTRACE_CLOCK_UNSPECIFIED);
 
   EXPECT_EQ(processed_pages, 3u);
@@ -0,0 +1,390 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/traced/probes/ftrace/event_decoders.h"
+
+#include <string.h>
+
+#include "perfetto/protozero/message.h"
+#include "src/traced/probes/ftrace/cpu_reader.h"
+#include "src/traced/probes/ftrace/event_info_constants.h"
+#include "src/traced/probes/ftrace/ftrace_metadata.h"
+#include "src/traced/probes/ftrace/proto_translation_table.h"
+
+#include "protos/perfetto/trace/ftrace/ftrace.pbzero.h"
+#include "protos/perfetto/trace/ftrace/ipi.pbzero.h"
+#include "protos/perfetto/trace/ftrace/irq.pbzero.h"
+#include "protos/perfetto/trace/ftrace/power.pbzero.h"
+#include "protos/perfetto/trace/ftrace/sched.pbzero.h"
+#include "protos/perfetto/trace/ftrace/task.pbzero.h"
+#include "protos/perfetto/trace/ftrace/workqueue.pbzero.h"
+
+namespace perfetto {
+namespace {
+
+// Decodes a field whose translation strategy is known at compile time. Must
+// match CpuReader::ParseField(), which is used for the strategies that don't
+// benefit from the specialization (e.g. __data_loc strings).
+template <TranslationStrategy kStrategy>
+inline bool DecodeField(const Field& field,
+                        uint32_t field_id,
+                        const uint8_t* start,
+                        const uint8_t* end,
+                        const ProtoTranslationTable* table,
+                        protozero::Message* message,
+                        FtraceMetadata* metadata) {
+  const uint8_t* field_start = start + field.ftrace_offset;
+  if constexpr (kStrategy == kUint32ToUint32 || kStrategy == kUint32ToUint64) {
+    CpuReader::ReadIntoVarInt<uint32_t>(field_start, field_id, message);
+  } else if constexpr (kStrategy == kUint64ToUint64) {
+    CpuReader::ReadIntoVarInt<uint64_t>(field_start, field_id, message);
+  } else if constexpr (kStrategy == kInt16ToInt32 ||
+                       kStrategy == kInt16ToInt64) {
+    CpuReader::ReadIntoVarInt<int16_t>(field_start, field_id, message);
+  } else if constexpr (kStrategy == kInt32ToInt32 ||
+                       kStrategy == kInt32ToInt64) {
+    CpuReader::ReadIntoVarInt<int32_t>(field_start, field_id, message);
+  } else if constexpr (kStrategy == kInt64ToInt64) {
+    CpuReader::ReadIntoVarInt<int64_t>(field_start, field_id, message);
+  } else if constexpr (kStrategy == kBoolToUint32 ||
+                       kStrategy == kBoolToUint64) {
+    CpuReader::ReadIntoVarInt<uint8_t>(field_start, field_id, message);
+  } else if constexpr (kStrategy == kPid32ToInt32 ||
+                       kStrategy == kPid32ToInt64) {
+    CpuReader::ReadPid(field_start, field_id, message, metadata);
+  } else if constexpr (kStrategy == kFtraceSymAddr64ToUint64) {
+    CpuReader::ReadSymbolAddr<uint64_t>(field_start, field_id, message,
+                                        metadata);
+  } else if constexpr (kStrategy == kFixedCStringToString) {
+    const char* str = reinterpret_cast<const char*>(field_start);
+    message->AppendBytes(field_id, str, strnlen(str, field.ftrace_size));
+  } else {
+    return CpuReader::ParseField(field, start, end, table, message, metadata);
+  }
+  return true;
+}
+
+// A field of an expected event layout.
+template <uint32_t kFieldId, TranslationStrategy kStrategy>
+struct F {
+  static bool Matches(const Field& field) {
+    return field.proto_field_id == kFieldId && field.strategy == kStrategy;
+  }
+
+  static inline bool Decode(const Field& field,
+                            const uint8_t* start,
+                            const uint8_t* end,
+                            const ProtoTranslationTable* table,
+                            protozero::Message* message,
+                            FtraceMetadata* metadata) {
+    return DecodeField<kStrategy>(field, kFieldId, start, end, table, message,
+                                  metadata);
+  }
+};
+
+// An expected event layout: the fields of the event, in the order of
+// Event::fields (i.e. the order of event_info.cc).
+template <typename... Fields>
+struct Layout {
+  static bool Matches(const Event& event) {
+    if (event.fields.size() != sizeof...(Fields))
+      return false;
+    const Field* field = event.fields.data();
+    return (Fields::Matches(*field++) && ...);
+  }
+
+  static bool Decode(const Event& info,
+                     const uint8_t* start,
+                     const uint8_t* end,
+                     const ProtoTranslationTable* table,
+                     protozero::Message* message,
+                     FtraceMetadata* metadata) {
+    const Field* field = info.fields.data();
+    bool success = true;
+    ((success &=
+      Fields::Decode(*field++, start, end, table, message, metadata)),
+     ...);
+    return success;
+  }
+};
+
+struct SpecializedDecoder {
+  const char* group;
+  const char* name;
+  bool (*matches)(const Event&);
+  EventDecoderFn decode;
+};
+
+template <typename L>
+constexpr SpecializedDecoder Decoder(const char* group, const char* name) {
+  return SpecializedDecoder{group, name, &L::Matches, &L::Decode};
+}
+
+namespace sched {
+using Switch = protos::pbzero::SchedSwitchFtraceEvent;
+using Waking = protos::pbzero::SchedWakingFtraceEvent;
+using Wakeup = protos::pbzero::SchedWakeupFtraceEvent;
+using WakeupNew = protos::pbzero::SchedWakeupNewFtraceEvent;
+using ProcessExit = protos::pbzero::SchedProcessExitFtraceEvent;
+using ProcessFree = protos::pbzero::SchedProcessFreeFtraceEvent;
+using ProcessFork = protos::pbzero::SchedProcessForkFtraceEvent;
+using ProcessExec = protos::pbzero::SchedProcessExecFtraceEvent;
+using BlockedReason = protos::pbzero::SchedBlockedReasonFtraceEvent;
+
+// |prev_state| is a long: 64 bits on 64-bit kernels, 32 bits otherwise.
+template <TranslationStrategy kPrevStateStrategy>
+using SwitchLayout =
+    Layout<F<Switch::kPrevCommFieldNumber, kFixedCStringToString>,
+           F<Switch::kPrevPidFieldNumber, kPid32ToInt32>,
+           F<Switch::kPrevPrioFieldNumber, kInt32ToInt32>,
+           F<Switch::kPrevStateFieldNumber, kPrevStateStrategy>,
+           F<Switch::kNextCommFieldNumber, kFixedCStringToString>,
+           F<Switch::kNextPidFieldNumber, kPid32ToInt32>,
+           F<Switch::kNextPrioFieldNumber, kInt32ToInt32>>;
+
+// sched_waking, sched_wakeup and sched_wakeup_new share the same layout.
+template <typename P>
+using WakeupLayout = Layout<F<P::kCommFieldNumber, kFixedCStringToString>,
+                            F<P::kPidFieldNumber, kPid32ToInt32>,
+                            F<P::kPrioFieldNumber, kInt32ToInt32>,
+                            F<P::kSuccessFieldNumber, kInt32ToInt32>,
+                            F<P::kTargetCpuFieldNumber, kInt32ToInt32>>;
+
+using ProcessExitLayout =
+    Layout<F<ProcessExit::kCommFieldNumber, kFixedCStringToString>,
+           F<ProcessExit::kPidFieldNumber, kPid32ToInt32>,
+           F<ProcessExit::kPrioFieldNumber, kInt32ToInt32>>;
+
+// Some kernels (e.g. 4.4 on Android) also have the tgid.
+using ProcessExitWithTgidLayout =
+    Layout<F<ProcessExit::kCommFieldNumber, kFixedCStringToString>,
+           F<ProcessExit::kPidFieldNumber, kPid32ToInt32>,
+           F<ProcessExit::kTgidFieldNumber, kPid32ToInt32>,
+           F<ProcessExit::kPrioFieldNumber, kInt32ToInt32>>;
+
+using ProcessFreeLayout =
+    Layout<F<ProcessFree::kCommFieldNumber, kFixedCStringToString>,
+           F<ProcessFree::kPidFieldNumber, kPid32ToInt32>,
+           F<ProcessFree::kPrioFieldNumber, kInt32ToInt32>>;
+
+using ProcessForkLayout =
+    Layout<F<ProcessFork::kParentCommFieldNumber, kFixedCStringToString>,
+           F<ProcessFork::kParentPidFieldNumber, kPid32ToInt32>,
+           F<ProcessFork::kChildCommFieldNumber, kFixedCStringToString>,
+           F<ProcessFork::kChildPidFieldNumber, kPid32ToInt32>>;
+
+using ProcessExecLayout =
+    Layout<F<ProcessExec::kFilenameFieldNumber, kDataLocToString>,
+           F<ProcessExec::kPidFieldNumber, kPid32ToInt32>,
+           F<ProcessExec::kOldPidFieldNumber, kPid32ToInt32>>;
+
+// |caller| is a kernel address: symbolized on 64-bit kernels only.
+template <TranslationStrategy kCallerStrategy>
+using BlockedReasonLayout =
+    Layout<F<BlockedReason::kPidFieldNumber, kPid32ToInt32>,
+           F<BlockedReason::kCallerFieldNumber, kCallerStrategy>,
+           F<BlockedReason::kIoWaitFieldNumber, kBoolToUint32>>;
+}  // namespace sched
+
+namespace task {
+using Newtask = protos::pbzero::TaskNewtaskFtraceEvent;
+using Rename = protos::pbzero::TaskRenameFtraceEvent;
+
+// |clone_flags| is an unsigned long.
+template <TranslationStrategy kCloneFlagsStrategy>
+using NewtaskLayout =
+    Layout<F<Newtask::kPidFieldNumber, kPid32ToInt32>,
+           F<Newtask::kCommFieldNumber, kFixedCStringToString>,
+           F<Newtask::kCloneFlagsFieldNumber, kCloneFlagsStrategy>,
+           F<Newtask::kOomScoreAdjFieldNumber, kInt16ToInt32>>;
+
+using RenameLayout =
+    Layout<F<Rename::kPidFieldNumber, kPid32ToInt32>,
+           F<Rename::kOldcommFieldNumber, kFixedCStringToString>,
+           F<Rename::kNewcommFieldNumber, kFixedCStringToString>,
+           F<Rename::kOomScoreAdjFieldNumber, kInt16ToInt32>>;
+}  // namespace task
+
+namespace power {
+using CpuFrequency = protos::pbzero::CpuFrequencyFtraceEvent;
+using CpuIdle = protos::pbzero::CpuIdleFtraceEvent;
+using SuspendResume = protos::pbzero::SuspendResumeFtraceEvent;
+
+template <typename P>
+using CpuStateLayout = Layout<F<P::kStateFieldNumber, kUint32ToUint32>,
+                              F<P::kCpuIdFieldNumber, kUint32ToUint32>>;
+
+using SuspendResumeLayout =
+    Layout<F<SuspendResume::kActionFieldNumber, kStringPtrToString>,
+           F<SuspendResume::kValFieldNumber, kInt32ToInt32>,
+           F<SuspendResume::kStartFieldNumber, kBoolToUint32>>;
+}  // namespace power
+
+namespace irq {
+using HandlerEntry = protos::pbzero::IrqHandlerEntryFtraceEvent;
+using HandlerExit = protos::pbzero::IrqHandlerExitFtraceEvent;
+using SoftirqEntry = protos::pbzero::SoftirqEntryFtraceEvent;
+using SoftirqExit = protos::pbzero::SoftirqExitFtraceEvent;
+using SoftirqRaise = protos::pbzero::SoftirqRaiseFtraceEvent;
+
+using HandlerEntryLayout =
+    Layout<F<HandlerEntry::kIrqFieldNumber, kInt32ToInt32>,
+           F<HandlerEntry::kNameFieldNumber, kDataLocToString>>;
+
+// Older kernels (e.g. 3.10) also have the handler address.
+using HandlerEntryWithHandlerLayout =
+    Layout<F<HandlerEntry::kIrqFieldNumber, kInt32ToInt32>,
+           F<HandlerEntry::kNameFieldNumber, kDataLocToString>,
+           F<HandlerEntry::kHandlerFieldNumber, kUint32ToUint32>>;
+
+using HandlerExitLayout =
+    Layout<F<HandlerExit::kIrqFieldNumber, kInt32ToInt32>,
+           F<HandlerExit::kRetFieldNumber, kInt32ToInt32>>;
+
+template <typename P>
+using SoftirqLayout = Layout<F<P::kVecFieldNumber, kUint32ToUint32>>;
+}  // namespace irq
+
+namespace ipi {
+using Raise = protos::pbzero::IpiRaiseFtraceEvent;
+using Entry = protos::pbzero::IpiEntryFtraceEvent;
+using Exit = protos::pbzero::IpiExitFtraceEvent;
+
+using RaiseLayout = Layout<F<Raise::kTargetCpusFieldNumber, kUint32ToUint32>,
+                           F<Raise::kReasonFieldNumber, kStringPtrToString>>;
+
+template <typename P>
+using EntryExitLayout = Layout<F<P::kReasonFieldNumber, kStringPtrToString>>;
+}  // namespace ipi
+
+namespace workqueue {
+using ExecuteStart = protos::pbzero::WorkqueueExecuteStartFtraceEvent;
+using ExecuteEnd = protos::pbzero::WorkqueueExecuteEndFtraceEvent;
+using ActivateWork = protos::pbzero::WorkqueueActivateWorkFtraceEvent;
+using QueueWork = protos::pbzero::WorkqueueQueueWorkFtraceEvent;
+
+// Pointers are symbolized on 64-bit kernels, and are plain integers on 32-bit
+// ones.
+template <TranslationStrategy kPtr>
+using ExecuteStartLayout = Layout<F<ExecuteStart::kWorkFieldNumber, kPtr>,
+                                  F<ExecuteStart::kFunctionFieldNumber, kPtr>>;
+
+template <TranslationStrategy kPtr>
+using ExecuteEndLayout = Layout<F<ExecuteEnd::kWorkFieldNumber, kPtr>>;
+
+// Newer kernels also have the function.
+template <TranslationStrategy kPtr>
+using ExecuteEndWithFunctionLayout =
+    Layout<F<ExecuteEnd::kWorkFieldNumber, kPtr>,
+           F<ExecuteEnd::kFunctionFieldNumber, kPtr>>;
+
+template <TranslationStrategy kPtr>
+using ActivateWorkLayout = Layout<F<ActivateWork::kWorkFieldNumber, kPtr>>;
+
+template <TranslationStrategy kPtr>
+using QueueWorkLayout =
+    Layout<F<QueueWork::kWorkFieldNumber, kPtr>,
+           F<QueueWork::kFunctionFieldNumber, kPtr>,
+           F<QueueWork::kWorkqueueFieldNumber, kPtr>,
+           F<QueueWork::kReqCpuFieldNumber, kUint32ToUint32>,
+           F<QueueWork::kCpuFieldNumber, kUint32ToUint32>>;
+}  // namespace workqueue
+
+namespace ftrace {
+using Print = protos::pbzero::PrintFtraceEvent;
+
+using PrintLayout = Layout<F<Print::kBufFieldNumber, kCStringToString>>;
+}  // namespace ftrace
+
+// The layouts of each event are matched in order, the first one matching the
+// runtime format is used.
+constexpr SpecializedDecoder kDecoders[] = {
+    Decoder<sched::SwitchLayout<kInt64ToInt64>>("sched", "sched_switch"),
+    Decoder<sched::SwitchLayout<kInt32ToInt64>>("sched", "sched_switch"),
+    Decoder<sched::WakeupLayout<sched::Waking>>("sched", "sched_waking"),
+    Decoder<sched::WakeupLayout<sched::Wakeup>>("sched", "sched_wakeup"),
+    Decoder<sched::WakeupLayout<sched::WakeupNew>>("sched",
+                                                   "sched_wakeup_new"),
+    Decoder<sched::ProcessExitLayout>("sched", "sched_process_exit"),
+    Decoder<sched::ProcessExitWithTgidLayout>("sched", "sched_process_exit"),
+    Decoder<sched::ProcessFreeLayout>("sched", "sched_process_free"),
+    Decoder<sched::ProcessForkLayout>("sched", "sched_process_fork"),
+    Decoder<sched::ProcessExecLayout>("sched", "sched_process_exec"),
+    Decoder<sched::BlockedReasonLayout<kFtraceSymAddr64ToUint64>>(
+        "sched",
+        "sched_blocked_reason"),
+    Decoder<sched::BlockedReasonLayout<kUint32ToUint64>>(
+        "sched",
+        "sched_blocked_reason"),
+    Decoder<task::NewtaskLayout<kUint64ToUint64>>("task", "task_newtask"),
+    Decoder<task::NewtaskLayout<kUint32ToUint64>>("task", "task_newtask"),
+    Decoder<task::RenameLayout>("task", "task_rename"),
+    Decoder<power::CpuStateLayout<power::CpuFrequency>>("power",
+                                                        "cpu_frequency"),
+    Decoder<power::CpuStateLayout<power::CpuIdle>>("power", "cpu_idle"),
+    Decoder<power::SuspendResumeLayout>("power", "suspend_resume"),
+    Decoder<irq::HandlerEntryLayout>("irq", "irq_handler_entry"),
+    Decoder<irq::HandlerEntryWithHandlerLayout>("irq", "irq_handler_entry"),
+    Decoder<irq::HandlerExitLayout>("irq", "irq_handler_exit"),
+    Decoder<irq::SoftirqLayout<irq::SoftirqEntry>>("irq", "softirq_entry"),
+    Decoder<irq::SoftirqLayout<irq::SoftirqExit>>("irq", "softirq_exit"),
+    Decoder<irq::SoftirqLayout<irq::SoftirqRaise>>("irq", "softirq_raise"),
+    Decoder<ipi::RaiseLayout>("ipi", "ipi_raise"),
+    Decoder<ipi::EntryExitLayout<ipi::Entry>>("ipi", "ipi_entry"),
+    Decoder<ipi::EntryExitLayout<ipi::Exit>>("ipi", "ipi_exit"),
+    Decoder<workqueue::ExecuteStartLayout<kFtraceSymAddr64ToUint64>>(
+        "workqueue",
+        "workqueue_execute_start"),
+    Decoder<workqueue::ExecuteStartLayout<kUint32ToUint64>>(
+        "workqueue",
+        "workqueue_execute_start"),
+    Decoder<workqueue::ExecuteEndLayout<kFtraceSymAddr64ToUint64>>(
+        "workqueue",
+        "workqueue_execute_end"),
+    Decoder<workqueue::ExecuteEndWithFunctionLayout<kFtraceSymAddr64ToUint64>>(
+        "workqueue",
+        "workqueue_execute_end"),
+    Decoder<workqueue::ExecuteEndLayout<kUint32ToUint64>>(
+        "workqueue",
+        "workqueue_execute_end"),
+    Decoder<workqueue::ActivateWorkLayout<kFtraceSymAddr64ToUint64>>(
+        "workqueue",
+        "workqueue_activate_work"),
+    Decoder<workqueue::ActivateWorkLayout<kUint32ToUint64>>(
+        "workqueue",
+        "workqueue_activate_work"),
+    Decoder<workqueue::QueueWorkLayout<kFtraceSymAddr64ToUint64>>(
+        "workqueue",
+        "workqueue_queue_work"),
+    Decoder<workqueue::QueueWorkLayout<kUint32ToUint64>>(
+        "workqueue",
+        "workqueue_queue_work"),
+    Decoder<ftrace::PrintLayout>("ftrace", "print"),
+};
+
+}  // namespace
+
+EventDecoderFn GetSpecializedEventDecoder(const Event& event) {
+  for (const SpecializedDecoder& decoder : kDecoders) {
+    if (strcmp(decoder.name, event.name) == 0 &&
+        strcmp(decoder.group, event.group) == 0 && decoder.matches(event)) {
+      return decoder.decode;
+    }
+  }
+  return nullptr;
+}
+
+}  // namespace perfetto
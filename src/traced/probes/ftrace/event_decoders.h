@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACED_PROBES_FTRACE_EVENT_DECODERS_H_
+#define SRC_TRACED_PROBES_FTRACE_EVENT_DECODERS_H_
+
+#include <stdint.h>
+
+namespace protozero {
+class Message;
+}  // namespace protozero
+
+namespace perfetto {
+
+struct Event;
+struct FtraceMetadata;
+class ProtoTranslationTable;
+
+// Decodes the event-specific fields (i.e. not the common fields) of the ftrace
+// event |info| beginning at |start| and ending at |end| into |message|.
+using EventDecoderFn = bool (*)(const Event& info,
+                                const uint8_t* start,
+                                const uint8_t* end,
+                                const ProtoTranslationTable* table,
+                                protozero::Message* message,
+                                FtraceMetadata* metadata);
+
+// Returns a decoder specialized for the fields of |event|, or nullptr if there
+// is none. Specialized decoders exist only for a set of high-frequency events
+// (e.g. sched_switch) and are written for the layouts of the common kernels:
+// the proto field ids and the translation strategies of all the fields are
+// compile-time constants, so the fields are decoded with straight-line code
+// instead of the per-field switch of CpuReader::ParseField(). Only the field
+// offsets are read from the runtime format.
+//
+// If the runtime format of |event| doesn't match any of the expected layouts
+// (e.g. the kernel has an extra field), nullptr is returned and the event is
+// decoded by the generic path.
+EventDecoderFn GetSpecializedEventDecoder(const Event& event);
+
+}  // namespace perfetto
+
+#endif  // SRC_TRACED_PROBES_FTRACE_EVENT_DECODERS_H_
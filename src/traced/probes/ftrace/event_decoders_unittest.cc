@@ -0,0 +1,193 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/traced/probes/ftrace/event_decoders.h"
+
+#include <string.h>
+
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "perfetto/protozero/scattered_heap_buffer.h"
+#include "src/base/test/utils.h"
+#include "src/traced/probes/ftrace/cpu_reader.h"
+#include "src/traced/probes/ftrace/event_info.h"
+#include "src/traced/probes/ftrace/ftrace_metadata.h"
+#include "src/traced/probes/ftrace/ftrace_procfs.h"
+#include "src/traced/probes/ftrace/proto_translation_table.h"
+#include "test/gtest_and_gmock.h"
+
+#include "protos/perfetto/trace/ftrace/ftrace_event.pbzero.h"
+#include "protos/perfetto/trace/ftrace/sched.pbzero.h"
+
+namespace perfetto {
+namespace {
+
+using ::testing::ElementsAreArray;
+
+std::unique_ptr<ProtoTranslationTable> CreateTable(FtraceProcfs* ftrace) {
+  return ProtoTranslationTable::Create(ftrace, GetStaticEventInfo(),
+                                       GetStaticCommonFieldsInfo());
+}
+
+// Returns a random event payload, with valid __data_loc fields.
+std::vector<uint8_t> MakeRandomEvent(const Event& event,
+                                     std::minstd_rand* rnd) {
+  constexpr uint16_t kDataLocSize = 8;
+  std::vector<uint8_t> data(event.size + kDataLocSize * event.fields.size());
+  for (uint8_t& byte : data)
+    byte = static_cast<uint8_t>((*rnd)());
+  uint16_t data_loc_offset = event.size;
+  for (const Field& field : event.fields) {
+    if (field.strategy != kDataLocToString)
+      continue;
+    uint32_t data_loc =
+        static_cast<uint32_t>(kDataLocSize << 16) | data_loc_offset;
+    memcpy(&data[field.ftrace_offset], &data_loc, sizeof(data_loc));
+    data_loc_offset += kDataLocSize;
+  }
+  return data;
+}
+
+struct ParsedEvent {
+  std::string proto;
+  FtraceMetadata metadata;
+};
+
+ParsedEvent ParseEvent(const Event& event,
+                       const std::vector<uint8_t>& data,
+                       const ProtoTranslationTable* table) {
+  ParsedEvent parsed;
+  protozero::HeapBuffered<protos::pbzero::FtraceEvent> msg;
+  EXPECT_TRUE(CpuReader::ParseEvent(
+      static_cast<uint16_t>(event.ftrace_event_id), data.data(),
+      data.data() + data.size(), table, /*ds_config=*/nullptr, msg.get(),
+      &parsed.metadata));
+  parsed.proto = msg.SerializeAsString();
+  return parsed;
+}
+
+// The specialized decoders must produce the same output as the generic path,
+// for all the kernels in the test data.
+class EventDecodersKernelTest
+    : public ::testing::TestWithParam<std::string> {};
+
+TEST_P(EventDecodersKernelTest, MatchGenericDecoding) {
+  std::string path = base::GetTestDataPath(
+      "src/traced/probes/ftrace/test/data/" + GetParam() + "/");
+  FtraceProcfs ftrace(path);
+  std::unique_ptr<ProtoTranslationTable> table = CreateTable(&ftrace);
+  std::unique_ptr<ProtoTranslationTable> generic_table = CreateTable(&ftrace);
+  ASSERT_TRUE(table && generic_table);
+  generic_table->DisableSpecializedDecodersForTesting();
+
+  std::minstd_rand rnd(0);
+  size_t num_specialized = 0;
+  for (const Event& event : table->events()) {
+    if (!event.ftrace_event_id ||
+        !table->GetSpecializedDecoder(event.ftrace_event_id)) {
+      continue;
+    }
+    num_specialized++;
+    for (int i = 0; i < 10; i++) {
+      std::vector<uint8_t> data = MakeRandomEvent(event, &rnd);
+      ParsedEvent expected = ParseEvent(event, data, generic_table.get());
+      ParsedEvent actual = ParseEvent(event, data, table.get());
+      EXPECT_EQ(actual.proto, expected.proto) << event.name;
+      EXPECT_THAT(actual.metadata.pids,
+                  ElementsAreArray(expected.metadata.pids))
+          << event.name;
+      EXPECT_EQ(actual.metadata.kernel_addrs.size(),
+                expected.metadata.kernel_addrs.size())
+          << event.name;
+    }
+  }
+  EXPECT_GT(num_specialized, 0u);
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    Kernels,
+    EventDecodersKernelTest,
+    ::testing::Values("android_raven_AOSP.MASTER_5.10.43",
+                      "android_walleye_OPM5.171019.017.A1_4.4.88",
+                      "android_seed_N2F62_3.10.49",
+                      "android_hammerhead_MRA59G_3.4.0",
+                      "synthetic"));
+
+TEST(EventDecodersTest, CommonLayouts) {
+  std::string path = base::GetTestDataPath(
+      "src/traced/probes/ftrace/test/data/android_raven_AOSP.MASTER_5.10.43/");
+  FtraceProcfs ftrace(path);
+  std::unique_ptr<ProtoTranslationTable> table = CreateTable(&ftrace);
+  ASSERT_TRUE(table);
+  for (const char* name : {"sched_switch", "sched_waking", "sched_wakeup",
+                           "sched_process_exit", "sched_process_free"}) {
+    size_t id = table->EventToFtraceId(GroupAndName("sched", name));
+    ASSERT_NE(id, 0u);
+    EXPECT_NE(table->GetSpecializedDecoder(id), nullptr) << name;
+  }
+  for (const char* name : {"cpu_frequency", "cpu_idle", "suspend_resume"}) {
+    size_t id = table->EventToFtraceId(GroupAndName("power", name));
+    ASSERT_NE(id, 0u);
+    EXPECT_NE(table->GetSpecializedDecoder(id), nullptr) << name;
+  }
+  size_t print_id = table->EventToFtraceId(GroupAndName("ftrace", "print"));
+  EXPECT_NE(table->GetSpecializedDecoder(print_id), nullptr);
+
+  // No specialization for events that aren't expected at high rates.
+  size_t id = table->EventToFtraceId(GroupAndName("sched", "sched_pi_setprio"));
+  ASSERT_NE(id, 0u);
+  EXPECT_EQ(table->GetSpecializedDecoder(id), nullptr);
+}
+
+TEST(EventDecodersTest, FallBackOnUnexpectedLayout) {
+  using protos::pbzero::SchedSwitchFtraceEvent;
+  auto make_field = [](uint32_t proto_field_id, TranslationStrategy strategy) {
+    Field field{};
+    field.proto_field_id = proto_field_id;
+    field.strategy = strategy;
+    return field;
+  };
+  Event event{};
+  event.name = "sched_switch";
+  event.group = "sched";
+  event.fields = {
+      make_field(SchedSwitchFtraceEvent::kPrevCommFieldNumber,
+                 kFixedCStringToString),
+      make_field(SchedSwitchFtraceEvent::kPrevPidFieldNumber, kPid32ToInt32),
+      make_field(SchedSwitchFtraceEvent::kPrevPrioFieldNumber, kInt32ToInt32),
+      make_field(SchedSwitchFtraceEvent::kPrevStateFieldNumber, kInt64ToInt64),
+      make_field(SchedSwitchFtraceEvent::kNextCommFieldNumber,
+                 kFixedCStringToString),
+      make_field(SchedSwitchFtraceEvent::kNextPidFieldNumber, kPid32ToInt32),
+      make_field(SchedSwitchFtraceEvent::kNextPrioFieldNumber, kInt32ToInt32),
+  };
+  EXPECT_NE(GetSpecializedEventDecoder(event), nullptr);
+
+  // Different type.
+  event.fields[2].strategy = kInt64ToInt64;
+  EXPECT_EQ(GetSpecializedEventDecoder(event), nullptr);
+  event.fields[2].strategy = kInt32ToInt32;
+
+  // Missing field.
+  event.fields.pop_back();
+  EXPECT_EQ(GetSpecializedEventDecoder(event), nullptr);
+}
+
+}  // namespace
+}  // namespace perfetto
@@ -25,8 +25,10 @@
 #include <iterator>
 
 #include "perfetto/base/compiler.h"
+#include "perfetto/ext/base/string_utils.h"
 #include "perfetto/ext/base/utils.h"
 #include "src/traced/probes/ftrace/atrace_wrapper.h"
+#include "src/traced/probes/ftrace/compact_events.h"
 #include "src/traced/probes/ftrace/compact_sched.h"
 #include "src/traced/probes/ftrace/ftrace_stats.h"
 
@@ -560,6 +562,69 @@ bool FtraceConfigMuxer::SetSyscallEventFilter(
   return true;
 }
 
+void FtraceConfigMuxer::UpdateKernelFilters() {
+  // Threads: filtered only if all the configs restrict them.
+  std::set<int32_t> event_pids;
+  for (const auto& id_config : ds_configs_) {
+    const FtraceDataSourceConfig& config = id_config.second;
+    if (config.filter_pids.empty()) {
+      event_pids.clear();
+      break;
+    }
+    event_pids.insert(config.filter_pids.begin(), config.filter_pids.end());
+  }
+  if (current_state_.event_pids != event_pids) {
+    if (!ftrace_->SetEventPidFilter(event_pids)) {
+      PERFETTO_ELOG("Failed to set the ftrace pid filter");
+      event_pids.clear();
+      ftrace_->SetEventPidFilter(event_pids);
+    }
+    current_state_.event_pids = std::move(event_pids);
+  }
+
+  // ftrace/print: filtered only if all the configs that want print events
+  // have a print_filter that can be expressed as a kernel filter.
+  size_t print_id = table_->EventToFtraceId(GroupAndName("ftrace", "print"));
+  std::vector<std::string> print_exprs;
+  for (const auto& id_config : ds_configs_) {
+    const FtraceDataSourceConfig& config = id_config.second;
+    if (!print_id || !config.event_filter.IsEventEnabled(print_id))
+      continue;
+    std::optional<std::string> expr;
+    if (config.print_filter.has_value())
+      expr = config.print_filter->filter().ToKernelFilter();
+    if (!expr.has_value()) {
+      print_exprs.clear();
+      break;
+    }
+    print_exprs.push_back("(" + *expr + ")");
+  }
+  std::string print_filter = base::Join(print_exprs, " || ");
+  if (current_state_.print_filter != print_filter) {
+    // Not all kernels support filters on ftrace's own events. If the new
+    // filter is rejected, don't leave the old one behind.
+    if (!ftrace_->SetEventFilter("ftrace", "print", print_filter)) {
+      PERFETTO_DLOG("Failed to set the ftrace/print filter");
+      print_filter.clear();
+      ftrace_->SetEventFilter("ftrace", "print", print_filter);
+    }
+    current_state_.print_filter = std::move(print_filter);
+  }
+}
+
+std::vector<std::string> FtraceConfigMuxer::GetKernelFilters() const {
+  std::vector<std::string> filters;
+  if (!current_state_.syscall_filter.empty()) {
+    filters.push_back("raw_syscalls/sys_enter");
+    filters.push_back("raw_syscalls/sys_exit");
+  }
+  if (!current_state_.print_filter.empty())
+    filters.push_back("ftrace/print");
+  if (!current_state_.event_pids.empty())
+    filters.push_back("set_event_pid");
+  return filters;
+}
+
 // Post-conditions:
 // 1. result >= 1 (should have at least one page per CPU)
 // 2. result * 4 < kMaxTotalBufferSizeKb
@@ -626,6 +691,15 @@ bool FtraceConfigMuxer::SetupConfig(FtraceConfigId id,
       ftrace_->ClearTrace();
     }
 
+    // A previous instance of traced_probes that crashed can leave its pid and
+    // print filters behind. UpdateKernelFilters() only writes the filters that
+    // differ from |current_state_|, so reset both here to keep stale filters
+    // from silently dropping events.
+    ftrace_->SetEventPidFilter({});
+    ftrace_->SetEventFilter("ftrace", "print", "");
+    current_state_.event_pids.clear();
+    current_state_.print_filter.clear();
+
     // Set up the rest of the tracefs state, without starting it.
     // Notes:
     // * resizing buffers can be quite slow (up to hundreds of ms).
@@ -744,6 +818,15 @@ bool FtraceConfigMuxer::SetupConfig(FtraceConfigId id,
   auto compact_sched =
       CreateCompactSchedConfig(request, table_->compact_sched_format());
 
+  std::vector<std::string> unsupported_compact_events;
+  CompactEventsConfig compact_events =
+      CreateCompactEventsConfig(request, table_, &unsupported_compact_events);
+  // Events without a compact encoding are still recorded as regular ftrace
+  // events, so this isn't an error.
+  for (const std::string& event : unsupported_compact_events) {
+    PERFETTO_DLOG("No compact encoding for %s", event.c_str());
+  }
+
   std::optional<FtracePrintFilterConfig> ftrace_print_filter;
   if (request.has_print_filter()) {
     ftrace_print_filter =
@@ -761,11 +844,14 @@ bool FtraceConfigMuxer::SetupConfig(FtraceConfigId id,
   ds_configs_.emplace(
       std::piecewise_construct, std::forward_as_tuple(id),
       std::forward_as_tuple(std::move(filter), std::move(syscall_filter),
-                            compact_sched, std::move(ftrace_print_filter),
+                            compact_sched, std::move(compact_events),
+                            std::move(ftrace_print_filter),
                             std::move(apps), std::move(categories),
                             request.symbolize_ksyms(),
                             request.preserve_ftrace_buffer(),
-                            GetSyscallsReturningFds(syscalls_)));
+                            GetSyscallsReturningFds(syscalls_),
+                            std::vector<int32_t>(request.filter_pids())));
+  UpdateKernelFilters();
   return true;
 }
 
@@ -819,6 +905,7 @@ bool FtraceConfigMuxer::RemoveConfig(FtraceConfigId config_id) {
   if (!SetSyscallEventFilter(/*extra_syscalls=*/{})) {
     PERFETTO_ELOG("Failed to set raw_syscall ftrace filter in RemoveConfig");
   }
+  UpdateKernelFilters();
 
   // Disable any events that are currently enabled, but are not in any configs
   // anymore.
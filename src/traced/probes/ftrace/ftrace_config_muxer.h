@@ -22,6 +22,7 @@
 #include <set>
 
 #include "src/kernel_utils/syscall_table.h"
+#include "src/traced/probes/ftrace/compact_events.h"
 #include "src/traced/probes/ftrace/compact_sched.h"
 #include "src/traced/probes/ftrace/ftrace_config_utils.h"
 #include "src/traced/probes/ftrace/ftrace_print_filter.h"
@@ -44,21 +45,25 @@ struct FtraceDataSourceConfig {
   FtraceDataSourceConfig(EventFilter _event_filter,
                          EventFilter _syscall_filter,
                          CompactSchedConfig _compact_sched,
+                         CompactEventsConfig _compact_events,
                          std::optional<FtracePrintFilterConfig> _print_filter,
                          std::vector<std::string> _atrace_apps,
                          std::vector<std::string> _atrace_categories,
                          bool _symbolize_ksyms,
                          bool _preserve_ftrace_buffer,
-                         base::FlatSet<int64_t> _syscalls_returning_fd)
+                         base::FlatSet<int64_t> _syscalls_returning_fd,
+                         std::vector<int32_t> _filter_pids)
       : event_filter(std::move(_event_filter)),
         syscall_filter(std::move(_syscall_filter)),
         compact_sched(_compact_sched),
+        compact_events(std::move(_compact_events)),
         print_filter(std::move(_print_filter)),
         atrace_apps(std::move(_atrace_apps)),
         atrace_categories(std::move(_atrace_categories)),
         symbolize_ksyms(_symbolize_ksyms),
         preserve_ftrace_buffer(_preserve_ftrace_buffer),
-        syscalls_returning_fd(std::move(_syscalls_returning_fd)) {}
+        syscalls_returning_fd(std::move(_syscalls_returning_fd)),
+        filter_pids(std::move(_filter_pids)) {}
   // The event filter allows to quickly check if a certain ftrace event with id
   // x is enabled for this data source.
   EventFilter event_filter;
@@ -70,6 +75,10 @@ struct FtraceDataSourceConfig {
   // Configuration of the optional compact encoding of scheduling events.
   const CompactSchedConfig compact_sched;
 
+  // Events recorded in the generic compact encoding, see
+  // FtraceConfig.compact_events.
+  const CompactEventsConfig compact_events;
+
   // Optional configuration that's used to filter "ftrace/print" events based on
   // the content of their "buf" field.
   std::optional<FtracePrintFilterConfig> print_filter;
@@ -86,6 +95,10 @@ struct FtraceDataSourceConfig {
 
   // List of syscalls monitored to return a new filedescriptor upon success
   base::FlatSet<int64_t> syscalls_returning_fd;
+
+  // Threads whose events are recorded (all threads if empty). Enforced only by
+  // the kernel, see FtraceConfig.filter_pids.
+  std::vector<int32_t> filter_pids;
 };
 
 // Ftrace is a bunch of globally modifiable persistent state.
@@ -167,6 +180,10 @@ class FtraceConfigMuxer {
 
   size_t GetDataSourcesCount() const { return ds_configs_.size(); }
 
+  // Returns the filters currently pushed down to the kernel, as reported in
+  // FtraceStats.kernel_filters.
+  std::vector<std::string> GetKernelFilters() const;
+
   // Returns the syscall ids for the current architecture
   // matching the (subjectively) most commonly used syscalls
   // producing a new file descriptor as their return value.
@@ -181,6 +198,8 @@ class FtraceConfigMuxer {
   struct FtraceState {
     EventFilter ftrace_events;
     std::set<size_t> syscall_filter;  // syscall ids or kAllSyscallsId
+    std::set<int32_t> event_pids;     // set_event_pid, empty if unfiltered
+    std::string print_filter;         // ftrace/print filter, empty if none
     bool funcgraph_on = false;        // current_tracer == "function_graph"
     size_t cpu_buffer_size_pages = 0;
     protos::pbzero::FtraceClock ftrace_clock{};
@@ -224,6 +243,13 @@ class FtraceConfigMuxer {
   // so the filter can be updated before ds_configs_.
   bool SetSyscallEventFilter(const EventFilter& extra_syscalls);
 
+  // Pushes the thread (FtraceConfig.filter_pids) and ftrace/print
+  // (FtraceConfig.print_filter) filters of all ds_configs_ down to the kernel,
+  // so that unwanted events are dropped before they reach the ring buffer. As
+  // for syscalls, the kernel filters are the union of the configs' filters.
+  // Failures are not fatal: print events are still filtered in userspace.
+  void UpdateKernelFilters();
+
   FtraceProcfs* ftrace_;
   ProtoTranslationTable* table_;
   SyscallTable syscalls_;
@@ -29,8 +29,10 @@
 using testing::_;
 using testing::AnyNumber;
 using testing::Contains;
+using testing::ElementsAre;
 using testing::ElementsAreArray;
 using testing::Eq;
+using testing::InSequence;
 using testing::Invoke;
 using testing::IsEmpty;
 using testing::MatchesRegex;
@@ -207,6 +209,10 @@ class FtraceConfigMuxerTest : public ::testing::Test {
       event.name = "print";
       event.group = "ftrace";
       event.ftrace_event_id = kFakePrintEventId;
+      Field buf = {};
+      buf.ftrace_name = "buf";
+      buf.strategy = kCStringToString;
+      event.fields.push_back(buf);
       events.push_back(event);
     }
 
@@ -345,6 +351,118 @@ TEST_F(FtraceConfigMuxerTest, SyscallFilterMuxing) {
   ASSERT_THAT(model.GetSyscallFilterForTesting(), UnorderedElementsAre());
 }
 
+TEST_F(FtraceConfigMuxerTest, PidFilterMuxing) {
+  auto fake_table = CreateFakeTable();
+  NiceMock<MockFtraceProcfs> ftrace;
+  FtraceConfigMuxer model(&ftrace, fake_table.get(), GetSyscallTable(), {});
+
+  FtraceConfig config_12 = CreateFtraceConfig({"sched/sched_switch"});
+  config_12.add_filter_pids(1);
+  config_12.add_filter_pids(2);
+  FtraceConfig config_3 = CreateFtraceConfig({"sched/sched_switch"});
+  config_3.add_filter_pids(3);
+  FtraceConfig config_all = CreateFtraceConfig({"sched/sched_switch"});
+
+  ON_CALL(ftrace, ReadFileIntoString("/root/current_tracer"))
+      .WillByDefault(Return("nop"));
+  ON_CALL(ftrace, AppendToFile(_, _)).WillByDefault(Return(true));
+  EXPECT_CALL(ftrace, AppendToFile(_, _)).Times(AnyNumber());
+  EXPECT_CALL(ftrace, ClearFile(_)).Times(AnyNumber());
+
+  // The file is truncated when the first config is set up and before every
+  // update.
+  EXPECT_CALL(ftrace, ClearFile("/root/set_event_pid")).Times(7);
+  {
+    InSequence seq;
+    EXPECT_CALL(ftrace, AppendToFile("/root/set_event_pid", "1 2"));
+    EXPECT_CALL(ftrace, AppendToFile("/root/set_event_pid", "1 2 3")).Times(2);
+    EXPECT_CALL(ftrace, AppendToFile("/root/set_event_pid", "3"));
+  }
+
+  ASSERT_TRUE(model.SetupConfig(1, config_12));
+  EXPECT_THAT(model.GetKernelFilters(), ElementsAre("set_event_pid"));
+  ASSERT_TRUE(model.SetupConfig(2, config_3));
+
+  // A config without pids needs the events of all threads.
+  ASSERT_TRUE(model.SetupConfig(3, config_all));
+  EXPECT_THAT(model.GetKernelFilters(), IsEmpty());
+  ASSERT_TRUE(model.RemoveConfig(3));
+
+  ASSERT_TRUE(model.RemoveConfig(1));
+  EXPECT_THAT(model.GetKernelFilters(), ElementsAre("set_event_pid"));
+  ASSERT_TRUE(model.RemoveConfig(2));
+  EXPECT_THAT(model.GetKernelFilters(), IsEmpty());
+}
+
+TEST_F(FtraceConfigMuxerTest, PrintFilterPushDown) {
+  auto fake_table = CreateFakeTable();
+  NiceMock<MockFtraceProcfs> ftrace;
+  FtraceConfigMuxer model(&ftrace, fake_table.get(), GetSyscallTable(), {});
+
+  FtraceConfig filtered_config = CreateFtraceConfig({"ftrace/print"});
+  auto* rule = filtered_config.mutable_print_filter()->add_rules();
+  rule->set_prefix("foo");
+  rule->set_allow(false);
+  FtraceConfig unfiltered_config = CreateFtraceConfig({"ftrace/print"});
+  FtraceConfig no_print_config = CreateFtraceConfig({"sched/sched_switch"});
+
+  ON_CALL(ftrace, ReadFileIntoString("/root/current_tracer"))
+      .WillByDefault(Return("nop"));
+  EXPECT_CALL(ftrace, WriteToFile(_, _)).Times(AnyNumber());
+  {
+    InSequence seq;
+    // Cleared when the first config is set up.
+    EXPECT_CALL(ftrace, WriteToFile("/root/events/ftrace/print/filter", "0"));
+    EXPECT_CALL(ftrace, WriteToFile("/root/events/ftrace/print/filter",
+                                    "(!(buf ~ \"foo*\"))"));
+    EXPECT_CALL(ftrace, WriteToFile("/root/events/ftrace/print/filter", "0"));
+    EXPECT_CALL(ftrace, WriteToFile("/root/events/ftrace/print/filter",
+                                    "(!(buf ~ \"foo*\"))"));
+    EXPECT_CALL(ftrace, WriteToFile("/root/events/ftrace/print/filter", "0"));
+  }
+
+  ASSERT_TRUE(model.SetupConfig(1, filtered_config));
+  EXPECT_THAT(model.GetKernelFilters(), ElementsAre("ftrace/print"));
+
+  // Configs that don't record print events don't matter.
+  ASSERT_TRUE(model.SetupConfig(2, no_print_config));
+  EXPECT_THAT(model.GetKernelFilters(), ElementsAre("ftrace/print"));
+
+  // Configs that record print events without filtering them do.
+  ASSERT_TRUE(model.SetupConfig(3, unfiltered_config));
+  EXPECT_THAT(model.GetKernelFilters(), IsEmpty());
+  ASSERT_TRUE(model.RemoveConfig(3));
+  EXPECT_THAT(model.GetKernelFilters(), ElementsAre("ftrace/print"));
+
+  ASSERT_TRUE(model.RemoveConfig(1));
+  ASSERT_TRUE(model.RemoveConfig(2));
+  EXPECT_THAT(model.GetKernelFilters(), IsEmpty());
+}
+
+TEST_F(FtraceConfigMuxerTest, ClearsStaleKernelFilters) {
+  auto fake_table = CreateFakeTable();
+  NiceMock<MockFtraceProcfs> ftrace;
+  FtraceConfigMuxer model(&ftrace, fake_table.get(), GetSyscallTable(), {});
+
+  // Neither config filters anything, but a crashed instance may have left its
+  // filters behind, so both are reset when the first config is set up.
+  FtraceConfig config = CreateFtraceConfig({"ftrace/print"});
+
+  ON_CALL(ftrace, ReadFileIntoString("/root/current_tracer"))
+      .WillByDefault(Return("nop"));
+  EXPECT_CALL(ftrace, WriteToFile(_, _)).Times(AnyNumber());
+  EXPECT_CALL(ftrace, ClearFile(_)).Times(AnyNumber());
+  EXPECT_CALL(ftrace, ClearFile("/root/set_event_pid"));
+  EXPECT_CALL(ftrace, WriteToFile("/root/events/ftrace/print/filter", "0"));
+  EXPECT_CALL(ftrace, AppendToFile("/root/set_event_pid", _)).Times(0);
+
+  ASSERT_TRUE(model.SetupConfig(1, config));
+  ASSERT_TRUE(model.SetupConfig(2, config));
+  EXPECT_THAT(model.GetKernelFilters(), IsEmpty());
+  ASSERT_TRUE(model.RemoveConfig(1));
+  ASSERT_TRUE(model.RemoveConfig(2));
+}
+
 TEST_F(FtraceConfigMuxerTest, AddGenericEvent) {
   auto mock_table = GetMockTable();
   MockFtraceProcfs ftrace;
@@ -361,6 +479,8 @@ TEST_F(FtraceConfigMuxerTest, AddGenericEvent) {
   EXPECT_CALL(ftrace, WriteToFile("/root/events/enable", "0"));
   EXPECT_CALL(ftrace, ClearFile("/root/trace"));
   EXPECT_CALL(ftrace, ClearFile(MatchesRegex("/root/per_cpu/cpu[0-9]/trace")));
+  EXPECT_CALL(ftrace, ClearFile("/root/set_event_pid"));
+  EXPECT_CALL(ftrace, WriteToFile("/root/events/ftrace/print/filter", "0"));
   ON_CALL(ftrace, ReadFileIntoString("/root/trace_clock"))
       .WillByDefault(Return("[local] global boot"));
   EXPECT_CALL(ftrace, ReadFileIntoString("/root/trace_clock"))
@@ -456,6 +576,8 @@ TEST_F(FtraceConfigMuxerTest, AddAllEvents) {
   EXPECT_CALL(ftrace, WriteToFile("/root/events/enable", "0"));
   EXPECT_CALL(ftrace, ClearFile("/root/trace"));
   EXPECT_CALL(ftrace, ClearFile(MatchesRegex("/root/per_cpu/cpu[0-9]/trace")));
+  EXPECT_CALL(ftrace, ClearFile("/root/set_event_pid"));
+  EXPECT_CALL(ftrace, WriteToFile("/root/events/ftrace/print/filter", "0"));
   ON_CALL(ftrace, ReadFileIntoString("/root/trace_clock"))
       .WillByDefault(Return("[local] global boot"));
   EXPECT_CALL(ftrace, ReadFileIntoString("/root/trace_clock"))
@@ -583,6 +705,8 @@ TEST_F(FtraceConfigMuxerTest, TurnFtraceOnOff) {
   EXPECT_CALL(ftrace, WriteToFile("/root/events/enable", "0"));
   EXPECT_CALL(ftrace, ClearFile("/root/trace"));
   EXPECT_CALL(ftrace, ClearFile(MatchesRegex("/root/per_cpu/cpu[0-9]/trace")));
+  EXPECT_CALL(ftrace, ClearFile("/root/set_event_pid"));
+  EXPECT_CALL(ftrace, WriteToFile("/root/events/ftrace/print/filter", "0"));
   ON_CALL(ftrace, ReadFileIntoString("/root/trace_clock"))
       .WillByDefault(Return("[local] global boot"));
   EXPECT_CALL(ftrace, ReadFileIntoString("/root/trace_clock"))
@@ -1088,6 +1212,8 @@ TEST_F(FtraceConfigMuxerTest, FallbackOnSetEvent) {
   EXPECT_CALL(ftrace, WriteToFile("/root/events/enable", "0"));
   EXPECT_CALL(ftrace, ClearFile("/root/trace"));
   EXPECT_CALL(ftrace, ClearFile(MatchesRegex("/root/per_cpu/cpu[0-9]/trace")));
+  EXPECT_CALL(ftrace, ClearFile("/root/set_event_pid"));
+  EXPECT_CALL(ftrace, WriteToFile("/root/events/ftrace/print/filter", "0"));
   ON_CALL(ftrace, ReadFileIntoString("/root/trace_clock"))
       .WillByDefault(Return("[local] global boot"));
   EXPECT_CALL(ftrace, ReadFileIntoString("/root/trace_clock"))
@@ -1276,6 +1402,7 @@ TEST_F(FtraceConfigMuxerTest, Funcgraph) {
 
   EXPECT_CALL(ftrace, ClearFile("/root/trace"));
   EXPECT_CALL(ftrace, ClearFile(MatchesRegex("/root/per_cpu/cpu[0-9]/trace")));
+  EXPECT_CALL(ftrace, ClearFile("/root/set_event_pid"));
 
   // Set up config, assert that the tracefs writes happened:
   EXPECT_CALL(ftrace, ClearFile("/root/set_ftrace_filter"));
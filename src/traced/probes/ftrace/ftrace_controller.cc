@@ -110,6 +110,24 @@ std::optional<int64_t> ReadFtraceNowTs(const base::ScopedFile& cpu_stats_fd) {
   return static_cast<int64_t>(stats.now_ts * 1000 * 1000 * 1000);
 }
 
+// Hands over the pids, inodes and fds seen by a reader thread to the data
+// source. Kernel symbols aren't merged: their indexes are interned per writer.
+void MergeMetadata(FtraceMetadata* from, FtraceMetadata* to) {
+  for (int32_t pid : from->pids)
+    to->AddPid(pid);
+  for (int32_t pid : from->rename_pids)
+    to->AddRenamePid(pid);
+  for (const auto& inode_and_device : from->inode_and_device)
+    to->inode_and_device.insert(inode_and_device);
+  for (const auto& fd : from->fds)
+    to->fds.insert(fd);
+  to->filtered_events += from->filtered_events;
+  to->filtered_bytes += from->filtered_bytes;
+  from->filtered_events = 0;
+  from->filtered_bytes = 0;
+  from->Clear();
+}
+
 std::map<std::string, std::vector<GroupAndName>> GetAtraceVendorEvents(
     FtraceProcfs* tracefs) {
 #if PERFETTO_BUILDFLAG(PERFETTO_OS_ANDROID)
@@ -148,6 +166,8 @@ bool HardResetFtraceState() {
     // older or release builds of Android:
     WriteToFile((prefix + "events/enable").c_str(), "0");
     WriteToFile((prefix + "events/raw_syscalls/filter").c_str(), "0");
+    WriteToFile((prefix + "events/ftrace/print/filter").c_str(), "0");
+    ClearFile((prefix + "set_event_pid").c_str());
     WriteToFile((prefix + "current_tracer").c_str(), "nop");
     res &= ClearFile((prefix + "trace").c_str());
     if (res)
@@ -216,7 +236,7 @@ void FtraceController::StartIfNeeded(FtraceInstanceState* instance) {
 
   // Lazily allocate the memory used for reading & parsing ftrace. In the case
   // of multiple ftrace instances, this might already be valid.
-  if (!parsing_mem_.IsValid()) {
+  if (!use_reader_threads_ && !parsing_mem_.IsValid()) {
     parsing_mem_ =
         base::PagedMemory::Allocate(base::kPageSize * kParsingBufferSizePages);
   }
@@ -233,6 +253,8 @@ void FtraceController::StartIfNeeded(FtraceInstanceState* instance) {
                       ftrace_clock_snapshot_.get(),
                       instance->ftrace_procfs->OpenPipeForCpu(cpu)));
     instance->per_cpu.emplace_back(std::move(reader), period_page_quota);
+    if (use_reader_threads_)
+      StartReaderThread(cpu, &instance->per_cpu.back());
   }
 
   // Special case for primary instance: if not using the boot clock, take
@@ -289,6 +311,11 @@ void FtraceController::ReadTick(int generation) {
     return;
   }
 
+  if (use_reader_threads_) {
+    StartParallelRead(generation);
+    return;
+  }
+
   // Read all cpu buffers with remaining per-period quota.
   bool all_cpus_done = ReadTickForInstance(&primary_);
   for (auto& kv : secondary_instances_) {
@@ -307,31 +334,36 @@ void FtraceController::ReadTick(int generation) {
     });
   } else {
     // Done until next drain period.
-    size_t period_page_quota =
-        primary_.ftrace_config_muxer->GetPerCpuBufferSizePages();
-    for (auto& per_cpu : primary_.per_cpu)
-      per_cpu.period_page_quota = period_page_quota;
+    StartNextDrainPeriod(generation);
+  }
+}
 
-    for (auto& it : secondary_instances_) {
-      FtraceInstanceState* instance = it.second.get();
-      size_t quota = instance->ftrace_config_muxer->GetPerCpuBufferSizePages();
-      for (auto& per_cpu : instance->per_cpu) {
-        per_cpu.period_page_quota = quota;
-      }
+void FtraceController::StartNextDrainPeriod(int generation) {
+  size_t period_page_quota =
+      primary_.ftrace_config_muxer->GetPerCpuBufferSizePages();
+  for (auto& per_cpu : primary_.per_cpu)
+    per_cpu.period_page_quota = period_page_quota;
+
+  for (auto& it : secondary_instances_) {
+    FtraceInstanceState* instance = it.second.get();
+    size_t quota = instance->ftrace_config_muxer->GetPerCpuBufferSizePages();
+    for (auto& per_cpu : instance->per_cpu) {
+      per_cpu.period_page_quota = quota;
     }
+  }
 
-    // Snapshot the clock so the data in the next period will be clock synced as
-    // well.
-    MaybeSnapshotFtraceClock();
+  // Snapshot the clock so the data in the next period will be clock synced as
+  // well.
+  MaybeSnapshotFtraceClock();
 
-    auto drain_period_ms = GetDrainPeriodMs();
-    task_runner_->PostDelayedTask(
-        [weak_this, generation] {
-          if (weak_this)
-            weak_this->ReadTick(generation);
-        },
-        drain_period_ms - (NowMs() % drain_period_ms));
-  }
+  auto weak_this = weak_factory_.GetWeakPtr();
+  auto drain_period_ms = GetDrainPeriodMs();
+  task_runner_->PostDelayedTask(
+      [weak_this, generation] {
+        if (weak_this)
+          weak_this->ReadTick(generation);
+      },
+      drain_period_ms - (NowMs() % drain_period_ms));
 }
 
 bool FtraceController::ReadTickForInstance(FtraceInstanceState* instance) {
@@ -396,9 +428,21 @@ void FtraceController::Flush(FlushRequestID flush_id) {
   metatrace::ScopedEvent evt(metatrace::TAG_FTRACE,
                              metatrace::FTRACE_CPU_FLUSH);
 
-  FlushForInstance(&primary_);
-  for (auto& it : secondary_instances_) {
-    FlushForInstance(it.second.get());
+  if (use_reader_threads_) {
+    // Finish the periodic read in progress (if any) first, so that the flush
+    // read below starts after it.
+    WaitForReaderThreads();
+    if (parallel_read_pending_)
+      FinishParallelRead();
+    if (PostParallelRead(/*flush_writers=*/true) > 0) {
+      WaitForReaderThreads();
+      MergeReaderThreadMetadata();
+    }
+  } else {
+    FlushForInstance(&primary_);
+    for (auto& it : secondary_instances_) {
+      FlushForInstance(it.second.get());
+    }
   }
 
   observer_->OnFtraceDataWrittenIntoDataSourceBuffers();
@@ -430,6 +474,140 @@ void FtraceController::FlushForInstance(FtraceInstanceState* instance) {
   }
 }
 
+void FtraceController::StartReaderThread(
+    size_t cpu,
+    FtraceInstanceState::PerCpuState* per_cpu) {
+  per_cpu->reader->EnableSplice();
+  per_cpu->parsing_mem =
+      base::PagedMemory::Allocate(base::kPageSize * kParsingBufferSizePages);
+  per_cpu->thread.reset(new base::ThreadTaskRunner(
+      base::ThreadTaskRunner::CreateAndStart("ftrace_cpu" +
+                                             std::to_string(cpu))));
+}
+
+void FtraceController::AddReaderThreadTargets(FtraceInstanceState* instance,
+                                              FtraceDataSource* data_source) {
+  PERFETTO_CHECK(data_source->can_create_trace_writers());
+  for (auto& per_cpu : instance->per_cpu) {
+    auto& target = per_cpu.thread_targets[data_source];
+    target.trace_writer = data_source->CreateTraceWriter();
+    target.metadata.reset(new FtraceMetadata());
+  }
+}
+
+// Unlike ReadTick() in the main thread mode, a parallel read doesn't need to
+// yield to other tasks: each thread drains its cpu up to the whole per-period
+// quota in one go. The read is finished (see FinishParallelRead()) on the
+// main thread, once the last reader thread is done.
+void FtraceController::StartParallelRead(int generation) {
+  PERFETTO_DCHECK(!parallel_read_pending_);
+  parallel_read_pending_ = true;
+  parallel_read_generation_ = generation;
+  if (PostParallelRead(/*flush_writers=*/false) == 0)
+    FinishParallelRead();
+}
+
+size_t FtraceController::PostParallelRead(bool flush_writers) {
+  std::vector<FtraceInstanceState*> instances{&primary_};
+  for (auto& kv : secondary_instances_)
+    instances.push_back(kv.second.get());
+
+  size_t num_reads = 0;
+  for (FtraceInstanceState* instance : instances) {
+    if (!instance->started_data_sources.empty())
+      num_reads += instance->per_cpu.size();
+  }
+  if (num_reads == 0)
+    return 0;
+
+  const uint64_t read_id = ++last_parallel_read_id_;
+  {
+    std::lock_guard<std::mutex> lock(reader_threads_mutex_);
+    PERFETTO_DCHECK(reader_threads_busy_ == 0);
+    reader_threads_busy_ = num_reads;
+  }
+
+  auto weak_this = weak_factory_.GetWeakPtr();
+  for (FtraceInstanceState* instance : instances) {
+    if (instance->started_data_sources.empty())
+      continue;
+    const size_t max_pages =
+        instance->ftrace_config_muxer->GetPerCpuBufferSizePages();
+    const auto ftrace_clock = instance->ftrace_config_muxer->ftrace_clock();
+    for (auto& per_cpu : instance->per_cpu) {
+      std::vector<CpuReader::ParsingTarget> targets;
+      for (auto& kv : per_cpu.thread_targets) {
+        // The reader threads must not touch |symbolizer_|: resolve the map
+        // here, on the main thread.
+        const FtraceDataSourceConfig* ds_config = kv.first->parsing_config();
+        const KernelSymbolMap* symbol_map =
+            ds_config->symbolize_ksyms
+                ? symbolizer_->GetOrCreateKernelSymbolMap()
+                : nullptr;
+        targets.push_back(CpuReader::ParsingTarget{
+            kv.second.trace_writer.get(), kv.second.metadata.get(), ds_config,
+            symbol_map});
+      }
+      CpuReader* reader = per_cpu.reader.get();
+      reader->set_ftrace_clock(ftrace_clock);
+      uint8_t* parsing_buf = static_cast<uint8_t*>(per_cpu.parsing_mem.Get());
+      per_cpu.thread->PostTask([this, weak_this, read_id, reader, parsing_buf,
+                                max_pages, flush_writers,
+                                targets = std::move(targets)] {
+        reader->ReadCycle(parsing_buf, kParsingBufferSizePages, max_pages,
+                          targets);
+        if (flush_writers) {
+          for (const CpuReader::ParsingTarget& target : targets)
+            target.trace_writer->Flush();
+        }
+        // Nothing in |this| can be touched after releasing the lock: the
+        // main thread might be waiting to destroy it.
+        std::lock_guard<std::mutex> lock(reader_threads_mutex_);
+        if (--reader_threads_busy_ > 0)
+          return;
+        task_runner_->PostTask([weak_this, read_id] {
+          if (weak_this)
+            weak_this->OnParallelReadDone(read_id);
+        });
+        reader_threads_cv_.notify_all();
+      });
+    }
+  }
+  return num_reads;
+}
+
+void FtraceController::OnParallelReadDone(uint64_t read_id) {
+  // The read might have been already finished by Flush() or StartDataSource()
+  // (or it was a flush read, which is finished synchronously).
+  if (parallel_read_pending_ && read_id == last_parallel_read_id_)
+    FinishParallelRead();
+}
+
+void FtraceController::FinishParallelRead() {
+  PERFETTO_DCHECK(parallel_read_pending_);
+  parallel_read_pending_ = false;
+  MergeReaderThreadMetadata();
+  observer_->OnFtraceDataWrittenIntoDataSourceBuffers();
+  StartNextDrainPeriod(parallel_read_generation_);
+}
+
+void FtraceController::WaitForReaderThreads() {
+  std::unique_lock<std::mutex> lock(reader_threads_mutex_);
+  reader_threads_cv_.wait(lock, [this] { return reader_threads_busy_ == 0; });
+}
+
+void FtraceController::MergeReaderThreadMetadata() {
+  auto merge = [](FtraceInstanceState* instance) {
+    for (auto& per_cpu : instance->per_cpu) {
+      for (auto& kv : per_cpu.thread_targets)
+        MergeMetadata(kv.second.metadata.get(), kv.first->mutable_metadata());
+    }
+  };
+  merge(&primary_);
+  for (auto& kv : secondary_instances_)
+    merge(kv.second.get());
+}
+
 // We are not implicitly flushing on Stop. The tracing service is supposed to
 // ask for an explicit flush before stopping, unless it needs to perform a
 // non-graceful stop.
@@ -465,6 +643,9 @@ bool FtraceController::AddDataSource(FtraceDataSource* data_source) {
   if (!ValidConfig(data_source->config()))
     return false;
 
+  // Setting up the config changes the translation table.
+  WaitForReaderThreads();
+
   FtraceInstanceState* instance =
       GetOrCreateInstance(data_source->config().instance_name());
   if (!instance)
@@ -499,10 +680,21 @@ bool FtraceController::StartDataSource(FtraceDataSource* data_source) {
       GetOrCreateInstance(data_source->config().instance_name());
   PERFETTO_CHECK(instance);
 
+  // StartIfNeeded() restarts the periodic reads, finish the one in progress.
+  WaitForReaderThreads();
+  if (parallel_read_pending_)
+    FinishParallelRead();
+
   if (!instance->ftrace_config_muxer->ActivateConfig(config_id))
     return false;
+  if (GetStartedDataSourcesCount() == 0) {
+    use_reader_threads_ = data_source->config().use_cpu_reader_threads() &&
+                          data_source->can_create_trace_writers();
+  }
   instance->started_data_sources.insert(data_source);
   StartIfNeeded(instance);
+  if (use_reader_threads_)
+    AddReaderThreadTargets(instance, data_source);
 
   // Parse kernel symbols if required by the config. This can be an expensive
   // operation (cpu-bound for 500ms+), so delay the StartDataSource
@@ -532,8 +724,14 @@ void FtraceController::RemoveDataSource(FtraceDataSource* data_source) {
       GetOrCreateInstance(data_source->config().instance_name());
   PERFETTO_CHECK(instance);
 
+  // The periodic read in progress (if any) is finished later, without this
+  // data source.
+  WaitForReaderThreads();
+
   instance->ftrace_config_muxer->RemoveConfig(data_source->config_id());
   instance->started_data_sources.erase(data_source);
+  for (auto& per_cpu : instance->per_cpu)
+    per_cpu.thread_targets.erase(data_source);
   StopIfNeeded(instance);
 }
 
@@ -546,6 +744,7 @@ void FtraceController::DumpFtraceStats(FtraceDataSource* data_source,
     return;
 
   DumpAllCpuStats(instance->ftrace_procfs.get(), stats_out);
+  stats_out->kernel_filters = instance->ftrace_config_muxer->GetKernelFilters();
   if (symbolizer_ && symbolizer_->is_valid()) {
     auto* symbol_map = symbolizer_->GetOrCreateKernelSymbolMap();
     stats_out->kernel_symbols_parsed =
@@ -20,13 +20,17 @@
 #include <stdint.h>
 #include <unistd.h>
 
+#include <condition_variable>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <set>
 #include <string>
+#include <vector>
 
 #include "perfetto/base/task_runner.h"
 #include "perfetto/ext/base/paged_memory.h"
+#include "perfetto/ext/base/thread_task_runner.h"
 #include "perfetto/ext/base/utils.h"
 #include "perfetto/ext/base/weak_ptr.h"
 #include "perfetto/ext/tracing/core/basic_types.h"
@@ -102,11 +106,24 @@ class FtraceController {
                    Observer*);
 
   struct FtraceInstanceState {
+    // The per-cpu writer and metadata that a reader thread uses for a data
+    // source, in place of the ones of the data source.
+    struct ReaderThreadTarget {
+      std::unique_ptr<TraceWriter> trace_writer;
+      std::unique_ptr<FtraceMetadata> metadata;
+    };
+
     struct PerCpuState {
       PerCpuState(std::unique_ptr<CpuReader> _reader, size_t _period_page_quota)
           : reader(std::move(_reader)), period_page_quota(_period_page_quota) {}
       std::unique_ptr<CpuReader> reader;
       size_t period_page_quota = 0;
+
+      // Only when using reader threads. While a parallel read is in progress
+      // |reader|, |parsing_mem| and |thread_targets| belong to |thread|.
+      std::unique_ptr<base::ThreadTaskRunner> thread;
+      base::PagedMemory parsing_mem;
+      std::map<FtraceDataSource*, ReaderThreadTarget> thread_targets;
     };
 
     FtraceInstanceState(std::unique_ptr<FtraceProcfs>,
@@ -140,6 +157,22 @@ class FtraceController {
   uint32_t GetDrainPeriodMs();
 
   void FlushForInstance(FtraceInstanceState* instance);
+  void StartNextDrainPeriod(int generation);
+
+  // Reader threads mode (see FtraceConfig.use_cpu_reader_threads): each cpu
+  // is read by its own thread, in parallel reads started by ReadTick() and
+  // Flush(). The main thread only waits for the reads in progress before
+  // changing the state that the threads use.
+  void StartReaderThread(size_t cpu, FtraceInstanceState::PerCpuState*);
+  void AddReaderThreadTargets(FtraceInstanceState*, FtraceDataSource*);
+  void StartParallelRead(int generation);
+  // Posts a read of up to a whole ftrace buffer on the thread of every cpu.
+  // Returns the number of posted reads.
+  size_t PostParallelRead(bool flush_writers);
+  void OnParallelReadDone(uint64_t read_id);
+  void FinishParallelRead();
+  void WaitForReaderThreads();
+  void MergeReaderThreadMetadata();
 
   void StartIfNeeded(FtraceInstanceState* instance);
   void StopIfNeeded(FtraceInstanceState* instance);
@@ -157,6 +190,15 @@ class FtraceController {
   FtraceConfigId next_cfg_id_ = 1;
   int generation_ = 0;
   bool retain_ksyms_on_stop_ = false;
+  // Chosen by the first data source started, see StartDataSource().
+  bool use_reader_threads_ = false;
+  // A parallel read started by ReadTick() hasn't been finished yet.
+  bool parallel_read_pending_ = false;
+  int parallel_read_generation_ = 0;
+  uint64_t last_parallel_read_id_ = 0;
+  std::mutex reader_threads_mutex_;
+  std::condition_variable reader_threads_cv_;
+  size_t reader_threads_busy_ = 0;  // Guarded by |reader_threads_mutex_|.
   std::set<FtraceDataSource*> data_sources_;
   // Default tracefs instance (normally /sys/kernel/tracing) is valid for as
   // long as the controller is valid.
@@ -20,6 +20,9 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#include <condition_variable>
+#include <mutex>
+
 #include "perfetto/ext/base/file_utils.h"
 #include "src/traced/probes/ftrace/compact_sched.h"
 #include "src/traced/probes/ftrace/cpu_reader.h"
@@ -325,6 +328,10 @@ TEST(FtraceControllerTest, OneSink) {
   EXPECT_CALL(*controller->procfs(),
               ClearFile(MatchesRegex("/root/per_cpu/cpu[0-9]/trace")))
       .WillRepeatedly(Return(true));
+  EXPECT_CALL(*controller->procfs(), ClearFile("/root/set_event_pid"))
+      .WillOnce(Return(true));
+  EXPECT_CALL(*controller->procfs(),
+              WriteToFile("/root/events/ftrace/print/filter", "0"));
   EXPECT_CALL(*controller->procfs(), WriteToFile("/root/buffer_size_kb", _));
   EXPECT_CALL(*controller->procfs(), WriteToFile(kFooEnablePath, "1"));
 
@@ -375,6 +382,10 @@ TEST(FtraceControllerTest, MultipleSinks) {
   EXPECT_CALL(*controller->procfs(),
               ClearFile(MatchesRegex("/root/per_cpu/cpu[0-9]/trace")))
       .WillRepeatedly(Return(true));
+  EXPECT_CALL(*controller->procfs(), ClearFile("/root/set_event_pid"))
+      .WillOnce(Return(true));
+  EXPECT_CALL(*controller->procfs(),
+              WriteToFile("/root/events/ftrace/print/filter", "0"));
   EXPECT_CALL(*controller->procfs(), WriteToFile("/root/buffer_size_kb", _));
   EXPECT_CALL(*controller->procfs(), WriteToFile(kFooEnablePath, "1"));
   auto data_sourceA = controller->AddFakeDataSource(configA);
@@ -425,6 +436,10 @@ TEST(FtraceControllerTest, ControllerMayDieFirst) {
   EXPECT_CALL(*controller->procfs(),
               ClearFile(MatchesRegex("/root/per_cpu/cpu[0-9]/trace")))
       .WillRepeatedly(Return(true));
+  EXPECT_CALL(*controller->procfs(), ClearFile("/root/set_event_pid"))
+      .WillOnce(Return(true));
+  EXPECT_CALL(*controller->procfs(),
+              WriteToFile("/root/events/ftrace/print/filter", "0"));
   EXPECT_CALL(*controller->procfs(), WriteToFile("/root/buffer_size_kb", _));
   EXPECT_CALL(*controller->procfs(), WriteToFile(kFooEnablePath, "1"));
   auto data_source = controller->AddFakeDataSource(config);
@@ -766,6 +781,73 @@ TEST(FtraceControllerTest, DefaultAndSecondaryInstance) {
   EXPECT_FALSE(controller->InstanceExists("secondary"));
 }
 
+TEST(FtraceControllerTest, CpuReaderThreads) {
+  const size_t kNumCpus = 4;
+  auto controller = CreateTestController(true /* nice procfs */, kNumCpus);
+
+  FtraceConfig config = CreateFtraceConfig({"group/foo"});
+  config.set_use_cpu_reader_threads(true);
+  std::unique_ptr<FtraceDataSource> data_source =
+      controller->AddFakeDataSource(config);
+  ASSERT_NE(nullptr, data_source);
+  size_t num_writers = 0;
+  data_source->set_trace_writer_factory([&num_writers] {
+    num_writers++;
+    return std::unique_ptr<TraceWriter>(new TraceWriterForTesting());
+  });
+
+  // Starting the data source creates one writer per cpu and posts the
+  // periodic read.
+  std::function<void()> read_tick;
+  EXPECT_CALL(*controller->runner(), PostDelayedTask(_, _))
+      .WillOnce(testing::SaveArg<0>(&read_tick));
+  ASSERT_TRUE(controller->StartDataSource(data_source.get()));
+  EXPECT_EQ(num_writers, kNumCpus);
+  Mock::VerifyAndClearExpectations(controller->runner());
+
+  // The read happens on the reader threads: the last one to finish posts the
+  // task that finishes the read on the main thread.
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::function<void()> read_done;
+  EXPECT_CALL(*controller->runner(), PostTask(_))
+      .WillOnce(Invoke([&](std::function<void()> task) {
+        std::lock_guard<std::mutex> lock(mutex);
+        read_done = std::move(task);
+        cv.notify_one();
+      }));
+  read_tick();
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [&] { return !!read_done; });
+  }
+  Mock::VerifyAndClearExpectations(controller->runner());
+
+  // Finishing the read schedules the one of the next drain period.
+  EXPECT_CALL(*controller->runner(), PostDelayedTask(_, _)).Times(1);
+  read_done();
+  Mock::VerifyAndClearExpectations(controller->runner());
+
+  // Flushing waits for a read on the reader threads. The task that they post
+  // when done is a no-op.
+  std::function<void()> flush_read_done;
+  EXPECT_CALL(*controller->runner(), PostTask(_))
+      .WillOnce(Invoke([&](std::function<void()> task) {
+        std::lock_guard<std::mutex> lock(mutex);
+        flush_read_done = std::move(task);
+      }));
+  controller->Flush(1);
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    ASSERT_TRUE(flush_read_done);
+  }
+  EXPECT_CALL(*controller->runner(), PostDelayedTask(_, _)).Times(0);
+  flush_read_done();
+  Mock::VerifyAndClearExpectations(controller->runner());
+
+  controller->RemoveDataSource(data_source.get());
+}
+
 TEST(FtraceControllerTest, TracefsInstanceFilepaths) {
   std::optional<std::string> path;
   path = FtraceController::AbsolutePathForInstance("/root/", "test");
@@ -125,6 +125,8 @@ void FtraceDataSource::DumpFtraceStats(FtraceStats* stats) {
   if (controller_weak_)
     controller_weak_->DumpFtraceStats(this, stats);
   stats->setup_errors = std::move(setup_errors_);
+  stats->kernel_filter_missed_events = metadata_.filtered_events;
+  stats->kernel_filter_missed_bytes = metadata_.filtered_bytes;
 }
 
 void FtraceDataSource::Flush(FlushRequestID flush_request_id,
@@ -84,6 +84,17 @@ class FtraceDataSource : public ProbesDataSource {
   FtraceSetupErrors* mutable_setup_errors() { return &setup_errors_; }
   TraceWriter* trace_writer() { return writer_.get(); }
 
+  // Creates additional writers into the same target buffer, used by the
+  // per-cpu reader threads (see FtraceConfig.use_cpu_reader_threads).
+  using TraceWriterFactory = std::function<std::unique_ptr<TraceWriter>()>;
+  void set_trace_writer_factory(TraceWriterFactory factory) {
+    trace_writer_factory_ = std::move(factory);
+  }
+  bool can_create_trace_writers() const { return !!trace_writer_factory_; }
+  std::unique_ptr<TraceWriter> CreateTraceWriter() {
+    return trace_writer_factory_();
+  }
+
  private:
   // Hands out internal pointers to callbacks.
   FtraceDataSource(const FtraceDataSource&) = delete;
@@ -103,6 +114,7 @@ class FtraceDataSource : public ProbesDataSource {
   // -- Fields initialized by the Initialize() call:
   FtraceConfigId config_id_ = 0;
   std::unique_ptr<TraceWriter> writer_;
+  TraceWriterFactory trace_writer_factory_;
   base::WeakPtr<FtraceController> controller_weak_;
   // Muxer-held state for parsing ftrace according to this data source's
   // configuration. Not the raw FtraceConfig proto (held by |config_|).
@@ -146,6 +146,12 @@ struct FtraceMetadata {
   int32_t last_seen_common_pid = 0;
   uint32_t last_kernel_addr_index_written = 0;
 
+  // Events dropped by the userspace filters of the data source (i.e.
+  // FtraceConfig.print_filter) and their size in bytes. These accumulate over
+  // the whole trace: Clear() doesn't reset them.
+  uint64_t filtered_events = 0;
+  uint64_t filtered_bytes = 0;
+
   base::FlatSet<InodeBlockPair> inode_and_device;
   base::FlatSet<int32_t> rename_pids;
   base::FlatSet<int32_t> pids;
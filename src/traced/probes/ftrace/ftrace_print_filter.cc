@@ -65,6 +65,12 @@ bool AtraceMessageMatches(const std::string& before_pid_part,
   return PrefixMatches(after_pid_prefix, s.data(), s.size());
 }
 
+// Returns true if |s| can be used verbatim in a quoted glob pattern of a
+// kernel event filter.
+bool IsGlobLiteral(const std::string& s) {
+  return s.find_first_of("*?[]\\\"\n") == std::string::npos;
+}
+
 }  // namespace
 
 // static
@@ -107,6 +113,43 @@ bool FtracePrintFilter::IsAllowed(const char* start, size_t size) const {
   return true;
 }
 
+std::optional<std::string> FtracePrintFilter::ToKernelFilter() const {
+  // The first matching rule decides, and strings that don't match any rule are
+  // allowed. So, going backwards from the last rule, the allowed strings are:
+  //   allow rule: matches || allowed by the following rules
+  //   deny rule: !matches && allowed by the following rules
+  // Since the kernel filter must not drop allowed strings, allow rules that
+  // can't be expressed exactly as globs are widened, while deny rules that
+  // can't be expressed exactly are skipped.
+  std::optional<std::string> expr;  // std::nullopt allows everything.
+  for (auto it = rules_.rbegin(); it != rules_.rend(); ++it) {
+    const Rule& rule = *it;
+    std::optional<std::string> glob;
+    bool exact = false;
+    if (rule.type == Rule::Type::kAtraceMessage) {
+      // The glob matches any pid, but also strings that have something else
+      // than digits between the '|' separators.
+      if (IsGlobLiteral(rule.before_pid_part) && IsGlobLiteral(rule.prefix))
+        glob = rule.before_pid_part + "|*|" + rule.prefix + "*";
+    } else if (IsGlobLiteral(rule.prefix)) {
+      glob = rule.prefix + "*";
+      exact = true;
+    }
+
+    if (rule.allow) {
+      if (!glob || !expr) {
+        expr = std::nullopt;
+      } else {
+        expr = "buf ~ \"" + *glob + "\" || (" + *expr + ")";
+      }
+    } else if (exact) {
+      std::string not_matches = "!(buf ~ \"" + *glob + "\")";
+      expr = expr ? not_matches + " && (" + *expr + ")" : not_matches;
+    }
+  }
+  return expr;
+}
+
 // static
 std::optional<FtracePrintFilterConfig> FtracePrintFilterConfig::Create(
     const protos::gen::FtraceConfig::PrintFilter& config,
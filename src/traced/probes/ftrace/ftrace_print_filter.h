@@ -43,6 +43,12 @@ class FtracePrintFilter {
   // first '\0' byte, whichever comes first.
   bool IsAllowed(const char* start, size_t size) const;
 
+  // Returns an expression for the "filter" file of the "ftrace/print" event
+  // that lets the kernel drop (some of) the strings not allowed by this
+  // filter. The kernel never drops a string that IsAllowed() would accept.
+  // Returns std::nullopt if no string can be dropped in the kernel.
+  std::optional<std::string> ToKernelFilter() const;
+
  private:
   struct Rule {
     enum class Type {
@@ -68,6 +74,8 @@ class FtracePrintFilterConfig {
 
   uint32_t event_id() const { return event_id_; }
 
+  const FtracePrintFilter& filter() const { return filter_; }
+
   // Returns true if the "ftrace/print" event (encoded from `start` to `end`)
   // should be allowed.
   //
@@ -222,5 +222,74 @@ TEST(FtracePrintFilterTest, AtraceRuleMatches) {
   EXPECT_FALSE(filter.IsAllowed("C|111111|mycounter...", 21));
 }
 
+TEST(FtracePrintFilterTest, KernelFilterEmptyConfig) {
+  FtraceConfig::PrintFilter conf;
+  FtracePrintFilter filter(conf);
+
+  EXPECT_EQ(filter.ToKernelFilter(), std::nullopt);
+}
+
+TEST(FtracePrintFilterTest, KernelFilterPrefixRules) {
+  FtraceConfig::PrintFilter conf;
+  auto* rule = conf.add_rules();
+  rule->set_prefix("foo");
+  rule->set_allow(true);
+  rule = conf.add_rules();
+  rule->set_prefix("bar");
+  rule->set_allow(false);
+  FtracePrintFilter filter(conf);
+
+  EXPECT_EQ(filter.ToKernelFilter(),
+            "buf ~ \"foo*\" || (!(buf ~ \"bar*\"))");
+}
+
+TEST(FtracePrintFilterTest, KernelFilterDenyAllByDefault) {
+  FtraceConfig::PrintFilter conf;
+  auto* rule = conf.add_rules();
+  auto* atrace = rule->mutable_atrace_msg();
+  atrace->set_type("C");
+  atrace->set_prefix("mycounter");
+  rule->set_allow(true);
+  rule = conf.add_rules();
+  rule->set_prefix("");
+  rule->set_allow(false);
+  FtracePrintFilter filter(conf);
+
+  EXPECT_EQ(filter.ToKernelFilter(),
+            "buf ~ \"C|*|mycounter*\" || (!(buf ~ \"*\"))");
+}
+
+TEST(FtracePrintFilterTest, KernelFilterSkipsInexactDenyRules) {
+  FtraceConfig::PrintFilter conf;
+  // The kernel glob would also match strings that the atrace rule doesn't.
+  auto* rule = conf.add_rules();
+  auto* atrace = rule->mutable_atrace_msg();
+  atrace->set_type("C");
+  atrace->set_prefix("mycounter");
+  rule->set_allow(false);
+  rule = conf.add_rules();
+  rule->set_prefix("a*b");
+  rule->set_allow(false);
+  rule = conf.add_rules();
+  rule->set_prefix("foo");
+  rule->set_allow(false);
+  FtracePrintFilter filter(conf);
+
+  EXPECT_EQ(filter.ToKernelFilter(), "!(buf ~ \"foo*\")");
+}
+
+TEST(FtracePrintFilterTest, KernelFilterInexactAllowRuleKeepsAll) {
+  FtraceConfig::PrintFilter conf;
+  auto* rule = conf.add_rules();
+  rule->set_prefix("\"quoted\"");
+  rule->set_allow(true);
+  rule = conf.add_rules();
+  rule->set_prefix("");
+  rule->set_allow(false);
+  FtracePrintFilter filter(conf);
+
+  EXPECT_EQ(filter.ToKernelFilter(), std::nullopt);
+}
+
 }  // namespace
 }  // namespace perfetto
@@ -132,6 +132,27 @@ bool FtraceProcfs::SetSyscallFilter(const std::set<size_t>& filter) {
   return true;
 }
 
+bool FtraceProcfs::SetEventFilter(const std::string& group,
+                                  const std::string& name,
+                                  const std::string& filter) {
+  std::string path = root_ + "events/" + group + "/" + name + "/filter";
+  // Writing "0" clears the filter.
+  return WriteToFile(path, filter.empty() ? "0" : filter);
+}
+
+bool FtraceProcfs::SetEventPidFilter(const std::set<int32_t>& pids) {
+  std::string path = root_ + "set_event_pid";
+  // Writes are merged with the current pids, unless the file is truncated.
+  if (!ClearFile(path))
+    return false;
+  if (pids.empty())
+    return true;
+  std::vector<std::string> parts;
+  for (int32_t pid : pids)
+    parts.push_back(std::to_string(pid));
+  return AppendToFile(path, base::Join(parts, " "));
+}
+
 bool FtraceProcfs::EnableEvent(const std::string& group,
                                const std::string& name) {
   std::string path = root_ + "events/" + group + "/" + name + "/enable";
@@ -46,6 +46,16 @@ class FtraceProcfs {
   // Set the filter for syscall events. If empty, clear the filter.
   bool SetSyscallFilter(const std::set<size_t>& filter);
 
+  // Set the filter expression of the event with the given |group| and |name|.
+  // If empty, clear the filter.
+  bool SetEventFilter(const std::string& group,
+                      const std::string& name,
+                      const std::string& filter);
+
+  // Restrict the recording of all events to the given thread ids
+  // ("set_event_pid"). If empty, clear the restriction.
+  bool SetEventPidFilter(const std::set<int32_t>& pids);
+
   // Enable the event under with the given |group| and |name|.
   bool EnableEvent(const std::string& group, const std::string& name);
 
@@ -32,6 +32,12 @@ void FtraceStats::Write(protos::pbzero::FtraceStats* writer) const {
     writer->add_unknown_ftrace_events(err);
   for (const std::string& err : setup_errors.failed_ftrace_events)
     writer->add_failed_ftrace_events(err);
+  for (const std::string& filter : kernel_filters)
+    writer->add_kernel_filters(filter);
+  if (kernel_filter_missed_events) {
+    writer->set_kernel_filter_missed_events(kernel_filter_missed_events);
+    writer->set_kernel_filter_missed_bytes(kernel_filter_missed_bytes);
+  }
 }
 
 void FtraceCpuStats::Write(protos::pbzero::FtraceCpuStats* writer) const {
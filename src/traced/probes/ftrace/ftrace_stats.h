@@ -55,6 +55,9 @@ struct FtraceStats {
   FtraceSetupErrors setup_errors;
   uint32_t kernel_symbols_parsed = 0;
   uint32_t kernel_symbols_mem_kb = 0;
+  std::vector<std::string> kernel_filters;
+  uint64_t kernel_filter_missed_events = 0;
+  uint64_t kernel_filter_missed_bytes = 0;
 
   void Write(protos::pbzero::FtraceStats*) const;
 };
@@ -528,6 +528,13 @@ ProtoTranslationTable::ProtoTranslationTable(
         &events_.at(event.ftrace_event_id);
     name_to_events_[event.name].push_back(&events_.at(event.ftrace_event_id));
     group_to_events_[event.group].push_back(&events_.at(event.ftrace_event_id));
+
+    EventDecoderFn decoder = GetSpecializedEventDecoder(event);
+    if (decoder) {
+      if (specialized_decoders_.size() <= event.ftrace_event_id)
+        specialized_decoders_.resize(event.ftrace_event_id + 1);
+      specialized_decoders_[event.ftrace_event_id] = decoder;
+    }
   }
   for (const Field& field : common_fields_) {
     if (field.proto_field_id == protos::pbzero::FtraceEvent::kPidFieldNumber) {
@@ -30,6 +30,7 @@
 
 #include "perfetto/ext/base/scoped_file.h"
 #include "src/traced/probes/ftrace/compact_sched.h"
+#include "src/traced/probes/ftrace/event_decoders.h"
 #include "src/traced/probes/ftrace/event_info.h"
 #include "src/traced/probes/ftrace/format_parser/format_parser.h"
 #include "src/traced/probes/ftrace/printk_formats_parser.h"
@@ -138,6 +139,18 @@ class ProtoTranslationTable {
     return evt;
   }
 
+  // Returns the specialized decoder for the fields of the event with the given
+  // ftrace id, or nullptr if the event must be decoded generically. See
+  // event_decoders.h.
+  EventDecoderFn GetSpecializedDecoder(size_t id) const {
+    if (id >= specialized_decoders_.size())
+      return nullptr;
+    return specialized_decoders_[id];
+  }
+
+  // Makes all events use the generic decoding path.
+  void DisableSpecializedDecodersForTesting() { specialized_decoders_.clear(); }
+
   size_t EventToFtraceId(const GroupAndName& group_and_name) const {
     if (!group_and_name_to_event_.count(group_and_name))
       return 0;
@@ -200,6 +213,8 @@ class ProtoTranslationTable {
   std::set<std::string> interned_strings_;
   CompactSchedEventFormat compact_sched_format_;
   PrintkMap printk_formats_;
+  // Indexed by ftrace event id.
+  std::vector<EventDecoderFn> specialized_decoders_;
 };
 
 // Class for efficient 'is event with id x enabled?' checks.
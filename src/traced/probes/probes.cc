@@ -19,6 +19,8 @@
 #include <stdlib.h>
 #include <unistd.h>
 
+#include <string>
+
 #include "perfetto/base/logging.h"
 #include "perfetto/ext/base/file_utils.h"
 #include "perfetto/ext/base/getopt.h"
@@ -40,15 +42,18 @@ int PERFETTO_EXPORT_ENTRYPOINT ProbesMain(int argc, char** argv) {
     OPT_VERSION,
     OPT_BACKGROUND,
     OPT_RESET_FTRACE,
+    OPT_INODE_CACHE_FILE,
   };
 
   bool background = false;
   bool reset_ftrace = false;
+  std::string inode_cache_file;
 
   static const option long_options[] = {
       {"background", no_argument, nullptr, OPT_BACKGROUND},
       {"cleanup-after-crash", no_argument, nullptr, OPT_CLEANUP_AFTER_CRASH},
       {"reset-ftrace", no_argument, nullptr, OPT_RESET_FTRACE},
+      {"inode-cache-file", required_argument, nullptr, OPT_INODE_CACHE_FILE},
       {"version", no_argument, nullptr, OPT_VERSION},
       {nullptr, 0, nullptr, 0}};
 
@@ -69,6 +74,9 @@ int PERFETTO_EXPORT_ENTRYPOINT ProbesMain(int argc, char** argv) {
         // This is like --cleanup-after-crash but doesn't quit.
         reset_ftrace = true;
         break;
+      case OPT_INODE_CACHE_FILE:
+        inode_cache_file = optarg;
+        break;
       case OPT_VERSION:
         printf("%s\n", base::GetVersionString());
         return 0;
@@ -76,7 +84,7 @@ int PERFETTO_EXPORT_ENTRYPOINT ProbesMain(int argc, char** argv) {
         fprintf(
             stderr,
             "Usage: %s [--background] [--reset-ftrace] [--cleanup-after-crash] "
-            "[--version]\n",
+            "[--inode-cache-file=PATH] [--version]\n",
             argv[0]);
         return 1;
     }
@@ -117,6 +125,8 @@ int PERFETTO_EXPORT_ENTRYPOINT ProbesMain(int argc, char** argv) {
 
   base::UnixTaskRunner task_runner;
   ProbesProducer producer;
+  if (!inode_cache_file.empty())
+    producer.SetInodeCacheFile(inode_cache_file);
   // If the TRACED_PROBES_NOTIFY_FD env var is set, write 1 and close the FD,
   // when all data sources have been registered. This is used for //src/tracebox
   // --background-wait, to make sure that the data sources are registered before
@@ -143,6 +143,9 @@ ProbesProducer::CreateDSInstance<FtraceDataSource>(
   std::unique_ptr<FtraceDataSource> data_source(new FtraceDataSource(
       ftrace_->GetWeakPtr(), session_id, std::move(ftrace_config),
       endpoint_->CreateTraceWriter(buffer_id)));
+  data_source->set_trace_writer_factory([this, buffer_id] {
+    return endpoint_->CreateTraceWriter(buffer_id);
+  });
   if (!ftrace_->AddDataSource(data_source.get())) {
     PERFETTO_ELOG("Failed to setup ftrace");
     return nullptr;
@@ -162,7 +165,7 @@ ProbesProducer::CreateDSInstance<InodeFileDataSource>(
     CreateStaticDeviceToInodeMap("/system", &system_inodes_);
   return std::unique_ptr<InodeFileDataSource>(new InodeFileDataSource(
       source_config, task_runner_, session_id, &system_inodes_, &cache_,
-      endpoint_->CreateTraceWriter(buffer_id)));
+      endpoint_->CreateTraceWriter(buffer_id), persistent_inode_cache_.get()));
 }
 
 template <>
@@ -668,6 +671,14 @@ void ProbesProducer::ResetConnectionBackoff() {
   connection_backoff_ms_ = kInitialConnectionBackoffMs;
 }
 
+void ProbesProducer::SetInodeCacheFile(const std::string& path) {
+  persistent_inode_cache_.reset(new PersistentInodeCache(path));
+  if (persistent_inode_cache_->Load()) {
+    PERFETTO_LOG("Loaded %zu entries from the inode cache %s",
+                 persistent_inode_cache_->size(), path.c_str());
+  }
+}
+
 void ProbesProducer::ActivateTrigger(std::string trigger) {
   android_stats::MaybeLogTriggerEvent(
       PerfettoTriggerAtom::kProbesProducerTrigger, trigger);
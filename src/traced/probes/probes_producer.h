@@ -80,6 +80,10 @@ class ProbesProducer : public Producer, public FtraceController::Observer {
     all_data_sources_registered_cb_ = cb;
   }
 
+  // Enables InodeFileConfig.use_persistent_cache, with the cache stored in
+  // |path|.
+  void SetInodeCacheFile(const std::string& path);
+
  private:
   static ProbesProducer* instance_;
 
@@ -132,6 +136,7 @@ class ProbesProducer : public Producer, public FtraceController::Observer {
 
   std::unordered_map<DataSourceInstanceID, base::Watchdog::Timer> watchdogs_;
   LRUInodeCache cache_{kLRUInodeCacheSize};
+  std::unique_ptr<PersistentInodeCache> persistent_inode_cache_;
   std::map<BlockDeviceID, std::unordered_map<Inode, InodeMapValue>>
       system_inodes_;
 
@@ -0,0 +1,307 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/traced/probes/ps/process_connector.h"
+
+#include <errno.h>
+#include <linux/cn_proc.h>
+#include <linux/connector.h>
+#include <linux/netlink.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "perfetto/base/logging.h"
+#include "perfetto/base/task_runner.h"
+#include "perfetto/ext/base/utils.h"
+
+namespace perfetto {
+
+namespace {
+
+// Large enough for any message of the process connector.
+constexpr size_t kRecvBufSize = 4096;
+
+// Caps the number of datagrams read in a single task, so that fork storms
+// don't starve the other data sources. The fd watch fires again if there is
+// more data.
+constexpr size_t kMaxDatagramsPerTask = 1024;
+
+// The socket buffer must absorb the events generated between two reads.
+constexpr int kSocketBufferSize = 1024 * 1024;
+
+// How long to wait for the kernel to acknowledge the subscription.
+constexpr uint32_t kAckTimeoutMs = 100;
+
+constexpr uint32_t kListenSeq = 1;
+
+// The kernel echoes |seq| and replies with |ack| + 1. |ack| is set to the
+// netlink port id of the socket, so that the multicast acks of other listeners
+// can be told apart from ours.
+bool SendMcastOp(int sock,
+                 proc_cn_mcast_op op,
+                 uint32_t seq,
+                 uint32_t port_id) {
+  alignas(nlmsghdr) uint8_t buf[NLMSG_SPACE(sizeof(cn_msg) + sizeof(op))]{};
+  auto* hdr = reinterpret_cast<nlmsghdr*>(buf);
+  hdr->nlmsg_len = NLMSG_LENGTH(sizeof(cn_msg) + sizeof(op));
+  hdr->nlmsg_type = NLMSG_DONE;
+  hdr->nlmsg_pid = port_id;
+  auto* msg = reinterpret_cast<cn_msg*>(NLMSG_DATA(hdr));
+  msg->id.idx = CN_IDX_PROC;
+  msg->id.val = CN_VAL_PROC;
+  msg->seq = seq;
+  msg->ack = port_id;
+  msg->len = sizeof(op);
+  memcpy(msg->data, &op, sizeof(op));
+  return PERFETTO_EINTR(send(sock, buf, hdr->nlmsg_len, MSG_NOSIGNAL)) ==
+         static_cast<ssize_t>(hdr->nlmsg_len);
+}
+
+// Invokes |fn| with the proc_event (and the cn_msg that carries it) of every
+// message of the datagram.
+template <typename Fn>
+bool ForEachProcEvent(const uint8_t* data, size_t size, Fn fn) {
+  constexpr size_t kMinEventSize = offsetof(proc_event, event_data);
+  while (size >= NLMSG_HDRLEN) {
+    nlmsghdr hdr;
+    memcpy(&hdr, data, sizeof(hdr));
+    if (hdr.nlmsg_len < NLMSG_HDRLEN || hdr.nlmsg_len > size)
+      return false;
+    if (hdr.nlmsg_type == NLMSG_ERROR || hdr.nlmsg_type == NLMSG_OVERRUN)
+      return false;
+    if (hdr.nlmsg_type != NLMSG_NOOP) {
+      const uint8_t* payload = data + NLMSG_HDRLEN;
+      size_t payload_size = hdr.nlmsg_len - NLMSG_HDRLEN;
+      cn_msg msg;
+      if (payload_size < sizeof(msg))
+        return false;
+      memcpy(&msg, payload, sizeof(msg));
+      if (msg.len > payload_size - sizeof(msg) || msg.len < kMinEventSize)
+        return false;
+      if (msg.id.idx == CN_IDX_PROC && msg.id.val == CN_VAL_PROC) {
+        // Older kernels can send a shorter union, leave the rest zeroed.
+        proc_event event{};
+        memcpy(&event, payload + sizeof(msg),
+               std::min(static_cast<size_t>(msg.len), sizeof(event)));
+        fn(msg, event);
+      }
+    }
+    size_t len = NLMSG_ALIGN(hdr.nlmsg_len);
+    if (len >= size)
+      break;
+    data += len;
+    size -= len;
+  }
+  return true;
+}
+
+// Looks for the kernel's reply to the PROC_CN_MCAST_LISTEN request sent from
+// the socket bound to |port_id| in the datagram. If found, returns true and
+// sets |err| to its error code.
+bool FindListenAck(const uint8_t* data,
+                   size_t size,
+                   uint32_t port_id,
+                   uint32_t* err) {
+  bool acked = false;
+  ForEachProcEvent(
+      data, size,
+      [&acked, port_id, err](const cn_msg& msg, const proc_event& event) {
+        if (event.what != proc_event::PROC_EVENT_NONE ||
+            msg.seq != kListenSeq || msg.ack != port_id + 1) {
+          return;
+        }
+        acked = true;
+        *err = event.event_data.ack.err;
+      });
+  return acked;
+}
+
+}  // namespace
+
+ProcessConnector::Delegate::~Delegate() = default;
+
+// static
+std::unique_ptr<ProcessConnector> ProcessConnector::Create(
+    base::TaskRunner* task_runner,
+    Delegate* delegate) {
+  base::ScopedFile sock(socket(PF_NETLINK,
+                               SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK,
+                               NETLINK_CONNECTOR));
+  if (!sock) {
+    PERFETTO_PLOG("socket(NETLINK_CONNECTOR) failed");
+    return nullptr;
+  }
+  sockaddr_nl addr{};
+  addr.nl_family = AF_NETLINK;
+  addr.nl_groups = CN_IDX_PROC;
+  if (bind(*sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+    PERFETTO_PLOG("bind(NETLINK_CONNECTOR) failed");
+    return nullptr;
+  }
+  // The kernel assigned a unique port id to the socket on bind().
+  socklen_t addr_len = sizeof(addr);
+  if (getsockname(*sock, reinterpret_cast<sockaddr*>(&addr), &addr_len) != 0) {
+    PERFETTO_PLOG("getsockname(NETLINK_CONNECTOR) failed");
+    return nullptr;
+  }
+  // Best effort, the kernel caps it to rmem_max.
+  int buf_size = kSocketBufferSize;
+  setsockopt(*sock, SOL_SOCKET, SO_RCVBUF, &buf_size, sizeof(buf_size));
+
+  if (!SendMcastOp(*sock, PROC_CN_MCAST_LISTEN, kListenSeq, addr.nl_pid)) {
+    PERFETTO_PLOG("Failed to subscribe to the process connector");
+    return nullptr;
+  }
+  std::unique_ptr<ProcessConnector> connector(
+      new ProcessConnector(task_runner, delegate, std::move(sock)));
+  connector->port_id_ = addr.nl_pid;
+  // The ack arrives on the socket as any other message. The kernel multicasts
+  // it only if there is at least one listener, so no ack also means that the
+  // subscription failed.
+  connector->state_ = State::kAwaitingAck;
+  auto weak_connector = connector->weak_factory_.GetWeakPtr();
+  task_runner->PostDelayedTask(
+      [weak_connector] {
+        if (weak_connector)
+          weak_connector->OnAckTimeout();
+      },
+      kAckTimeoutMs);
+  return connector;
+}
+
+ProcessConnector::ProcessConnector(base::TaskRunner* task_runner,
+                                   Delegate* delegate,
+                                   base::ScopedFile sock)
+    : task_runner_(task_runner),
+      delegate_(delegate),
+      sock_(std::move(sock)),
+      weak_factory_(this) {
+  auto weak_this = weak_factory_.GetWeakPtr();
+  task_runner_->AddFileDescriptorWatch(*sock_, [weak_this] {
+    if (weak_this)
+      weak_this->OnSocketDataAvailable();
+  });
+}
+
+ProcessConnector::~ProcessConnector() {
+  if (state_ == State::kFailed)
+    return;
+  Unsubscribe();
+}
+
+void ProcessConnector::Unsubscribe() {
+  task_runner_->RemoveFileDescriptorWatch(*sock_);
+  // The kernel counts the listeners, and stops generating the events when
+  // there are none left. This is needed even if the subscription wasn't
+  // acknowledged, as the kernel may have counted it anyway. If it was rejected,
+  // the kernel rejects this request for the same reason.
+  SendMcastOp(*sock_, PROC_CN_MCAST_IGNORE, 0, port_id_);
+}
+
+void ProcessConnector::OnAckTimeout() {
+  if (state_ != State::kAwaitingAck)
+    return;
+  errno = ETIMEDOUT;
+  Fail();
+}
+
+void ProcessConnector::Fail() {
+  PERFETTO_PLOG("Failed to subscribe to the process connector");
+  state_ = State::kFailed;
+  Unsubscribe();
+  // Must be the last statement: the delegate can destroy |this|.
+  delegate_->OnProcessConnectorFailed();
+}
+
+// static
+bool ProcessConnector::ParseMessage(const uint8_t* data,
+                                    size_t size,
+                                    std::vector<ProcessEvent>* events) {
+  return ForEachProcEvent(
+      data, size, [events](const cn_msg&, const proc_event& event) {
+        switch (event.what) {
+          case proc_event::PROC_EVENT_FORK:
+            events->push_back({ProcessEvent::kFork,
+                               event.event_data.fork.child_pid,
+                               event.event_data.fork.child_tgid});
+            break;
+          case proc_event::PROC_EVENT_EXEC:
+            events->push_back({ProcessEvent::kExec,
+                               event.event_data.exec.process_pid,
+                               event.event_data.exec.process_tgid});
+            break;
+          case proc_event::PROC_EVENT_COMM:
+            events->push_back({ProcessEvent::kComm,
+                               event.event_data.comm.process_pid,
+                               event.event_data.comm.process_tgid});
+            break;
+          case proc_event::PROC_EVENT_EXIT:
+            events->push_back({ProcessEvent::kExit,
+                               event.event_data.exit.process_pid,
+                               event.event_data.exit.process_tgid});
+            break;
+          default:
+            break;
+        }
+      });
+}
+
+void ProcessConnector::OnSocketDataAvailable() {
+  alignas(nlmsghdr) uint8_t buf[kRecvBufSize];
+  bool events_lost = false;
+  events_.clear();
+  for (size_t i = 0; i < kMaxDatagramsPerTask; i++) {
+    sockaddr_nl addr{};
+    socklen_t addr_len = sizeof(addr);
+    ssize_t rsize = PERFETTO_EINTR(recvfrom(*sock_, buf, sizeof(buf), 0,
+                                            reinterpret_cast<sockaddr*>(&addr),
+                                            &addr_len));
+    if (rsize < 0) {
+      // The kernel dropped some messages, but the socket is still usable.
+      if (errno == ENOBUFS) {
+        events_lost = true;
+        continue;
+      }
+      if (errno != EAGAIN && errno != EWOULDBLOCK)
+        PERFETTO_DPLOG("recvfrom(NETLINK_CONNECTOR) failed");
+      break;
+    }
+    // Only trust the messages sent by the kernel.
+    if (addr.nl_pid != 0)
+      continue;
+    uint32_t err = 0;
+    if (state_ == State::kAwaitingAck &&
+        FindListenAck(buf, static_cast<size_t>(rsize), port_id_, &err)) {
+      if (err != 0) {
+        errno = static_cast<int>(err);
+        Fail();
+        return;
+      }
+      state_ = State::kSubscribed;
+    }
+    if (!ParseMessage(buf, static_cast<size_t>(rsize), &events_))
+      PERFETTO_DLOG("Malformed process connector message");
+  }
+  if (!events_.empty())
+    delegate_->OnProcessEvents(events_);
+  if (events_lost)
+    delegate_->OnProcessEventsLost();
+}
+
+}  // namespace perfetto
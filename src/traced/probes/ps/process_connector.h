@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACED_PROBES_PS_PROCESS_CONNECTOR_H_
+#define SRC_TRACED_PROBES_PS_PROCESS_CONNECTOR_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <vector>
+
+#include "perfetto/ext/base/scoped_file.h"
+#include "perfetto/ext/base/weak_ptr.h"
+
+namespace perfetto {
+
+namespace base {
+class TaskRunner;
+}
+
+// A process lifetime event, as reported by the kernel process connector.
+struct ProcessEvent {
+  enum Type {
+    kFork,
+    kExec,
+    kComm,
+    kExit,
+  };
+  Type type;
+  // For kFork these are the ids of the child.
+  int32_t pid;
+  int32_t tgid;
+};
+
+// Subscribes to the process events multicast by the kernel process connector
+// (NETLINK_CONNECTOR, CN_IDX_PROC), so that the process table can be kept up
+// to date without rescanning /proc. Requires CAP_NET_ADMIN.
+class ProcessConnector {
+ public:
+  class Delegate {
+   public:
+    virtual ~Delegate();
+    // Called with the events received, in order, on the task runner.
+    virtual void OnProcessEvents(const std::vector<ProcessEvent>&) = 0;
+    // Called when the socket buffer overflowed and some events were dropped by
+    // the kernel. The process table must be rebuilt from /proc.
+    virtual void OnProcessEventsLost() = 0;
+    // Called when the kernel rejected the subscription, or didn't acknowledge
+    // it in time. No more events will be received. The connector can be
+    // destroyed from within this call.
+    virtual void OnProcessConnectorFailed() = 0;
+  };
+
+  // Opens the netlink socket and asks the kernel to start multicasting the
+  // process events. The acknowledgement is received asynchronously, if the
+  // subscription fails the delegate's OnProcessConnectorFailed() is called.
+  // Returns nullptr if the process connector isn't available (e.g. missing
+  // permissions to open the socket).
+  static std::unique_ptr<ProcessConnector> Create(base::TaskRunner*,
+                                                  Delegate*);
+
+  // |sock| must be a non-blocking datagram socket, already subscribed. Public
+  // for testing, where |sock| is one end of a socketpair.
+  ProcessConnector(base::TaskRunner*, Delegate*, base::ScopedFile sock);
+  ~ProcessConnector();
+
+  // Parses one netlink datagram, appending the process events it contains to
+  // |events|. Returns false if the datagram is malformed.
+  static bool ParseMessage(const uint8_t* data,
+                           size_t size,
+                           std::vector<ProcessEvent>* events);
+
+ private:
+  ProcessConnector(const ProcessConnector&) = delete;
+  ProcessConnector& operator=(const ProcessConnector&) = delete;
+
+  enum class State {
+    kAwaitingAck,
+    kSubscribed,
+    kFailed,
+  };
+
+  void OnSocketDataAvailable();
+  void OnAckTimeout();
+  void Fail();
+  void Unsubscribe();
+
+  base::TaskRunner* const task_runner_;
+  Delegate* const delegate_;
+  base::ScopedFile sock_;
+  uint32_t port_id_ = 0;
+  State state_ = State::kSubscribed;
+  std::vector<ProcessEvent> events_;
+
+  base::WeakPtrFactory<ProcessConnector> weak_factory_;  // Keep last.
+};
+
+}  // namespace perfetto
+
+#endif  // SRC_TRACED_PROBES_PS_PROCESS_CONNECTOR_H_
@@ -0,0 +1,186 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/traced/probes/ps/process_connector.h"
+
+#include <fcntl.h>
+#include <linux/cn_proc.h>
+#include <linux/connector.h>
+#include <linux/netlink.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include <vector>
+
+#include "perfetto/ext/base/utils.h"
+#include "src/base/test/test_task_runner.h"
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::Field;
+using ::testing::Invoke;
+using ::testing::Matcher;
+
+class MockDelegate : public ProcessConnector::Delegate {
+ public:
+  MOCK_METHOD(void,
+              OnProcessEvents,
+              (const std::vector<ProcessEvent>&),
+              (override));
+  MOCK_METHOD(void, OnProcessEventsLost, (), (override));
+  MOCK_METHOD(void, OnProcessConnectorFailed, (), (override));
+};
+
+// Appends a netlink message carrying |event| to |buf|.
+void AppendMessage(const proc_event& event,
+                   std::vector<uint8_t>* buf,
+                   uint32_t cn_idx = CN_IDX_PROC) {
+  const size_t msg_size = NLMSG_LENGTH(sizeof(cn_msg) + sizeof(event));
+  const size_t offset = buf->size();
+  buf->resize(offset + NLMSG_ALIGN(msg_size));
+  nlmsghdr hdr{};
+  hdr.nlmsg_len = static_cast<uint32_t>(msg_size);
+  hdr.nlmsg_type = NLMSG_DONE;
+  memcpy(buf->data() + offset, &hdr, sizeof(hdr));
+  cn_msg msg{};
+  msg.id.idx = cn_idx;
+  msg.id.val = CN_VAL_PROC;
+  msg.len = sizeof(event);
+  memcpy(buf->data() + offset + NLMSG_HDRLEN, &msg, sizeof(msg));
+  memcpy(buf->data() + offset + NLMSG_HDRLEN + sizeof(msg), &event,
+         sizeof(event));
+}
+
+proc_event MakeFork(int32_t pid, int32_t tgid) {
+  proc_event event{};
+  event.what = proc_event::PROC_EVENT_FORK;
+  event.event_data.fork.parent_pid = 1;
+  event.event_data.fork.parent_tgid = 1;
+  event.event_data.fork.child_pid = pid;
+  event.event_data.fork.child_tgid = tgid;
+  return event;
+}
+
+proc_event MakeExit(int32_t pid, int32_t tgid) {
+  proc_event event{};
+  event.what = proc_event::PROC_EVENT_EXIT;
+  event.event_data.exit.process_pid = pid;
+  event.event_data.exit.process_tgid = tgid;
+  return event;
+}
+
+Matcher<ProcessEvent> IsEvent(ProcessEvent::Type type,
+                              int32_t pid,
+                              int32_t tgid) {
+  return AllOf(Field(&ProcessEvent::type, type), Field(&ProcessEvent::pid, pid),
+               Field(&ProcessEvent::tgid, tgid));
+}
+
+TEST(ProcessConnectorTest, ParseMessage) {
+  std::vector<uint8_t> buf;
+  AppendMessage(MakeFork(10, 10), &buf);
+  AppendMessage(MakeFork(11, 10), &buf);
+
+  proc_event exec{};
+  exec.what = proc_event::PROC_EVENT_EXEC;
+  exec.event_data.exec.process_pid = 10;
+  exec.event_data.exec.process_tgid = 10;
+  AppendMessage(exec, &buf);
+
+  proc_event comm{};
+  comm.what = proc_event::PROC_EVENT_COMM;
+  comm.event_data.comm.process_pid = 11;
+  comm.event_data.comm.process_tgid = 10;
+  strcpy(comm.event_data.comm.comm, "thread");
+  AppendMessage(comm, &buf);
+
+  // Events not relevant to the process table, and messages of other
+  // connectors, are skipped.
+  proc_event uid{};
+  uid.what = proc_event::PROC_EVENT_UID;
+  AppendMessage(uid, &buf);
+  AppendMessage(MakeFork(12, 12), &buf, CN_IDX_PROC + 1);
+
+  AppendMessage(MakeExit(11, 10), &buf);
+
+  std::vector<ProcessEvent> events;
+  ASSERT_TRUE(ProcessConnector::ParseMessage(buf.data(), buf.size(), &events));
+  EXPECT_THAT(events, ElementsAre(IsEvent(ProcessEvent::kFork, 10, 10),
+                                  IsEvent(ProcessEvent::kFork, 11, 10),
+                                  IsEvent(ProcessEvent::kExec, 10, 10),
+                                  IsEvent(ProcessEvent::kComm, 11, 10),
+                                  IsEvent(ProcessEvent::kExit, 11, 10)));
+}
+
+TEST(ProcessConnectorTest, ParseMalformedMessage) {
+  std::vector<uint8_t> buf;
+  AppendMessage(MakeFork(10, 10), &buf);
+
+  // Truncated message.
+  std::vector<ProcessEvent> events;
+  EXPECT_FALSE(
+      ProcessConnector::ParseMessage(buf.data(), buf.size() - 8, &events));
+
+  // Payload length past the end of the message.
+  std::vector<uint8_t> bad_len = buf;
+  uint16_t len = 1000;
+  memcpy(bad_len.data() + NLMSG_HDRLEN + offsetof(cn_msg, len), &len,
+         sizeof(len));
+  EXPECT_FALSE(
+      ProcessConnector::ParseMessage(bad_len.data(), bad_len.size(), &events));
+
+  // Netlink errors.
+  std::vector<uint8_t> error = buf;
+  uint16_t type = NLMSG_ERROR;
+  memcpy(error.data() + offsetof(nlmsghdr, nlmsg_type), &type, sizeof(type));
+  EXPECT_FALSE(
+      ProcessConnector::ParseMessage(error.data(), error.size(), &events));
+
+  EXPECT_TRUE(events.empty());
+}
+
+TEST(ProcessConnectorTest, ReadFromSocket) {
+  int fds[2];
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK, 0, fds), 0);
+  base::ScopedFile peer(fds[1]);
+  base::TestTaskRunner task_runner;
+  MockDelegate delegate;
+  ProcessConnector connector(&task_runner, &delegate, base::ScopedFile(fds[0]));
+
+  // One event per datagram, as the kernel does.
+  for (const proc_event& event : {MakeFork(10, 10), MakeExit(10, 10)}) {
+    std::vector<uint8_t> buf;
+    AppendMessage(event, &buf);
+    ASSERT_EQ(send(*peer, buf.data(), buf.size(), 0),
+              static_cast<ssize_t>(buf.size()));
+  }
+
+  auto checkpoint = task_runner.CreateCheckpoint("events");
+  EXPECT_CALL(delegate, OnProcessEvents(ElementsAre(
+                            IsEvent(ProcessEvent::kFork, 10, 10),
+                            IsEvent(ProcessEvent::kExit, 10, 10))))
+      .WillOnce(Invoke([&checkpoint](const std::vector<ProcessEvent>&) {
+        checkpoint();
+      }));
+  EXPECT_CALL(delegate, OnProcessEventsLost()).Times(0);
+  task_runner.RunUntilCheckpoint("events");
+}
+
+}  // namespace
+}  // namespace perfetto
@@ -16,7 +16,9 @@
 
 #include "src/traced/probes/ps/process_stats_data_source.h"
 
+#include <fcntl.h>
 #include <stdlib.h>
+#include <sys/resource.h>
 #include <unistd.h>
 
 #include <algorithm>
@@ -71,6 +73,13 @@ inline uint32_t ToU32(const char* str) {
   return static_cast<uint32_t>(strtol(str, nullptr, 10));
 }
 
+// Upper bound of the fds kept open for polling the process stats. The actual
+// limit is also capped to half of RLIMIT_NOFILE.
+constexpr size_t kMaxStatsFds = 8192;
+
+constexpr const char* kStatsFileNames[] = {"status", "smaps_rollup",
+                                           "oom_score_adj"};
+
 }  // namespace
 
 // static
@@ -97,6 +106,7 @@ ProcessStatsDataSource::ProcessStatsDataSource(
   dump_all_procs_on_start_ = cfg.scan_all_processes_on_start();
   resolve_process_fds_ = cfg.resolve_process_fds();
   scan_smaps_rollup_ = cfg.scan_smaps_rollup();
+  use_process_connector_ = cfg.use_process_connector();
 
   enable_on_demand_dumps_ = true;
   for (auto quirk = cfg.quirks(); quirk; ++quirk) {
@@ -126,6 +136,19 @@ void ProcessStatsDataSource::Start() {
     WriteAllProcesses();
   }
 
+  if (poll_period_ms_ && use_process_connector_) {
+    process_connector_ = CreateProcessConnector();
+    if (!process_connector_) {
+      PERFETTO_ELOG(
+          "Process connector not available, falling back to /proc scans");
+    }
+    max_stats_fds_ = kMaxStatsFds;
+    struct rlimit rlim {};
+    if (getrlimit(RLIMIT_NOFILE, &rlim) == 0 && rlim.rlim_cur != RLIM_INFINITY)
+      max_stats_fds_ =
+          std::min(max_stats_fds_, static_cast<size_t>(rlim.rlim_cur / 2));
+  }
+
   if (poll_period_ms_) {
     auto weak_this = GetWeakPtr();
     task_runner_->PostTask(std::bind(&ProcessStatsDataSource::Tick, weak_this));
@@ -149,7 +172,7 @@ void ProcessStatsDataSource::WriteAllProcesses() {
   base::FlatSet<int32_t> pids;
   while (int32_t pid = ReadNextNumericDir(*proc_dir)) {
     WriteProcessOrThread(pid);
-    base::StackString<128> task_path("/proc/%d/task", pid);
+    base::StackString<128> task_path("%s/%d/task", GetProcMountpoint(), pid);
     base::ScopedDir task_dir(opendir(task_path.c_str()));
     if (!task_dir)
       continue;
@@ -375,7 +398,8 @@ base::ScopedDir ProcessStatsDataSource::OpenProcDir() {
 
 std::string ProcessStatsDataSource::ReadProcPidFile(int32_t pid,
                                                     const std::string& file) {
-  base::StackString<128> path("/proc/%" PRId32 "/%s", pid, file.c_str());
+  base::StackString<128> path("%s/%" PRId32 "/%s", GetProcMountpoint(), pid,
+                              file.c_str());
   std::string contents;
   contents.reserve(4096);
   if (!base::ReadFile(path.c_str(), &contents))
@@ -383,6 +407,11 @@ std::string ProcessStatsDataSource::ReadProcPidFile(int32_t pid,
   return contents;
 }
 
+std::unique_ptr<ProcessConnector>
+ProcessStatsDataSource::CreateProcessConnector() {
+  return ProcessConnector::Create(task_runner_, this);
+}
+
 std::string ProcessStatsDataSource::ReadProcStatusEntry(const std::string& buf,
                                                         const char* key) {
   auto begin = buf.find(key);
@@ -481,56 +510,207 @@ void ProcessStatsDataSource::WriteAllProcessStats() {
 
   CacheProcFsScanStartTimestamp();
   PERFETTO_METATRACE_SCOPED(TAG_PROC_POLLERS, PS_WRITE_ALL_PROCESS_STATS);
-  base::ScopedDir proc_dir = OpenProcDir();
-  if (!proc_dir)
-    return;
   base::FlatSet<int32_t> pids;
-  while (int32_t pid = ReadNextNumericDir(*proc_dir)) {
-    cur_ps_stats_process_ = nullptr;
+  if (process_connector_ && !proc_rescan_needed_) {
+    // The process events keep |tracked_pids_| up to date, no need to list
+    // /proc.
+    std::vector<int32_t> gone_pids;
+    for (int32_t pid : exited_pids_) {
+      base::StackString<64> path("%s/%" PRId32, GetProcMountpoint(), pid);
+      if (!base::FileExists(path.c_str()))
+        gone_pids.push_back(pid);
+    }
+    for (int32_t pid : gone_pids) {
+      tracked_pids_.erase(pid);
+      exited_pids_.erase(pid);
+      ForgetProcess(pid);
+    }
+    for (int32_t pid : tracked_pids_) {
+      if (WriteProcessStats(pid))
+        pids.insert(pid);
+    }
+  } else {
+    base::ScopedDir proc_dir = OpenProcDir();
+    if (!proc_dir)
+      return;
+    base::FlatSet<int32_t> all_pids;
+    while (int32_t pid = ReadNextNumericDir(*proc_dir)) {
+      all_pids.insert(pid);
+      if (WriteProcessStats(pid))
+        pids.insert(pid);
+    }
+    if (process_connector_) {
+      for (auto it = stats_fds_.begin(); it != stats_fds_.end();) {
+        if (all_pids.count(it->first)) {
+          ++it;
+          continue;
+        }
+        for (const base::ScopedFile& fd : it->second)
+          num_stats_fds_ -= fd ? 1 : 0;
+        it = stats_fds_.erase(it);
+      }
+      base::FlatSet<int32_t> exited_pids;
+      for (int32_t pid : exited_pids_) {
+        if (all_pids.count(pid))
+          exited_pids.insert(pid);
+      }
+      exited_pids_ = std::move(exited_pids);
+      tracked_pids_ = std::move(all_pids);
+      proc_rescan_needed_ = false;
+    }
+  }
+  FinalizeCurPacket();
 
-    uint32_t pid_u = static_cast<uint32_t>(pid);
-    if (skip_stats_for_pids_.size() > pid_u && skip_stats_for_pids_[pid_u])
-      continue;
+  // Ensure that we write once long-term process info (e.g., name) for new pids
+  // that we haven't seen before.
+  WriteProcessTree(pids);
+}
 
-    std::string proc_status = ReadProcPidFile(pid, "status");
-    if (proc_status.empty())
-      continue;
+// Returns true if |pid| is a userspace process whose stats can be polled.
+bool ProcessStatsDataSource::WriteProcessStats(int32_t pid) {
+  cur_ps_stats_process_ = nullptr;
 
-    if (scan_smaps_rollup_) {
-      std::string proc_smaps_rollup = ReadProcPidFile(pid, "smaps_rollup");
-      proc_status.append(proc_smaps_rollup);
+  uint32_t pid_u = static_cast<uint32_t>(pid);
+  if (skip_stats_for_pids_.size() > pid_u && skip_stats_for_pids_[pid_u])
+    return false;
+
+  std::string proc_status = ReadStatsFile(pid, kStatusFile);
+  if (proc_status.empty())
+    return false;
+
+  if (scan_smaps_rollup_) {
+    std::string proc_smaps_rollup = ReadStatsFile(pid, kSmapsRollupFile);
+    proc_status.append(proc_smaps_rollup);
+  }
+
+  if (!WriteMemCounters(pid, proc_status)) {
+    // If WriteMemCounters() fails the pid is very likely a kernel thread
+    // that has a valid /proc/[pid]/status but no memory values. In this
+    // case avoid keep polling it over and over.
+    if (skip_stats_for_pids_.size() <= pid_u)
+      skip_stats_for_pids_.resize(pid_u + 1);
+    skip_stats_for_pids_[pid_u] = true;
+    CloseStatsFds(pid);
+    return false;
+  }
+
+  std::string oom_score_adj = ReadStatsFile(pid, kOomScoreAdjFile);
+  if (!oom_score_adj.empty()) {
+    CachedProcessStats& cached = process_stats_cache_[pid];
+    auto counter = ToInt(oom_score_adj);
+    if (counter != cached.oom_score_adj) {
+      GetOrCreateStatsProcess(pid)->set_oom_score_adj(counter);
+      cached.oom_score_adj = counter;
     }
+  }
 
-    if (!WriteMemCounters(pid, proc_status)) {
-      // If WriteMemCounters() fails the pid is very likely a kernel thread
-      // that has a valid /proc/[pid]/status but no memory values. In this
-      // case avoid keep polling it over and over.
-      if (skip_stats_for_pids_.size() <= pid_u)
-        skip_stats_for_pids_.resize(pid_u + 1);
-      skip_stats_for_pids_[pid_u] = true;
-      continue;
+  // Ensure we write data on any fds not seen before
+  WriteFds(pid);
+  return true;
+}
+
+std::string ProcessStatsDataSource::ReadStatsFile(int32_t pid,
+                                                  StatsFile file) {
+  if (!process_connector_)
+    return ReadProcPidFile(pid, kStatsFileNames[file]);
+
+  // Procfs regenerates the contents on each read from offset 0, so the fds
+  // can be kept open across polls. They refer to the process rather than to
+  // the pid: once the process is gone reads fail, even if the pid is reused.
+  base::ScopedFile& fd = stats_fds_[pid][file];
+  if (!fd) {
+    if (num_stats_fds_ >= max_stats_fds_)
+      return ReadProcPidFile(pid, kStatsFileNames[file]);
+    base::StackString<128> path("%s/%" PRId32 "/%s", GetProcMountpoint(), pid,
+                                kStatsFileNames[file]);
+    fd = base::OpenFile(path.c_str(), O_RDONLY);
+    if (!fd)
+      return "";
+    num_stats_fds_++;
+  }
+
+  std::string contents;
+  contents.resize(4096);
+  size_t size = 0;
+  for (;;) {
+    if (size == contents.size())
+      contents.resize(contents.size() * 2);
+    ssize_t rsize =
+        PERFETTO_EINTR(pread(*fd, &contents[size], contents.size() - size,
+                             static_cast<off_t>(size)));
+    if (rsize < 0) {
+      CloseStatsFds(pid);
+      return "";
     }
+    if (rsize == 0)
+      break;
+    size += static_cast<size_t>(rsize);
+  }
+  contents.resize(size);
+  return contents;
+}
 
-    std::string oom_score_adj = ReadProcPidFile(pid, "oom_score_adj");
-    if (!oom_score_adj.empty()) {
-      CachedProcessStats& cached = process_stats_cache_[pid];
-      auto counter = ToInt(oom_score_adj);
-      if (counter != cached.oom_score_adj) {
-        GetOrCreateStatsProcess(pid)->set_oom_score_adj(counter);
-        cached.oom_score_adj = counter;
-      }
+void ProcessStatsDataSource::CloseStatsFds(int32_t pid) {
+  auto it = stats_fds_.find(pid);
+  if (it == stats_fds_.end())
+    return;
+  for (const base::ScopedFile& fd : it->second)
+    num_stats_fds_ -= fd ? 1 : 0;
+  stats_fds_.erase(it);
+}
+
+void ProcessStatsDataSource::OnProcessEvents(
+    const std::vector<ProcessEvent>& events) {
+  for (const ProcessEvent& event : events) {
+    switch (event.type) {
+      case ProcessEvent::kFork:
+        if (event.pid != event.tgid)
+          break;
+        // The pid of an exited process was reused: drop its cached state.
+        if (exited_pids_.erase(event.pid))
+          ForgetProcess(event.pid);
+        tracked_pids_.insert(event.pid);
+        break;
+      case ProcessEvent::kExec:
+      case ProcessEvent::kComm:
+        // The cmdline or the name changed, re-read them the next time the pid
+        // is seen. For processes this happens on the next poll.
+        seen_pids_.erase(event.pid);
+        break;
+      case ProcessEvent::kExit:
+        // Forget the pid, in case it gets reused.
+        seen_pids_.erase(event.pid);
+        // This is the exit of the main thread, not necessarily of the whole
+        // process: check on the next poll.
+        if (event.pid == event.tgid && tracked_pids_.count(event.pid))
+          exited_pids_.insert(event.pid);
+        break;
     }
+  }
+}
 
-    // Ensure we write data on any fds not seen before
-    WriteFds(pid);
+void ProcessStatsDataSource::OnProcessEventsLost() {
+  PERFETTO_DLOG("Process events lost, rescanning /proc on the next poll");
+  proc_rescan_needed_ = true;
+}
 
-    pids.insert(pid);
-  }
-  FinalizeCurPacket();
+void ProcessStatsDataSource::OnProcessConnectorFailed() {
+  PERFETTO_ELOG(
+      "Process connector not available, falling back to /proc scans");
+  process_connector_.reset();
+  stats_fds_.clear();
+  num_stats_fds_ = 0;
+  tracked_pids_.clear();
+  exited_pids_.clear();
+  proc_rescan_needed_ = true;
+}
 
-  // Ensure that we write once long-term process info (e.g., name) for new pids
-  // that we haven't seen before.
-  WriteProcessTree(pids);
+void ProcessStatsDataSource::ForgetProcess(int32_t pid) {
+  process_stats_cache_.erase(pid);
+  CloseStatsFds(pid);
+  uint32_t pid_u = static_cast<uint32_t>(pid);
+  if (skip_stats_for_pids_.size() > pid_u)
+    skip_stats_for_pids_[pid_u] = false;
 }
 
 // Returns true if the stats for the given |pid| have been written, false it
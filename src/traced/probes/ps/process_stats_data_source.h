@@ -32,6 +32,7 @@
 #include "perfetto/tracing/core/forward_decls.h"
 #include "src/traced/probes/common/cpu_freq_info.h"
 #include "src/traced/probes/probes_data_source.h"
+#include "src/traced/probes/ps/process_connector.h"
 
 namespace perfetto {
 
@@ -47,7 +48,8 @@ class ProcessStats_Process;
 }  // namespace pbzero
 }  // namespace protos
 
-class ProcessStatsDataSource : public ProbesDataSource {
+class ProcessStatsDataSource : public ProbesDataSource,
+                               public ProcessConnector::Delegate {
  public:
   static const ProbesDataSource::Descriptor descriptor;
 
@@ -60,6 +62,7 @@ class ProcessStatsDataSource : public ProbesDataSource {
 
   base::WeakPtr<ProcessStatsDataSource> GetWeakPtr() const;
   void WriteAllProcesses();
+  void WriteAllProcessStats();
   void OnPids(const base::FlatSet<int32_t>& pids);
   void OnRenamePids(const base::FlatSet<int32_t>& pids);
   void OnFds(const base::FlatSet<std::pair<pid_t, uint64_t>>& fds);
@@ -69,12 +72,18 @@ class ProcessStatsDataSource : public ProbesDataSource {
   void Flush(FlushRequestID, std::function<void()> callback) override;
   void ClearIncrementalState() override;
 
+  // ProcessConnector::Delegate implementation.
+  void OnProcessEvents(const std::vector<ProcessEvent>&) override;
+  void OnProcessEventsLost() override;
+  void OnProcessConnectorFailed() override;
+
   bool on_demand_dumps_enabled() const { return enable_on_demand_dumps_; }
 
   // Virtual for testing.
   virtual const char* GetProcMountpoint();
   virtual base::ScopedDir OpenProcDir();
   virtual std::string ReadProcPidFile(int32_t pid, const std::string& file);
+  virtual std::unique_ptr<ProcessConnector> CreateProcessConnector();
 
  private:
   struct CachedProcessStats {
@@ -127,9 +136,20 @@ class ProcessStatsDataSource : public ProbesDataSource {
                           const std::string& proc_status,
                           TidArray& out);
 
+  // The /proc/pid files read on every poll.
+  enum StatsFile : size_t {
+    kStatusFile = 0,
+    kSmapsRollupFile,
+    kOomScoreAdjFile,
+    kNumStatsFiles,
+  };
+
   // Functions for periodically sampling process stats/counters.
   static void Tick(base::WeakPtr<ProcessStatsDataSource>);
-  void WriteAllProcessStats();
+  bool WriteProcessStats(int32_t pid);
+  std::string ReadStatsFile(int32_t pid, StatsFile);
+  void CloseStatsFds(int32_t pid);
+  void ForgetProcess(int32_t pid);
   bool WriteMemCounters(int32_t pid, const std::string& proc_status);
   void WriteFds(int32_t pid);
   void WriteSingleFd(int32_t pid, uint64_t fd);
@@ -197,6 +217,24 @@ class ProcessStatsDataSource : public ProbesDataSource {
   uint32_t process_stats_cache_ttl_ticks_ = 0;
   std::unordered_map<int32_t, CachedProcessStats> process_stats_cache_;
 
+  // Fields for tracking the process table through the kernel process
+  // connector, instead of rescanning /proc on every poll.
+  bool use_process_connector_ = false;
+  std::unique_ptr<ProcessConnector> process_connector_;
+  // Set until the first scan of /proc, and whenever process events are lost.
+  bool proc_rescan_needed_ = true;
+  // All the processes alive, as per the last scan and the process events.
+  base::FlatSet<int32_t> tracked_pids_;
+  // Tracked processes whose main thread exited. The other threads can keep
+  // the process alive, so they are untracked only once /proc/[pid] is gone.
+  base::FlatSet<int32_t> exited_pids_;
+  // Open fds of the files in StatsFile, so that each poll only costs a
+  // pread() per file. Capped to |max_stats_fds_| fds overall.
+  std::unordered_map<int32_t, std::array<base::ScopedFile, kNumStatsFiles>>
+      stats_fds_;
+  size_t num_stats_fds_ = 0;
+  size_t max_stats_fds_ = 0;
+
   using TimeInStateCacheEntry = std::tuple</* tid */ int32_t,
                                            /* cpu_freq_index */ uint32_t,
                                            /* ticks */ uint64_t>;
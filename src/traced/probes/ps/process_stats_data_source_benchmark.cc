@@ -0,0 +1,155 @@
+// Copyright (C) 2023 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <benchmark/benchmark.h>
+
+#include <sys/socket.h>
+
+#include <memory>
+#include <string>
+
+#include "perfetto/ext/base/string_utils.h"
+#include "perfetto/tracing/core/data_source_config.h"
+#include "src/base/test/test_task_runner.h"
+#include "src/base/test/tmp_dir_tree.h"
+#include "src/traced/probes/ps/process_stats_data_source.h"
+#include "src/tracing/core/null_trace_writer.h"
+
+#include "protos/perfetto/config/process_stats/process_stats_config.gen.h"
+
+namespace perfetto {
+namespace {
+
+// The relevant part of the /proc/pid/status of a userspace process.
+constexpr char kStatusFormat[] =
+    "Name:\tproc_%d\n"
+    "Umask:\t0022\n"
+    "State:\tS (sleeping)\n"
+    "Tgid:\t%d\n"
+    "Ngid:\t0\n"
+    "Pid:\t%d\n"
+    "PPid:\t1\n"
+    "TracerPid:\t0\n"
+    "Uid:\t1000\t1000\t1000\t1000\n"
+    "Gid:\t1000\t1000\t1000\t1000\n"
+    "FDSize:\t64\n"
+    "Groups:\t4 20 24 27 30 46 1000\n"
+    "NStgid:\t%d\n"
+    "NSpid:\t%d\n"
+    "VmPeak:\t  230244 kB\n"
+    "VmSize:\t  230240 kB\n"
+    "VmLck:\t       0 kB\n"
+    "VmPin:\t       0 kB\n"
+    "VmHWM:\t   18200 kB\n"
+    "VmRSS:\t   18200 kB\n"
+    "RssAnon:\t    5000 kB\n"
+    "RssFile:\t   13200 kB\n"
+    "RssShmem:\t       0 kB\n"
+    "VmData:\t    8000 kB\n"
+    "VmStk:\t     132 kB\n"
+    "VmExe:\t      24 kB\n"
+    "VmLib:\t    9000 kB\n"
+    "VmPTE:\t     100 kB\n"
+    "VmSwap:\t       0 kB\n"
+    "Threads:\t4\n"
+    "SigQ:\t0/62570\n"
+    "voluntary_ctxt_switches:\t150\n"
+    "nonvoluntary_ctxt_switches:\t10\n";
+
+// A fake /proc with |num_processes| userspace processes.
+class SyntheticProc {
+ public:
+  explicit SyntheticProc(int num_processes) {
+    for (int pid = 1; pid <= num_processes; pid++) {
+      std::string dir = std::to_string(pid);
+      tree_.AddDir(dir);
+      base::StackString<2048> status(kStatusFormat, pid, pid, pid, pid, pid);
+      tree_.AddFile(dir + "/status", status.ToStdString());
+      tree_.AddFile(dir + "/cmdline", "proc_" + dir + '\0');
+      tree_.AddFile(dir + "/oom_score_adj", "0");
+    }
+  }
+
+  const std::string& path() const { return tree_.path(); }
+
+ private:
+  base::TmpDirTree tree_;
+};
+
+class SyntheticProcStatsDataSource : public ProcessStatsDataSource {
+ public:
+  SyntheticProcStatsDataSource(base::TaskRunner* task_runner,
+                               const DataSourceConfig& config,
+                               const std::string& proc_path)
+      : ProcessStatsDataSource(task_runner,
+                               /*session_id=*/0,
+                               std::unique_ptr<TraceWriter>(
+                                   new NullTraceWriter()),
+                               config,
+                               /*cpu_freq_info=*/nullptr),
+        task_runner_(task_runner),
+        proc_path_(proc_path) {}
+
+  const char* GetProcMountpoint() override { return proc_path_.c_str(); }
+
+  // No process is created or destroyed while polling the synthetic /proc, so
+  // a connector that never reports any event is enough.
+  std::unique_ptr<ProcessConnector> CreateProcessConnector() override {
+    int fds[2];
+    PERFETTO_CHECK(socketpair(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK, 0, fds) ==
+                   0);
+    peer_.reset(fds[1]);
+    return std::unique_ptr<ProcessConnector>(
+        new ProcessConnector(task_runner_, this, base::ScopedFile(fds[0])));
+  }
+
+ private:
+  base::TaskRunner* const task_runner_;
+  const std::string proc_path_;
+  base::ScopedFile peer_;
+};
+
+void BM_ProcessStatsPoll(benchmark::State& state, bool use_process_connector) {
+  const int num_processes = static_cast<int>(state.range(0));
+  SyntheticProc proc(num_processes);
+  base::TestTaskRunner task_runner;
+
+  protos::gen::ProcessStatsConfig cfg;
+  cfg.set_proc_stats_poll_ms(100);
+  cfg.set_use_process_connector(use_process_connector);
+  cfg.add_quirks(protos::gen::ProcessStatsConfig::DISABLE_ON_DEMAND);
+  DataSourceConfig ds_config;
+  ds_config.set_process_stats_config_raw(cfg.SerializeAsString());
+  SyntheticProcStatsDataSource data_source(&task_runner, ds_config,
+                                           proc.path());
+  data_source.Start();
+
+  // The first poll always scans /proc.
+  data_source.WriteAllProcessStats();
+
+  for (auto _ : state) {
+    data_source.WriteAllProcessStats();
+  }
+  state.SetItemsProcessed(state.iterations() * num_processes);
+}
+
+BENCHMARK_CAPTURE(BM_ProcessStatsPoll, proc_scan, false)
+    ->Arg(1000)
+    ->Arg(5000);
+BENCHMARK_CAPTURE(BM_ProcessStatsPoll, process_connector, true)
+    ->Arg(1000)
+    ->Arg(5000);
+
+}  // namespace
+}  // namespace perfetto
@@ -17,6 +17,10 @@
 #include "src/traced/probes/ps/process_stats_data_source.h"
 
 #include <dirent.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+
+#include <set>
 
 #include "perfetto/ext/base/file_utils.h"
 #include "perfetto/ext/base/string_utils.h"
@@ -64,6 +68,10 @@ class TestProcessStatsDataSource : public ProcessStatsDataSource {
               ReadProcPidFile,
               (int32_t pid, const std::string&),
               (override));
+  MOCK_METHOD(std::unique_ptr<ProcessConnector>,
+              CreateProcessConnector,
+              (),
+              (override));
 };
 
 class ProcessStatsDataSourceTest : public ::testing::Test {
@@ -629,5 +637,144 @@ TEST_F(ProcessStatsDataSourceTest, ScanSmapsRollupIsOn) {
     base::Rmdir(*path);
 }
 
+TEST_F(ProcessStatsDataSourceTest, TracksProcessesWithProcessConnector) {
+  DataSourceConfig ds_config;
+  ProcessStatsConfig cfg;
+  cfg.set_proc_stats_poll_ms(100);
+  cfg.set_use_process_connector(true);
+  cfg.add_quirks(ProcessStatsConfig::DISABLE_ON_DEMAND);
+  ds_config.set_process_stats_config_raw(cfg.SerializeAsString());
+  auto data_source = GetProcessStatsDataSource(ds_config);
+
+  // Populate a fake /proc/ directory. The files are rewritten in place, as the
+  // data source keeps them open across polls.
+  auto fake_proc = base::TempDir::Create();
+  const std::string fake_proc_path = fake_proc.path();
+  const char* const kFiles[] = {"status", "cmdline", "oom_score_adj"};
+  auto pid_path = [&fake_proc_path](int32_t pid) {
+    return fake_proc_path + "/" + std::to_string(pid);
+  };
+  auto write_file = [&pid_path](int32_t pid, const char* file,
+                                const std::string& contents) {
+    base::ScopedFile fd = base::OpenFile(pid_path(pid) + "/" + file,
+                                         O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    ASSERT_TRUE(fd);
+    ASSERT_EQ(base::WriteAll(*fd, contents.data(), contents.size()),
+              static_cast<ssize_t>(contents.size()));
+  };
+  auto write_status = [&write_file](int32_t pid, uint32_t vm_size_kb) {
+    base::StackString<256> status(
+        "Name:\tproc_%d\nTgid:\t%d\nPid:\t%d\nPPid:\t1\nVmSize:\t%u kB\n", pid,
+        pid, pid, vm_size_kb);
+    write_file(pid, "status", status.ToStdString());
+  };
+  auto create_process = [&](int32_t pid, uint32_t vm_size_kb) {
+    ASSERT_EQ(mkdir(pid_path(pid).c_str(), 0755), 0);
+    write_status(pid, vm_size_kb);
+    write_file(pid, "cmdline", "proc_" + std::to_string(pid) + '\0');
+    write_file(pid, "oom_score_adj", "0");
+  };
+  auto remove_process = [&](int32_t pid) {
+    for (const char* file : kFiles)
+      unlink((pid_path(pid) + "/" + file).c_str());
+    base::Rmdir(pid_path(pid));
+  };
+  create_process(1, 100);
+  create_process(2, 200);
+
+  EXPECT_CALL(*data_source, GetProcMountpoint())
+      .WillRepeatedly(
+          Invoke([&fake_proc_path] { return fake_proc_path.c_str(); }));
+  EXPECT_CALL(*data_source, ReadProcPidFile(_, _))
+      .WillRepeatedly(
+          Invoke([&pid_path](int32_t pid, const std::string& file) {
+            std::string contents;
+            base::ReadFile(pid_path(pid) + "/" + file, &contents);
+            return contents;
+          }));
+  EXPECT_CALL(*data_source, CreateProcessConnector())
+      .WillOnce(Invoke([this, &data_source] {
+        int fds[2];
+        PERFETTO_CHECK(
+            socketpair(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK, 0, fds) == 0);
+        base::ScopedFile peer(fds[1]);
+        return std::unique_ptr<ProcessConnector>(new ProcessConnector(
+            &task_runner_, data_source.get(), base::ScopedFile(fds[0])));
+      }));
+  int proc_dir_scans = 0;
+  EXPECT_CALL(*data_source, OpenProcDir())
+      .WillRepeatedly(Invoke([&fake_proc_path, &proc_dir_scans] {
+        proc_dir_scans++;
+        return base::ScopedDir(opendir(fake_proc_path.c_str()));
+      }));
+
+  data_source->Start();
+  data_source->WriteAllProcessStats();
+  EXPECT_EQ(proc_dir_scans, 1);
+
+  // The next poll relies on the process events rather than listing /proc.
+  write_status(1, 101);
+  write_file(1, "cmdline", std::string("renamed\0", 8));
+  create_process(3, 300);
+  remove_process(2);
+  data_source->OnProcessEvents({{ProcessEvent::kFork, 3, 3},
+                                {ProcessEvent::kFork, 4, 3},
+                                {ProcessEvent::kComm, 1, 1},
+                                {ProcessEvent::kExit, 2, 2}});
+  data_source->WriteAllProcessStats();
+  EXPECT_EQ(proc_dir_scans, 1);
+
+  // The main thread of 3 exits, but its other thread keeps the process alive:
+  // it's still polled.
+  write_status(3, 301);
+  data_source->OnProcessEvents({{ProcessEvent::kExit, 3, 3}});
+  data_source->WriteAllProcessStats();
+
+  // Once the last thread exits as well, the process is gone.
+  remove_process(3);
+  write_status(1, 102);
+  data_source->OnProcessEvents({{ProcessEvent::kExit, 4, 3}});
+  data_source->WriteAllProcessStats();
+  EXPECT_EQ(proc_dir_scans, 1);
+
+  // After losing some events, /proc is listed again.
+  write_status(1, 103);
+  data_source->OnProcessEventsLost();
+  data_source->WriteAllProcessStats();
+  EXPECT_EQ(proc_dir_scans, 2);
+
+  // The stats and the process tree of each poll, in order.
+  auto trace = writer_raw_->GetAllTracePackets();
+  std::vector<std::set<std::pair<int32_t, uint64_t>>> vm_sizes;
+  std::vector<std::set<std::pair<int32_t, std::string>>> cmdlines;
+  for (const auto& packet : trace) {
+    if (packet.has_process_stats()) {
+      vm_sizes.emplace_back();
+      for (const auto& process : packet.process_stats().processes())
+        vm_sizes.back().emplace(process.pid(), process.vm_size_kb());
+    }
+    if (packet.has_process_tree()) {
+      cmdlines.emplace_back();
+      for (const auto& process : packet.process_tree().processes())
+        cmdlines.back().emplace(process.pid(), process.cmdline()[0]);
+    }
+  }
+  using VmSizes = std::set<std::pair<int32_t, uint64_t>>;
+  EXPECT_THAT(vm_sizes, ElementsAre(VmSizes{{1, 100}, {2, 200}},
+                                    VmSizes{{1, 101}, {3, 300}},
+                                    VmSizes{{3, 301}}, VmSizes{{1, 102}},
+                                    VmSizes{{1, 103}}));
+  using Cmdlines = std::set<std::pair<int32_t, std::string>>;
+  EXPECT_THAT(cmdlines,
+              ElementsAre(Cmdlines{{1, "proc_1"}, {2, "proc_2"}},
+                          Cmdlines{{1, "renamed"}, {3, "proc_3"}},
+                          Cmdlines{{3, "proc_3"}}));
+
+  // Close the cached fds before cleaning up |fake_proc|.
+  data_source.reset();
+  remove_process(1);
+  remove_process(3);
+}
+
 }  // namespace
 }  // namespace perfetto
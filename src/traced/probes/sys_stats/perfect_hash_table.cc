@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/traced/probes/sys_stats/perfect_hash_table.h"
+
+#include <algorithm>
+#include <numeric>
+
+#include "perfetto/base/logging.h"
+
+namespace perfetto {
+
+namespace {
+
+// Bound on the seeds tried for each bucket before growing the table. With a
+// load factor <= 1 a seed is usually found in a handful of attempts.
+constexpr uint32_t kMaxSeed = 1 << 16;
+
+}  // namespace
+
+PerfectHashTable::PerfectHashTable()
+    : PerfectHashTable(std::vector<KeyAndId>()) {}
+
+PerfectHashTable::PerfectHashTable(const std::vector<KeyAndId>& keys)
+    : num_keys_(keys.size()) {
+  size_t num_slots = 1;
+  while (num_slots < keys.size())
+    num_slots <<= 1;
+  while (!Build(keys, num_slots)) {
+    num_slots <<= 1;
+    // Can only happen with duplicate keys.
+    PERFETTO_CHECK(num_slots <= std::max<size_t>(keys.size(), 1) * 64);
+  }
+}
+
+bool PerfectHashTable::Build(const std::vector<KeyAndId>& keys,
+                             size_t num_slots) {
+  mask_ = static_cast<uint32_t>(num_slots - 1);
+  slots_.assign(num_slots, Slot());
+  displacements_.assign(num_slots, 0);
+
+  std::vector<std::vector<size_t>> buckets(num_slots);
+  for (size_t i = 0; i < keys.size(); i++)
+    buckets[Hash(keys[i].str, 0) & mask_].push_back(i);
+
+  // Place the largest buckets first, while there are more free slots.
+  std::vector<size_t> order(num_slots);
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&buckets](size_t a, size_t b) {
+    return buckets[a].size() > buckets[b].size();
+  });
+
+  std::vector<bool> used(num_slots);
+  std::vector<size_t> bucket_slots;
+  size_t i = 0;
+  for (; i < order.size() && buckets[order[i]].size() > 1; i++) {
+    const std::vector<size_t>& bucket = buckets[order[i]];
+    uint32_t seed = 1;
+    for (;; seed++) {
+      if (seed > kMaxSeed)
+        return false;
+      bucket_slots.clear();
+      for (size_t key_index : bucket) {
+        size_t slot = Hash(keys[key_index].str, seed) & mask_;
+        if (used[slot] || std::find(bucket_slots.begin(), bucket_slots.end(),
+                                    slot) != bucket_slots.end()) {
+          break;
+        }
+        bucket_slots.push_back(slot);
+      }
+      if (bucket_slots.size() == bucket.size())
+        break;
+    }
+    displacements_[order[i]] = static_cast<int32_t>(seed);
+    for (size_t k = 0; k < bucket.size(); k++) {
+      used[bucket_slots[k]] = true;
+      slots_[bucket_slots[k]] = {keys[bucket[k]].str, keys[bucket[k]].id};
+    }
+  }
+
+  size_t free_slot = 0;
+  for (; i < order.size() && buckets[order[i]].size() == 1; i++) {
+    while (used[free_slot])
+      free_slot++;
+    used[free_slot] = true;
+    const KeyAndId& key = keys[buckets[order[i]][0]];
+    slots_[free_slot] = {key.str, key.id};
+    displacements_[order[i]] = -static_cast<int32_t>(free_slot) - 1;
+  }
+  return true;
+}
+
+}  // namespace perfetto
@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACED_PROBES_SYS_STATS_PERFECT_HASH_TABLE_H_
+#define SRC_TRACED_PROBES_SYS_STATS_PERFECT_HASH_TABLE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "perfetto/ext/base/string_view.h"
+#include "perfetto/ext/traced/sys_stats_counters.h"
+
+namespace perfetto {
+
+// Maps the keys of a /proc file (e.g. "MemTotal" in /proc/meminfo) to their
+// counter ids. The set of keys is fixed when the table is built, which allows
+// to use a perfect hash: a lookup hashes the key twice and compares it with a
+// single candidate, without probing.
+//
+// Built with the hash-and-displace scheme: keys are first spread into buckets
+// by a hash with seed 0. Each bucket with more than one key then gets its own
+// seed, chosen so that its keys land in free slots. Buckets with one key are
+// placed directly in one of the remaining slots.
+class PerfectHashTable {
+ public:
+  static constexpr int kNotFound = -1;
+
+  PerfectHashTable();
+  // The keys must be unique and must outlive the table.
+  explicit PerfectHashTable(const std::vector<KeyAndId>& keys);
+
+  // Returns the id of |key|, or kNotFound.
+  int Find(base::StringView key) const {
+    const uint32_t bucket = Hash(key, 0) & mask_;
+    const int32_t displacement = displacements_[bucket];
+    const size_t slot_index =
+        displacement < 0 ? static_cast<size_t>(-displacement - 1)
+                         : Hash(key, static_cast<uint32_t>(displacement)) & mask_;
+    const Slot& slot = slots_[slot_index];
+    return slot.key == key ? slot.id : kNotFound;
+  }
+
+  size_t size() const { return num_keys_; }
+
+ private:
+  struct Slot {
+    base::StringView key;
+    int id = kNotFound;
+  };
+
+  static uint32_t Hash(base::StringView key, uint32_t seed) {
+    // FNV-1a, followed by the murmur3 finalizer: FNV alone doesn't mix the
+    // short keys of /proc files well enough into the low bits.
+    uint32_t h = 2166136261u ^ (seed * 0x9e3779b9u);
+    for (size_t i = 0; i < key.size(); i++) {
+      h ^= static_cast<uint8_t>(key.data()[i]);
+      h *= 16777619u;
+    }
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+  }
+
+  bool Build(const std::vector<KeyAndId>& keys, size_t num_slots);
+
+  // Both have a power of two size.
+  std::vector<Slot> slots_;
+  // For each bucket: >= 0 is the seed of the hash that gives the slot of its
+  // keys, < 0 is -(slot + 1) for buckets with only one key.
+  std::vector<int32_t> displacements_;
+  uint32_t mask_ = 0;
+  size_t num_keys_ = 0;
+};
+
+}  // namespace perfetto
+
+#endif  // SRC_TRACED_PROBES_SYS_STATS_PERFECT_HASH_TABLE_H_
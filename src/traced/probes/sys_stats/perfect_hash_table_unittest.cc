@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/traced/probes/sys_stats/perfect_hash_table.h"
+
+#include <string>
+#include <vector>
+
+#include "perfetto/ext/base/utils.h"
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace {
+
+TEST(PerfectHashTableTest, Empty) {
+  PerfectHashTable table;
+  EXPECT_EQ(table.size(), 0u);
+  EXPECT_EQ(table.Find("MemTotal"), PerfectHashTable::kNotFound);
+  EXPECT_EQ(table.Find(""), PerfectHashTable::kNotFound);
+}
+
+TEST(PerfectHashTableTest, AllMeminfoAndVmstatKeys) {
+  for (const auto& all_keys :
+       {std::vector<KeyAndId>(std::begin(kMeminfoKeys), std::end(kMeminfoKeys)),
+        std::vector<KeyAndId>(std::begin(kVmstatKeys),
+                              std::end(kVmstatKeys))}) {
+    PerfectHashTable table(all_keys);
+    ASSERT_EQ(table.size(), all_keys.size());
+    for (const KeyAndId& key : all_keys)
+      EXPECT_EQ(table.Find(key.str), key.id) << key.str;
+
+    // Keys are matched in full (e.g. the "MemTotal:" token of /proc/meminfo).
+    for (const KeyAndId& key : all_keys) {
+      std::string str = key.str;
+      EXPECT_EQ(table.Find(base::StringView(str + ":")),
+                PerfectHashTable::kNotFound);
+    }
+    EXPECT_EQ(table.Find(""), PerfectHashTable::kNotFound);
+    EXPECT_EQ(table.Find("not_a_counter"), PerfectHashTable::kNotFound);
+  }
+}
+
+TEST(PerfectHashTableTest, Subset) {
+  PerfectHashTable table({{"MemTotal", 1}, {"Cached", 5}, {"CmaFree", 33}});
+  EXPECT_EQ(table.size(), 3u);
+  EXPECT_EQ(table.Find("MemTotal"), 1);
+  EXPECT_EQ(table.Find("Cached"), 5);
+  EXPECT_EQ(table.Find("CmaFree"), 33);
+  EXPECT_EQ(table.Find("MemFree"), PerfectHashTable::kNotFound);
+  EXPECT_EQ(table.Find("CmaTotal"), PerfectHashTable::kNotFound);
+}
+
+}  // namespace
+}  // namespace perfetto
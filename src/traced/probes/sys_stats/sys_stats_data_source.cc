@@ -17,6 +17,7 @@
 #include "src/traced/probes/sys_stats/sys_stats_data_source.h"
 
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #include <algorithm>
@@ -32,6 +33,7 @@
 #include "perfetto/ext/base/scoped_file.h"
 #include "perfetto/ext/base/string_splitter.h"
 #include "perfetto/ext/base/string_utils.h"
+#include "perfetto/ext/base/string_view.h"
 #include "perfetto/ext/base/utils.h"
 #include "perfetto/ext/traced/sys_stats_counters.h"
 
@@ -54,6 +56,46 @@ base::ScopedFile OpenReadOnly(const char* path) {
   return fd;
 }
 
+// Helpers to scan the /proc files in place. They don't allocate nor modify
+// the buffer, unlike base::StringSplitter, and don't go through strtoll().
+
+const char* FindLineEnd(const char* p, const char* end) {
+  const char* eol =
+      static_cast<const char*>(memchr(p, '\n', static_cast<size_t>(end - p)));
+  return eol ? eol : end;
+}
+
+const char* SkipSpaces(const char* p, const char* end) {
+  while (p < end && *p == ' ')
+    p++;
+  return p;
+}
+
+// Returns the token starting at |*p| and moves |*p| past it.
+base::StringView NextToken(const char** p, const char* end) {
+  const char* start = SkipSpaces(*p, end);
+  const char* token_end = start;
+  while (token_end < end && *token_end != ' ')
+    token_end++;
+  *p = token_end;
+  return base::StringView(start, static_cast<size_t>(token_end - start));
+}
+
+// Parses a decimal number like strtoll() does: an optional '-' sign, then
+// digits up to the first non-digit. Negative values wrap around, as the
+// static_cast<uint64_t>(strtoll()) this replaces.
+uint64_t ParseNumber(base::StringView token) {
+  const char* p = token.data();
+  const char* end = p + token.size();
+  bool negative = p < end && *p == '-';
+  if (negative)
+    p++;
+  uint64_t value = 0;
+  for (; p < end && *p >= '0' && *p <= '9'; p++)
+    value = value * 10 + static_cast<uint64_t>(*p - '0');
+  return negative ? 0 - value : value;
+}
+
 uint32_t ClampTo10Ms(uint32_t period_ms, const char* counter_name) {
   if (period_ms > 0 && period_ms < 10) {
     PERFETTO_ILOG("%s %" PRIu32
@@ -96,9 +138,8 @@ SysStatsDataSource::SysStatsDataSource(
 
   read_buf_ = base::PagedMemory::Allocate(kReadBufSize);
 
-  // Build a lookup map that allows to quickly translate strings like "MemTotal"
-  // into the corresponding enum value, only for the counters enabled in the
-  // config.
+  // Build the lookup tables that translate strings like "MemTotal" into the
+  // corresponding enum value, only for the counters enabled in the config.
 
   using protos::pbzero::SysStatsConfig;
   SysStatsConfig::Decoder cfg(ds_config.sys_stats_config_raw());
@@ -115,11 +156,13 @@ SysStatsDataSource::SysStatsDataSource(
       PERFETTO_DFATAL("Meminfo counter out of bounds %u", counter);
     }
   }
+  std::vector<KeyAndId> meminfo_keys;
   for (size_t i = 0; i < base::ArraySize(kMeminfoKeys); i++) {
     const auto& k = kMeminfoKeys[i];
     if (meminfo_counters_enabled[static_cast<size_t>(k.id)])
-      meminfo_counters_.emplace(k.str, k.id);
+      meminfo_keys.push_back(k);
   }
+  meminfo_counters_ = PerfectHashTable(meminfo_keys);
 
   constexpr size_t kMaxVmstatEnum = protos::pbzero::VmstatCounters_MAX;
   std::bitset<kMaxVmstatEnum + 1> vmstat_counters_enabled{};
@@ -133,11 +176,13 @@ SysStatsDataSource::SysStatsDataSource(
       PERFETTO_DFATAL("Vmstat counter out of bounds %u", counter);
     }
   }
+  std::vector<KeyAndId> vmstat_keys;
   for (size_t i = 0; i < base::ArraySize(kVmstatKeys); i++) {
     const auto& k = kVmstatKeys[i];
     if (vmstat_counters_enabled[static_cast<size_t>(k.id)])
-      vmstat_counters_.emplace(k.str, k.id);
+      vmstat_keys.push_back(k);
   }
+  vmstat_counters_ = PerfectHashTable(vmstat_keys);
 
   if (!cfg.has_stat_counters())
     stat_enabled_fields_ = ~0u;
@@ -327,7 +372,8 @@ void SysStatsDataSource::ReadDevfreq(protos::pbzero::SysStats* sys_stats) {
         continue;
       const char* name = dir_ent->d_name;
       const char* file_content = ReadDevfreqCurFreq(name);
-      auto value = static_cast<uint64_t>(strtoll(file_content, nullptr, 10));
+      const char* end = file_content + strlen(file_content);
+      uint64_t value = ParseNumber(NextToken(&file_content, end));
       auto* devfreq = sys_stats->add_devfreq();
       devfreq->set_key(name);
       devfreq->set_value(value);
@@ -358,11 +404,15 @@ const char* SysStatsDataSource::ReadDevfreqCurFreq(
   const char* freq_file_name = "cur_freq";
   base::StackString<256> cur_freq_path("%s/%s/%s", devfreq_base_path,
                                        deviceName.c_str(), freq_file_name);
-  base::ScopedFile fd = OpenReadOnly(cur_freq_path.c_str());
-  if (!fd && !devfreq_error_logged_) {
-    devfreq_error_logged_ = true;
-    PERFETTO_PLOG("Failed to open %s", cur_freq_path.c_str());
-    return "";
+  // The devices don't come and go, keep their files open across ticks.
+  base::ScopedFile& fd = devfreq_fds_[deviceName];
+  if (!fd) {
+    fd = OpenReadOnly(cur_freq_path.c_str());
+    if (!fd && !devfreq_error_logged_) {
+      devfreq_error_logged_ = true;
+      PERFETTO_PLOG("Failed to open %s", cur_freq_path.c_str());
+      return "";
+    }
   }
   size_t rsize = ReadFile(&fd, cur_freq_path.c_str());
   if (!rsize)
@@ -374,23 +424,25 @@ void SysStatsDataSource::ReadMeminfo(protos::pbzero::SysStats* sys_stats) {
   size_t rsize = ReadFile(&meminfo_fd_, "/proc/meminfo");
   if (!rsize)
     return;
-  char* buf = static_cast<char*>(read_buf_.Get());
-  for (base::StringSplitter lines(buf, rsize, '\n'); lines.Next();) {
-    base::StringSplitter words(&lines, ' ');
-    if (!words.Next())
+  const char* buf = static_cast<char*>(read_buf_.Get());
+  const char* buf_end = buf + rsize - 1;  // Exclude the null terminator.
+  for (const char* line = buf; line < buf_end;) {
+    const char* eol = FindLineEnd(line, buf_end);
+    const char* p = line;
+    line = eol + 1;
+    base::StringView key = NextToken(&p, eol);
+    if (key.empty())
       continue;
-    // Extract the meminfo key, dropping trailing ':' (e.g., "MemTotal: NN KB").
-    words.cur_token()[words.cur_token_size() - 1] = '\0';
-    auto it = meminfo_counters_.find(words.cur_token());
-    if (it == meminfo_counters_.end())
+    // Drop the trailing ':' of the meminfo key (e.g., "MemTotal: NN KB").
+    int counter_id = meminfo_counters_.Find(key.substr(0, key.size() - 1));
+    if (counter_id == PerfectHashTable::kNotFound)
       continue;
-    int counter_id = it->second;
-    if (!words.Next())
+    base::StringView value = NextToken(&p, eol);
+    if (value.empty())
       continue;
-    auto value = static_cast<uint64_t>(strtoll(words.cur_token(), nullptr, 10));
     auto* meminfo = sys_stats->add_meminfo();
     meminfo->set_key(static_cast<protos::pbzero::MeminfoCounters>(counter_id));
-    meminfo->set_value(value);
+    meminfo->set_value(ParseNumber(value));
   }
 }
 
@@ -398,21 +450,21 @@ void SysStatsDataSource::ReadVmstat(protos::pbzero::SysStats* sys_stats) {
   size_t rsize = ReadFile(&vmstat_fd_, "/proc/vmstat");
   if (!rsize)
     return;
-  char* buf = static_cast<char*>(read_buf_.Get());
-  for (base::StringSplitter lines(buf, rsize, '\n'); lines.Next();) {
-    base::StringSplitter words(&lines, ' ');
-    if (!words.Next())
-      continue;
-    auto it = vmstat_counters_.find(words.cur_token());
-    if (it == vmstat_counters_.end())
+  const char* buf = static_cast<char*>(read_buf_.Get());
+  const char* buf_end = buf + rsize - 1;  // Exclude the null terminator.
+  for (const char* line = buf; line < buf_end;) {
+    const char* eol = FindLineEnd(line, buf_end);
+    const char* p = line;
+    line = eol + 1;
+    int counter_id = vmstat_counters_.Find(NextToken(&p, eol));
+    if (counter_id == PerfectHashTable::kNotFound)
       continue;
-    int counter_id = it->second;
-    if (!words.Next())
+    base::StringView value = NextToken(&p, eol);
+    if (value.empty())
       continue;
-    auto value = static_cast<uint64_t>(strtoll(words.cur_token(), nullptr, 10));
     auto* vmstat = sys_stats->add_vmstat();
     vmstat->set_key(static_cast<protos::pbzero::VmstatCounters>(counter_id));
-    vmstat->set_value(value);
+    vmstat->set_value(ParseNumber(value));
   }
 }
 
@@ -420,20 +472,26 @@ void SysStatsDataSource::ReadStat(protos::pbzero::SysStats* sys_stats) {
   size_t rsize = ReadFile(&stat_fd_, "/proc/stat");
   if (!rsize)
     return;
-  char* buf = static_cast<char*>(read_buf_.Get());
-  for (base::StringSplitter lines(buf, rsize, '\n'); lines.Next();) {
-    base::StringSplitter words(&lines, ' ');
-    if (!words.Next())
+  const char* buf = static_cast<char*>(read_buf_.Get());
+  const char* buf_end = buf + rsize - 1;  // Exclude the null terminator.
+  for (const char* line = buf; line < buf_end;) {
+    const char* eol = FindLineEnd(line, buf_end);
+    const char* p = line;
+    line = eol + 1;
+    base::StringView key = NextToken(&p, eol);
+    if (key.empty())
       continue;
 
     // Per-CPU stats.
     if ((stat_enabled_fields_ & (1 << SysStatsConfig::STAT_CPU_TIMES)) &&
-        words.cur_token_size() > 3 && !strncmp(words.cur_token(), "cpu", 3)) {
-      long cpu_id = strtol(words.cur_token() + 3, nullptr, 10);
+        key.size() > 3 && key.StartsWith("cpu")) {
+      uint64_t cpu_id = ParseNumber(key.substr(3));
       std::array<uint64_t, 7> cpu_times{};
-      for (size_t i = 0; i < cpu_times.size() && words.Next(); i++) {
-        cpu_times[i] =
-            static_cast<uint64_t>(strtoll(words.cur_token(), nullptr, 10));
+      for (size_t i = 0; i < cpu_times.size(); i++) {
+        base::StringView value = NextToken(&p, eol);
+        if (value.empty())
+          break;
+        cpu_times[i] = ParseNumber(value);
       }
       auto* cpu_stat = sys_stats->add_cpu_stat();
       cpu_stat->set_cpu_id(static_cast<uint32_t>(cpu_id));
@@ -447,9 +505,12 @@ void SysStatsDataSource::ReadStat(protos::pbzero::SysStats* sys_stats) {
     }
     // IRQ counters
     else if ((stat_enabled_fields_ & (1 << SysStatsConfig::STAT_IRQ_COUNTS)) &&
-             !strcmp(words.cur_token(), "intr")) {
-      for (size_t i = 0; words.Next(); i++) {
-        auto v = static_cast<uint64_t>(strtoll(words.cur_token(), nullptr, 10));
+             key == "intr") {
+      for (size_t i = 0;; i++) {
+        base::StringView value = NextToken(&p, eol);
+        if (value.empty())
+          break;
+        uint64_t v = ParseNumber(value);
         if (i == 0) {
           sys_stats->set_num_irq_total(v);
         } else if (v > 0) {
@@ -462,9 +523,12 @@ void SysStatsDataSource::ReadStat(protos::pbzero::SysStats* sys_stats) {
     // Softirq counters.
     else if ((stat_enabled_fields_ &
               (1 << SysStatsConfig::STAT_SOFTIRQ_COUNTS)) &&
-             !strcmp(words.cur_token(), "softirq")) {
-      for (size_t i = 0; words.Next(); i++) {
-        auto v = static_cast<uint64_t>(strtoll(words.cur_token(), nullptr, 10));
+             key == "softirq") {
+      for (size_t i = 0;; i++) {
+        base::StringView value = NextToken(&p, eol);
+        if (value.empty())
+          break;
+        uint64_t v = ParseNumber(value);
         if (i == 0) {
           sys_stats->set_num_softirq_total(v);
         } else {
@@ -476,11 +540,10 @@ void SysStatsDataSource::ReadStat(protos::pbzero::SysStats* sys_stats) {
     }
     // Number of forked processes since boot.
     else if ((stat_enabled_fields_ & (1 << SysStatsConfig::STAT_FORK_COUNT)) &&
-             !strcmp(words.cur_token(), "processes")) {
-      if (words.Next()) {
-        sys_stats->set_num_forks(
-            static_cast<uint64_t>(strtoll(words.cur_token(), nullptr, 10)));
-      }
+             key == "processes") {
+      base::StringView value = NextToken(&p, eol);
+      if (!value.empty())
+        sys_stats->set_num_forks(ParseNumber(value));
     }
 
   }  // for (line)
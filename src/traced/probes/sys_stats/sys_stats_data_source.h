@@ -17,8 +17,6 @@
 #ifndef SRC_TRACED_PROBES_SYS_STATS_SYS_STATS_DATA_SOURCE_H_
 #define SRC_TRACED_PROBES_SYS_STATS_SYS_STATS_DATA_SOURCE_H_
 
-#include <string.h>
-
 #include <map>
 #include <memory>
 #include <string>
@@ -31,6 +29,7 @@
 #include "perfetto/tracing/core/data_source_config.h"
 #include "src/traced/probes/common/cpu_freq_info.h"
 #include "src/traced/probes/probes_data_source.h"
+#include "src/traced/probes/sys_stats/perfect_hash_table.h"
 
 namespace perfetto {
 
@@ -65,18 +64,13 @@ class SysStatsDataSource : public ProbesDataSource {
 
   void set_ns_per_user_hz_for_testing(uint64_t ns) { ns_per_user_hz_ = ns; }
   uint32_t tick_for_testing() const { return tick_; }
+  void ReadSysStatsForTesting() { ReadSysStats(); }
 
   // Virtual for testing
   virtual base::ScopedDir OpenDevfreqDir();
   virtual const char* ReadDevfreqCurFreq(const std::string& name);
 
  private:
-  struct CStrCmp {
-    bool operator()(const char* a, const char* b) const {
-      return strcmp(a, b) < 0;
-    }
-  };
-
   static void Tick(base::WeakPtr<SysStatsDataSource>);
 
   SysStatsDataSource(const SysStatsDataSource&) = delete;
@@ -100,8 +94,10 @@ class SysStatsDataSource : public ProbesDataSource {
   base::ScopedFile diskstat_fd_;
   base::PagedMemory read_buf_;
   TraceWriter::TracePacketHandle cur_packet_;
-  std::map<const char*, int, CStrCmp> meminfo_counters_;
-  std::map<const char*, int, CStrCmp> vmstat_counters_;
+  PerfectHashTable meminfo_counters_;
+  PerfectHashTable vmstat_counters_;
+  // Keyed by devfreq device name, see ReadDevfreqCurFreq().
+  std::map<std::string, base::ScopedFile> devfreq_fds_;
   uint64_t ns_per_user_hz_ = 0;
   uint32_t tick_ = 0;
   uint32_t tick_period_ms_ = 0;
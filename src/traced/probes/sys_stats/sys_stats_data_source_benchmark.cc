@@ -0,0 +1,271 @@
+// Copyright (C) 2023 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <benchmark/benchmark.h>
+
+#include <string.h>
+#include <unistd.h>
+
+#include <array>
+#include <map>
+#include <memory>
+#include <string>
+
+#include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/paged_memory.h"
+#include "perfetto/ext/base/string_splitter.h"
+#include "perfetto/ext/base/string_utils.h"
+#include "perfetto/ext/traced/sys_stats_counters.h"
+#include "perfetto/tracing/core/data_source_config.h"
+#include "src/base/test/test_task_runner.h"
+#include "src/base/test/tmp_dir_tree.h"
+#include "src/traced/probes/sys_stats/sys_stats_data_source.h"
+#include "src/tracing/core/null_trace_writer.h"
+
+#include "protos/perfetto/config/sys_stats/sys_stats_config.gen.h"
+#include "protos/perfetto/trace/sys_stats/sys_stats.pbzero.h"
+#include "protos/perfetto/trace/trace_packet.pbzero.h"
+
+namespace perfetto {
+namespace {
+
+constexpr size_t kReadBufSize = 1024 * 16;
+
+// A fake /proc with meminfo, vmstat and stat files of a machine with
+// |num_cpus| CPUs.
+class SyntheticProc {
+ public:
+  explicit SyntheticProc(int num_cpus) {
+    std::string meminfo;
+    for (const KeyAndId& key : kMeminfoKeys) {
+      base::StackString<128> line("%-16s%10d kB\n",
+                                  (std::string(key.str) + ":").c_str(),
+                                  key.id * 1000);
+      meminfo += line.ToStdString();
+    }
+    tree_.AddFile("meminfo", meminfo);
+
+    std::string vmstat;
+    for (const KeyAndId& key : kVmstatKeys)
+      vmstat += std::string(key.str) + " " + std::to_string(key.id * 7) + "\n";
+    tree_.AddFile("vmstat", vmstat);
+
+    std::string stat = "cpu  1000 20 3000 400000 500 0 600 0 0 0\n";
+    for (int cpu = 0; cpu < num_cpus; cpu++) {
+      stat += "cpu" + std::to_string(cpu) +
+              " 278720 34689 141048 18117 1 20782 5873 0 0 0\n";
+    }
+    stat += "intr 238128517";
+    for (int irq = 0; irq < 512; irq++)
+      stat += irq % 5 ? " 0" : " 1234";
+    stat += "\nctxt 373122860\nbtime 1536912218\nprocesses 243320\n";
+    stat += "procs_running 1\nprocs_blocked 0\n";
+    stat += "softirq 84611084 10220177 28299167 155083 3035679 6390543 66234 "
+            "4396819 15604187 0 16443195\n";
+    tree_.AddFile("stat", stat);
+  }
+
+  std::string FilePath(const char* proc_path) const {
+    return tree_.AbsolutePath(proc_path + strlen("/proc/"));
+  }
+
+ private:
+  base::TmpDirTree tree_;
+};
+
+const SyntheticProc* g_proc = nullptr;
+
+base::ScopedFile OpenSyntheticProcFile(const char* path) {
+  if (strncmp(path, "/proc/", 6) != 0 || !g_proc)
+    return base::ScopedFile();
+  return base::OpenFile(g_proc->FilePath(path), O_RDONLY);
+}
+
+DataSourceConfig GetConfig() {
+  protos::gen::SysStatsConfig cfg;
+  cfg.set_meminfo_period_ms(10);
+  cfg.set_vmstat_period_ms(10);
+  cfg.set_stat_period_ms(10);
+  DataSourceConfig ds_config;
+  ds_config.set_sys_stats_config_raw(cfg.SerializeAsString());
+  return ds_config;
+}
+
+void BM_SysStatsTick(benchmark::State& state) {
+  SyntheticProc proc(static_cast<int>(state.range(0)));
+  g_proc = &proc;
+  base::TestTaskRunner task_runner;
+  SysStatsDataSource data_source(
+      &task_runner, /*session_id=*/0,
+      std::unique_ptr<TraceWriter>(new NullTraceWriter()), GetConfig(),
+      /*cpu_freq_info=*/nullptr, OpenSyntheticProcFile);
+
+  for (auto _ : state) {
+    data_source.ReadSysStatsForTesting();
+  }
+  g_proc = nullptr;
+}
+
+// The parsing used by SysStatsDataSource before the perfect hash lookup and
+// the in-place scanning: base::StringSplitter over the buffer, a std::map
+// lookup of the keys and strtoll() for the values. Kept here as a baseline.
+class LegacySysStatsReader {
+ public:
+  explicit LegacySysStatsReader(const SyntheticProc& proc)
+      : meminfo_fd_(base::OpenFile(proc.FilePath("/proc/meminfo"), O_RDONLY)),
+        vmstat_fd_(base::OpenFile(proc.FilePath("/proc/vmstat"), O_RDONLY)),
+        stat_fd_(base::OpenFile(proc.FilePath("/proc/stat"), O_RDONLY)),
+        read_buf_(base::PagedMemory::Allocate(kReadBufSize)) {
+    for (const KeyAndId& key : kMeminfoKeys)
+      meminfo_counters_.emplace(key.str, key.id);
+    for (const KeyAndId& key : kVmstatKeys)
+      vmstat_counters_.emplace(key.str, key.id);
+  }
+
+  void ReadSysStats() {
+    auto packet = writer_.NewTracePacket();
+    auto* sys_stats = packet->set_sys_stats();
+    ReadKeyValueFile(*meminfo_fd_, /*strip_colon=*/true, meminfo_counters_,
+                     [sys_stats](int id, uint64_t value) {
+                       auto* meminfo = sys_stats->add_meminfo();
+                       meminfo->set_key(
+                           static_cast<protos::pbzero::MeminfoCounters>(id));
+                       meminfo->set_value(value);
+                     });
+    ReadKeyValueFile(*vmstat_fd_, /*strip_colon=*/false, vmstat_counters_,
+                     [sys_stats](int id, uint64_t value) {
+                       auto* vmstat = sys_stats->add_vmstat();
+                       vmstat->set_key(
+                           static_cast<protos::pbzero::VmstatCounters>(id));
+                       vmstat->set_value(value);
+                     });
+    ReadStat(sys_stats);
+  }
+
+ private:
+  struct CStrCmp {
+    bool operator()(const char* a, const char* b) const {
+      return strcmp(a, b) < 0;
+    }
+  };
+  using CounterMap = std::map<const char*, int, CStrCmp>;
+
+  size_t ReadFile(int fd) {
+    ssize_t res = pread(fd, read_buf_.Get(), kReadBufSize - 1, 0);
+    PERFETTO_CHECK(res > 0);
+    static_cast<char*>(read_buf_.Get())[res] = '\0';
+    return static_cast<size_t>(res) + 1;
+  }
+
+  template <typename Fn>
+  void ReadKeyValueFile(int fd,
+                        bool strip_colon,
+                        const CounterMap& counters,
+                        Fn fn) {
+    size_t rsize = ReadFile(fd);
+    char* buf = static_cast<char*>(read_buf_.Get());
+    for (base::StringSplitter lines(buf, rsize, '\n'); lines.Next();) {
+      base::StringSplitter words(&lines, ' ');
+      if (!words.Next())
+        continue;
+      if (strip_colon)
+        words.cur_token()[words.cur_token_size() - 1] = '\0';
+      auto it = counters.find(words.cur_token());
+      if (it == counters.end() || !words.Next())
+        continue;
+      fn(it->second,
+         static_cast<uint64_t>(strtoll(words.cur_token(), nullptr, 10)));
+    }
+  }
+
+  void ReadStat(protos::pbzero::SysStats* sys_stats) {
+    size_t rsize = ReadFile(*stat_fd_);
+    char* buf = static_cast<char*>(read_buf_.Get());
+    for (base::StringSplitter lines(buf, rsize, '\n'); lines.Next();) {
+      base::StringSplitter words(&lines, ' ');
+      if (!words.Next())
+        continue;
+      if (words.cur_token_size() > 3 && !strncmp(words.cur_token(), "cpu", 3)) {
+        long cpu_id = strtol(words.cur_token() + 3, nullptr, 10);
+        std::array<uint64_t, 7> cpu_times{};
+        for (size_t i = 0; i < cpu_times.size() && words.Next(); i++) {
+          cpu_times[i] =
+              static_cast<uint64_t>(strtoll(words.cur_token(), nullptr, 10));
+        }
+        auto* cpu_stat = sys_stats->add_cpu_stat();
+        cpu_stat->set_cpu_id(static_cast<uint32_t>(cpu_id));
+        cpu_stat->set_user_ns(cpu_times[0]);
+        cpu_stat->set_user_ice_ns(cpu_times[1]);
+        cpu_stat->set_system_mode_ns(cpu_times[2]);
+        cpu_stat->set_idle_ns(cpu_times[3]);
+        cpu_stat->set_io_wait_ns(cpu_times[4]);
+        cpu_stat->set_irq_ns(cpu_times[5]);
+        cpu_stat->set_softirq_ns(cpu_times[6]);
+      } else if (!strcmp(words.cur_token(), "intr")) {
+        for (size_t i = 0; words.Next(); i++) {
+          auto v =
+              static_cast<uint64_t>(strtoll(words.cur_token(), nullptr, 10));
+          if (i == 0) {
+            sys_stats->set_num_irq_total(v);
+          } else if (v > 0) {
+            auto* irq_stat = sys_stats->add_num_irq();
+            irq_stat->set_irq(static_cast<int32_t>(i - 1));
+            irq_stat->set_count(v);
+          }
+        }
+      } else if (!strcmp(words.cur_token(), "softirq")) {
+        for (size_t i = 0; words.Next(); i++) {
+          auto v =
+              static_cast<uint64_t>(strtoll(words.cur_token(), nullptr, 10));
+          if (i == 0) {
+            sys_stats->set_num_softirq_total(v);
+          } else {
+            auto* softirq_stat = sys_stats->add_num_softirq();
+            softirq_stat->set_irq(static_cast<int32_t>(i - 1));
+            softirq_stat->set_count(v);
+          }
+        }
+      } else if (!strcmp(words.cur_token(), "processes")) {
+        if (words.Next()) {
+          sys_stats->set_num_forks(
+              static_cast<uint64_t>(strtoll(words.cur_token(), nullptr, 10)));
+        }
+      }
+    }
+  }
+
+  base::ScopedFile meminfo_fd_;
+  base::ScopedFile vmstat_fd_;
+  base::ScopedFile stat_fd_;
+  base::PagedMemory read_buf_;
+  CounterMap meminfo_counters_;
+  CounterMap vmstat_counters_;
+  NullTraceWriter writer_;
+};
+
+void BM_SysStatsTickLegacy(benchmark::State& state) {
+  SyntheticProc proc(static_cast<int>(state.range(0)));
+  LegacySysStatsReader reader(proc);
+
+  for (auto _ : state) {
+    reader.ReadSysStats();
+  }
+}
+
+BENCHMARK(BM_SysStatsTick)->Arg(8)->Arg(64)->Arg(128);
+BENCHMARK(BM_SysStatsTickLegacy)->Arg(8)->Arg(64)->Arg(128);
+
+}  // namespace
+}  // namespace perfetto
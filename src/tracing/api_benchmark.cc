@@ -12,6 +12,9 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <string>
+#include <vector>
+
 #include <benchmark/benchmark.h>
 
 #include "perfetto/tracing.h"
@@ -20,7 +23,10 @@
 #include "protos/perfetto/trace/trace_packet.pbzero.h"
 #include "protos/perfetto/trace/track_event/log_message.pbzero.h"
 
-PERFETTO_DEFINE_CATEGORIES(perfetto::Category("benchmark"));
+PERFETTO_DEFINE_CATEGORIES(
+    perfetto::Category("benchmark"),
+    perfetto::Category("benchmark2"),
+    perfetto::Category::Group("benchmark,benchmark2"));
 PERFETTO_TRACK_EVENT_STATIC_STORAGE();
 
 namespace {
@@ -139,6 +145,36 @@ static void BM_TracingTrackEventBasic(benchmark::State& state) {
   PERFETTO_CHECK(!tracing_session->ReadTraceBlocking().empty());
 }
 
+// Events in a category group carry one category iid per group member, all of
+// which are part of the pre-serialized event prefix.
+static void BM_TracingTrackEventCategoryGroup(benchmark::State& state) {
+  auto tracing_session = StartTracing("track_event");
+
+  while (state.KeepRunning()) {
+    TRACE_EVENT_BEGIN("benchmark,benchmark2", "Event");
+    benchmark::ClobberMemory();
+  }
+
+  tracing_session->StopBlocking();
+  PERFETTO_CHECK(!tracing_session->ReadTraceBlocking().empty());
+}
+
+// Alternates between event types, so that each event needs a different
+// pre-serialized prefix.
+static void BM_TracingTrackEventMixedTypes(benchmark::State& state) {
+  auto tracing_session = StartTracing("track_event");
+
+  while (state.KeepRunning()) {
+    TRACE_EVENT_BEGIN("benchmark", "Event");
+    TRACE_EVENT_INSTANT("benchmark2", "Instant");
+    TRACE_EVENT_END("benchmark");
+    benchmark::ClobberMemory();
+  }
+
+  tracing_session->StopBlocking();
+  PERFETTO_CHECK(!tracing_session->ReadTraceBlocking().empty());
+}
+
 static void BM_TracingTrackEventDebugAnnotations(benchmark::State& state) {
   auto tracing_session = StartTracing("track_event");
 
@@ -167,12 +203,40 @@ static void BM_TracingTrackEventLambda(benchmark::State& state) {
   PERFETTO_CHECK(!tracing_session->ReadTraceBlocking().empty());
 }
 
+// Emits events whose names are picked among `state.range(0)` distinct strings
+// that are built at runtime but live for the whole session (e.g. names coming
+// from a table loaded at startup). This stresses the event name interning
+// index, which has to hold one entry per distinct name.
+static void BM_TracingTrackEventHighCardinalityNames(benchmark::State& state) {
+  auto tracing_session = StartTracing("track_event");
+
+  const size_t kNumNames = static_cast<size_t>(state.range(0));
+  std::vector<std::string> names;
+  for (size_t i = 0; i < kNumNames; i++)
+    names.push_back("Event" + std::to_string(i));
+
+  // Walk the names with a stride co-prime with their count, so that
+  // consecutive events don't hit neighbouring entries.
+  size_t i = 0;
+  for (auto _ : state) {
+    TRACE_EVENT_BEGIN("benchmark", perfetto::StaticString{names[i].c_str()});
+    i = (i + 7919) % kNumNames;
+    benchmark::ClobberMemory();
+  }
+
+  tracing_session->StopBlocking();
+  PERFETTO_CHECK(!tracing_session->ReadTraceBlocking().empty());
+}
+
 }  // namespace
 
 BENCHMARK(BM_TracingDataSourceDisabled);
 BENCHMARK(BM_TracingDataSourceLambda);
 BENCHMARK(BM_TracingDataSourceLambdaDifferentPacketSize)->Range(1, 1000);
 BENCHMARK(BM_TracingTrackEventBasic);
+BENCHMARK(BM_TracingTrackEventCategoryGroup);
+BENCHMARK(BM_TracingTrackEventMixedTypes);
 BENCHMARK(BM_TracingTrackEventDebugAnnotations);
 BENCHMARK(BM_TracingTrackEventDisabled);
 BENCHMARK(BM_TracingTrackEventLambda);
+BENCHMARK(BM_TracingTrackEventHighCardinalityNames)->Range(16, 16 << 10);
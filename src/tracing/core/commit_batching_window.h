@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACING_CORE_COMMIT_BATCHING_WINDOW_H_
+#define SRC_TRACING_CORE_COMMIT_BATCHING_WINDOW_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+
+namespace perfetto {
+
+// Computes the duration of the commit batching period used by the
+// SharedMemoryArbiter. With a static duration (the default, |max_ms| <=
+// |min_ms|) this always returns |min_ms|.
+// When adaptive batching is enabled, the window starts at |min_ms| and:
+// - Doubles (up to |max_ms|) after a period that committed at least
+//   |kWidenThresholdChunks|: the producer is busy, coalescing more chunks in
+//   a single CommitData IPC saves service wakeups.
+// - Halves (down to |min_ms|) after a period that committed at most
+//   |kShrinkThresholdChunks|, or that had to be flushed early because the SMB
+//   was filling up: the producer is idle (latency matters more than IPC
+//   count) or the window is too long for the SMB size.
+// This class is not thread-safe, the arbiter accesses it under its lock.
+class CommitBatchingWindow {
+ public:
+  static constexpr size_t kWidenThresholdChunks = 16;
+  static constexpr size_t kShrinkThresholdChunks = 2;
+
+  void Configure(uint32_t min_ms, uint32_t max_ms) {
+    min_ms_ = min_ms;
+    max_ms_ = std::max(min_ms, max_ms);
+    current_ms_ = std::min(std::max(current_ms_, min_ms_), max_ms_);
+  }
+
+  // Called when a batching period ends. |chunks| is the number of chunks that
+  // have been committed during the period. |flushed_early| is true if the
+  // period was interrupted by an immediate flush due to SMB pressure.
+  void OnPeriodEnded(size_t chunks, bool flushed_early) {
+    if (!is_adaptive())
+      return;
+    if (flushed_early || chunks <= kShrinkThresholdChunks) {
+      current_ms_ = std::max(min_ms_, current_ms_ / 2);
+    } else if (chunks >= kWidenThresholdChunks) {
+      uint64_t widened = current_ms_ ? uint64_t{current_ms_} * 2 : 1;
+      current_ms_ = static_cast<uint32_t>(std::min<uint64_t>(max_ms_, widened));
+    }
+  }
+
+  bool is_adaptive() const { return max_ms_ > min_ms_; }
+  uint32_t current_ms() const { return current_ms_; }
+  uint32_t min_ms() const { return min_ms_; }
+  uint32_t max_ms() const { return max_ms_; }
+
+ private:
+  uint32_t min_ms_ = 0;
+  uint32_t max_ms_ = 0;
+  uint32_t current_ms_ = 0;
+};
+
+}  // namespace perfetto
+
+#endif  // SRC_TRACING_CORE_COMMIT_BATCHING_WINDOW_H_
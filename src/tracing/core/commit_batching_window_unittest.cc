@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/tracing/core/commit_batching_window.h"
+
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace {
+
+constexpr size_t kBusy = CommitBatchingWindow::kWidenThresholdChunks;
+constexpr size_t kIdle = CommitBatchingWindow::kShrinkThresholdChunks;
+
+TEST(CommitBatchingWindowTest, StaticByDefault) {
+  CommitBatchingWindow w;
+  EXPECT_FALSE(w.is_adaptive());
+  EXPECT_EQ(w.current_ms(), 0u);
+  w.OnPeriodEnded(kBusy * 10, false);
+  EXPECT_EQ(w.current_ms(), 0u);
+
+  w.Configure(5, 0);
+  EXPECT_FALSE(w.is_adaptive());
+  EXPECT_EQ(w.current_ms(), 5u);
+  w.OnPeriodEnded(kBusy * 10, false);
+  EXPECT_EQ(w.current_ms(), 5u);
+}
+
+TEST(CommitBatchingWindowTest, WidensUnderLoad) {
+  CommitBatchingWindow w;
+  w.Configure(0, 10);
+  EXPECT_TRUE(w.is_adaptive());
+  EXPECT_EQ(w.current_ms(), 0u);
+  w.OnPeriodEnded(kBusy, false);
+  EXPECT_EQ(w.current_ms(), 1u);
+  w.OnPeriodEnded(kBusy, false);
+  EXPECT_EQ(w.current_ms(), 2u);
+  w.OnPeriodEnded(kBusy, false);
+  EXPECT_EQ(w.current_ms(), 4u);
+  w.OnPeriodEnded(kBusy, false);
+  EXPECT_EQ(w.current_ms(), 8u);
+  w.OnPeriodEnded(kBusy, false);
+  EXPECT_EQ(w.current_ms(), 10u);
+  w.OnPeriodEnded(kBusy, false);
+  EXPECT_EQ(w.current_ms(), 10u);
+
+  // A moderate load keeps the window stable.
+  w.OnPeriodEnded(kIdle + 1, false);
+  EXPECT_EQ(w.current_ms(), 10u);
+}
+
+TEST(CommitBatchingWindowTest, ShrinksWhenIdle) {
+  CommitBatchingWindow w;
+  w.Configure(2, 16);
+  EXPECT_EQ(w.current_ms(), 2u);
+  for (int i = 0; i < 4; i++)
+    w.OnPeriodEnded(kBusy, false);
+  EXPECT_EQ(w.current_ms(), 16u);
+
+  w.OnPeriodEnded(kIdle, false);
+  EXPECT_EQ(w.current_ms(), 8u);
+  w.OnPeriodEnded(0, false);
+  EXPECT_EQ(w.current_ms(), 4u);
+  w.OnPeriodEnded(0, false);
+  EXPECT_EQ(w.current_ms(), 2u);
+  w.OnPeriodEnded(0, false);
+  EXPECT_EQ(w.current_ms(), 2u);
+}
+
+TEST(CommitBatchingWindowTest, ShrinksOnEarlyFlush) {
+  CommitBatchingWindow w;
+  w.Configure(0, 8);
+  for (int i = 0; i < 4; i++)
+    w.OnPeriodEnded(kBusy, false);
+  EXPECT_EQ(w.current_ms(), 8u);
+
+  // The SMB filled up before the end of the period: even if many chunks were
+  // committed, the window is too long.
+  w.OnPeriodEnded(kBusy * 10, true);
+  EXPECT_EQ(w.current_ms(), 4u);
+}
+
+TEST(CommitBatchingWindowTest, Reconfigure) {
+  CommitBatchingWindow w;
+  w.Configure(0, 64);
+  for (int i = 0; i < 10; i++)
+    w.OnPeriodEnded(kBusy, false);
+  EXPECT_EQ(w.current_ms(), 64u);
+
+  // Lowering the max clamps the current window.
+  w.Configure(0, 16);
+  EXPECT_EQ(w.current_ms(), 16u);
+
+  // Raising the min clamps the current window too.
+  w.Configure(32, 64);
+  EXPECT_EQ(w.current_ms(), 32u);
+
+  // Disabling adaptive batching goes back to the static duration.
+  w.Configure(1, 0);
+  EXPECT_FALSE(w.is_adaptive());
+  EXPECT_EQ(w.current_ms(), 1u);
+}
+
+TEST(CommitBatchingWindowTest, NoOverflow) {
+  CommitBatchingWindow w;
+  w.Configure(0, UINT32_MAX);
+  for (int i = 0; i < 40; i++)
+    w.OnPeriodEnded(kBusy, false);
+  EXPECT_EQ(w.current_ms(), UINT32_MAX);
+}
+
+}  // namespace
+}  // namespace perfetto
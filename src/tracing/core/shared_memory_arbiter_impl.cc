@@ -252,6 +252,9 @@ void SharedMemoryArbiterImpl::UpdateCommitDataRequest(
   base::TaskRunner* task_runner_to_post_delayed_callback_on = nullptr;
   // The delay with which the flush will be posted.
   uint32_t flush_delay_ms = 0;
+  // Whether the posted flush is the one that ends the batching period started
+  // by this call. Immediate flushes within a period don't end it.
+  bool ends_batching_period = false;
   base::WeakPtr<SharedMemoryArbiterImpl> weak_this;
   {
     std::lock_guard<std::mutex> scoped_lock(lock_);
@@ -264,8 +267,9 @@ void SharedMemoryArbiterImpl::UpdateCommitDataRequest(
       if (fully_bound_ && !delayed_flush_scheduled_) {
         weak_this = weak_ptr_factory_.GetWeakPtr();
         task_runner_to_post_delayed_callback_on = task_runner_;
-        flush_delay_ms = batch_commits_duration_ms_;
+        flush_delay_ms = batching_window_.current_ms();
         delayed_flush_scheduled_ = true;
+        ends_batching_period = true;
       }
     }
 
@@ -274,6 +278,7 @@ void SharedMemoryArbiterImpl::UpdateCommitDataRequest(
       PERFETTO_DCHECK(chunk.writer_id() == writer_id);
       uint8_t chunk_idx = chunk.chunk_idx();
       bytes_pending_commit_ += chunk.size();
+      ++chunks_in_batching_period_;
       size_t page_idx;
       // If the chunk needs patching, it should not be marked as complete yet,
       // because this would indicate to the service that the producer will not
@@ -358,6 +363,8 @@ void SharedMemoryArbiterImpl::UpdateCommitDataRequest(
     // trace.
     if (fully_bound_ &&
         (last_patch_req || bytes_pending_commit_ >= shmem_abi_.size() / 2)) {
+      if (!last_patch_req)
+        batching_period_flushed_early_ = true;
       weak_this = weak_ptr_factory_.GetWeakPtr();
       task_runner_to_post_delayed_callback_on = task_runner_;
       flush_delay_ms = 0;
@@ -369,14 +376,15 @@ void SharedMemoryArbiterImpl::UpdateCommitDataRequest(
   // because |task_runner_| is never reset.
   if (task_runner_to_post_delayed_callback_on) {
     task_runner_to_post_delayed_callback_on->PostDelayedTask(
-        [weak_this] {
+        [weak_this, ends_batching_period] {
           if (!weak_this)
             return;
-          {
+          if (ends_batching_period) {
             std::lock_guard<std::mutex> scoped_lock(weak_this->lock_);
             // Clear |delayed_flush_scheduled_|, allowing the next call to
             // UpdateCommitDataRequest to start another batching period.
             weak_this->delayed_flush_scheduled_ = false;
+            weak_this->OnBatchingPeriodEndedLocked();
           }
           weak_this->FlushPendingCommitDataRequests();
         },
@@ -454,10 +462,27 @@ bool SharedMemoryArbiterImpl::TryDirectPatchLocked(
   return true;
 }
 
+void SharedMemoryArbiterImpl::OnBatchingPeriodEndedLocked() {
+  batching_window_.OnPeriodEnded(chunks_in_batching_period_,
+                                 batching_period_flushed_early_);
+  chunks_in_batching_period_ = 0;
+  batching_period_flushed_early_ = false;
+}
+
 void SharedMemoryArbiterImpl::SetBatchCommitsDuration(
     uint32_t batch_commits_duration_ms) {
   std::lock_guard<std::mutex> scoped_lock(lock_);
   batch_commits_duration_ms_ = batch_commits_duration_ms;
+  batching_window_.Configure(batch_commits_duration_ms_,
+                             max_batch_commits_duration_ms_);
+}
+
+void SharedMemoryArbiterImpl::SetMaxBatchCommitsDuration(
+    uint32_t max_batch_commits_duration_ms) {
+  std::lock_guard<std::mutex> scoped_lock(lock_);
+  max_batch_commits_duration_ms_ = max_batch_commits_duration_ms;
+  batching_window_.Configure(batch_commits_duration_ms_,
+                             max_batch_commits_duration_ms_);
 }
 
 bool SharedMemoryArbiterImpl::EnableDirectSMBPatching() {
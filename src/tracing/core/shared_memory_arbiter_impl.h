@@ -30,6 +30,7 @@
 #include "perfetto/ext/tracing/core/shared_memory_abi.h"
 #include "perfetto/ext/tracing/core/shared_memory_arbiter.h"
 #include "perfetto/tracing/core/forward_decls.h"
+#include "src/tracing/core/commit_batching_window.h"
 #include "src/tracing/core/id_allocator.h"
 
 namespace perfetto {
@@ -168,6 +169,9 @@ class SharedMemoryArbiterImpl : public SharedMemoryArbiter {
 
   void SetBatchCommitsDuration(uint32_t batch_commits_duration_ms) override;
 
+  void SetMaxBatchCommitsDuration(
+      uint32_t max_batch_commits_duration_ms) override;
+
   bool EnableDirectSMBPatching() override;
 
   void SetDirectSMBPatchingSupportedByService() override;
@@ -245,6 +249,10 @@ class SharedMemoryArbiterImpl : public SharedMemoryArbiter {
   // state.
   bool UpdateFullyBoundLocked();
 
+  // Feeds the stats of the batching period that just ended into
+  // |batching_window_| and resets them.
+  void OnBatchingPeriodEndedLocked();
+
   // Only accessed on |task_runner_| after the producer endpoint was bound.
   TracingService::ProducerEndpoint* producer_endpoint_ = nullptr;
 
@@ -285,6 +293,20 @@ class SharedMemoryArbiterImpl : public SharedMemoryArbiter {
   // See SharedMemoryArbiter::SetBatchCommitsDuration.
   uint32_t batch_commits_duration_ms_ = 0;
 
+  // See SharedMemoryArbiter::SetMaxBatchCommitsDuration.
+  uint32_t max_batch_commits_duration_ms_ = 0;
+
+  // Computes the duration of the next batching period from
+  // |batch_commits_duration_ms_| and |max_batch_commits_duration_ms_|.
+  CommitBatchingWindow batching_window_;
+
+  // Number of chunks committed since the current batching period started.
+  size_t chunks_in_batching_period_ = 0;
+
+  // Whether the current batching period has been cut short by an immediate
+  // flush because |bytes_pending_commit_| exceeded half of the SMB.
+  bool batching_period_flushed_early_ = false;
+
   // See SharedMemoryArbiter::EnableDirectSMBPatching.
   bool direct_patching_enabled_ = false;
 
@@ -0,0 +1,130 @@
+// Copyright (C) 2023 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <atomic>
+
+#include <benchmark/benchmark.h>
+
+#include "perfetto/ext/base/paged_memory.h"
+#include "perfetto/ext/base/thread_task_runner.h"
+#include "perfetto/ext/tracing/core/commit_data_request.h"
+#include "perfetto/ext/tracing/core/tracing_service.h"
+#include "src/tracing/core/patch_list.h"
+#include "src/tracing/core/shared_memory_arbiter_impl.h"
+
+namespace perfetto {
+namespace {
+
+constexpr size_t kPageSize = 4096;
+constexpr size_t kNumPages = 256;
+
+// Pretends to be the service: every CommitData() call frees the committed
+// chunks right away, so that the producer never stalls on a full SMB and the
+// benchmark measures the commit path only.
+class FakeProducerEndpoint : public TracingService::ProducerEndpoint {
+ public:
+  void set_abi(SharedMemoryABI* abi) { abi_ = abi; }
+  uint64_t num_commits() const { return num_commits_.load(); }
+
+  void CommitData(const CommitDataRequest& req,
+                  CommitDataCallback callback) override {
+    num_commits_.fetch_add(1, std::memory_order_relaxed);
+    for (const auto& ctm : req.chunks_to_move()) {
+      SharedMemoryABI::Chunk chunk =
+          abi_->TryAcquireChunkForReading(ctm.page(), ctm.chunk());
+      if (chunk.is_valid())
+        abi_->ReleaseChunkAsFree(std::move(chunk));
+    }
+    if (callback)
+      callback();
+  }
+
+  void Disconnect() override {}
+  void RegisterDataSource(const DataSourceDescriptor&) override {}
+  void UpdateDataSource(const DataSourceDescriptor&) override {}
+  void UnregisterDataSource(const std::string&) override {}
+  void RegisterTraceWriter(uint32_t, uint32_t) override {}
+  void UnregisterTraceWriter(uint32_t) override {}
+  SharedMemory* shared_memory() const override { return nullptr; }
+  size_t shared_buffer_page_size_kb() const override { return 0; }
+  std::unique_ptr<TraceWriter> CreateTraceWriter(
+      BufferID,
+      BufferExhaustedPolicy) override {
+    return nullptr;
+  }
+  SharedMemoryArbiter* MaybeSharedMemoryArbiter() override { return nullptr; }
+  bool IsShmemProvidedByProducer() const override { return false; }
+  void NotifyFlushComplete(FlushRequestID) override {}
+  void NotifyDataSourceStarted(DataSourceInstanceID) override {}
+  void NotifyDataSourceStopped(DataSourceInstanceID) override {}
+  void ActivateTriggers(const std::vector<std::string>&) override {}
+  void Sync(std::function<void()>) override {}
+
+ private:
+  SharedMemoryABI* abi_ = nullptr;
+  std::atomic<uint64_t> num_commits_{0};
+};
+
+// Args: base batching period (ms), max batching period (ms). A max of 0 means
+// static batching (the pre-existing behavior).
+static void BM_SharedMemoryArbiterCommitThroughput(benchmark::State& state) {
+  const uint32_t batch_ms = static_cast<uint32_t>(state.range(0));
+  const uint32_t max_batch_ms = static_cast<uint32_t>(state.range(1));
+
+  base::PagedMemory mem = base::PagedMemory::Allocate(kPageSize * kNumPages);
+  base::ThreadTaskRunner task_runner =
+      base::ThreadTaskRunner::CreateAndStart("bm_arbiter");
+  FakeProducerEndpoint endpoint;
+  std::unique_ptr<SharedMemoryArbiterImpl> arbiter(new SharedMemoryArbiterImpl(
+      mem.Get(), kPageSize * kNumPages, kPageSize, &endpoint,
+      task_runner.get()));
+  endpoint.set_abi(arbiter->shmem_abi_for_testing());
+  arbiter->SetBatchCommitsDuration(batch_ms);
+  arbiter->SetMaxBatchCommitsDuration(max_batch_ms);
+
+  PatchList patches;
+  SharedMemoryABI::ChunkHeader header{};
+  header.writer_id.store(1, std::memory_order_relaxed);
+  uint64_t num_chunks = 0;
+  for (auto _ : state) {
+    SharedMemoryABI::Chunk chunk =
+        arbiter->GetNewChunk(header, BufferExhaustedPolicy::kStall);
+    benchmark::DoNotOptimize(chunk.payload_begin());
+    arbiter->ReturnCompletedChunk(std::move(chunk), /*target_buffer=*/1,
+                                  &patches);
+    num_chunks++;
+  }
+
+  task_runner.PostTaskAndWaitForTesting(
+      [&arbiter] { arbiter->FlushPendingCommitDataRequests(); });
+  uint64_t num_commits = endpoint.num_commits();
+  state.SetItemsProcessed(static_cast<int64_t>(num_chunks));
+  state.counters["commits"] = benchmark::Counter(
+      static_cast<double>(num_commits), benchmark::Counter::kIsRate);
+  state.counters["chunks_per_commit"] =
+      num_commits ? static_cast<double>(num_chunks) /
+                        static_cast<double>(num_commits)
+                  : 0;
+  task_runner.PostTaskAndWaitForTesting([&arbiter] { arbiter.reset(); });
+}
+
+}  // namespace
+}  // namespace perfetto
+
+BENCHMARK(perfetto::BM_SharedMemoryArbiterCommitThroughput)
+    ->Args({0, 0})
+    ->Args({1, 0})
+    ->Args({0, 8})
+    ->Args({1, 32})
+    ->UseRealTime();
@@ -56,6 +56,10 @@ class SharedMemoryArbiterImplTest : public AlignedBufferTest {
 
   bool IsArbiterFullyBound() { return arbiter_->fully_bound_; }
 
+  uint32_t BatchingWindowMs() {
+    return arbiter_->batching_window_.current_ms();
+  }
+
   void TearDown() override {
     arbiter_.reset();
     task_runner_.reset();
@@ -207,6 +211,68 @@ TEST_P(SharedMemoryArbiterImplTest, BatchCommits) {
   arbiter_->FlushPendingCommitDataRequests();
 }
 
+// With adaptive batching enabled, an idle producer still starts from the base
+// batching period, i.e. commits are not delayed.
+TEST_P(SharedMemoryArbiterImplTest, AdaptiveBatchCommitsStartsFromBase) {
+  SharedMemoryArbiterImpl::set_default_layout_for_testing(
+      SharedMemoryABI::PageLayout::kPageDiv1);
+  arbiter_->SetMaxBatchCommitsDuration(UINT32_MAX);
+
+  PatchList ignored;
+  for (uint32_t i = 0; i < 2; i++) {
+    SharedMemoryABI::Chunk chunk =
+        arbiter_->GetNewChunk({}, BufferExhaustedPolicy::kDefault);
+    ASSERT_TRUE(chunk.is_valid());
+    EXPECT_CALL(mock_producer_endpoint_, CommitData(_, _))
+        .WillOnce(Invoke([i](const CommitDataRequest& req,
+                             MockProducerEndpoint::CommitDataCallback) {
+          ASSERT_EQ(1, req.chunks_to_move_size());
+          ASSERT_EQ(i, req.chunks_to_move()[0].page());
+        }));
+    arbiter_->ReturnCompletedChunk(std::move(chunk), 1, &ignored);
+    task_runner_->RunUntilIdle();
+    ASSERT_TRUE(Mock::VerifyAndClearExpectations(&mock_producer_endpoint_));
+  }
+}
+
+// An immediate flush (e.g. for a patch) within a batching period must not end
+// the period: only the delayed flush does. Otherwise the delayed flush would
+// see an empty period and shrink the window.
+TEST_P(SharedMemoryArbiterImplTest, AdaptiveBatchCommitsImmediateFlush) {
+  SharedMemoryArbiterImpl::set_default_layout_for_testing(
+      SharedMemoryABI::PageLayout::kPageDiv14);
+  arbiter_->SetMaxBatchCommitsDuration(UINT32_MAX);
+
+  // A busy period widens the window from 0 to 1 ms.
+  PatchList ignored;
+  for (size_t i = 0; i < CommitBatchingWindow::kWidenThresholdChunks; i++) {
+    SharedMemoryABI::Chunk chunk =
+        arbiter_->GetNewChunk({}, BufferExhaustedPolicy::kDefault);
+    ASSERT_TRUE(chunk.is_valid());
+    arbiter_->ReturnCompletedChunk(std::move(chunk), 1, &ignored);
+  }
+  task_runner_->RunUntilIdle();
+  ASSERT_EQ(1u, BatchingWindowMs());
+
+  // A period with a few chunks, the last of which carries a patch for a chunk
+  // that was already committed and is flushed immediately.
+  for (size_t i = 0; i <= CommitBatchingWindow::kShrinkThresholdChunks; i++) {
+    SharedMemoryABI::Chunk chunk =
+        arbiter_->GetNewChunk({}, BufferExhaustedPolicy::kDefault);
+    ASSERT_TRUE(chunk.is_valid());
+    PatchList patches;
+    if (i == CommitBatchingWindow::kShrinkThresholdChunks)
+      patches.emplace_back(0, 0)->size_field[0] = 0x42;
+    arbiter_->ReturnCompletedChunk(std::move(chunk), 1, &patches);
+  }
+
+  // Let both the immediate and the delayed flush run.
+  auto checkpoint = task_runner_->CreateCheckpoint("period_ended");
+  task_runner_->PostDelayedTask(checkpoint, 10);
+  task_runner_->RunUntilCheckpoint("period_ended");
+  EXPECT_EQ(1u, BatchingWindowMs());
+}
+
 // Check that we can actually create up to kMaxWriterID TraceWriter(s).
 TEST_P(SharedMemoryArbiterImplTest, WriterIDsAllocation) {
   auto checkpoint = task_runner_->CreateCheckpoint("last_unregistered");
@@ -315,7 +315,10 @@ ssize_t TraceBuffer::DeleteNextChunksFor(size_t bytes_to_clear) {
   TRACE_BUFFER_DLOG("Delete [%zu %zu]", wptr_ - begin(), search_end - begin());
   DcheckIsAlignedAndWithinBounds(wptr_);
   PERFETTO_DCHECK(search_end <= end());
-  std::vector<ChunkMap::iterator> index_delete;
+  // Deletions are deferred until we know that the whole range can be cleared.
+  // Keys are stored rather than iterators, as the latter are invalidated by
+  // each erase().
+  std::vector<ChunkMeta::Key> index_delete;
   uint64_t chunks_overwritten = stats_.chunks_overwritten();
   uint64_t bytes_overwritten = stats_.bytes_overwritten();
   uint64_t padding_bytes_cleared = stats_.padding_bytes_cleared();
@@ -351,7 +354,7 @@ ssize_t TraceBuffer::DeleteNextChunksFor(size_t bytes_to_clear) {
           chunks_overwritten++;
           bytes_overwritten += next_chunk.size;
         }
-        index_delete.push_back(it);
+        index_delete.push_back(key);
         will_remove = true;
       }
       TRACE_BUFFER_DLOG(
@@ -374,8 +377,8 @@ ssize_t TraceBuffer::DeleteNextChunksFor(size_t bytes_to_clear) {
   }
 
   // Remove from the index.
-  for (auto it : index_delete) {
-    index_.erase(it);
+  for (const ChunkMeta::Key& key : index_delete) {
+    index_.erase(key);
   }
   stats_.set_chunks_overwritten(chunks_overwritten);
   stats_.set_bytes_overwritten(bytes_overwritten);
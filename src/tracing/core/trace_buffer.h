@@ -34,6 +34,7 @@
 #include "perfetto/ext/tracing/core/slice.h"
 #include "perfetto/ext/tracing/core/trace_stats.h"
 #include "src/tracing/core/histogram.h"
+#include "src/tracing/core/trace_buffer_index.h"
 
 namespace perfetto {
 
@@ -113,7 +114,9 @@ class TracePacket;
 //
 // However, in order to keep some operations (patching and reading) fast, a
 // lookaside index is maintained (in |index_|), keeping each chunk in the buffer
-// indexed by their {ProducerID, WriterID, ChunkID} tuple.
+// indexed by their {ProducerID, WriterID, ChunkID} tuple. The index stores the
+// chunks of each {ProducerID, WriterID} sequence contiguously (see
+// TraceBufferIndex), as reading proceeds one sequence at a time.
 //
 // Patching data out-of-band
 // -------------------------
@@ -419,6 +422,7 @@ class TraceBuffer {
     }
 
     ChunkMeta(const ChunkMeta&) noexcept = default;
+    ChunkMeta& operator=(const ChunkMeta&) = default;
 
     bool is_complete() const { return index_flags & kComplete; }
 
@@ -442,9 +446,9 @@ class TraceBuffer {
       }
     }
 
-    const uint32_t record_off;  // Offset of ChunkRecord within |data_|.
-    const uid_t trusted_uid;    // uid of the producer.
-    const pid_t trusted_pid;    // pid of the producer.
+    uint32_t record_off;  // Offset of ChunkRecord within |data_|.
+    uid_t trusted_uid;    // uid of the producer.
+    pid_t trusted_pid;    // pid of the producer.
 
     // Flags set by TraceBuffer to track the state of the chunk in the index.
     uint8_t index_flags = 0;
@@ -465,7 +469,7 @@ class TraceBuffer {
     uint16_t cur_fragment_offset = 0;
   };
 
-  using ChunkMap = std::map<ChunkMeta::Key, ChunkMeta>;
+  using ChunkMap = TraceBufferIndex<ChunkMeta::Key, ChunkMeta>;
 
   // Allows to iterate over a sub-sequence of |index_| for all keys belonging to
   // the same {ProducerID,WriterID}. Furthermore takes into account the wrapping
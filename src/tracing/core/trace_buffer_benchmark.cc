@@ -0,0 +1,130 @@
+// Copyright (C) 2023 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "perfetto/ext/tracing/core/basic_types.h"
+#include "perfetto/ext/tracing/core/trace_packet.h"
+#include "src/tracing/core/trace_buffer.h"
+
+namespace {
+
+using perfetto::ChunkID;
+using perfetto::ProducerID;
+using perfetto::TraceBuffer;
+using perfetto::TracePacket;
+using perfetto::WriterID;
+
+// Chunks are filled with |kPacketsPerChunk| packets of |kPacketSize| bytes
+// (including the one-byte varint size preamble), which is about a 4KB page.
+constexpr size_t kPacketSize = 128;
+constexpr uint16_t kPacketsPerChunk = 31;
+constexpr size_t kBufferSize = 32 * 1024 * 1024;
+
+std::vector<uint8_t> MakeChunkPayload() {
+  std::vector<uint8_t> payload;
+  for (size_t i = 0; i < kPacketsPerChunk; i++) {
+    payload.push_back(static_cast<uint8_t>(kPacketSize - 1));
+    payload.insert(payload.end(), kPacketSize - 1, static_cast<uint8_t>(i));
+  }
+  return payload;
+}
+
+// Writes spread across |num_writers| sequences: up to 256 writers for each
+// producer.
+struct WriterSequences {
+  explicit WriterSequences(size_t num_writers) : next_chunk_id(num_writers) {}
+
+  void CopyNextChunk(TraceBuffer* buf,
+                     const std::vector<uint8_t>& payload,
+                     size_t writer_idx) {
+    ProducerID producer_id = static_cast<ProducerID>(1 + writer_idx / 256);
+    WriterID writer_id = static_cast<WriterID>(1 + writer_idx % 256);
+    buf->CopyChunkUntrusted(producer_id, /*producer_uid_trusted=*/0,
+                            /*producer_pid_trusted=*/0, writer_id,
+                            next_chunk_id[writer_idx]++, kPacketsPerChunk,
+                            /*chunk_flags=*/0, /*chunk_complete=*/true,
+                            payload.data(), payload.size());
+  }
+
+  std::vector<ChunkID> next_chunk_id;
+};
+
+static void BM_TraceBufferCopyChunk(benchmark::State& state) {
+  const size_t num_writers = static_cast<size_t>(state.range(0));
+  std::unique_ptr<TraceBuffer> buf = TraceBuffer::Create(kBufferSize);
+  std::vector<uint8_t> payload = MakeChunkPayload();
+  WriterSequences writers(num_writers);
+
+  // The buffer wraps several times during the benchmark, so this also covers
+  // the deletion of the overwritten chunks from the index.
+  size_t writer_idx = 0;
+  for (auto _ : state) {
+    writers.CopyNextChunk(buf.get(), payload, writer_idx);
+    writer_idx = (writer_idx + 1) % num_writers;
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(payload.size()));
+}
+
+static void BM_TraceBufferRead(benchmark::State& state) {
+  const size_t num_writers = static_cast<size_t>(state.range(0));
+  std::unique_ptr<TraceBuffer> src_buf = TraceBuffer::Create(kBufferSize);
+  std::vector<uint8_t> payload = MakeChunkPayload();
+  WriterSequences writers(num_writers);
+
+  // Fill the buffer (without wrapping) interleaving the writers, like
+  // concurrent producers do.
+  const size_t num_chunks = kBufferSize / (payload.size() + 64);
+  for (size_t i = 0; i < num_chunks; i++)
+    writers.CopyNextChunk(src_buf.get(), payload, i % num_writers);
+
+  uint64_t bytes_read = 0;
+  for (auto _ : state) {
+    state.PauseTiming();
+    // Reading is destructive, so read a fresh clone at every iteration.
+    std::unique_ptr<TraceBuffer> buf = src_buf->CloneReadOnly();
+    state.ResumeTiming();
+
+    buf->BeginRead();
+    TracePacket packet;
+    TraceBuffer::PacketSequenceProperties sequence_properties{};
+    bool previous_packet_dropped;
+    while (buf->ReadNextTracePacket(&packet, &sequence_properties,
+                                    &previous_packet_dropped)) {
+      bytes_read += packet.size();
+      packet = TracePacket();
+    }
+    benchmark::ClobberMemory();
+
+    state.PauseTiming();
+    buf.reset();
+    state.ResumeTiming();
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(bytes_read));
+}
+
+}  // namespace
+
+BENCHMARK(BM_TraceBufferCopyChunk)->Arg(1)->Arg(64)->Arg(1024)->Arg(4096);
+BENCHMARK(BM_TraceBufferRead)
+    ->Arg(1)
+    ->Arg(64)
+    ->Arg(1024)
+    ->Arg(4096)
+    ->Unit(benchmark::kMillisecond);
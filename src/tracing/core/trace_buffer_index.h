@@ -0,0 +1,265 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACING_CORE_TRACE_BUFFER_INDEX_H_
+#define SRC_TRACING_CORE_TRACE_BUFFER_INDEX_H_
+
+#include <stddef.h>
+
+#include <algorithm>
+#include <deque>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "perfetto/base/logging.h"
+#include "perfetto/ext/tracing/core/basic_types.h"
+
+namespace perfetto {
+
+// The lookaside index of TraceBuffer: an ordered map of
+// {ProducerID, WriterID, ChunkID} -> |Value|, with a subset of the std::map
+// interface.
+//
+// It is laid out for the access patterns of TraceBuffer rather than as a
+// balanced tree with one node per chunk:
+// - Sequences ({ProducerID, WriterID} pairs) are kept in a flat vector, sorted
+//   and binary-searched. There are at most a few thousands of them.
+// - The chunks of each sequence are stored contiguously in a deque, sorted by
+//   ChunkID. Chunks are almost always appended in ChunkID order and deleted
+//   from the oldest, so both are O(1). As ChunkIDs of a sequence are mostly
+//   consecutive, a chunk is usually found at |chunk_id - first_chunk_id|
+//   without searching.
+// Walking a sequence on the read path hence touches adjacent memory instead
+// of chasing pointers between map nodes.
+//
+// |Key| must have |producer_id|, |writer_id| and |chunk_id| fields. |Value|
+// must be copy-assignable.
+//
+// Iterators are invalidated by any insertion or deletion.
+template <typename Key, typename Value>
+class TraceBufferIndex {
+ public:
+  using value_type = std::pair<Key, Value>;
+
+  class iterator {
+   public:
+    iterator() = default;
+
+    value_type& operator*() const { return index_->At(seq_, pos_); }
+    value_type* operator->() const { return &index_->At(seq_, pos_); }
+
+    iterator& operator++() {
+      PERFETTO_DCHECK(seq_ < index_->seqs_.size());
+      if (++pos_ == index_->seqs_[seq_].chunks.size()) {
+        seq_++;
+        pos_ = 0;
+      }
+      return *this;
+    }
+
+    iterator operator++(int) {
+      iterator it = *this;
+      ++*this;
+      return it;
+    }
+
+    iterator& operator--() {
+      if (pos_ == 0) {
+        PERFETTO_DCHECK(seq_ > 0);
+        seq_--;
+        pos_ = index_->seqs_[seq_].chunks.size();
+      }
+      pos_--;
+      return *this;
+    }
+
+    iterator operator--(int) {
+      iterator it = *this;
+      --*this;
+      return it;
+    }
+
+    bool operator==(const iterator& other) const {
+      return seq_ == other.seq_ && pos_ == other.pos_;
+    }
+    bool operator!=(const iterator& other) const { return !(*this == other); }
+
+   private:
+    friend class TraceBufferIndex;
+
+    iterator(TraceBufferIndex* index, size_t seq, size_t pos)
+        : index_(index), seq_(seq), pos_(pos) {}
+
+    TraceBufferIndex* index_ = nullptr;
+    size_t seq_ = 0;  // Index in |seqs_|.
+    size_t pos_ = 0;  // Index in |seqs_[seq_].chunks|.
+  };
+
+  iterator begin() { return iterator(this, 0, 0); }
+  iterator end() { return iterator(this, seqs_.size(), 0); }
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  void clear() {
+    seqs_.clear();
+    size_ = 0;
+  }
+
+  iterator find(const Key& key) {
+    size_t seq = LowerBoundSequence(key);
+    if (seq == seqs_.size() || !SameSequence(seqs_[seq], key))
+      return end();
+    const Chunks& chunks = seqs_[seq].chunks;
+    size_t pos = LowerBoundChunk(chunks, key.chunk_id);
+    if (pos == chunks.size() || chunks[pos].first.chunk_id != key.chunk_id)
+      return end();
+    return iterator(this, seq, pos);
+  }
+
+  // Returns an iterator to the first entry whose key is >= |key|.
+  iterator lower_bound(const Key& key) {
+    size_t seq = LowerBoundSequence(key);
+    if (seq == seqs_.size() || !SameSequence(seqs_[seq], key))
+      return iterator(this, seq, 0);
+    return MakeIterator(seq, LowerBoundChunk(seqs_[seq].chunks, key.chunk_id));
+  }
+
+  // Returns an iterator to the first entry whose key is > |key|.
+  iterator upper_bound(const Key& key) {
+    size_t seq = LowerBoundSequence(key);
+    if (seq == seqs_.size() || !SameSequence(seqs_[seq], key))
+      return iterator(this, seq, 0);
+    const Chunks& chunks = seqs_[seq].chunks;
+    size_t pos = LowerBoundChunk(chunks, key.chunk_id);
+    if (pos < chunks.size() && chunks[pos].first.chunk_id == key.chunk_id)
+      pos++;
+    return MakeIterator(seq, pos);
+  }
+
+  // Inserts {key, value} unless |key| is already present. Returns an iterator
+  // to the entry for |key| and whether the insertion took place.
+  std::pair<iterator, bool> emplace(const Key& key, const Value& value) {
+    size_t seq = LowerBoundSequence(key);
+    if (seq == seqs_.size() || !SameSequence(seqs_[seq], key)) {
+      Sequence new_seq;
+      new_seq.producer_id = key.producer_id;
+      new_seq.writer_id = key.writer_id;
+      seqs_.insert(seqs_.begin() + static_cast<ptrdiff_t>(seq),
+                   std::move(new_seq));
+    }
+    Chunks& chunks = seqs_[seq].chunks;
+
+    // Fast path: chunks are appended in increasing ChunkID order.
+    size_t pos = chunks.size();
+    if (!chunks.empty() && !(chunks.back().first.chunk_id < key.chunk_id)) {
+      pos = LowerBoundChunk(chunks, key.chunk_id);
+      if (chunks[pos].first.chunk_id == key.chunk_id)
+        return std::make_pair(iterator(this, seq, pos), false);
+    }
+    chunks.insert(chunks.begin() + static_cast<ptrdiff_t>(pos),
+                  value_type(key, value));
+    size_++;
+    return std::make_pair(iterator(this, seq, pos), true);
+  }
+
+  void erase(iterator it) {
+    PERFETTO_DCHECK(it.index_ == this && it != end());
+    Chunks& chunks = seqs_[it.seq_].chunks;
+    if (it.pos_ == 0) {
+      chunks.pop_front();
+    } else if (it.pos_ == chunks.size() - 1) {
+      chunks.pop_back();
+    } else {
+      chunks.erase(chunks.begin() + static_cast<ptrdiff_t>(it.pos_));
+    }
+    if (chunks.empty())
+      seqs_.erase(seqs_.begin() + static_cast<ptrdiff_t>(it.seq_));
+    size_--;
+  }
+
+  // Returns the number of erased entries (0 or 1).
+  size_t erase(const Key& key) {
+    iterator it = find(key);
+    if (it == end())
+      return 0;
+    erase(it);
+    return 1;
+  }
+
+ private:
+  using Chunks = std::deque<value_type>;
+
+  struct Sequence {
+    ProducerID producer_id = 0;
+    WriterID writer_id = 0;
+    Chunks chunks;
+  };
+
+  static bool SameSequence(const Sequence& seq, const Key& key) {
+    return seq.producer_id == key.producer_id &&
+           seq.writer_id == key.writer_id;
+  }
+
+  value_type& At(size_t seq, size_t pos) {
+    PERFETTO_DCHECK(seq < seqs_.size() && pos < seqs_[seq].chunks.size());
+    return seqs_[seq].chunks[pos];
+  }
+
+  // Normalizes past-the-end positions within a sequence to the beginning of
+  // the next one, so that equal positions have a single representation.
+  iterator MakeIterator(size_t seq, size_t pos) {
+    if (pos == seqs_[seq].chunks.size())
+      return iterator(this, seq + 1, 0);
+    return iterator(this, seq, pos);
+  }
+
+  // Returns the index of the first sequence >= {key.producer_id,
+  // key.writer_id}.
+  size_t LowerBoundSequence(const Key& key) const {
+    auto it = std::lower_bound(
+        seqs_.begin(), seqs_.end(), key, [](const Sequence& s, const Key& k) {
+          return std::tie(s.producer_id, s.writer_id) <
+                 std::tie(k.producer_id, k.writer_id);
+        });
+    return static_cast<size_t>(it - seqs_.begin());
+  }
+
+  // Returns the index of the first chunk with an ID >= |chunk_id|.
+  static size_t LowerBoundChunk(const Chunks& chunks, ChunkID chunk_id) {
+    if (chunks.empty())
+      return 0;
+    // Fast path: ChunkIDs in a sequence are usually consecutive.
+    ChunkID first_id = chunks.front().first.chunk_id;
+    if (chunk_id >= first_id) {
+      size_t guess = static_cast<size_t>(chunk_id - first_id);
+      if (guess < chunks.size() && chunks[guess].first.chunk_id == chunk_id)
+        return guess;
+    }
+    auto it = std::lower_bound(
+        chunks.begin(), chunks.end(), chunk_id,
+        [](const value_type& c, ChunkID id) { return c.first.chunk_id < id; });
+    return static_cast<size_t>(it - chunks.begin());
+  }
+
+  std::vector<Sequence> seqs_;
+  size_t size_ = 0;
+};
+
+}  // namespace perfetto
+
+#endif  // SRC_TRACING_CORE_TRACE_BUFFER_INDEX_H_
@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2023 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/tracing/core/trace_buffer_index.h"
+
+#include <map>
+#include <random>
+#include <tuple>
+
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace {
+
+struct Key {
+  Key(ProducerID p, WriterID w, ChunkID c)
+      : producer_id(p), writer_id(w), chunk_id(c) {}
+
+  bool operator<(const Key& other) const {
+    return std::tie(producer_id, writer_id, chunk_id) <
+           std::tie(other.producer_id, other.writer_id, other.chunk_id);
+  }
+
+  bool operator==(const Key& other) const {
+    return std::tie(producer_id, writer_id, chunk_id) ==
+           std::tie(other.producer_id, other.writer_id, other.chunk_id);
+  }
+
+  ProducerID producer_id;
+  WriterID writer_id;
+  ChunkID chunk_id;
+};
+
+using Index = TraceBufferIndex<Key, int>;
+
+std::vector<Key> GetKeys(Index* index) {
+  std::vector<Key> keys;
+  for (const auto& kv : *index)
+    keys.push_back(kv.first);
+  return keys;
+}
+
+TEST(TraceBufferIndexTest, Empty) {
+  Index index;
+  EXPECT_TRUE(index.empty());
+  EXPECT_EQ(index.begin(), index.end());
+  EXPECT_EQ(index.find(Key(1, 1, 1)), index.end());
+  EXPECT_EQ(index.lower_bound(Key(1, 1, 1)), index.end());
+  EXPECT_EQ(index.upper_bound(Key(1, 1, 1)), index.end());
+  EXPECT_EQ(index.erase(Key(1, 1, 1)), 0u);
+}
+
+TEST(TraceBufferIndexTest, OrderedAcrossSequences) {
+  Index index;
+  EXPECT_TRUE(index.emplace(Key(2, 1, 0), 20).second);
+  EXPECT_TRUE(index.emplace(Key(1, 2, 5), 125).second);
+  EXPECT_TRUE(index.emplace(Key(1, 1, 3), 113).second);
+  EXPECT_TRUE(index.emplace(Key(1, 1, 1), 111).second);
+  EXPECT_TRUE(index.emplace(Key(1, 1, 2), 112).second);
+  EXPECT_FALSE(index.emplace(Key(1, 1, 2), 0).second);
+  EXPECT_EQ(index.size(), 5u);
+
+  EXPECT_THAT(GetKeys(&index),
+              testing::ElementsAre(Key(1, 1, 1), Key(1, 1, 2), Key(1, 1, 3),
+                                   Key(1, 2, 5), Key(2, 1, 0)));
+  EXPECT_EQ(index.find(Key(1, 1, 2))->second, 112);
+  EXPECT_EQ(index.find(Key(1, 2, 5))->second, 125);
+  EXPECT_EQ(index.find(Key(1, 2, 4)), index.end());
+
+  // Bounds at the end of a sequence move to the next one.
+  EXPECT_EQ(index.upper_bound(Key(1, 1, kMaxChunkID))->first, Key(1, 2, 5));
+  EXPECT_EQ(index.upper_bound(Key(1, 1, 3))->first, Key(1, 2, 5));
+  EXPECT_EQ(index.upper_bound(Key(1, 1, 0))->first, Key(1, 1, 1));
+  EXPECT_EQ(index.lower_bound(Key(1, 2, 0))->first, Key(1, 2, 5));
+  EXPECT_EQ(index.lower_bound(Key(1, 3, 0))->first, Key(2, 1, 0));
+  EXPECT_EQ(index.upper_bound(Key(2, 1, 0)), index.end());
+
+  auto it = index.end();
+  --it;
+  EXPECT_EQ(it->first, Key(2, 1, 0));
+  --it;
+  EXPECT_EQ(it->first, Key(1, 2, 5));
+}
+
+TEST(TraceBufferIndexTest, EraseRemovesEmptySequences) {
+  Index index;
+  index.emplace(Key(1, 1, 1), 0);
+  index.emplace(Key(1, 2, 1), 0);
+  index.emplace(Key(1, 2, 2), 0);
+  index.emplace(Key(1, 3, 1), 0);
+
+  EXPECT_EQ(index.erase(Key(1, 2, 1)), 1u);
+  EXPECT_THAT(GetKeys(&index), testing::ElementsAre(Key(1, 1, 1), Key(1, 2, 2),
+                                                    Key(1, 3, 1)));
+  EXPECT_EQ(index.erase(Key(1, 2, 2)), 1u);
+  EXPECT_THAT(GetKeys(&index),
+              testing::ElementsAre(Key(1, 1, 1), Key(1, 3, 1)));
+  EXPECT_EQ(index.upper_bound(Key(1, 1, kMaxChunkID))->first, Key(1, 3, 1));
+  index.erase(index.begin());
+  index.erase(index.begin());
+  EXPECT_TRUE(index.empty());
+  EXPECT_EQ(index.begin(), index.end());
+}
+
+// Compares against std::map with random insertions and deletions, including
+// non-consecutive and out-of-order ChunkIDs.
+TEST(TraceBufferIndexTest, MatchesStdMap) {
+  Index index;
+  std::map<Key, int> ref;
+  std::minstd_rand rnd(0);
+  for (int i = 0; i < 20000; i++) {
+    Key key(static_cast<ProducerID>(rnd() % 4),
+            static_cast<WriterID>(rnd() % 8),
+            static_cast<ChunkID>(rnd() % 64));
+    int value = static_cast<int>(rnd());
+    switch (rnd() % 3) {
+      case 0:
+      case 1: {
+        bool inserted = ref.emplace(key, value).second;
+        ASSERT_EQ(index.emplace(key, value).second, inserted);
+        break;
+      }
+      case 2:
+        ASSERT_EQ(index.erase(key), ref.erase(key));
+        break;
+    }
+    ASSERT_EQ(index.size(), ref.size());
+
+    auto it = index.upper_bound(key);
+    auto ref_it = ref.upper_bound(key);
+    if (ref_it == ref.end()) {
+      ASSERT_EQ(it, index.end());
+    } else {
+      ASSERT_EQ(it->first, ref_it->first);
+      ASSERT_EQ(it->second, ref_it->second);
+    }
+  }
+  std::vector<Key> ref_keys;
+  for (const auto& kv : ref)
+    ref_keys.push_back(kv.first);
+  EXPECT_EQ(GetKeys(&index), ref_keys);
+}
+
+}  // namespace
+}  // namespace perfetto
@@ -885,6 +885,10 @@ base::Status TracingServiceImpl::EnableTracing(ConsumerEndpointImpl* consumer,
       }
     }
     tracing_session->write_into_file = std::move(fd);
+    if (init_opts_.async_file_writes) {
+      tracing_session->async_file_writer.reset(
+          new base::AsyncFileWriter(*tracing_session->write_into_file));
+    }
     uint32_t write_period_ms = cfg.file_write_period_ms();
     if (write_period_ms == 0)
       write_period_ms = kDefaultWriteIntoFilePeriodMs;
@@ -2192,6 +2196,10 @@ bool TracingServiceImpl::ReadBuffersIntoFile(TracingSessionID tsid) {
 
   if (stop_writing_into_file || tracing_session->write_period_ms == 0) {
     // Ensure all data was written to the file before we close it.
+    if (tracing_session->async_file_writer) {
+      tracing_session->async_file_writer->Flush();
+      tracing_session->async_file_writer.reset();
+    }
     base::FlushFile(tracing_session->write_into_file.get());
     tracing_session->write_into_file.reset();
     tracing_session->write_period_ms = 0;
@@ -2509,9 +2517,21 @@ bool TracingServiceImpl::WriteIntoFile(TracingSession* tracing_session,
 
   uint64_t total_wr_size = 0;
 
+  // The async writer copies the data into its own buffers, so |packets| can be
+  // released as soon as this function returns.
+  base::AsyncFileWriter* async_writer = tracing_session->async_file_writer.get();
+  for (size_t i = 0; async_writer && i < num_iovecs; i++) {
+    if (!async_writer->Write(iovecs[i].iov_base, iovecs[i].iov_len)) {
+      PERFETTO_ELOG("Async write into file failed");
+      stop_writing_into_file = true;
+      break;
+    }
+    total_wr_size += iovecs[i].iov_len;
+  }
+
   // writev() can take at most IOV_MAX entries per call. Batch them.
   constexpr size_t kIOVMax = IOV_MAX;
-  for (size_t i = 0; i < num_iovecs; i += kIOVMax) {
+  for (size_t i = 0; !async_writer && i < num_iovecs; i += kIOVMax) {
     int iov_batch_size = static_cast<int>(std::min(num_iovecs - i, kIOVMax));
     ssize_t wr_size = PERFETTO_EINTR(writev(fd, &iovecs[i], iov_batch_size));
     if (wr_size <= 0) {
@@ -31,6 +31,7 @@
 #include "perfetto/base/logging.h"
 #include "perfetto/base/status.h"
 #include "perfetto/base/time.h"
+#include "perfetto/ext/base/async_file_writer.h"
 #include "perfetto/ext/base/circular_queue.h"
 #include "perfetto/ext/base/periodic_task.h"
 #include "perfetto/ext/base/uuid.h"
@@ -634,6 +635,11 @@ class TracingServiceImpl : public TracingService {
     // trace packets into, rather than returning it to the consumer via
     // OnTraceData().
     base::ScopedFile write_into_file;
+
+    // Set only if InitOpts.async_file_writes is true. Writes into
+    // |write_into_file| from a dedicated thread. Declared after
+    // |write_into_file| so it's destroyed (and flushed) before the fd is closed.
+    std::unique_ptr<base::AsyncFileWriter> async_file_writer;
     uint32_t write_period_ms = 0;
     uint64_t max_file_size_bytes = 0;
     uint64_t bytes_written_into_file = 0;
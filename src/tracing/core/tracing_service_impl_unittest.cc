@@ -2209,6 +2209,64 @@ TEST_F(TracingServiceImplTest, WriteIntoFileWithPath) {
                   Property(&protos::gen::TestEvent::str, Eq("payload")))));
 }
 
+TEST_F(TracingServiceImplTest, WriteIntoFileAsync) {
+  TracingService::InitOpts init_opts;
+  init_opts.async_file_writes = true;
+  InitializeSvcWithOpts(init_opts);
+
+  std::unique_ptr<MockConsumer> consumer = CreateMockConsumer();
+  consumer->Connect(svc.get());
+
+  std::unique_ptr<MockProducer> producer = CreateMockProducer();
+  producer->Connect(svc.get(), "mock_producer");
+  producer->RegisterDataSource("data_source");
+
+  TraceConfig trace_config;
+  trace_config.add_buffers()->set_size_kb(4096);
+  auto* ds_config = trace_config.add_data_sources()->mutable_config();
+  ds_config->set_name("data_source");
+  ds_config->set_target_buffer(0);
+  trace_config.set_write_into_file(true);
+  trace_config.set_file_write_period_ms(1);
+  base::TempFile tmp_file = base::TempFile::Create();
+  consumer->EnableTracing(trace_config, base::ScopedFile(dup(tmp_file.fd())));
+
+  producer->WaitForTracingSetup();
+  producer->WaitForDataSourceSetup("data_source");
+  producer->WaitForDataSourceStart("data_source");
+  std::unique_ptr<TraceWriter> writer =
+      producer->CreateTraceWriter("data_source");
+
+  // Write enough data to fill several buffers of the async writer.
+  static constexpr size_t kNumPackets = 100;
+  const std::string payload(4096, 'x');
+  for (size_t i = 0; i < kNumPackets; i++) {
+    auto tp = writer->NewTracePacket();
+    tp->set_for_testing()->set_str(payload + std::to_string(i));
+  }
+  writer->Flush();
+  writer.reset();
+
+  consumer->DisableTracing();
+  producer->WaitForDataSourceStop("data_source");
+  consumer->WaitForTracingDisabled();
+
+  // The file must be complete as soon as tracing is disabled.
+  std::string trace_raw;
+  ASSERT_TRUE(base::ReadFile(tmp_file.path(), &trace_raw));
+  protos::gen::Trace trace;
+  ASSERT_TRUE(trace.ParseFromString(trace_raw));
+  size_t num_test_packets = 0;
+  for (const auto& packet : trace.packet()) {
+    if (!packet.has_for_testing())
+      continue;
+    EXPECT_EQ(packet.for_testing().str(),
+              payload + std::to_string(num_test_packets));
+    num_test_packets++;
+  }
+  EXPECT_EQ(num_test_packets, kNumPackets);
+}
+
 TEST_F(TracingServiceImplTest, WriteIntoFileFilterMultipleChunks) {
   static const size_t kNumTestPackets = 5;
   static const size_t kPayloadSize = 500 * 1024UL;
@@ -209,7 +209,8 @@ class TracingMuxerImpl : public TracingMuxer {
    public:
     ProducerImpl(TracingMuxerImpl*,
                  TracingBackendId,
-                 uint32_t shmem_batch_commits_duration_ms);
+                 uint32_t shmem_batch_commits_duration_ms,
+                 uint32_t shmem_batch_commits_max_duration_ms);
     ~ProducerImpl() override;
 
     void Initialize(std::unique_ptr<ProducerEndpoint> endpoint);
@@ -247,6 +248,7 @@ class TracingMuxerImpl : public TracingMuxer {
     bool producer_provided_smb_failed_ = false;
 
     const uint32_t shmem_batch_commits_duration_ms_ = 0;
+    const uint32_t shmem_batch_commits_max_duration_ms_ = 0;
 
     // Set of data sources that have been actually registered on this producer.
     // This can be a subset of the global |data_sources_|, because data sources
@@ -18,6 +18,7 @@
 
 #include "perfetto/base/proc_utils.h"
 #include "perfetto/base/time.h"
+#include "perfetto/protozero/proto_utils.h"
 #include "perfetto/tracing/core/data_source_config.h"
 #include "perfetto/tracing/internal/track_event_interned_fields.h"
 #include "perfetto/tracing/track_event.h"
@@ -46,6 +47,10 @@ namespace internal {
 
 BaseTrackEventInternedDataIndex::~BaseTrackEventInternedDataIndex() = default;
 
+bool BaseTrackEventInternedDataIndex::ClearForReuse() {
+  return false;
+}
+
 namespace {
 
 static constexpr const char kLegacySlowPrefix[] = "disabled-by-default-";
@@ -57,6 +62,60 @@ constexpr auto kClockIdIncremental =
 
 constexpr auto kClockIdAbsolute = TrackEventIncrementalState::kClockIdAbsolute;
 
+using EventPrefix = TrackEventIncrementalState::EventPrefix;
+
+// Proto preambles of the fields in the pre-serialized event prefix, encoded at
+// compile time.
+constexpr uint32_t kTrackEventTypeTag = protozero::proto_utils::MakeTagVarInt(
+    protos::pbzero::TrackEvent::kTypeFieldNumber);
+constexpr uint32_t kTrackEventCategoryIidsTag =
+    protozero::proto_utils::MakeTagVarInt(
+        protos::pbzero::TrackEvent::kCategoryIidsFieldNumber);
+static_assert(kTrackEventTypeTag < 0x80 && kTrackEventCategoryIidsTag < 0x80,
+              "The event prefix assumes single-byte field preambles");
+
+// A category iid field: the preamble and a uint64 varint.
+constexpr size_t kMaxCategoryIidFieldSize = 1 + 10;
+
+size_t GetEventPrefixCacheIndex(const Category* category,
+                                protos::pbzero::TrackEvent::Type type) {
+  static_assert(TrackEventIncrementalState::kEventPrefixCacheSize == 32,
+                "Update the hash shift below");
+  uint64_t key = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(category)) ^
+                 static_cast<uint64_t>(type);
+  return static_cast<size_t>((key * 0x9E3779B97F4A7C15ull) >> (64 - 5));
+}
+
+// Serializes the `type` and `category_iids` fields of a track event into
+// |prefix|, interning the category names if needed. Returns false if they
+// don't fit, in which case the fields have to be written one by one.
+bool BuildEventPrefix(EventContext* ctx,
+                      const Category* category,
+                      protos::pbzero::TrackEvent::Type type,
+                      EventPrefix* prefix) {
+  using protozero::proto_utils::WriteVarInt;
+  uint8_t* ptr = prefix->bytes;
+  uint8_t* const end = prefix->bytes + EventPrefix::kMaxSize;
+  if (type != protos::pbzero::TrackEvent::TYPE_UNSPECIFIED) {
+    *ptr++ = static_cast<uint8_t>(kTrackEventTypeTag);
+    ptr = WriteVarInt(static_cast<uint32_t>(type), ptr);
+  }
+  bool fits = true;
+  category->ForEachGroupMember([&](const char* member_name, size_t name_size) {
+    size_t category_iid =
+        InternedEventCategory::Get(ctx, member_name, name_size);
+    if (static_cast<size_t>(end - ptr) < kMaxCategoryIidFieldSize) {
+      fits = false;
+      return false;
+    }
+    *ptr++ = static_cast<uint8_t>(kTrackEventCategoryIidsTag);
+    ptr = WriteVarInt(static_cast<uint64_t>(category_iid), ptr);
+    return true;
+  });
+  prefix->size = static_cast<uint8_t>(ptr - prefix->bytes);
+  return fits;
+}
+
 class TrackEventSessionObserverRegistry {
  public:
   static TrackEventSessionObserverRegistry* GetInstance() {
@@ -532,8 +591,40 @@ EventContext TrackEventInternal::WriteEvent(
   EventContext ctx(std::move(packet), incr_state, &tls_state);
 
   auto track_event = ctx.event();
-  if (type != protos::pbzero::TrackEvent::TYPE_UNSPECIFIED)
+
+  // We assume that |category| points to the string with static lifetime.
+  // This means we can use their addresses as interning keys, and cache the
+  // serialized category iids for the lifetime of the incremental state.
+  if (category && type != protos::pbzero::TrackEvent::TYPE_SLICE_END &&
+      type != protos::pbzero::TrackEvent::TYPE_COUNTER) {
+    EventPrefix* prefix = &incr_state->event_prefix_cache[
+        GetEventPrefixCacheIndex(category, type)];
+    if (PERFETTO_UNLIKELY(prefix->category != category ||
+                          prefix->type != type)) {
+      prefix->category = nullptr;
+      if (BuildEventPrefix(&ctx, category, type, prefix)) {
+        prefix->category = category;
+        prefix->type = type;
+      }
+    }
+    if (PERFETTO_LIKELY(prefix->category)) {
+      track_event->AppendRawProtoBytes(prefix->bytes, prefix->size);
+    } else {
+      // Too many category iids to fit in a prefix. They have been interned by
+      // BuildEventPrefix() already.
+      if (type != protos::pbzero::TrackEvent::TYPE_UNSPECIFIED)
+        track_event->set_type(type);
+      category->ForEachGroupMember(
+          [&](const char* member_name, size_t name_size) {
+            size_t category_iid =
+                InternedEventCategory::Get(&ctx, member_name, name_size);
+            track_event->add_category_iids(category_iid);
+            return true;
+          });
+    }
+  } else if (type != protos::pbzero::TrackEvent::TYPE_UNSPECIFIED) {
     track_event->set_type(type);
+  }
 
   if (tls_state.enable_thread_time_sampling && on_current_thread_track) {
     int64_t thread_time_ns = base::GetThreadCPUTimeNs().count();
@@ -544,20 +635,6 @@ EventContext TrackEventInternal::WriteEvent(
         thread_time_delta_ns /
         static_cast<int64_t>(tls_state.timestamp_unit_multiplier));
   }
-
-  // We assume that |category| points to the string with static lifetime.
-  // This means we can use their addresses as interning keys.
-  // TODO(skyostil): Intern categories at compile time.
-  if (category && type != protos::pbzero::TrackEvent::TYPE_SLICE_END &&
-      type != protos::pbzero::TrackEvent::TYPE_COUNTER) {
-    category->ForEachGroupMember(
-        [&](const char* member_name, size_t name_size) {
-          size_t category_iid =
-              InternedEventCategory::Get(&ctx, member_name, name_size);
-          track_event->add_category_iids(category_iid);
-          return true;
-        });
-  }
   return ctx;
 }
 
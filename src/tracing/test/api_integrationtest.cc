@@ -1476,6 +1476,31 @@ TEST_P(PerfettoApiTest, TrackEventCategories) {
   EXPECT_THAT(trace, Not(HasSubstr("NotEnabled")));
 }
 
+TEST_P(PerfettoApiTest, TrackEventCategoriesAcrossIncrementalStateClears) {
+  // Create a new trace session.
+  auto* tracing_session = NewTraceWithCategories({"foo", "bar", "yellow"});
+  tracing_session->get()->StartBlocking();
+
+  // The serialized category iids of an event are cached per category and
+  // event type, and must be rebuilt after each clear since iids are reset.
+  for (int i = 0; i < 2; i++) {
+    TRACE_EVENT_BEGIN("foo,bar", "Group");
+    TRACE_EVENT_INSTANT("bar", "Instant");
+    TRACE_EVENT_BEGIN("bar", "Single");
+    TRACE_EVENT_END("bar");
+    TRACE_EVENT_END("foo,bar");
+    perfetto::test::TracingMuxerImplInternalsForTest::ClearIncrementalState();
+  }
+  TRACE_EVENT_INSTANT("red,green,blue,yellow", "Instant");
+
+  auto slices = StopSessionAndReadSlicesFromTrace(tracing_session);
+  EXPECT_THAT(slices,
+              ElementsAre("B:foo,bar.Group", "I:bar.Instant", "B:bar.Single",
+                          "E", "E", "B:foo,bar.Group", "I:bar.Instant",
+                          "B:bar.Single", "E", "E",
+                          "I:red,green,blue,yellow.Instant"));
+}
+
 TEST_P(PerfettoApiTest, ClearIncrementalState) {
   perfetto::DataSourceDescriptor dsd;
   dsd.set_name("incr_data_source");
@@ -2956,6 +2981,67 @@ TEST_P(PerfettoApiTest, TrackEventTypedArgsWithInterningByHashing) {
   EXPECT_THAT(log_messages, ElementsAre("Though this be madness,"));
 }
 
+struct InternedLogMessageBodyPointer
+    : public perfetto::TrackEventInternedDataIndex<
+          InternedLogMessageBodyPointer,
+          perfetto::protos::pbzero::InternedData::kLogMessageBodyFieldNumber,
+          const char*,
+          perfetto::PointerInternedDataTraits> {
+  static void Add(perfetto::protos::pbzero::InternedData* interned_data,
+                  size_t iid,
+                  const char* value) {
+    auto l = interned_data->add_log_message_body();
+    l->set_iid(iid);
+    l->set_body(value);
+    commit_count++;
+  }
+
+  static int commit_count;
+};
+
+int InternedLogMessageBodyPointer::commit_count = 0;
+
+TEST_P(PerfettoApiTest, TrackEventTypedArgsWithInterningByPointer) {
+  // Create a new trace session.
+  auto* tracing_session = NewTraceWithCategories({"foo"});
+  tracing_session->get()->StartBlocking();
+
+  // Enough distinct values to make the index grow a few times.
+  std::vector<std::string> bodies;
+  for (size_t i = 0; i < 1000; i++)
+    bodies.push_back("Body " + std::to_string(i));
+
+  InternedLogMessageBodyPointer::commit_count = 0;
+  TRACE_EVENT_BEGIN("foo", "EventWithState", [&](perfetto::EventContext ctx) {
+    for (size_t i = 0; i < bodies.size(); i++) {
+      EXPECT_EQ(i + 1,
+                InternedLogMessageBodyPointer::Get(&ctx, bodies[i].c_str()));
+    }
+    for (size_t i = 0; i < bodies.size(); i++) {
+      EXPECT_EQ(i + 1,
+                InternedLogMessageBodyPointer::Get(&ctx, bodies[i].c_str()));
+    }
+    auto log = ctx.event()->set_log_message();
+    log->set_body_iid(1);
+  });
+  TRACE_EVENT_END("foo");
+  EXPECT_EQ(1000, InternedLogMessageBodyPointer::commit_count);
+
+  // After an incremental state clear the (recycled) index must be empty, so
+  // the interned data is emitted again.
+  perfetto::test::TracingMuxerImplInternalsForTest::ClearIncrementalState();
+  TRACE_EVENT_BEGIN("foo", "EventWithState", [&](perfetto::EventContext ctx) {
+    EXPECT_EQ(1u, InternedLogMessageBodyPointer::Get(&ctx, bodies[5].c_str()));
+    EXPECT_EQ(1u, InternedLogMessageBodyPointer::Get(&ctx, bodies[5].c_str()));
+    auto log = ctx.event()->set_log_message();
+    log->set_body_iid(1);
+  });
+  TRACE_EVENT_END("foo");
+  EXPECT_EQ(1001, InternedLogMessageBodyPointer::commit_count);
+
+  tracing_session->get()->StopBlocking();
+}
+
 struct InternedSourceLocation
     : public perfetto::TrackEventInternedDataIndex<
           InternedSourceLocation,